@@ -0,0 +1,15 @@
+#include <stdio.h>
+#include "Benchmarks.h"
+
+// --------------------------------------------------------
+// Entry point for the benchmarks on their own (the CMake
+// build, which has no window or D3D11 device).  Running
+// DX11Starter.exe with "-benchmark" does the same thing.
+// --------------------------------------------------------
+int main()
+{
+	Benchmarks::RunAll();
+
+	printf("Done.\n");
+	return 0;
+}
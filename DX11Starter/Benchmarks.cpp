@@ -0,0 +1,1426 @@
+#include "Benchmarks.h"
+#include "KinematicSystem.h"
+#include "DynamicBVH.h"
+#include "FrustumCuller.h"
+#include "Camera.h"
+#include "SpatialHashGrid.h"
+#include "ThreadPool.h"
+#include "SceneRaycaster.h"
+#include "ContributionCuller.h"
+#include "RenderQueue.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
+#include "ClusterBuilder.h"
+#include "RenderDevice.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Entity.h"
+#include "SceneSubmitter.h"
+#include "SoftwareRasterizer.h"
+#include "CpuTexture.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Tiny high resolution stopwatch (steady_clock is the
+// performance counter on Windows)
+// --------------------------------------------------------
+class BenchmarkTimer
+{
+public:
+	BenchmarkTimer() { Restart(); }
+
+	void Restart() { startTime = std::chrono::steady_clock::now(); }
+
+	double ElapsedMilliseconds()
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+		return elapsed.count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point startTime;
+};
+
+// --------------------------------------------------------
+// Reflection the game's shaders compile to, built from the
+// C++ mirrors of their cbuffers (see ShaderConstants.h), so
+// real SimpleShaders can be loaded on the null device
+// --------------------------------------------------------
+template<typename T>
+static ShaderReflectionData::Buffer ReflectConstants(const char* name, unsigned int bindIndex)
+{
+	ShaderReflectionData::Buffer buffer;
+	buffer.Name = name;
+	buffer.Size = sizeof(T);
+	buffer.BindIndex = bindIndex;
+
+	unsigned int fieldCount;
+	const ConstantBufferField* fields = T::GetFields(fieldCount);
+	for (unsigned int f = 0; f < fieldCount; f++)
+	{
+		ShaderReflectionData::Variable variable;
+		variable.Name = fields[f].Name;
+		variable.ByteOffset = fields[f].Offset;
+		variable.Size = fields[f].Size;
+		buffer.Variables.push_back(variable);
+	}
+	return buffer;
+}
+
+static ShaderReflectionData::Resource ReflectResource(const char* name, unsigned int bindIndex)
+{
+	ShaderReflectionData::Resource resource;
+	resource.Name = name;
+	resource.BindIndex = bindIndex;
+	return resource;
+}
+
+// DXGI_FORMAT values of the game's vertex inputs (the null
+// device only keeps them)
+static const unsigned int FormatR32Float = 41;
+static const unsigned int FormatR32G32Float = 16;
+static const unsigned int FormatR32G32B32Float = 6;
+static const unsigned int FormatR32G32B32A32Float = 2;
+
+static void ReflectInput(ShaderReflectionData& data, const char* semantic, unsigned int index, unsigned int format, bool perInstance)
+{
+	ShaderReflectionData::InputElement element;
+	element.SemanticName = semantic;
+	element.SemanticIndex = index;
+	element.Format = format;
+	element.PerInstance = perInstance;
+	data.Inputs.push_back(element);
+}
+
+// VertexShader.hlsl, or VertexShaderInstanced.hlsl (which
+// reads world matrices and fades from per-instance data
+// instead of a perObject cbuffer)
+static ShaderReflectionData ReflectGameVertexShader(bool instanced)
+{
+	ShaderReflectionData data;
+	data.Buffers.push_back(ReflectConstants<PerFrameVSConstants>("perFrame", 0));
+	if (!instanced)
+		data.Buffers.push_back(ReflectConstants<PerObjectConstants>("perObject", 1));
+
+	ReflectInput(data, "POSITION", 0, FormatR32G32B32Float, false);
+	ReflectInput(data, "NORMAL", 0, FormatR32G32B32Float, false);
+	ReflectInput(data, "UV", 0, FormatR32G32Float, false);
+	if (instanced)
+	{
+		for (unsigned int row = 0; row < 4; row++)
+			ReflectInput(data, "WORLD_PER_INSTANCE", row, FormatR32G32B32A32Float, true);
+		ReflectInput(data, "FADE_PER_INSTANCE", 0, FormatR32Float, true);
+	}
+	return data;
+}
+
+// PixelShader.hlsl
+static ShaderReflectionData ReflectGamePixelShader()
+{
+	ShaderReflectionData data;
+	data.Buffers.push_back(ReflectConstants<PerFramePSConstants>("perFrame", 0));
+	data.Buffers.push_back(ReflectConstants<PerMaterialConstants>("perMaterial", 1));
+	data.Textures.push_back(ReflectResource("diffuseTexture", 0));
+	data.Samplers.push_back(ReflectResource("basicSampler", 0));
+	return data;
+}
+
+// --------------------------------------------------------
+// Runs every benchmark with its default settings
+// --------------------------------------------------------
+void Benchmarks::RunAll()
+{
+	KinematicIntegration(1000000, 0.25f, 100);
+
+	DynamicBVHScaling(10000, 0.01f, 60);
+	DynamicBVHScaling(10000, 0.10f, 60);
+	DynamicBVHScaling(100000, 0.01f, 60);
+	DynamicBVHScaling(100000, 0.10f, 60);
+	DynamicBVHScaling(1000000, 0.01f, 20);
+	DynamicBVHScaling(1000000, 0.10f, 20);
+
+	SpatialHashQueries(1000000, 10000);
+
+	SceneRaycasts(1000, 10000);
+	SceneRaycasts(1000, 50000);
+
+	MultiViewCulling(100000, 1, 60);
+	MultiViewCulling(100000, 2, 60);
+	MultiViewCulling(100000, 4, 60);
+	MultiViewCulling(100000, 8, 60);
+
+	ContributionCulling(100000, 2.0f, 6.0f);
+	ContributionCulling(100000, 4.0f, 12.0f);
+
+	RenderQueueSort(100000, 60);
+
+	RedundantStateFiltering(100000, false);
+	RedundantStateFiltering(100000, true);
+
+	ConstantRingAllocation(10000, 60, 64 * 1024);
+	ConstantRingAllocation(100000, 60, 64 * 1024);
+
+	ShaderVariableLookup(100000, 60);
+
+	ClusteredLightBinning(1000, 60);
+	ClusteredLightBinning(10000, 60);
+
+	FrameSubmission(10000, 60, false);
+	FrameSubmission(10000, 60, true);
+	FrameSubmission(100000, 10, true);
+
+	SoftwareRendering(1280, 720, 0, 60);
+	SoftwareRendering(1280, 720, 1000, 20);
+
+	TextureSampling(1024, 4000000);
+}
+
+// --------------------------------------------------------
+// Integrates a large number of moving bodies, some of which
+// are asleep, and reports the average cost per tick
+// --------------------------------------------------------
+void Benchmarks::KinematicIntegration(int bodyCount, float sleepingFraction, int frames)
+{
+	KinematicSystem kinematics;
+
+	int sleepingCount = (int)(bodyCount * sleepingFraction);
+	for (int i = 0; i < bodyCount; i++)
+	{
+		KinematicMotion motion;
+		if (i >= sleepingCount)
+		{
+			motion.Velocity = DirectX::XMFLOAT3(0.1f, 0.05f * (i % 7), -0.2f);
+			motion.AngularVelocity = DirectX::XMFLOAT3(0.0f, 0.3f, 0.01f * (i % 5));
+			motion.ScaleRate = DirectX::XMFLOAT3(0.0f, 0.001f, 0.0f);
+		}
+
+		kinematics.AddBody(
+			DirectX::XMFLOAT3((float)(i % 1000), 0.0f, (float)(i / 1000)),
+			DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f),
+			DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f),
+			motion);
+	}
+
+	// Warm up caches once before timing
+	kinematics.Integrate(1.0f / 60.0f);
+
+	BenchmarkTimer timer;
+	for (int f = 0; f < frames; f++)
+		kinematics.Integrate(1.0f / 60.0f);
+	double ms = timer.ElapsedMilliseconds() / frames;
+
+	printf("Kinematics: %d bodies (%d awake) - %.3f ms/tick, %.1f M bodies/s\n",
+		kinematics.GetBodyCount(),
+		kinematics.GetAwakeCount(),
+		ms,
+		kinematics.GetAwakeCount() / (ms * 1000.0));
+}
+
+// --------------------------------------------------------
+// Builds a BVH over randomly scattered boxes, then measures
+// per-frame refit cost with a fraction of them moving, and
+// frustum/box query cost compared to linear SIMD culling
+// --------------------------------------------------------
+void Benchmarks::DynamicBVHScaling(int objectCount, float motionFraction, int frames)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> spread(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> height(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> step(-0.05f, 0.05f);
+
+	std::vector<AABB> boxes(objectCount);
+	for (int i = 0; i < objectCount; i++)
+	{
+		DirectX::XMFLOAT3 p(spread(rng), height(rng), spread(rng));
+		boxes[i].Min = DirectX::XMFLOAT3(p.x - 0.5f, p.y - 0.5f, p.z - 0.5f);
+		boxes[i].Max = DirectX::XMFLOAT3(p.x + 0.5f, p.y + 0.5f, p.z + 0.5f);
+	}
+
+	// Build
+	DynamicBVH tree;
+	std::vector<int> proxies(objectCount);
+	BenchmarkTimer timer;
+	for (int i = 0; i < objectCount; i++)
+		proxies[i] = tree.CreateProxy(boxes[i], i);
+	double buildMs = timer.ElapsedMilliseconds();
+
+	// Linear culler over the same boxes, for comparison
+	FrustumCuller culler;
+	culler.Resize(objectCount);
+	for (int i = 0; i < objectCount; i++)
+	{
+		BoundingSphere sphere = { DirectX::XMFLOAT3(boxes[i].Min.x + 0.5f, boxes[i].Min.y + 0.5f, boxes[i].Min.z + 0.5f), 0.87f };
+		culler.SetBounds(i, sphere, boxes[i]);
+	}
+
+	Camera camera;
+	camera.UpdateProjectionMatrix(16.0f / 9.0f);
+	const Frustum& frustum = camera.GetFrustum();
+
+	// Moving a fraction of the objects every frame
+	int movingCount = (int)(objectCount * motionFraction);
+	int reinserted = 0;
+	double updateMs = 0.0;
+	double queryMs = 0.0;
+	double boxQueryMs = 0.0;
+	double linearMs = 0.0;
+	std::vector<int> results;
+	for (int f = 0; f < frames; f++)
+	{
+		timer.Restart();
+		for (int i = 0; i < movingCount; i++)
+		{
+			DirectX::XMFLOAT3 d(step(rng), 0.0f, step(rng));
+			AABB& box = boxes[i];
+			box.Min = DirectX::XMFLOAT3(box.Min.x + d.x, box.Min.y, box.Min.z + d.z);
+			box.Max = DirectX::XMFLOAT3(box.Max.x + d.x, box.Max.y, box.Max.z + d.z);
+			if (tree.MoveProxy(proxies[i], box, d))
+				reinserted++;
+		}
+		tree.Rebalance(16);
+		updateMs += timer.ElapsedMilliseconds();
+
+		timer.Restart();
+		tree.QueryFrustum(frustum, results);
+		queryMs += timer.ElapsedMilliseconds();
+
+		AABB region;
+		region.Min = DirectX::XMFLOAT3(-25.0f, -25.0f, -25.0f);
+		region.Max = DirectX::XMFLOAT3(25.0f, 25.0f, 25.0f);
+		timer.Restart();
+		tree.QueryAABB(region, results);
+		boxQueryMs += timer.ElapsedMilliseconds();
+
+		timer.Restart();
+		culler.Cull(frustum, results);
+		linearMs += timer.ElapsedMilliseconds();
+	}
+
+	tree.QueryFrustum(frustum, results);
+	printf("BVH: %d objects, %.0f%% moving - build %.1f ms, height %d\n",
+		objectCount, motionFraction * 100.0f, buildMs, tree.GetHeight());
+	printf("     update %.3f ms/frame (%d reinserts/frame)\n",
+		updateMs / frames, reinserted / frames);
+	printf("     frustum query %.3f ms (%d visible, %d nodes visited), box query %.3f ms, linear SIMD cull %.3f ms\n",
+		queryMs / frames, (int)results.size(), tree.GetNodesVisited(), boxQueryMs / frames, linearMs / frames);
+}
+
+// --------------------------------------------------------
+// Fills a spatial hash with small spheres spread over a
+// large flat world, then measures incremental updates and
+// the latency of radius, box and nearest-k queries, both on
+// one thread and spread across the thread pool
+// --------------------------------------------------------
+void Benchmarks::SpatialHashQueries(int itemCount, int queryCount)
+{
+	std::mt19937 rng(4321);
+	std::uniform_real_distribution<float> spread(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> height(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> size(0.25f, 1.0f);
+	std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+
+	std::vector<DirectX::XMFLOAT3> centers(itemCount);
+	std::vector<float> radii(itemCount);
+	for (int i = 0; i < itemCount; i++)
+	{
+		centers[i] = DirectX::XMFLOAT3(spread(rng), height(rng), spread(rng));
+		radii[i] = size(rng);
+	}
+
+	SpatialHashGrid grid(4.0f);
+	BenchmarkTimer timer;
+	for (int i = 0; i < itemCount; i++)
+		grid.Insert(i, centers[i], radii[i]);
+	double buildMs = timer.ElapsedMilliseconds();
+
+	// One frame of 10% of the items moving
+	int movingCount = itemCount / 10;
+	timer.Restart();
+	for (int i = 0; i < movingCount; i++)
+	{
+		DirectX::XMFLOAT3& c = centers[i];
+		c = DirectX::XMFLOAT3(c.x + step(rng), c.y, c.z + step(rng));
+		grid.Update(i, c, radii[i]);
+	}
+	double updateMs = timer.ElapsedMilliseconds();
+
+	std::vector<DirectX::XMFLOAT3> points(queryCount);
+	for (int i = 0; i < queryCount; i++)
+		points[i] = DirectX::XMFLOAT3(spread(rng), height(rng), spread(rng));
+
+	// Single threaded latency
+	std::vector<int> results;
+	long long found = 0;
+
+	timer.Restart();
+	for (int i = 0; i < queryCount; i++)
+	{
+		grid.QueryRadius(points[i], 10.0f, results);
+		found += results.size();
+	}
+	double radiusUs = timer.ElapsedMilliseconds() * 1000.0 / queryCount;
+	double radiusAverage = (double)found / queryCount;
+
+	timer.Restart();
+	for (int i = 0; i < queryCount; i++)
+	{
+		AABB box;
+		box.Min = DirectX::XMFLOAT3(points[i].x - 10.0f, points[i].y - 5.0f, points[i].z - 10.0f);
+		box.Max = DirectX::XMFLOAT3(points[i].x + 10.0f, points[i].y + 5.0f, points[i].z + 10.0f);
+		grid.QueryAABB(box, results);
+	}
+	double boxUs = timer.ElapsedMilliseconds() * 1000.0 / queryCount;
+
+	timer.Restart();
+	for (int i = 0; i < queryCount; i++)
+		grid.QueryNearest(points[i], 16, results);
+	double nearestUs = timer.ElapsedMilliseconds() * 1000.0 / queryCount;
+
+	// The same radius queries from every thread at once
+	ThreadPool& pool = ThreadPool::Shared();
+	int threads = pool.GetThreadCount();
+	std::vector<std::vector<int>> threadResults(threads);
+	timer.Restart();
+	pool.ParallelFor(threads, [&](int t)
+	{
+		for (int i = t; i < queryCount; i += threads)
+			grid.QueryRadius(points[i], 10.0f, threadResults[t]);
+	});
+	double parallelMs = timer.ElapsedMilliseconds();
+
+	// What gameplay code does today: scan everything
+	int scanQueries = 10;
+	timer.Restart();
+	for (int q = 0; q < scanQueries; q++)
+	{
+		results.clear();
+		for (int i = 0; i < itemCount; i++)
+		{
+			float dx = centers[i].x - points[q].x;
+			float dy = centers[i].y - points[q].y;
+			float dz = centers[i].z - points[q].z;
+			float r = 10.0f + radii[i];
+			if (dx * dx + dy * dy + dz * dz <= r * r)
+				results.push_back(i);
+		}
+	}
+	double scanUs = timer.ElapsedMilliseconds() * 1000.0 / scanQueries;
+
+	printf("Spatial hash: %d items in %d cells - build %.1f ms, %d moves %.2f ms\n",
+		grid.GetItemCount(), grid.GetCellCount(), buildMs, movingCount, updateMs);
+	printf("     radius %.2f us (%.1f hits), box %.2f us, 16-nearest %.2f us, linear scan %.1f us\n",
+		radiusUs, radiusAverage, boxUs, nearestUs, scanUs);
+	printf("     %d radius queries on %d threads: %.2f ms (%.0f queries/s)\n",
+		queryCount, threads, parallelMs, queryCount / (parallelMs / 1000.0));
+}
+
+// --------------------------------------------------------
+// Line of sight style raycasts: agents scattered through a
+// field of sphere instances each check a few nearby targets.
+// Traced one ray at a time, then as a batch of packets
+// across the thread pool.
+// --------------------------------------------------------
+void Benchmarks::SceneRaycasts(int instanceCount, int rayCount)
+{
+	// A UV sphere (about 1000 triangles) shared by every instance
+	const int rings = 16;
+	const int segments = 32;
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+	for (int r = 0; r <= rings; r++)
+	{
+		float phi = DirectX::XM_PI * r / rings;
+		for (int s = 0; s <= segments; s++)
+		{
+			float theta = DirectX::XM_2PI * s / segments;
+			positions.push_back(DirectX::XMFLOAT3(sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta)));
+		}
+	}
+	for (int r = 0; r < rings; r++)
+	{
+		for (int s = 0; s < segments; s++)
+		{
+			unsigned int a = r * (segments + 1) + s;
+			unsigned int b = a + segments + 1;
+			indices.push_back(a); indices.push_back(b); indices.push_back(a + 1);
+			indices.push_back(a + 1); indices.push_back(b); indices.push_back(b + 1);
+		}
+	}
+
+	BenchmarkTimer timer;
+	TriangleBVH bvh(positions, indices);
+	double meshBuildMs = timer.ElapsedMilliseconds();
+
+	std::mt19937 rng(99);
+	std::uniform_real_distribution<float> spread(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> height(0.0f, 10.0f);
+	std::uniform_real_distribution<float> size(0.5f, 3.0f);
+
+	SceneRaycaster scene;
+	std::vector<DirectX::XMFLOAT4X4> worlds(instanceCount);
+	for (int i = 0; i < instanceCount; i++)
+	{
+		float s = size(rng);
+		DirectX::XMStoreFloat4x4(&worlds[i], DirectX::XMMatrixMultiply(
+			DirectX::XMMatrixScaling(s, s, s),
+			DirectX::XMMatrixTranslation(spread(rng), height(rng), spread(rng))));
+		scene.AddInstance(&bvh, worlds[i], i);
+	}
+	timer.Restart();
+	scene.Commit();
+	double sceneBuildMs = timer.ElapsedMilliseconds();
+
+	// Each "agent" checks line of sight to a few targets nearby
+	const int raysPerAgent = 8;
+	std::uniform_real_distribution<float> nearby(-30.0f, 30.0f);
+	std::vector<Ray> rays(rayCount);
+	DirectX::XMFLOAT3 from;
+	for (int i = 0; i < rayCount; i++)
+	{
+		if (i % raysPerAgent == 0)
+			from = DirectX::XMFLOAT3(spread(rng), height(rng), spread(rng));
+		DirectX::XMFLOAT3 to(from.x + nearby(rng), height(rng), from.z + nearby(rng));
+		DirectX::XMFLOAT3 d(to.x - from.x, to.y - from.y, to.z - from.z);
+		float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		rays[i].Origin = from;
+		rays[i].Direction = DirectX::XMFLOAT3(d.x / length, d.y / length, d.z / length);
+		rays[i].MaxDistance = length;
+	}
+
+	// One at a time on this thread
+	timer.Restart();
+	int blocked = 0;
+	for (int i = 0; i < rayCount; i++)
+	{
+		RayHit hit;
+		if (scene.Raycast(rays[i], hit))
+			blocked++;
+	}
+	double singleMs = timer.ElapsedMilliseconds();
+
+	// The whole batch in packets across the pool
+	std::vector<RayHit> hits;
+	scene.Raycast(rays, hits);
+	timer.Restart();
+	scene.Raycast(rays, hits);
+	double batchMs = timer.ElapsedMilliseconds();
+
+	// Nothing moved: Commit() should have nothing to do
+	for (int i = 0; i < instanceCount; i++)
+		scene.SetTransform(i, worlds[i]);
+	timer.Restart();
+	scene.Commit();
+	double idleCommitMs = timer.ElapsedMilliseconds();
+
+	// A tenth of the instances move, which only refits
+	std::uniform_real_distribution<float> step(-2.0f, 2.0f);
+	for (int i = 0; i < instanceCount; i += 10)
+	{
+		worlds[i]._41 += step(rng);
+		worlds[i]._43 += step(rng);
+		scene.SetTransform(i, worlds[i]);
+	}
+	timer.Restart();
+	scene.Commit();
+	double refitMs = timer.ElapsedMilliseconds();
+
+	// Refit and freshly built trees have to agree
+	SceneRaycaster rebuilt;
+	for (int i = 0; i < instanceCount; i++)
+		rebuilt.AddInstance(&bvh, worlds[i], i);
+	rebuilt.Commit();
+	std::vector<RayHit> rebuiltHits;
+	scene.Raycast(rays, hits);
+	rebuilt.Raycast(rays, rebuiltHits);
+	int mismatches = 0;
+	for (int i = 0; i < rayCount; i++)
+		if (hits[i].Instance != rebuiltHits[i].Instance || hits[i].Triangle != rebuiltHits[i].Triangle)
+			mismatches++;
+
+	printf("Raycasts: %d instances of %d triangles - mesh BVH %.2f ms (%d nodes), scene tree %.2f ms\n",
+		instanceCount, bvh.GetTriangleCount(), meshBuildMs, bvh.GetNodeCount(), sceneBuildMs);
+	printf("     %d rays (%d blocked) - one by one %.2f ms, batched %.2f ms on %d threads (%.1f M rays/s)\n",
+		rayCount, blocked, singleMs, batchMs, ThreadPool::Shared().GetThreadCount(), rayCount / (batchMs * 1000.0));
+	printf("     commit with nothing moved %.3f ms, refit after %d moved %.3f ms%s\n",
+		idleCommitMs, (instanceCount + 9) / 10, refitMs,
+		mismatches == 0 ? "" : (" - " + std::to_string(mismatches) + " MISMATCHES against a rebuild").c_str());
+}
+
+// --------------------------------------------------------
+// Culls the same objects against several views, once as a
+// separate pass per view and once as a single multi-view
+// sweep, to show how the cost grows with the view count
+// --------------------------------------------------------
+void Benchmarks::MultiViewCulling(int objectCount, int viewCount, int frames)
+{
+	std::mt19937 rng(777);
+	std::uniform_real_distribution<float> spread(-100.0f, 100.0f);
+
+	FrustumCuller culler;
+	culler.Resize(objectCount);
+	for (int i = 0; i < objectCount; i++)
+	{
+		DirectX::XMFLOAT3 p(spread(rng), spread(rng) * 0.1f, spread(rng));
+		BoundingSphere sphere = { p, 0.87f };
+		AABB box = { DirectX::XMFLOAT3(p.x - 0.5f, p.y - 0.5f, p.z - 0.5f), DirectX::XMFLOAT3(p.x + 0.5f, p.y + 0.5f, p.z + 0.5f) };
+		culler.SetBounds(i, sphere, box);
+	}
+
+	// Cameras spun around the origin, standing in for light and extra views
+	std::vector<Frustum> frusta(viewCount);
+	for (int v = 0; v < viewCount; v++)
+	{
+		float angle = DirectX::XM_2PI * v / viewCount;
+		DirectX::XMMATRIX view = DirectX::XMMatrixLookToLH(
+			DirectX::XMVectorSet(0.0f, 5.0f, 0.0f, 0.0f),
+			DirectX::XMVectorSet(cosf(angle), 0.0f, sinf(angle), 0.0f),
+			DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		DirectX::XMMATRIX proj = DirectX::XMMatrixPerspectiveFovLH(0.25f * DirectX::XM_PI, 16.0f / 9.0f, 0.1f, 100.0f);
+		DirectX::XMFLOAT4X4 viewProj;
+		DirectX::XMStoreFloat4x4(&viewProj, DirectX::XMMatrixMultiply(view, proj));
+		frusta[v] = FrustumCuller::ExtractFrustum(viewProj);
+	}
+
+	std::vector<int> visible;
+	std::vector<VisibilityBits> visibility;
+	BenchmarkTimer timer;
+	for (int f = 0; f < frames; f++)
+		for (int v = 0; v < viewCount; v++)
+			culler.Cull(frusta[v], visible);
+	double separateMs = timer.ElapsedMilliseconds() / frames;
+
+	timer.Restart();
+	for (int f = 0; f < frames; f++)
+		culler.CullViews(&frusta[0], viewCount, visibility);
+	double sweepMs = timer.ElapsedMilliseconds() / frames;
+
+	int totalVisible = 0;
+	for (int v = 0; v < viewCount; v++)
+		totalVisible += culler.GetViewStats(v).Visible;
+
+	printf("Multi-view cull: %d objects x %d views (%d visible in total) - separate passes %.3f ms, one sweep %.3f ms\n",
+		objectCount, viewCount, totalVisible, separateMs, sweepMs);
+}
+
+// --------------------------------------------------------
+// A dense open field of small props seen from ground level:
+// how many draws survive frustum culling, and how many are
+// left once sub-pixel-ish objects are dropped as well
+// --------------------------------------------------------
+void Benchmarks::ContributionCulling(int objectCount, float minPixels, float fadeBand)
+{
+	std::mt19937 rng(2468);
+	std::uniform_real_distribution<float> spread(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.05f, 0.5f);
+
+	FrustumCuller culler;
+	culler.Resize(objectCount);
+	std::vector<BoundingSphere> spheres(objectCount);
+	for (int i = 0; i < objectCount; i++)
+	{
+		float r = size(rng);
+		DirectX::XMFLOAT3 p(spread(rng), r, spread(rng));
+		spheres[i] = { p, r };
+		AABB box = { DirectX::XMFLOAT3(p.x - r, p.y - r, p.z - r), DirectX::XMFLOAT3(p.x + r, p.y + r, p.z + r) };
+		culler.SetBounds(i, spheres[i], box);
+	}
+
+	Camera camera;
+	camera.Update(0.0f, 0.0f, CameraInput());
+	camera.UpdateProjectionMatrix(1280.0f / 720.0f);
+
+	std::vector<int> visible;
+	culler.Cull(camera.GetFrustum(), visible);
+	int frustumVisible = (int)visible.size();
+
+	ContributionCuller contribution;
+	contribution.SetView(camera.GetPosition(), camera.GetFieldOfView(), camera.GetAspectRatio(), 1280, 720);
+
+	BenchmarkTimer timer;
+	int drawn = 0;
+	int fading = 0;
+	for (int index : visible)
+	{
+		float fade = ContributionCuller::GetFade(contribution.GetScreenSize(spheres[index]), minPixels, fadeBand);
+		if (fade > 0.0f) drawn++;
+		if (fade > 0.0f && fade < 1.0f) fading++;
+	}
+	double ms = timer.ElapsedMilliseconds();
+
+	printf("Contribution cull: %d objects, %.0f px cutoff + %.0f px fade - %d in frustum, %d drawn (%d fading), %.3f ms\n",
+		objectCount, minPixels, fadeBand, frustumVisible, drawn, fading, ms);
+}
+
+// --------------------------------------------------------
+// Fills and sorts a render queue of random draws each frame,
+// with std::sort on the same keys for comparison, and counts
+// how many state changes the sorted order saves
+// --------------------------------------------------------
+void Benchmarks::RenderQueueSort(int drawCount, int frames)
+{
+	std::mt19937 rng(97531);
+	std::uniform_int_distribution<int> shaderId(0, 7);
+	std::uniform_int_distribution<int> materialId(0, 63);
+	std::uniform_int_distribution<int> meshId(0, 255);
+	std::uniform_real_distribution<float> depthRange(0.1f, 100.0f);
+	std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+	struct Draw { unsigned int Shader, Material, Mesh; bool Transparent; };
+	std::vector<Draw> draws(drawCount);
+	std::vector<float> depths(drawCount);
+	for (Draw& d : draws)
+	{
+		d.Shader = shaderId(rng);
+		d.Material = materialId(rng);
+		d.Mesh = meshId(rng);
+		d.Transparent = chance(rng) < 0.1f;
+	}
+
+	RenderQueue queue;
+	queue.SetDepthRange(0.1f, 100.0f);
+	double fillMs = 0.0, sortMs = 0.0, stdSortMs = 0.0;
+	std::vector<RenderItem> reference;
+	for (int f = 0; f < frames; f++)
+	{
+		// Everything moves a little every frame
+		for (float& depth : depths) depth = depthRange(rng);
+
+		BenchmarkTimer timer;
+		queue.Clear();
+		for (int i = 0; i < drawCount; i++)
+		{
+			const Draw& d = draws[i];
+			queue.Add(d.Transparent ? RenderPass::Transparent : RenderPass::Opaque, d.Shader, d.Material, d.Mesh, depths[i], i);
+		}
+		fillMs += timer.ElapsedMilliseconds();
+
+		reference = queue.GetItems();
+
+		timer.Restart();
+		queue.Sort();
+		sortMs += timer.ElapsedMilliseconds();
+
+		timer.Restart();
+		std::sort(reference.begin(), reference.end(), [](const RenderItem& a, const RenderItem& b) { return a.Key < b.Key; });
+		stdSortMs += timer.ElapsedMilliseconds();
+	}
+
+	// State changes (shader, material or mesh differing from
+	// the previous draw) before and after sorting
+	auto countChanges = [&](const std::vector<int>& order)
+	{
+		int changes = 0;
+		for (size_t i = 1; i < order.size(); i++)
+		{
+			const Draw& a = draws[order[i - 1]];
+			const Draw& b = draws[order[i]];
+			changes += (a.Shader != b.Shader) + (a.Material != b.Material) + (a.Mesh != b.Mesh);
+		}
+		return changes;
+	};
+	std::vector<int> order(drawCount);
+	for (int i = 0; i < drawCount; i++) order[i] = i;
+	int unsortedChanges = countChanges(order);
+	for (int i = 0; i < drawCount; i++) order[i] = queue.GetItem(i).Payload;
+	int sortedChanges = countChanges(order);
+
+	printf("Render queue: %d draws - fill %.3f ms, radix sort %.3f ms (std::sort %.3f ms), state changes %d -> %d\n",
+		drawCount, fillMs / frames, sortMs / frames, stdSortMs / frames, unsortedChanges, sortedChanges);
+}
+
+// --------------------------------------------------------
+// Issues a frame of draws' binds straight to a recording
+// context and again through the state cache, checks both
+// streams draw with identical state, and reports how many
+// binds the cache dropped
+// --------------------------------------------------------
+void Benchmarks::RedundantStateFiltering(int drawCount, bool sortDraws)
+{
+	std::mt19937 rng(86420);
+	std::uniform_int_distribution<int> shaderId(0, 3);
+	std::uniform_int_distribution<int> materialId(0, 31);
+	std::uniform_int_distribution<int> meshId(0, 127);
+	std::uniform_real_distribution<float> depthRange(0.1f, 100.0f);
+
+	// Stand-in resources: never dereferenced, only compared
+	auto fake = [](int kind, int id) { return (void*)(size_t)(((kind + 1) << 24) | ((id + 1) << 4)); };
+
+	RenderQueue queue;
+	for (int i = 0; i < drawCount; i++)
+		queue.Add(RenderPass::Opaque, shaderId(rng), materialId(rng), meshId(rng), depthRange(rng), i);
+	if (sortDraws)
+		queue.Sort();
+
+	// Same binds the game issues per draw
+	auto issue = [&](auto& target)
+	{
+		for (const RenderItem& item : queue.GetItems())
+		{
+			int shader = (int)((item.Key >> (RenderQueue::DepthBits + RenderQueue::MeshBits + RenderQueue::MaterialBits)) & ((1 << RenderQueue::ShaderBits) - 1));
+			int material = (int)((item.Key >> (RenderQueue::DepthBits + RenderQueue::MeshBits)) & ((1 << RenderQueue::MaterialBits) - 1));
+			int mesh = (int)((item.Key >> RenderQueue::DepthBits) & ((1 << RenderQueue::MeshBits) - 1));
+
+			target.SetVertexBuffer(0, (RenderBuffer*)fake(0, mesh), 32, 0);
+			target.SetIndexBuffer((RenderBuffer*)fake(1, mesh), RenderIndexFormat::UInt32, 0);
+			target.SetInputLayout((RenderInputLayout*)fake(2, 0));
+			target.SetVertexShader((RenderVertexShader*)fake(3, shader));
+			target.SetVSConstantBuffer(0, (RenderBuffer*)fake(4, shader), 0, 0);
+			target.SetPixelShader((RenderPixelShader*)fake(5, shader));
+			target.SetPSConstantBuffer(0, (RenderBuffer*)fake(6, shader), 0, 0);
+			target.SetPSShaderResource(0, (RenderShaderResource*)fake(7, material));
+			target.SetPSSampler(0, (RenderSampler*)fake(8, 0));
+			target.DrawIndexed(36, 0, 0);
+		}
+	};
+
+	RecordingStateContext unfiltered;
+	BenchmarkTimer timer;
+	issue(unfiltered);
+	double unfilteredMs = timer.ElapsedMilliseconds();
+
+	RecordingStateContext filtered;
+	StateCache cache(&filtered);
+	timer.Restart();
+	issue(cache);
+	double filteredMs = timer.ElapsedMilliseconds();
+
+	bool identical = unfiltered.GetDrawStates() == filtered.GetDrawStates();
+	BindStats stats = cache.GetStats();
+
+	printf("State filtering: %d draws (%s) - binds %d -> %d (%.1f%% dropped), %.3f ms unfiltered, %.3f ms filtered, draw state %s\n",
+		drawCount, sortDraws ? "sorted" : "unsorted",
+		unfiltered.GetBindCount(), filtered.GetBindCount(),
+		100.0 * (stats.Requested - stats.Issued) / stats.Requested,
+		unfilteredMs, filteredMs,
+		identical ? "identical" : "MISMATCH");
+}
+
+// --------------------------------------------------------
+// Allocates a vertex and a pixel shader buffer per draw
+// from a ring that starts too small, growing it between
+// frames the way the game does.  Checks every allocation is
+// aligned, inside the ring and clear of everything handed
+// out since the last discard.
+// --------------------------------------------------------
+void Benchmarks::ConstantRingAllocation(int drawCount, int frames, unsigned int startCapacity)
+{
+	// Sizes of the game's vertex and pixel shader cbuffers
+	const unsigned int sizes[] = { 196, 96 };
+
+	RingAllocator ring;
+	ring.Init(startCapacity, 256);
+
+	int badAllocations = 0;
+	int growthFrames = 0;
+	int steadyWraps = 0;		// Most wraps in a frame since the last growth
+	double allocateMs = 0.0;
+	for (int f = 0; f < frames; f++)
+	{
+		unsigned int needed = ring.BeginFrame();
+		if (needed > ring.GetCapacity())
+		{
+			unsigned int capacity = ring.GetCapacity();
+			while (capacity < needed)
+				capacity *= 2;
+			ring.Init(capacity, 256);
+			growthFrames++;
+			steadyWraps = 0;
+		}
+
+		unsigned int epochEnd = 0;
+		BenchmarkTimer timer;
+		for (int d = 0; d < drawCount; d++)
+		{
+			for (unsigned int size : sizes)
+			{
+				RingAllocation allocation;
+				if (!ring.Allocate(size, allocation))
+				{
+					badAllocations++;
+					continue;
+				}
+
+				if (allocation.Discard)
+					epochEnd = 0;
+				if (allocation.Offset % 256 != 0 ||
+					allocation.Size < size ||
+					allocation.Offset + allocation.Size > ring.GetCapacity() ||
+					allocation.Offset < epochEnd)
+					badAllocations++;
+				epochEnd = allocation.Offset + allocation.Size;
+			}
+		}
+		allocateMs += timer.ElapsedMilliseconds();
+
+		steadyWraps = (std::max)(steadyWraps, ring.GetFrameWraps());
+	}
+
+	printf("Constant ring: %d draws - %.3f ms per frame (%.1f ns per allocation), grew %d times to %u KB, then at most %d wrap(s) per frame, %s\n",
+		drawCount, allocateMs / frames, allocateMs * 1000000.0 / ((double)frames * drawCount * 2),
+		growthFrames, ring.GetCapacity() / 1024, steadyWraps,
+		badAllocations == 0 ? "all allocations valid" : "INVALID ALLOCATIONS");
+}
+
+// --------------------------------------------------------
+// Sets two of the game's pixel shader variables the three
+// ways SimplePixelShader can find them: by string (hashing
+// the name into the variable map every call), by a handle
+// resolved once, and by a name hashed at compile time.  The
+// shader is loaded from the game's reflection on the null
+// device, so these are its real setters.
+// --------------------------------------------------------
+void Benchmarks::ShaderVariableLookup(int drawCount, int frames)
+{
+	NullRenderDevice device;
+	SimplePixelShader shader(&device);
+	shader.LoadReflection(ReflectGamePixelShader());
+
+	static constexpr SimpleShaderName ColorTintName("colorTint");
+	static constexpr SimpleShaderName ClusterParamsName("clusterParams");
+	SimpleShaderHandle tintHandle = shader.GetVariableHandle(ColorTintName);
+	SimpleShaderHandle clusterHandle = shader.GetVariableHandle(ClusterParamsName);
+
+	// Different values every draw, so no set is skipped
+	DirectX::XMFLOAT4 tint(1.0f, 1.0f, 1.0f, 1.0f);
+	DirectX::XMFLOAT4 clusterParams(0.0f, 0.0f, 1.0f, 0.0f);
+
+	int failures = 0;
+	double stringMs = 0.0;
+	double handleMs = 0.0;
+	double hashedMs = 0.0;
+	for (int f = 0; f < frames; f++)
+	{
+		BenchmarkTimer timer;
+		for (int d = 0; d < drawCount; d++)
+		{
+			tint.x = clusterParams.x = (float)d;
+			failures += !shader.SetData("colorTint", &tint, sizeof(tint));
+			failures += !shader.SetData("clusterParams", &clusterParams, sizeof(clusterParams));
+		}
+		stringMs += timer.ElapsedMilliseconds();
+
+		timer.Restart();
+		for (int d = 0; d < drawCount; d++)
+		{
+			tint.x = clusterParams.x = (float)(d + 1);
+			failures += !shader.SetData(tintHandle, &tint, sizeof(tint));
+			failures += !shader.SetData(clusterHandle, &clusterParams, sizeof(clusterParams));
+		}
+		handleMs += timer.ElapsedMilliseconds();
+
+		timer.Restart();
+		for (int d = 0; d < drawCount; d++)
+		{
+			tint.x = clusterParams.x = (float)(d + 2);
+			failures += !shader.SetData(shader.GetVariableHandle(ColorTintName), &tint, sizeof(tint));
+			failures += !shader.SetData(shader.GetVariableHandle(ClusterParamsName), &clusterParams, sizeof(clusterParams));
+		}
+		hashedMs += timer.ElapsedMilliseconds();
+	}
+
+	double sets = (double)frames * drawCount * 2;
+	printf("Shader variables: %d draws - by string %.1f ns, by handle %.1f ns, by hashed name %.1f ns per set (%.1fx faster by handle)%s\n",
+		drawCount, stringMs * 1000000.0 / sets, handleMs * 1000000.0 / sets, hashedMs * 1000000.0 / sets,
+		handleMs > 0.0 ? stringMs / handleMs : 0.0,
+		failures == 0 ? "" : " - LOOKUPS FAILED");
+}
+
+// --------------------------------------------------------
+// Moves point and spot lights through a city-sized volume
+// and bins them into clusters each frame.  The last frame
+// is checked against testing every light against every
+// cluster one at a time (which is also timed).
+// --------------------------------------------------------
+void Benchmarks::ClusteredLightBinning(int lightCount, int frames)
+{
+	std::mt19937 rng(11235);
+	std::uniform_real_distribution<float> across(-60.0f, 60.0f);
+	std::uniform_real_distribution<float> height(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> depth(-10.0f, 110.0f);
+	std::uniform_real_distribution<float> range(1.0f, 4.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<LocalLight> lights(lightCount);
+	std::vector<DirectX::XMFLOAT3> origins(lightCount);
+	for (int i = 0; i < lightCount; i++)
+	{
+		LocalLight& light = lights[i];
+		light = {};
+		origins[i] = DirectX::XMFLOAT3(across(rng), height(rng), depth(rng));
+		light.Range = range(rng);
+		light.Color = DirectX::XMFLOAT3(unit(rng), unit(rng), unit(rng));
+
+		// A quarter are spot lights pointing anywhere
+		if (i % 4 == 3)
+		{
+			DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMVectorSet(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f, 0.0f));
+			DirectX::XMStoreFloat3(&light.Direction, direction);
+			light.Type = (unsigned int)LocalLightType::Spot;
+			light.Range *= 2.0f;
+			light.CosOuterAngle = cosf(0.2f + unit(rng) * 0.8f);
+			light.CosInnerAngle = (1.0f + light.CosOuterAngle) * 0.5f;
+		}
+		else
+			light.Type = (unsigned int)LocalLightType::Point;
+	}
+
+	// Same lens as the game's camera, looking down +Z
+	float aspect = 1280.0f / 720.0f;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMStoreFloat4x4(&projection, DirectX::XMMatrixPerspectiveFovLH(0.25f * 3.1415926535f, aspect, 0.1f, 100.0f));
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMStoreFloat4x4(&view, DirectX::XMMatrixLookToLH(
+		DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f),
+		DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+		DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+
+	ClusterBuilder builder;
+	builder.SetProjection(projection._11, projection._22, 0.1f, 100.0f);
+
+	double buildMs = 0.0;
+	long long indices = 0;
+	BenchmarkTimer timer;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		// Small circles around where each light started
+		float time = frame / 60.0f;
+		for (int i = 0; i < lightCount; i++)
+		{
+			float angle = time * 2.0f + i;
+			lights[i].Position = DirectX::XMFLOAT3(origins[i].x + cosf(angle), origins[i].y, origins[i].z + sinf(angle));
+		}
+
+		timer.Restart();
+		builder.Build(&lights[0], lightCount, view);
+		buildMs += timer.ElapsedMilliseconds();
+		indices += builder.GetStats().Indices;
+	}
+
+	// Every pair, scalar, against the last frame's clusters
+	// (whose lights are in light order)
+	const std::vector<ClusterRange>& clusters = builder.GetClusters();
+	const std::vector<unsigned int>& lightIndices = builder.GetLightIndices();
+	int mismatches = 0;
+	timer.Restart();
+	for (int c = 0; c < ClusterBuilder::ClusterCount; c++)
+	{
+		unsigned int next = clusters[c].Offset;
+		unsigned int end = clusters[c].Offset + clusters[c].Count;
+		for (int l = 0; l < lightCount; l++)
+		{
+			bool binned = next < end && lightIndices[next] == (unsigned int)l;
+			if (binned)
+				next++;
+			if (binned != builder.TouchesCluster(l, c))
+				mismatches++;
+		}
+	}
+	double bruteForceMs = timer.ElapsedMilliseconds();
+
+	ClusterStats stats = builder.GetStats();
+	printf("Clustered lights: %d lights (%d in view), %dx%dx%d clusters - %.3f ms per build on %d threads, every pair one by one %.1f ms\n",
+		lightCount, stats.LightsInView, ClusterBuilder::TilesX, ClusterBuilder::TilesY, ClusterBuilder::Slices,
+		buildMs / frames, ThreadPool::Shared().GetThreadCount(), bruteForceMs);
+	printf("     %.0f light/cluster pairs per frame, %d clusters lit, %.1f lights per lit cluster (max %d)%s\n",
+		(double)indices / frames, stats.OccupiedClusters,
+		stats.OccupiedClusters > 0 ? (double)stats.Indices / stats.OccupiedClusters : 0.0, stats.MaxLightsPerCluster,
+		mismatches == 0 ? "" : (" - " + std::to_string(mismatches) + " MISMATCHES").c_str());
+}
+
+// --------------------------------------------------------
+// Submits a scene through the same path Game::Draw takes on
+// the immediate context, against the null render device:
+// real shaders (loaded from reflection), materials, meshes
+// and entities, the constant ring, and a SceneSubmitter that
+// queues, sorts, groups and records the draws.
+//
+// The device counts every call and byte and rejects
+// anything D3D11 would, so besides the time per frame this
+// prints numbers that only change when submission itself
+// does, and checks every frame draws the same thing and
+// that teardown releases everything.
+// --------------------------------------------------------
+void Benchmarks::FrameSubmission(int drawCount, int frames, bool instancing)
+{
+	const int meshCount = 64;
+	const int materialCount = 32;
+	const int shaderCount = 4;
+	const int transparentEvery = 8;		// Every 8th material is transparent
+
+	NullRenderDevice device;
+	RenderDeviceStats setupStats;
+	RenderDeviceStats frameStats;
+	BindStats bindStats;
+	int drawCalls = 0;
+	int groupCount = 0;
+	int invalidCalls = 0;
+	double submitMs = 0.0;
+	bool sameEveryFrame = true;
+	{
+		ConstantBufferRing constantRing;
+		constantRing.Init(&device);
+
+		// The game's shaders, with the frame's constants bound to
+		// their C++ structs like Game::LoadShaders does
+		static constexpr SimpleShaderName PerFrameName("perFrame");
+		SimpleVertexShader vertexShader(&device);
+		SimpleVertexShader instancedVertexShader(&device);
+		vertexShader.LoadReflection(ReflectGameVertexShader(false));
+		instancedVertexShader.LoadReflection(ReflectGameVertexShader(true));
+		vertexShader.SetConstantBufferRing(&constantRing);
+		instancedVertexShader.SetConstantBufferRing(&constantRing);
+		TypedConstantBuffer<PerFrameVSConstants> vsFrameConstants = vertexShader.BindConstantBuffer<PerFrameVSConstants>(PerFrameName);
+		TypedConstantBuffer<PerFrameVSConstants> instancedFrameConstants = instancedVertexShader.BindConstantBuffer<PerFrameVSConstants>(PerFrameName);
+
+		std::vector<std::unique_ptr<SimplePixelShader>> pixelShaders;
+		std::vector<TypedConstantBuffer<PerFramePSConstants>> psFrameConstants;
+		for (int s = 0; s < shaderCount; s++)
+		{
+			pixelShaders.emplace_back(new SimplePixelShader(&device));
+			pixelShaders[s]->LoadReflection(ReflectGamePixelShader());
+			pixelShaders[s]->SetConstantBufferRing(&constantRing);
+			psFrameConstants.push_back(pixelShaders[s]->BindConstantBuffer<PerFramePSConstants>(PerFrameName));
+		}
+
+		// Real meshes (boxes of different sizes) with null buffers
+		std::vector<std::unique_ptr<Mesh>> meshes;
+		for (int m = 0; m < meshCount; m++)
+		{
+			float s = 0.5f + m * 0.1f;
+			Vertex vertices[8];
+			for (int v = 0; v < 8; v++)
+			{
+				vertices[v].Position = DirectX::XMFLOAT3(v & 1 ? s : -s, v & 2 ? s : -s, v & 4 ? s : -s);
+				vertices[v].Normal = DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+				vertices[v].UV = DirectX::XMFLOAT2(0.0f, 0.0f);
+			}
+			unsigned int indices[] =
+			{
+				0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,
+				0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7,
+				0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+			};
+			meshes.emplace_back(new Mesh(vertices, 8, indices, 36, &device));
+		}
+
+		// Textures, samplers and blend states are made by the game
+		// with D3D11, so here they're stand-ins that are only bound
+		auto fake = [](int kind, int id) { return (void*)(size_t)(((kind + 1) << 24) | ((id + 1) << 4)); };
+		std::vector<std::unique_ptr<Material>> materials;
+		for (int m = 0; m < materialCount; m++)
+		{
+			Material* material = new Material(&device, pixelShaders[m % shaderCount].get(), &vertexShader,
+				(RenderShaderResource*)fake(0, m), (RenderSampler*)fake(1, 0));
+			material->SetInstancedVertexShader(&instancedVertexShader);
+			material->SetTransparent(m % transparentEvery == transparentEvery - 1);
+			materials.emplace_back(material);
+		}
+
+		// The scene: what each entity uses, and where it is
+		std::mt19937 rng(36912);
+		std::uniform_int_distribution<int> meshId(0, meshCount - 1);
+		std::uniform_int_distribution<int> materialId(0, materialCount - 1);
+		std::uniform_real_distribution<float> spread(-50.0f, 50.0f);
+		std::uniform_real_distribution<float> depthRange(1.0f, 100.0f);
+		std::vector<Entity*> entities;
+		std::vector<int> visible;
+		for (int d = 0; d < drawCount; d++)
+		{
+			Entity* entity = new Entity(meshes[meshId(rng)].get(), materials[materialId(rng)].get());
+			entity->SetPostion(DirectX::XMFLOAT3(spread(rng), spread(rng), depthRange(rng)));
+			entity->UpdateWorldMatrix();
+			entities.push_back(entity);
+			visible.push_back(d);
+		}
+		std::vector<float> fades(drawCount, 1.0f);
+		Camera camera;
+		camera.UpdateProjectionMatrix(16.0f / 9.0f);
+
+		SceneSubmitter submitter;
+		submitter.Init(&device);
+		submitter.SetInstancing(instancing);
+		submitter.SetTransparentStates((RenderBlendState*)fake(2, 0), (RenderDepthStencilState*)fake(3, 0));
+
+		setupStats = device.GetStats();
+		invalidCalls = setupStats.InvalidCalls;
+		RecordingStateContext& recording = device.GetRecording();
+		StateCache cache(device.GetContext());
+
+		// Frame -1 isn't timed: like the game's first frame, it
+		// grows the constant ring to fit the scene
+		std::vector<unsigned long long> firstFrameStates;
+		for (int f = -1; f < frames; f++)
+		{
+			recording.Clear();
+			device.ResetStats();
+			cache.Invalidate();
+			cache.ResetStats();
+
+			BenchmarkTimer timer;
+			constantRing.BeginFrame();
+			submitter.Prepare(entities, fades, visible, &camera);
+
+			// Same as Game::UploadFrameConstants
+			PerFrameVSConstants vsConstants = {};
+			vsConstants.view = camera.GetViewMatrix();
+			vsConstants.projection = camera.GetProjectionMatrix();
+			vertexShader.SetBufferData(vsFrameConstants, vsConstants);
+			vertexShader.CopyBufferData(vsFrameConstants.Buffer);
+			instancedVertexShader.SetBufferData(instancedFrameConstants, vsConstants);
+			instancedVertexShader.CopyBufferData(instancedFrameConstants.Buffer);
+
+			PerFramePSConstants psConstants = {};
+			for (int s = 0; s < shaderCount; s++)
+			{
+				pixelShaders[s]->SetBufferData(psFrameConstants[s], psConstants);
+				pixelShaders[s]->CopyBufferData(psFrameConstants[s].Buffer);
+			}
+
+			submitter.Record(0, submitter.GetGroupCount(), cache, nullptr);
+			if (f >= 0)
+				submitMs += timer.ElapsedMilliseconds();
+
+			// The same scene has to make the same draws every frame
+			if (f == 0)
+				firstFrameStates = recording.GetDrawStates();
+			else if (f > 0)
+				sameEveryFrame &= recording.GetDrawStates() == firstFrameStates;
+
+			frameStats = device.GetStats();
+			bindStats = cache.GetStats();
+			invalidCalls += frameStats.InvalidCalls;
+		}
+		drawCalls = recording.GetDrawCount();
+		groupCount = submitter.GetGroupCount();
+
+		device.ResetStats();
+		for (Entity* entity : entities)
+			delete entity;
+	}
+	invalidCalls += device.GetStats().InvalidCalls;
+
+	printf("Frame submission: %d entities (%s) - %.3f ms per frame (%.1f ns per entity) on the null device\n",
+		drawCount, instancing ? "instanced" : "not instanced",
+		submitMs / frames, submitMs * 1000000.0 / ((double)frames * drawCount));
+	printf("     per frame: %d groups, %d draws, binds %d -> %d, %d updates (%lld B), %d maps; setup: %d buffers (%lld B); %d objects left alive%s%s\n",
+		groupCount, drawCalls, bindStats.Requested, bindStats.Issued, frameStats.Updates, frameStats.BytesUpdated, frameStats.Maps,
+		setupStats.BuffersCreated, setupStats.BytesCreated, device.GetLiveObjectCount(),
+		sameEveryFrame ? "" : " - FRAMES DIFFER",
+		invalidCalls == 0 ? "" : " - INVALID DEVICE CALLS");
+}
+
+// --------------------------------------------------------
+// Draws the game's starting scene (plus an optional "-spheres"
+// field) on the CPU at the given size, reports frames per
+// second and saves the last frame as SoftwareFrame.bmp.
+//
+// Needs the game's .obj files in the working directory.  The
+// textures are procedural stand-ins, since decoding the .jpg
+// files takes WIC and a device.
+// --------------------------------------------------------
+void Benchmarks::SoftwareRendering(int width, int height, int sphereCount, int frames)
+{
+	using namespace DirectX;
+
+	NullRenderDevice device;
+
+	// Same meshes as Game::CreateBasicGeometry
+	Mesh cube("cube.obj", &device);
+	Mesh sphere("sphere.obj", &device);
+	Vertex starVertices[] =
+	{
+		{ XMFLOAT3(0.0f, 1.2f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(0.5f, -1.3f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(-0.3f, -0.3f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(-1.5f, 0.2f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(1.5f, 0.2f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(0.0f, -0.7f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(-0.5f, -1.3f, +0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) }
+	};
+	unsigned int starIndices[] = { 0, 1, 2, 3, 4, 5, 6, 2, 5 };
+	Mesh star(starVertices, 7, starIndices, 9, &device);
+	Mesh helix("helix.obj", &device);
+	if (cube.GetIndexCount() == 0 || sphere.GetIndexCount() == 0 || helix.GetIndexCount() == 0)
+		printf("Software rendering: missing .obj files, the scene will be incomplete\n");
+
+	// Checkerboards standing in for Cliff.jpg and StoneWall.jpg
+	auto checkerboard = [](int size, int cell, unsigned int colorA, unsigned int colorB)
+	{
+		std::vector<unsigned int> texels(size * size);
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+				texels[y * size + x] = ((x / cell + y / cell) & 1) ? colorA : colorB;
+		CpuTexture texture;
+		texture.Create(size, size, &texels[0]);
+		return texture;
+	};
+	CpuTexture cliff = checkerboard(512, 32, 0xFF5A6E82, 0xFF9CB4C8);
+	CpuTexture wall = checkerboard(512, 64, 0xFF707070, 0xFFB0B0B0);
+
+	// Entities where the game starts them
+	struct SceneDraw
+	{
+		Mesh* DrawMesh;
+		const CpuTexture* Texture;
+		XMFLOAT4X4 World;
+	};
+	std::vector<SceneDraw> scene;
+	auto addDraw = [&scene](Mesh* mesh, const CpuTexture* texture, XMFLOAT3 position, float scale)
+	{
+		SceneDraw draw = {};
+		draw.DrawMesh = mesh;
+		draw.Texture = texture;
+		XMStoreFloat4x4(&draw.World, XMMatrixMultiply(XMMatrixScaling(scale, scale, scale), XMMatrixTranslation(position.x, position.y, position.z)));
+		scene.push_back(draw);
+	};
+	addDraw(&cube, &cliff, XMFLOAT3(1.0f, 1.5f, 0.0f), 1.0f);
+	addDraw(&sphere, &cliff, XMFLOAT3(-1.0f, -2.0f, 0.0f), 1.0f);
+	addDraw(&star, &cliff, XMFLOAT3(-2.0f, -1.0f, 0.0f), 1.0f);
+	addDraw(&helix, &wall, XMFLOAT3(3.0f, 0.0f, 0.0f), 1.0f);
+	int sphereRow = (int)ceilf(sqrtf((float)sphereCount));
+	for (int i = 0; i < sphereCount; i++)
+		addDraw(&sphere, &cliff, XMFLOAT3((i % sphereRow - sphereRow * 0.5f) * 0.75f, -3.0f, 2.0f + (i / sphereRow) * 0.75f), 0.5f);
+
+	// The game's starting camera and lights
+	Camera camera;
+	camera.UpdateProjectionMatrix((float)width / height);
+	camera.Update(0.0f, 0.0f, CameraInput());
+	XMFLOAT4X4 view = camera.GetViewMatrix();
+	XMFLOAT4X4 projection = camera.GetProjectionMatrix();
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&view)),
+		XMMatrixTranspose(XMLoadFloat4x4(&projection))));
+
+	DirectionalLight light1 = {};
+	light1.AmbientColor = XMFLOAT4(0.1f, 0.1f, 0.1f, 0.1f);
+	light1.DiffuseColor = XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+	light1.Direction = XMFLOAT3(1.0f, -1.0f, 0.0f);
+	DirectionalLight light2 = {};
+	light2.AmbientColor = XMFLOAT4(0.1f, 0.1f, 0.1f, 0.1f);
+	light2.DiffuseColor = XMFLOAT4(0.4f, 0.8f, 0.35f, 1.0f);
+	light2.Direction = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	XMFLOAT4 clearColor(0.4f, 0.6f, 0.75f, 0.0f);
+	XMFLOAT4 tint(1.0f, 1.0f, 1.0f, 1.0f);
+
+	SoftwareRasterizer rasterizer(width, height);
+	SoftwareRasterStats totals;
+	BenchmarkTimer timer;
+	for (int f = 0; f < frames; f++)
+	{
+		rasterizer.BeginFrame(viewProj, light1, light2, clearColor);
+		for (const SceneDraw& draw : scene)
+			rasterizer.AddDraw(draw.DrawMesh->GetVertices(), draw.DrawMesh->GetIndices(), draw.World, draw.Texture, tint);
+		rasterizer.Render();
+
+		SoftwareRasterStats frame = rasterizer.GetStats();
+		totals.VertexMs += frame.VertexMs;
+		totals.SetupMs += frame.SetupMs;
+		totals.RasterMs += frame.RasterMs;
+	}
+	double frameMs = timer.ElapsedMilliseconds() / frames;
+
+	SoftwareRasterStats last = rasterizer.GetStats();
+	bool saved = rasterizer.SaveBitmap("SoftwareFrame.bmp");
+
+	printf("Software rendering: %dx%d, %d draws on %d thread(s) - %.3f ms per frame (%.1f fps)\n",
+		width, height, last.Draws, ThreadPool::Shared().GetThreadCount(), frameMs, 1000.0 / frameMs);
+	printf("     per frame: vertices %.3f ms, setup %.3f ms, raster %.3f ms; %d triangles, %d clipped, %d binned, %lld pixels shaded%s\n",
+		totals.VertexMs / frames, totals.SetupMs / frames, totals.RasterMs / frames,
+		last.Triangles, last.Clipped, last.Binned, last.Pixels,
+		saved ? " (saved SoftwareFrame.bmp)" : "");
+}
+
+// --------------------------------------------------------
+// Samples a noise texture with coherent UVs (a rotated grid
+// walked in rows, like a rasterizer's pixels) and with random
+// ones, one sample at a time and four at a time, and reports
+// samples per second.  The SIMD results are checked against
+// the scalar ones.
+// --------------------------------------------------------
+void Benchmarks::TextureSampling(int size, int sampleCount)
+{
+	std::mt19937 rng(4242);
+	std::vector<unsigned int> texels(size * size);
+	for (unsigned int& texel : texels)
+		texel = rng() | 0xFF000000;
+	CpuTexture texture;
+	texture.Create(size, size, &texels[0]);
+
+	sampleCount &= ~3;
+	std::vector<float> u(sampleCount), v(sampleCount), lod(sampleCount);
+	std::vector<float> rgba(sampleCount * 4);
+
+	auto run = [&](const char* pattern)
+	{
+		double checksum = 0.0;
+		BenchmarkTimer timer;
+
+		// One at a time
+		for (int i = 0; i < sampleCount; i++)
+			texture.SampleReference(u[i], v[i], lod[i], &rgba[i * 4]);
+		double scalarMs = timer.ElapsedMilliseconds();
+		std::vector<float> reference = rgba;
+
+		timer.Restart();
+		texture.SampleArray(&u[0], &v[0], &lod[0], sampleCount, &rgba[0]);
+		double trilinearMs = timer.ElapsedMilliseconds();
+
+		float maxDifference = 0.0f;
+		for (int i = 0; i < sampleCount * 4; i++)
+			maxDifference = (std::max)(maxDifference, fabsf(rgba[i] - reference[i]));
+
+		// Level 0 only
+		timer.Restart();
+		for (int i = 0; i < sampleCount; i += 4)
+		{
+			__m128 color[4];
+			texture.SampleBilinear4(_mm_loadu_ps(&u[i]), _mm_loadu_ps(&v[i]), 0, color);
+			checksum += _mm_cvtss_f32(color[0]);
+		}
+		double bilinearMs = timer.ElapsedMilliseconds();
+
+		auto rate = [sampleCount](double ms) { return sampleCount / (ms * 1000.0); };
+		printf("     %s: trilinear %.1f M samples/s (one at a time %.1f M/s, %.1fx), bilinear %.1f M samples/s - max difference %g%s\n",
+			pattern, rate(trilinearMs), rate(scalarMs), scalarMs / trilinearMs, rate(bilinearMs), maxDifference,
+			checksum == 0.0 ? " (empty?)" : "");
+	};
+
+	printf("Texture sampling: %dx%d RGBA8, %d levels in 4x4 tiles, %d samples per pattern\n",
+		size, size, texture.GetLevelCount(), sampleCount);
+
+	// A 1024 sample wide grid turned 30 degrees, about 2.5
+	// texels per step (between levels 1 and 2), stepping on
+	// from row to row like a screen
+	float step = 2.5f / size;
+	float lodStep = log2f(step * size);
+	float cosAngle = cosf(0.5236f), sinAngle = sinf(0.5236f);
+	for (int i = 0; i < sampleCount; i++)
+	{
+		float x = (float)(i % 1024) * step;
+		float y = (float)(i / 1024) * step;
+		u[i] = x * cosAngle - y * sinAngle;
+		v[i] = x * sinAngle + y * cosAngle;
+		lod[i] = lodStep;
+	}
+	run("coherent");
+
+	// Anywhere in [-2, 2], any level
+	std::uniform_real_distribution<float> coordinate(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> level(0.0f, (float)(texture.GetLevelCount() - 1));
+	for (int i = 0; i < sampleCount; i++)
+	{
+		u[i] = coordinate(rng);
+		v[i] = coordinate(rng);
+		lod[i] = level(rng);
+	}
+	run("random");
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmarks for engine systems.
+//
+// Run the executable with "-benchmark" on the command line
+// to execute these in a console instead of opening the game,
+// or build and run them without D3D11 through CMakeLists.txt.
+// --------------------------------------------------------
+namespace Benchmarks
+{
+	void RunAll();
+
+	void KinematicIntegration(int bodyCount, float sleepingFraction, int frames);
+	void DynamicBVHScaling(int objectCount, float motionFraction, int frames);
+	void SpatialHashQueries(int itemCount, int queryCount);
+	void SceneRaycasts(int instanceCount, int rayCount);
+	void MultiViewCulling(int objectCount, int viewCount, int frames);
+	void ContributionCulling(int objectCount, float minPixels, float fadeBand);
+	void RenderQueueSort(int drawCount, int frames);
+	void RedundantStateFiltering(int drawCount, bool sortDraws);
+	void ConstantRingAllocation(int drawCount, int frames, unsigned int startCapacity);
+	void ShaderVariableLookup(int drawCount, int frames);
+	void ClusteredLightBinning(int lightCount, int frames);
+	void FrameSubmission(int drawCount, int frames, bool instancing);
+	void SoftwareRendering(int width, int height, int sphereCount, int frames);
+	void TextureSampling(int size, int sampleCount);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <DirectXMath.h>
+
+// --------------------------------------------------------
+// Axis-aligned bounding box
+// --------------------------------------------------------
+struct AABB
+{
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+};
+
+// --------------------------------------------------------
+// Bounding sphere
+// --------------------------------------------------------
+struct BoundingSphere
+{
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+};
+
+// --------------------------------------------------------
+// Six planes (left, right, bottom, top, near, far), each
+// stored as (normal.xyz, d) with normals pointing inward.
+// A point p is inside a plane when dot(normal, p) + d >= 0
+// --------------------------------------------------------
+struct Frustum
+{
+	DirectX::XMFLOAT4 Planes[6];
+};
+
+// --------------------------------------------------------
+// Ray segment from Origin along Direction.  Hits are reported
+// as distances in units of Direction's length, so leave it
+// normalized to get world space distances.
+// --------------------------------------------------------
+struct Ray
+{
+	DirectX::XMFLOAT3 Origin;
+	DirectX::XMFLOAT3 Direction;
+	float MaxDistance;
+};
@@ -3,6 +3,12 @@
 DirectX::XMFLOAT4X4 Camera::GetViewMatrix() { return viewMatrix; }
 DirectX::XMFLOAT4X4 Camera::GetProjectionMatrix() { return projectionMatrix; }
 DirectX::XMFLOAT3 Camera::GetPosition() { return cameraPosition; }
+DirectX::XMFLOAT3 Camera::GetDirection() { return cameraDirection; }
+const Frustum& Camera::GetFrustum() { return frustum; }
+float Camera::GetFieldOfView() { return fieldOfView; }
+float Camera::GetAspectRatio() { return aspectRatio; }
+float Camera::GetNearPlane() { return nearPlane; }
+float Camera::GetFarPlane() { return farPlane; }
 
 Camera::Camera()
 {
@@ -11,35 +17,44 @@ Camera::Camera()
 
 	xRotation = 0.0f;
 	yRotation = 0.0f;
+
+	fieldOfView = 0.25f * 3.1415926535f;
+	aspectRatio = 1.0f;
+	nearPlane = 0.1f;
+	farPlane = 100.0f;
+
+	DirectX::XMStoreFloat4x4(&viewMatrix, DirectX::XMMatrixIdentity());
+	DirectX::XMStoreFloat4x4(&projectionMatrix, DirectX::XMMatrixIdentity());
+	frustum = {};
 }
 
-void Camera::Update(float deltaTime, float totalTime)
+void Camera::Update(float deltaTime, float /*totalTime*/, const CameraInput& input)
 {	
 	DirectX::XMMATRIX newViewMatrix = DirectX::XMMatrixLookToLH(DirectX::XMLoadFloat3(&cameraPosition), DirectX::XMLoadFloat3(&cameraDirection), DirectX::XMLoadFloat3(&up));
 
 	DirectX::XMVECTOR sideVector = DirectX::XMVector3Cross(DirectX::XMLoadFloat3(&cameraDirection), DirectX::XMLoadFloat3(&up));
 	//Camera Movement
-	if (GetAsyncKeyState('W') & 0x8000) 
+	if (input.Forward)
 	{
 		DirectX::XMStoreFloat3(&cameraPosition, DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&cameraPosition), DirectX::XMVectorScale(DirectX::XMLoadFloat3(&cameraDirection), 2 * deltaTime)));
 	}
-	if (GetAsyncKeyState('S') & 0x8000)
+	if (input.Back)
 	{
 		DirectX::XMStoreFloat3(&cameraPosition, DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&cameraPosition), DirectX::XMVectorScale(DirectX::XMLoadFloat3(&cameraDirection), 2 * deltaTime)));
 	}
-	if (GetAsyncKeyState('D') & 0x8000)
+	if (input.Right)
 	{
 		DirectX::XMStoreFloat3(&cameraPosition, DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&cameraPosition), DirectX::XMVectorScale(sideVector, 2 * deltaTime)));
 	}
-	if (GetAsyncKeyState('A') & 0x8000)
+	if (input.Left)
 	{
 		DirectX::XMStoreFloat3(&cameraPosition, DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&cameraPosition), DirectX::XMVectorScale(sideVector, 2 * deltaTime)));
 	}
-	if (GetAsyncKeyState(VK_SPACE) & 0x8000)
+	if (input.Up)
 	{
 		cameraPosition.y += 1 * 2 * deltaTime;
 	}
-	if (GetAsyncKeyState(VK_CONTROL) & 0x8000)
+	if (input.Down)
 	{
 		cameraPosition.y -= 1 * 2 * deltaTime;
 	}
@@ -47,16 +62,48 @@ void Camera::Update(float deltaTime, float totalTime)
 	DirectX::XMStoreFloat3(&cameraDirection, DirectX::XMVector3Rotate(DirectX::XMLoadFloat3(&forward), DirectX::XMQuaternionRotationRollPitchYaw(yRotation, xRotation, 0.0f)));
 
 	DirectX::XMStoreFloat4x4(&viewMatrix, XMMatrixTranspose(newViewMatrix));
+	UpdateFrustumPlanes();
 }
 
 void Camera::UpdateProjectionMatrix(float aspectRatio)
 {
+	this->aspectRatio = aspectRatio;
+
 	DirectX::XMMATRIX P = DirectX::XMMatrixPerspectiveFovLH(
-		0.25f * 3.1415926535f,	// Field of View Angle
+		fieldOfView,			// Field of View Angle
 		aspectRatio,			// Aspect ratio
-		0.1f,				  	// Near clip plane distance
-		100.0f);			  	// Far clip plane distance
+		nearPlane,			  	// Near clip plane distance
+		farPlane);			  	// Far clip plane distance
 	DirectX::XMStoreFloat4x4(&projectionMatrix, DirectX::XMMatrixTranspose(P)); // Transpose for HLSL!
+	UpdateFrustumPlanes();
+}
+
+//Extracts the six world space frustum planes from view * projection
+//(Gribb/Hartmann).  Our stored matrices are transposed for HLSL, so
+//the rows of the transposed matrix are the columns we need.
+void Camera::UpdateFrustumPlanes()
+{
+	DirectX::XMMATRIX viewProjT = DirectX::XMMatrixMultiply(
+		DirectX::XMLoadFloat4x4(&projectionMatrix),
+		DirectX::XMLoadFloat4x4(&viewMatrix));	// (V * P)^T = P^T * V^T
+
+	DirectX::XMVECTOR c0 = viewProjT.r[0];
+	DirectX::XMVECTOR c1 = viewProjT.r[1];
+	DirectX::XMVECTOR c2 = viewProjT.r[2];
+	DirectX::XMVECTOR c3 = viewProjT.r[3];
+
+	DirectX::XMVECTOR planes[6] =
+	{
+		DirectX::XMVectorAdd(c3, c0),		// Left
+		DirectX::XMVectorSubtract(c3, c0),	// Right
+		DirectX::XMVectorAdd(c3, c1),		// Bottom
+		DirectX::XMVectorSubtract(c3, c1),	// Top
+		c2,									// Near (D3D depth starts at 0)
+		DirectX::XMVectorSubtract(c3, c2)	// Far
+	};
+
+	for (int i = 0; i < 6; i++)
+		DirectX::XMStoreFloat4(&frustum.Planes[i], DirectX::XMPlaneNormalize(planes[i]));
 }
 
 void Camera::RotateCamera(int XpixelAmount, int YpixelAmount)
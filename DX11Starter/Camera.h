@@ -1,7 +1,18 @@
 #pragma once
-#include <d3d11.h>
 #include <DirectXMath.h>
-#include <Windows.h>
+
+#include "Bounds.h"
+
+//Movement keys held this frame (read by whoever owns the window)
+struct CameraInput
+{
+	bool Forward;
+	bool Back;
+	bool Left;
+	bool Right;
+	bool Up;
+	bool Down;
+};
 
 class Camera
 {
@@ -15,6 +26,16 @@ private:
 	float xRotation;
 	float yRotation;
 
+	//Projection settings, kept for screen size calculations
+	float fieldOfView;
+	float aspectRatio;
+	float nearPlane;
+	float farPlane;
+
+	//World space frustum, re-extracted whenever view or projection change
+	Frustum frustum;
+	void UpdateFrustumPlanes();
+
 	//Defaults
 	DirectX::XMFLOAT3 right = DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f);
 	DirectX::XMFLOAT3 up = DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
@@ -24,10 +45,16 @@ public:
 	DirectX::XMFLOAT4X4 GetViewMatrix();
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
 	DirectX::XMFLOAT3 GetPosition();
+	DirectX::XMFLOAT3 GetDirection();
+	const Frustum& GetFrustum();
+	float GetFieldOfView();
+	float GetAspectRatio();
+	float GetNearPlane();
+	float GetFarPlane();
 
 	Camera();
 
-	void Update(float deltaTime, float totalTime);
+	void Update(float deltaTime, float totalTime, const CameraInput& input);
 
 	void UpdateProjectionMatrix(float aspectRatio);
 
@@ -0,0 +1,383 @@
+#include "ClusterBuilder.h"
+#include "ThreadPool.h"
+
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+// Pairs are packed as cluster (in its slice) << 24 | light
+static const int PairLightBits = 24;
+static const unsigned int PairLightMask = (1u << PairLightBits) - 1;
+
+ClusterBuilder::ClusterBuilder()
+{
+	xScale = 0.0f;
+	yScale = 0.0f;
+	nearZ = 0.0f;
+	farZ = 0.0f;
+	sliceScale = 0.0f;
+	sliceBias = 0.0f;
+	sliceBins.resize(Slices);
+	clusters.resize(ClusterCount);
+}
+
+void ClusterBuilder::SetProjection(float xScale, float yScale, float nearZ, float farZ)
+{
+	if (xScale == this->xScale && yScale == this->yScale && nearZ == this->nearZ && farZ == this->farZ)
+		return;
+
+	this->xScale = xScale;
+	this->yScale = yScale;
+	this->nearZ = nearZ;
+	this->farZ = farZ;
+
+	float logDepthRange = logf(farZ / nearZ);
+	sliceScale = Slices / logDepthRange;
+	sliceBias = -Slices * logf(nearZ) / logDepthRange;
+
+	BuildClusterBounds();
+}
+
+// --------------------------------------------------------
+// Boxes around each froxel in view space.  A tile's edges
+// are rays from the eye, so its box spans the tile's corners
+// at both the near and far depth of its slice.
+// --------------------------------------------------------
+void ClusterBuilder::BuildClusterBounds()
+{
+	boxMinX.resize(ClusterCount); boxMinY.resize(ClusterCount); boxMinZ.resize(ClusterCount);
+	boxMaxX.resize(ClusterCount); boxMaxY.resize(ClusterCount); boxMaxZ.resize(ClusterCount);
+	sphereX.resize(ClusterCount); sphereY.resize(ClusterCount); sphereZ.resize(ClusterCount);
+	sphereRadius.resize(ClusterCount);
+	sliceBounds.resize(Slices * 6);
+	rowBounds.resize(Slices * TilesY * 6);
+
+	for (int s = 0; s < Slices; s++)
+	{
+		float sliceNear = nearZ * powf(farZ / nearZ, (float)s / Slices);
+		float sliceFar = nearZ * powf(farZ / nearZ, (float)(s + 1) / Slices);
+
+		// The far end of a slice is its widest
+		float* slice = &sliceBounds[s * 6];
+		slice[0] = -sliceFar / xScale; slice[1] = -sliceFar / yScale; slice[2] = sliceNear;
+		slice[3] = sliceFar / xScale; slice[4] = sliceFar / yScale; slice[5] = sliceFar;
+
+		for (int y = 0; y < TilesY; y++)
+		{
+			// Tile rows go down the screen, NDC y goes up
+			float ndcTop = 1.0f - 2.0f * y / TilesY;
+			float ndcBottom = 1.0f - 2.0f * (y + 1) / TilesY;
+
+			float* row = &rowBounds[(s * TilesY + y) * 6];
+			row[0] = row[1] = row[2] = FLT_MAX;
+			row[3] = row[4] = row[5] = -FLT_MAX;
+
+			for (int x = 0; x < TilesX; x++)
+			{
+				float ndcLeft = -1.0f + 2.0f * x / TilesX;
+				float ndcRight = -1.0f + 2.0f * (x + 1) / TilesX;
+
+				float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+				float depths[] = { sliceNear, sliceFar };
+				for (float depth : depths)
+				{
+					float left = ndcLeft * depth / xScale;
+					float right = ndcRight * depth / xScale;
+					float top = ndcTop * depth / yScale;
+					float bottom = ndcBottom * depth / yScale;
+					minX = fminf(minX, left);
+					maxX = fmaxf(maxX, right);
+					minY = fminf(minY, bottom);
+					maxY = fmaxf(maxY, top);
+				}
+
+				int c = (s * TilesY + y) * TilesX + x;
+				boxMinX[c] = minX; boxMinY[c] = minY; boxMinZ[c] = sliceNear;
+				boxMaxX[c] = maxX; boxMaxY[c] = maxY; boxMaxZ[c] = sliceFar;
+
+				float halfX = (maxX - minX) * 0.5f;
+				float halfY = (maxY - minY) * 0.5f;
+				float halfZ = (sliceFar - sliceNear) * 0.5f;
+				sphereX[c] = minX + halfX;
+				sphereY[c] = minY + halfY;
+				sphereZ[c] = sliceNear + halfZ;
+				sphereRadius[c] = sqrtf(halfX * halfX + halfY * halfY + halfZ * halfZ);
+
+				row[0] = fminf(row[0], minX); row[1] = fminf(row[1], minY); row[2] = fminf(row[2], sliceNear);
+				row[3] = fmaxf(row[3], maxX); row[4] = fmaxf(row[4], maxY); row[5] = fmaxf(row[5], sliceFar);
+			}
+		}
+	}
+}
+
+void ClusterBuilder::Build(const LocalLight* lights, int lightCount, const XMFLOAT4X4& view)
+{
+	if (lightCount > (int)PairLightMask)
+		lightCount = (int)PairLightMask;
+
+	// Bound every light in view space and find its slices
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	viewLights.resize(lightCount);
+	std::vector<int> sliceCounts(Slices + 1, 0);
+	for (int l = 0; l < lightCount; l++)
+	{
+		const LocalLight& light = lights[l];
+		ViewLight& viewLight = viewLights[l];
+
+		XMFLOAT3 apex;
+		XMStoreFloat3(&apex, XMVector3TransformCoord(XMLoadFloat3(&light.Position), viewMatrix));
+		viewLight.ApexX = apex.x;
+		viewLight.ApexY = apex.y;
+		viewLight.ApexZ = apex.z;
+		viewLight.Range = light.Range;
+		viewLight.Spot = light.Type == (unsigned int)LocalLightType::Spot;
+
+		if (viewLight.Spot)
+		{
+			XMFLOAT3 direction;
+			XMStoreFloat3(&direction, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&light.Direction), viewMatrix)));
+			viewLight.DirX = direction.x;
+			viewLight.DirY = direction.y;
+			viewLight.DirZ = direction.z;
+			viewLight.CosAngle = light.CosOuterAngle;
+			viewLight.SinAngle = sqrtf(fmaxf(0.0f, 1.0f - light.CosOuterAngle * light.CosOuterAngle));
+
+			// Smallest sphere around the cone: wide cones are
+			// bounded by their cap's circle, narrow ones by a
+			// sphere through the apex and the cap's rim
+			float centerDistance, radius;
+			if (viewLight.CosAngle < 0.70710678f)
+			{
+				centerDistance = light.Range * viewLight.CosAngle;
+				radius = light.Range * viewLight.SinAngle;
+			}
+			else
+			{
+				centerDistance = light.Range / (2.0f * viewLight.CosAngle);
+				radius = centerDistance;
+			}
+			viewLight.X = apex.x + direction.x * centerDistance;
+			viewLight.Y = apex.y + direction.y * centerDistance;
+			viewLight.Z = apex.z + direction.z * centerDistance;
+			viewLight.Radius = radius;
+		}
+		else
+		{
+			viewLight.DirX = viewLight.DirY = viewLight.DirZ = 0.0f;
+			viewLight.CosAngle = -1.0f;
+			viewLight.SinAngle = 0.0f;
+			viewLight.X = apex.x;
+			viewLight.Y = apex.y;
+			viewLight.Z = apex.z;
+			viewLight.Radius = light.Range;
+		}
+
+		// Lights entirely in front of the near plane or beyond
+		// the far plane touch no slices
+		float front = viewLight.Z - viewLight.Radius;
+		float back = viewLight.Z + viewLight.Radius;
+		if (back < nearZ || front > farZ)
+		{
+			viewLight.FirstSlice = 0;
+			viewLight.LastSlice = -1;
+			continue;
+		}
+
+		viewLight.FirstSlice = (int)floorf(logf(fmaxf(front, nearZ)) * sliceScale + sliceBias);
+		viewLight.LastSlice = (int)floorf(logf(fminf(back, farZ)) * sliceScale + sliceBias);
+		viewLight.FirstSlice = viewLight.FirstSlice < 0 ? 0 : viewLight.FirstSlice;
+		viewLight.LastSlice = viewLight.LastSlice >= Slices ? Slices - 1 : viewLight.LastSlice;
+		for (int s = viewLight.FirstSlice; s <= viewLight.LastSlice; s++)
+			sliceCounts[s + 1]++;
+	}
+
+	// List each slice's lights (in light order)
+	sliceLightStart.resize(Slices + 1);
+	sliceLightStart[0] = 0;
+	for (int s = 0; s < Slices; s++)
+		sliceLightStart[s + 1] = sliceLightStart[s] + sliceCounts[s + 1];
+
+	sliceLights.resize(sliceLightStart[Slices]);
+	std::vector<int> sliceFill(sliceLightStart.begin(), sliceLightStart.end() - 1);
+	for (int l = 0; l < lightCount; l++)
+	{
+		for (int s = viewLights[l].FirstSlice; s <= viewLights[l].LastSlice; s++)
+			sliceLights[sliceFill[s]++] = l;
+	}
+
+	ThreadPool::Shared().ParallelFor(Slices, [this](int slice) { BinSlice(slice); });
+
+	// Stitch the slices together in cluster order
+	lightIndices.clear();
+	stats = ClusterStats();
+	stats.Lights = lightCount;
+	for (int s = 0; s < Slices; s++)
+	{
+		const SliceBin& bin = sliceBins[s];
+		unsigned int offset = (unsigned int)lightIndices.size();
+		for (int c = 0; c < ClustersPerSlice; c++)
+		{
+			ClusterRange& range = clusters[s * ClustersPerSlice + c];
+			range.Offset = offset;
+			range.Count = bin.Counts[c];
+			offset += bin.Counts[c];
+
+			if (range.Count > 0)
+				stats.OccupiedClusters++;
+			if ((int)range.Count > stats.MaxLightsPerCluster)
+				stats.MaxLightsPerCluster = (int)range.Count;
+		}
+		lightIndices.insert(lightIndices.end(), bin.Indices.begin(), bin.Indices.end());
+	}
+	stats.Indices = (int)lightIndices.size();
+
+	std::vector<bool> touched(lightCount, false);
+	for (unsigned int index : lightIndices)
+		touched[index] = true;
+	for (int l = 0; l < lightCount; l++)
+		stats.LightsInView += touched[l] ? 1 : 0;
+}
+
+// --------------------------------------------------------
+// Tests one slice's lights against its clusters, four at a
+// time, then sorts the hits by cluster
+// --------------------------------------------------------
+void ClusterBuilder::BinSlice(int slice)
+{
+	SliceBin& bin = sliceBins[slice];
+	bin.Pairs.clear();
+
+	__m128 zero = _mm_setzero_ps();
+	for (int k = sliceLightStart[slice]; k < sliceLightStart[slice + 1]; k++)
+	{
+		int l = sliceLights[k];
+		const ViewLight& light = viewLights[l];
+
+		// Lights off to the side only overlap the slice's depths
+		const float* bounds = &sliceBounds[slice * 6];
+		if (!SphereTouchesBox(light.X, light.Y, light.Z, light.Radius, bounds, bounds + 3))
+			continue;
+
+		__m128 lx = _mm_set1_ps(light.X);
+		__m128 ly = _mm_set1_ps(light.Y);
+		__m128 lz = _mm_set1_ps(light.Z);
+		__m128 radiusSq = _mm_set1_ps(light.Radius * light.Radius);
+
+		for (int row = 0; row < TilesY; row++)
+		{
+			if (!RowTouched(light, slice, row))
+				continue;
+
+			int rowStart = (slice * TilesY + row) * TilesX;
+			for (int x = 0; x < TilesX; x += 4)
+			{
+				int c = rowStart + x;
+
+				// Sphere against box: distance to the box on each axis
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinX[c]), lx), zero), _mm_sub_ps(lx, _mm_loadu_ps(&boxMaxX[c])));
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinY[c]), ly), zero), _mm_sub_ps(ly, _mm_loadu_ps(&boxMaxY[c])));
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinZ[c]), lz), zero), _mm_sub_ps(lz, _mm_loadu_ps(&boxMaxZ[c])));
+				__m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				int mask = _mm_movemask_ps(_mm_cmple_ps(distSq, radiusSq));
+
+				// Cone against the clusters' bounding spheres
+				if (mask && light.Spot)
+				{
+					__m128 radius = _mm_loadu_ps(&sphereRadius[c]);
+					__m128 vx = _mm_sub_ps(_mm_loadu_ps(&sphereX[c]), _mm_set1_ps(light.ApexX));
+					__m128 vy = _mm_sub_ps(_mm_loadu_ps(&sphereY[c]), _mm_set1_ps(light.ApexY));
+					__m128 vz = _mm_sub_ps(_mm_loadu_ps(&sphereZ[c]), _mm_set1_ps(light.ApexZ));
+					__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+					__m128 along = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(vx, _mm_set1_ps(light.DirX)),
+						_mm_mul_ps(vy, _mm_set1_ps(light.DirY))),
+						_mm_mul_ps(vz, _mm_set1_ps(light.DirZ)));
+					__m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(along, along)), zero));
+					__m128 closest = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(light.CosAngle), across), _mm_mul_ps(along, _mm_set1_ps(light.SinAngle)));
+
+					__m128 outside = _mm_or_ps(_mm_or_ps(
+						_mm_cmpgt_ps(closest, radius),
+						_mm_cmpgt_ps(along, _mm_add_ps(radius, _mm_set1_ps(light.Range)))),
+						_mm_cmplt_ps(along, _mm_sub_ps(zero, radius)));
+					mask &= ~_mm_movemask_ps(outside);
+				}
+
+				for (int b = 0; b < 4; b++)
+				{
+					if (mask & (1 << b))
+						bin.Pairs.push_back((unsigned int)(row * TilesX + x + b) << PairLightBits | (unsigned int)l);
+				}
+			}
+		}
+	}
+
+	// Counting sort by cluster (stable, so each cluster's
+	// lights stay in light order)
+	unsigned int offsets[ClustersPerSlice];
+	memset(bin.Counts, 0, sizeof(bin.Counts));
+	for (unsigned int pair : bin.Pairs)
+		bin.Counts[pair >> PairLightBits]++;
+
+	unsigned int offset = 0;
+	for (int c = 0; c < ClustersPerSlice; c++)
+	{
+		offsets[c] = offset;
+		offset += bin.Counts[c];
+	}
+
+	bin.Indices.resize(bin.Pairs.size());
+	for (unsigned int pair : bin.Pairs)
+		bin.Indices[offsets[pair >> PairLightBits]++] = pair & PairLightMask;
+}
+
+bool ClusterBuilder::RowTouched(const ViewLight& light, int slice, int row) const
+{
+	const float* bounds = &rowBounds[(slice * TilesY + row) * 6];
+	return SphereTouchesBox(light.X, light.Y, light.Z, light.Radius, bounds, bounds + 3);
+}
+
+bool ClusterBuilder::SphereTouchesBox(float x, float y, float z, float radius, const float* boxMin, const float* boxMax)
+{
+	float dx = fmaxf(fmaxf(boxMin[0] - x, 0.0f), x - boxMax[0]);
+	float dy = fmaxf(fmaxf(boxMin[1] - y, 0.0f), y - boxMax[1]);
+	float dz = fmaxf(fmaxf(boxMin[2] - z, 0.0f), z - boxMax[2]);
+	return (dx * dx + dy * dy) + dz * dz <= radius * radius;
+}
+
+// --------------------------------------------------------
+// Cone against sphere, from Bart Wronski's "Cull that cone":
+// the sphere is outside if it's further from the cone's
+// side than its radius, past the cone's range, or behind
+// its apex
+// --------------------------------------------------------
+bool ClusterBuilder::ConeTouchesSphere(const ViewLight& light, float x, float y, float z, float radius) const
+{
+	float vx = x - light.ApexX;
+	float vy = y - light.ApexY;
+	float vz = z - light.ApexZ;
+	float lengthSq = (vx * vx + vy * vy) + vz * vz;
+	float along = (vx * light.DirX + vy * light.DirY) + vz * light.DirZ;
+	float across = sqrtf(fmaxf(lengthSq - along * along, 0.0f));
+	float closest = light.CosAngle * across - along * light.SinAngle;
+
+	return !(closest > radius || along > radius + light.Range || along < 0.0f - radius);
+}
+
+bool ClusterBuilder::TouchesCluster(int light, int cluster) const
+{
+	const ViewLight& viewLight = viewLights[light];
+	int slice = cluster / ClustersPerSlice;
+	int row = cluster % ClustersPerSlice / TilesX;
+	if (slice < viewLight.FirstSlice || slice > viewLight.LastSlice || !RowTouched(viewLight, slice, row))
+		return false;
+
+	float boxMin[] = { boxMinX[cluster], boxMinY[cluster], boxMinZ[cluster] };
+	float boxMax[] = { boxMaxX[cluster], boxMaxY[cluster], boxMaxZ[cluster] };
+	if (!SphereTouchesBox(viewLight.X, viewLight.Y, viewLight.Z, viewLight.Radius, boxMin, boxMax))
+		return false;
+
+	return !viewLight.Spot || ConeTouchesSphere(viewLight, sphereX[cluster], sphereY[cluster], sphereZ[cluster], sphereRadius[cluster]);
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Kinds of local light
+// --------------------------------------------------------
+enum class LocalLightType : unsigned int
+{
+	Point = 0,
+	Spot = 1
+};
+
+// --------------------------------------------------------
+// One point or spot light in world space, laid out as the
+// pixel shader reads it (StructuredBuffer<LocalLight>).
+// Light fades to nothing at Range.
+// --------------------------------------------------------
+struct LocalLight
+{
+	DirectX::XMFLOAT3 Position;
+	float Range;
+	DirectX::XMFLOAT3 Color;
+	unsigned int Type;				// LocalLightType
+	DirectX::XMFLOAT3 Direction;	// Spot lights only (normalized)
+	float CosOuterAngle;			// Spot light edge
+	float CosInnerAngle;			// Full strength inside this
+	float Padding[3];
+};
+
+static_assert(sizeof(LocalLight) % 16 == 0, "LocalLight must match the shader's 16 byte aligned struct");
+
+// --------------------------------------------------------
+// Where one cluster's lights are in the light index list
+// --------------------------------------------------------
+struct ClusterRange
+{
+	unsigned int Offset;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// What the last build produced
+// --------------------------------------------------------
+struct ClusterStats
+{
+	int Lights = 0;				// Lights given to Build()
+	int LightsInView = 0;		// Lights that touched any cluster
+	int Indices = 0;			// Light/cluster pairs
+	int OccupiedClusters = 0;
+	int MaxLightsPerCluster = 0;
+};
+
+// --------------------------------------------------------
+// Bins local lights into a view space "froxel" grid: screen
+// tiles in X and Y, and slices in depth that grow
+// exponentially (so near and far clusters are about as deep
+// as they are wide).  The pixel shader finds its cluster
+// from its screen position and depth and only loops over
+// that cluster's lights.
+//
+// Each light is moved to view space and bounded by a sphere
+// (spot lights by their cone's bounding sphere), which
+// decides its range of slices.  Slices are then binned in
+// parallel: each one tests its lights against the slice's
+// bounds, then each row's, then four clusters at a time with
+// SSE - sphere against cluster box, and for spot lights the
+// cone against the cluster's bounding sphere too.
+//
+// The output is the same for any thread count.
+// --------------------------------------------------------
+class ClusterBuilder
+{
+public:
+	static const int TilesX = 16;
+	static const int TilesY = 9;
+	static const int Slices = 24;
+	static const int ClustersPerSlice = TilesX * TilesY;
+	static const int ClusterCount = ClustersPerSlice * Slices;
+
+	ClusterBuilder();
+
+	// xScale and yScale are the projection matrix's _11 and _22.
+	// Rebuilds the cluster bounds if anything changed.
+	void SetProjection(float xScale, float yScale, float nearZ, float farZ);
+
+	// Bins world space lights for a view matrix (row vector,
+	// NOT transposed for HLSL)
+	void Build(const LocalLight* lights, int lightCount, const DirectX::XMFLOAT4X4& view);
+
+	const std::vector<ClusterRange>& GetClusters() const { return clusters; }
+	const std::vector<unsigned int>& GetLightIndices() const { return lightIndices; }
+	ClusterStats GetStats() const { return stats; }
+
+	// Slice of a view space depth is
+	//   floor(log(depth) * sliceScale + sliceBias)
+	float GetSliceScale() const { return sliceScale; }
+	float GetSliceBias() const { return sliceBias; }
+
+	// The same tests Build() makes, one light and cluster at a
+	// time, against the lights of the last build (for checking)
+	bool TouchesCluster(int light, int cluster) const;
+
+private:
+	float xScale;
+	float yScale;
+	float nearZ;
+	float farZ;
+	float sliceScale;
+	float sliceBias;
+
+	// View space cluster boxes and bounding spheres, one float
+	// stream per component (cluster index order)
+	std::vector<float> boxMinX, boxMinY, boxMinZ;
+	std::vector<float> boxMaxX, boxMaxY, boxMaxZ;
+	std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+
+	// Boxes around each slice, and each row of tiles in each
+	// slice (minX, minY, minZ, maxX, maxY, maxZ)
+	std::vector<float> sliceBounds;
+	std::vector<float> rowBounds;
+
+	// The last build's lights in view space
+	struct ViewLight
+	{
+		float X, Y, Z, Radius;		// Bounding sphere
+		float ApexX, ApexY, ApexZ;	// Spot lights: cone
+		float DirX, DirY, DirZ;
+		float Range, CosAngle, SinAngle;
+		bool Spot;
+		int FirstSlice, LastSlice;
+	};
+	std::vector<ViewLight> viewLights;
+
+	// Lights touching each slice (offsets into sliceLights)
+	std::vector<int> sliceLightStart;
+	std::vector<int> sliceLights;
+
+	// Each slice's results, merged in order after binning
+	struct SliceBin
+	{
+		std::vector<unsigned int> Pairs;		// cluster in slice << 24 | light
+		std::vector<unsigned int> Indices;
+		unsigned int Counts[ClustersPerSlice];
+	};
+	std::vector<SliceBin> sliceBins;
+
+	std::vector<ClusterRange> clusters;
+	std::vector<unsigned int> lightIndices;
+	ClusterStats stats;
+
+	void BuildClusterBounds();
+	void BinSlice(int slice);
+	bool RowTouched(const ViewLight& light, int slice, int row) const;
+	bool ConeTouchesSphere(const ViewLight& light, float x, float y, float z, float radius) const;
+	static bool SphereTouchesBox(float x, float y, float z, float radius, const float* boxMin, const float* boxMax);
+};
@@ -0,0 +1,160 @@
+#include "ConstantBufferRing.h"
+#include <string.h>
+
+// Offsets and sizes of bound ranges must be multiples of
+// 16 constants
+static const unsigned int ConstantBufferAlignment = 256;
+
+// --------------------------------------------------------
+// RingAllocator
+// --------------------------------------------------------
+RingAllocator::RingAllocator()
+{
+	Init(0, ConstantBufferAlignment);
+}
+
+void RingAllocator::Init(unsigned int capacity, unsigned int alignment)
+{
+	this->capacity = capacity;
+	this->alignment = alignment;
+	Reset();
+	frameBytes = 0;
+	frameAllocations = 0;
+	frameWraps = 0;
+}
+
+void RingAllocator::Reset()
+{
+	head = 0;
+	needsDiscard = true;
+}
+
+unsigned int RingAllocator::BeginFrame()
+{
+	unsigned int needed = frameWraps > 0 ? frameBytes : 0;
+
+	frameBytes = 0;
+	frameAllocations = 0;
+	frameWraps = 0;
+	return needed;
+}
+
+bool RingAllocator::Allocate(unsigned int size, RingAllocation& allocation)
+{
+	unsigned int alignedSize = (size + alignment - 1) / alignment * alignment;
+	if (alignedSize == 0 || alignedSize > capacity)
+		return false;
+
+	allocation.Discard = needsDiscard;
+	if (head + alignedSize > capacity)
+	{
+		head = 0;
+		allocation.Discard = true;
+		frameWraps++;
+	}
+
+	allocation.Offset = head;
+	allocation.Size = alignedSize;
+	head += alignedSize;
+	needsDiscard = false;
+
+	frameBytes += alignedSize;
+	frameAllocations++;
+	return true;
+}
+
+// --------------------------------------------------------
+// ConstantBufferRing
+// --------------------------------------------------------
+ConstantBufferRing::ConstantBufferRing()
+{
+	device = nullptr;
+	buffer = nullptr;
+	generation = 1;
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	if (buffer) device->ReleaseBuffer(buffer);
+}
+
+void ConstantBufferRing::Init(IRenderDevice* device, unsigned int capacity)
+{
+	this->device = device;
+	if (device->SupportsConstantBufferOffsets())
+		CreateBuffer(capacity);
+}
+
+void ConstantBufferRing::CreateBuffer(unsigned int capacity)
+{
+	if (buffer) device->ReleaseBuffer(buffer);
+
+	capacity = (capacity + ConstantBufferAlignment - 1) / ConstantBufferAlignment * ConstantBufferAlignment;
+
+	RenderBufferDesc desc;
+	desc.ByteWidth = capacity;
+	desc.Usage = RenderUsage::Dynamic;
+	desc.BindFlags = RenderBindConstantBuffer;
+	buffer = device->CreateBuffer(desc, nullptr);
+	if (!buffer)
+		capacity = 0;
+
+	allocator.Init(capacity, ConstantBufferAlignment);
+	generation++;
+}
+
+void ConstantBufferRing::BeginFrame()
+{
+	if (!buffer)
+		return;
+
+	unsigned int needed = allocator.BeginFrame();
+	if (needed > allocator.GetCapacity())
+	{
+		unsigned int capacity = allocator.GetCapacity();
+		while (capacity < needed)
+			capacity *= 2;
+		CreateBuffer(capacity);
+	}
+}
+
+void ConstantBufferRing::Reserve(unsigned int bytes)
+{
+	if (!buffer || bytes <= allocator.GetCapacity())
+		return;
+
+	unsigned int capacity = allocator.GetCapacity();
+	while (capacity < bytes)
+		capacity *= 2;
+	CreateBuffer(capacity);
+}
+
+bool ConstantBufferRing::Upload(const void* data, unsigned int size, ConstantBufferSlice& slice)
+{
+	RingAllocation allocation;
+	if (!buffer || !allocator.Allocate(size, allocation))
+		return false;
+
+	void* mapped = device->Map(buffer, allocation.Discard ? RenderMapMode::WriteDiscard : RenderMapMode::WriteNoOverwrite);
+	if (!mapped)
+	{
+		allocator.Reset();
+		return false;
+	}
+	memcpy((unsigned char*)mapped + allocation.Offset, data, size);
+	device->Unmap(buffer);
+
+	if (allocation.Discard)
+		generation++;
+
+	slice.Buffer = buffer;
+	slice.Generation = generation;
+	slice.FirstConstant = allocation.Offset / 16;
+	slice.ConstantCount = allocation.Size / 16;
+	return true;
+}
+
+bool ConstantBufferRing::IsCurrent(const ConstantBufferSlice& slice)
+{
+	return buffer && slice.Buffer == buffer && slice.ConstantCount > 0 && slice.Generation == generation;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "RenderDevice.h"
+
+// --------------------------------------------------------
+// Where one allocation landed in the ring
+// --------------------------------------------------------
+struct RingAllocation
+{
+	unsigned int Offset = 0;	// Bytes from the start of the buffer
+	unsigned int Size = 0;		// Rounded up to the alignment
+	bool Discard = false;		// Map with WRITE_DISCARD (wrapped), else NO_OVERWRITE
+};
+
+// --------------------------------------------------------
+// The CPU side of a ring of constant data: hands out aligned
+// ranges in order, wrapping to the start when the end is
+// reached.
+//
+// Nothing written since the last wrap is ever handed out
+// twice, and a wrap asks for a DISCARD map, which gives the
+// GPU its own copy of everything written before it.  So
+// NO_OVERWRITE is always safe for the other allocations.
+//
+// Frames that wrap ask for a bigger ring, so once sized
+// every frame's data fits in one pass.
+// --------------------------------------------------------
+class RingAllocator
+{
+public:
+	RingAllocator();
+
+	void Init(unsigned int capacity, unsigned int alignment);
+
+	// Starts a new frame.  Returns the capacity the last frame
+	// needed if it didn't fit, or 0 if the ring is big enough.
+	unsigned int BeginFrame();
+
+	// False if the request is bigger than the whole ring
+	bool Allocate(unsigned int size, RingAllocation& allocation);
+
+	// Forgets everything - the next allocation discards
+	void Reset();
+
+	unsigned int GetCapacity() { return capacity; }
+	unsigned int GetAlignment() { return alignment; }
+	unsigned int GetFrameBytes() { return frameBytes; }
+	int GetFrameAllocations() { return frameAllocations; }
+	int GetFrameWraps() { return frameWraps; }
+
+private:
+	unsigned int capacity;
+	unsigned int alignment;
+	unsigned int head;			// Next free byte
+	bool needsDiscard;			// Nothing's been mapped yet
+
+	unsigned int frameBytes;
+	int frameAllocations;
+	int frameWraps;
+};
+
+// --------------------------------------------------------
+// A range of a constant buffer to bind, in 16 byte
+// constants.  ConstantCount 0 binds the whole buffer.
+// --------------------------------------------------------
+struct ConstantBufferSlice
+{
+	RenderBuffer* Buffer = nullptr;
+	unsigned int FirstConstant = 0;
+	unsigned int ConstantCount = 0;
+	unsigned int Generation = 0;	// Ring discards before this one was written
+};
+
+// --------------------------------------------------------
+// One large dynamic constant buffer that every shader's
+// per-draw data is appended to, instead of each buffer
+// being updated in place (which makes the driver copy or
+// rename it on every draw).
+//
+// Needs a device that can bind at an offset and map
+// constant buffers with NO_OVERWRITE (Direct3D 11.1).
+// Without that, IsSupported() is false and shaders keep
+// their own buffers.  Slices are bound like any other
+// buffer, through the device's context.
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing();
+	~ConstantBufferRing();
+
+	void Init(IRenderDevice* device, unsigned int capacity = 1024 * 1024);
+	bool IsSupported() { return buffer != nullptr; }
+
+	// Regrows the buffer if last frame didn't fit
+	void BeginFrame();
+
+	// Grows the buffer (right away) until it holds at least
+	// this many bytes.  Everything uploaded so far is lost,
+	// so it's meant for load time, not the middle of a frame.
+	void Reserve(unsigned int bytes);
+
+	// Copies size bytes into the ring.  False if the ring
+	// isn't supported or the data couldn't be placed.
+	bool Upload(const void* data, unsigned int size, ConstantBufferSlice& slice);
+
+	// True while an earlier upload's data is still in the ring
+	// (it's gone once the ring wraps and discards), so it can
+	// be bound again without uploading it again
+	bool IsCurrent(const ConstantBufferSlice& slice);
+
+	RingAllocator& GetAllocator() { return allocator; }
+
+private:
+	IRenderDevice* device;
+	RenderBuffer* buffer;
+	RingAllocator allocator;
+	unsigned int generation;	// Bumped by every discard
+
+	void CreateBuffer(unsigned int capacity);
+};
@@ -0,0 +1,57 @@
+#include "ContributionCuller.h"
+
+#include <cfloat>
+#include <cmath>
+
+ContributionCuller::ContributionCuller()
+{
+	cameraPosition = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	pixelScaleX = 0.0f;
+	pixelScaleY = 0.0f;
+}
+
+// --------------------------------------------------------
+// An object at distance d with radius r covers r / d units
+// of the view plane at distance 1, and the full view plane
+// there is 2 * tan(fov / 2) tall (times the aspect wide)
+// --------------------------------------------------------
+void ContributionCuller::SetView(DirectX::XMFLOAT3 cameraPosition, float fieldOfView, float aspectRatio, int viewportWidth, int viewportHeight)
+{
+	this->cameraPosition = cameraPosition;
+
+	float halfHeight = tanf(fieldOfView * 0.5f);
+	float halfWidth = halfHeight * aspectRatio;
+	pixelScaleX = viewportWidth / halfWidth;
+	pixelScaleY = viewportHeight / halfHeight;
+}
+
+float ContributionCuller::GetScreenSize(const BoundingSphere& sphere) const
+{
+	float dx = sphere.Center.x - cameraPosition.x;
+	float dy = sphere.Center.y - cameraPosition.y;
+	float dz = sphere.Center.z - cameraPosition.z;
+	float distSq = dx * dx + dy * dy + dz * dz;
+	float radiusSq = sphere.Radius * sphere.Radius;
+
+	// Camera inside the sphere: it could fill the screen
+	if (distSq <= radiusSq)
+		return FLT_MAX;
+
+	// Tangent of the sphere's angular radius (r / d, corrected
+	// for how close the sphere is)
+	float angular = sphere.Radius / sqrtf(distSq - radiusSq);
+
+	// pixelScale is per half-screen, so radius -> diameter cancels out
+	float sizeX = angular * pixelScaleX;
+	float sizeY = angular * pixelScaleY;
+	return sizeX > sizeY ? sizeX : sizeY;
+}
+
+float ContributionCuller::GetFade(float screenSize, float minPixels, float fadeBand)
+{
+	if (screenSize <= minPixels)
+		return 0.0f;
+	if (fadeBand <= 0.0f || screenSize >= minPixels + fadeBand)
+		return 1.0f;
+	return (screenSize - minPixels) / fadeBand;
+}
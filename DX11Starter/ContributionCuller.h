@@ -0,0 +1,39 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include "Bounds.h"
+
+// --------------------------------------------------------
+// Screen-size ("contribution") culling.
+//
+// Estimates how many pixels an object's bounding sphere
+// covers from the camera's position and projection, so
+// objects too small to matter can skip their draw call.
+// Each material picks its own cutoff and a fade band above
+// it, so objects dissolve out instead of popping.
+// --------------------------------------------------------
+class ContributionCuller
+{
+public:
+	ContributionCuller();
+
+	// Field of view is vertical, in radians, and together with the
+	// aspect ratio should match what the projection was built with
+	void SetView(DirectX::XMFLOAT3 cameraPosition, float fieldOfView, float aspectRatio, int viewportWidth, int viewportHeight);
+
+	// Projected diameter of the sphere in pixels, along the
+	// screen axis where it's largest
+	float GetScreenSize(const BoundingSphere& sphere) const;
+
+	// 0 below minPixels, 1 above minPixels + fadeBand and
+	// linear in between
+	static float GetFade(float screenSize, float minPixels, float fadeBand);
+
+private:
+	DirectX::XMFLOAT3 cameraPosition;
+
+	// Pixels covered by one unit of (radius / distance)
+	// horizontally and vertically
+	float pixelScaleX;
+	float pixelScaleY;
+};
@@ -0,0 +1,379 @@
+#include "CpuTexture.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Texels per tile side; a 4x4 tile of RGBA8 is one 64 byte cache line
+static const int TileSize = 4;
+
+// UVs are clamped to this before wrapping so the integer
+// conversions can't overflow (floats this big have no
+// fraction left anyway)
+static const float MaxWrapCoordinate = 8388608.0f;
+
+static __m128 Floor4(__m128 x)
+{
+	// Truncate, then step down where that rounded up
+	// (negative non-integers).  Only valid below 2^31.
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+// --------------------------------------------------------
+// Wraps to [0, 1].  NaNs come out as 0, since _mm_max_ps
+// returns its second operand when either one is a NaN.
+// --------------------------------------------------------
+static __m128 WrapUnit4(__m128 x)
+{
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-MaxWrapCoordinate)), _mm_set1_ps(MaxWrapCoordinate));
+	return _mm_sub_ps(x, Floor4(x));
+}
+
+static float WrapUnit(float x)
+{
+	if (!(x >= -MaxWrapCoordinate)) x = -MaxWrapCoordinate;
+	if (x > MaxWrapCoordinate) x = MaxWrapCoordinate;
+	return x - floorf(x);
+}
+
+// --------------------------------------------------------
+// Approximate log2 for positive x: the exponent bits plus a
+// quadratic fit of log2 over the mantissa's [1, 2) range.
+// Good to about 0.005, finer than the 8 bits of LOD fraction
+// D3D asks of hardware.
+// --------------------------------------------------------
+static __m128 FastLog2(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	__m128 mantissa = _mm_castsi128_ps(_mm_or_si128(
+		_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+		_mm_set1_epi32(0x3F800000)));
+	__m128 fraction = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mantissa, _mm_set1_ps(-0.34484843f)), _mm_set1_ps(2.02466578f)), mantissa), _mm_set1_ps(-1.67487759f));
+	return _mm_add_ps(exponent, fraction);
+}
+
+CpuTexture::CpuTexture()
+{
+	width = 0;
+	height = 0;
+}
+
+// --------------------------------------------------------
+// Builds the chain in row order first (easier to filter),
+// then copies each level into its tiles
+// --------------------------------------------------------
+void CpuTexture::Create(int width, int height, const unsigned int* rgba)
+{
+	levels.clear();
+	tiledTexels.clear();
+	this->width = 0;
+	this->height = 0;
+	if (width <= 0 || height <= 0 || !rgba)
+		return;
+	this->width = width;
+	this->height = height;
+
+	std::vector<std::vector<unsigned int>> rows;
+	rows.emplace_back(rgba, rgba + width * height);
+	int levelWidth = width;
+	int levelHeight = height;
+	while (levelWidth > 1 || levelHeight > 1)
+	{
+		// 2x2 box filter, repeating the last row or column of
+		// odd sized levels
+		int nextWidth = (std::max)(levelWidth / 2, 1);
+		int nextHeight = (std::max)(levelHeight / 2, 1);
+		const std::vector<unsigned int>& source = rows.back();
+		std::vector<unsigned int> next(nextWidth * nextHeight);
+		for (int y = 0; y < nextHeight; y++)
+		{
+			int sy0 = y * 2;
+			int sy1 = (std::min)(sy0 + 1, levelHeight - 1);
+			for (int x = 0; x < nextWidth; x++)
+			{
+				int sx0 = x * 2;
+				int sx1 = (std::min)(sx0 + 1, levelWidth - 1);
+				unsigned int t00 = source[sy0 * levelWidth + sx0];
+				unsigned int t10 = source[sy0 * levelWidth + sx1];
+				unsigned int t01 = source[sy1 * levelWidth + sx0];
+				unsigned int t11 = source[sy1 * levelWidth + sx1];
+				unsigned int result = 0;
+				for (int shift = 0; shift < 32; shift += 8)
+				{
+					unsigned int sum = ((t00 >> shift) & 0xFF) + ((t10 >> shift) & 0xFF) +
+						((t01 >> shift) & 0xFF) + ((t11 >> shift) & 0xFF);
+					result |= ((sum + 2) / 4) << shift;
+				}
+				next[y * nextWidth + x] = result;
+			}
+		}
+		rows.push_back(std::move(next));
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	// Lay out the tiles, padding partial ones at the right and
+	// bottom edges (wrapping never reads the padding)
+	int offset = 0;
+	levelWidth = width;
+	levelHeight = height;
+	for (size_t l = 0; l < rows.size(); l++)
+	{
+		MipLevel level;
+		level.Width = levelWidth;
+		level.Height = levelHeight;
+		level.TilesX = (levelWidth + TileSize - 1) / TileSize;
+		level.Offset = offset;
+		levels.push_back(level);
+		offset += level.TilesX * ((levelHeight + TileSize - 1) / TileSize) * TileSize * TileSize;
+
+		levelWidth = (std::max)(levelWidth / 2, 1);
+		levelHeight = (std::max)(levelHeight / 2, 1);
+	}
+
+	tiledTexels.resize(offset, 0);
+	for (size_t l = 0; l < rows.size(); l++)
+	{
+		const MipLevel& level = levels[l];
+		for (int y = 0; y < level.Height; y++)
+			for (int x = 0; x < level.Width; x++)
+			{
+				int tile = (y / TileSize) * level.TilesX + x / TileSize;
+				int index = level.Offset + tile * TileSize * TileSize + (y % TileSize) * TileSize + x % TileSize;
+				tiledTexels[index] = rows[l][y * level.Width + x];
+			}
+	}
+}
+
+// --------------------------------------------------------
+// The footprint of a pixel in level 0 texels along each screen
+// axis; the longer one decides the level
+// --------------------------------------------------------
+__m128 CpuTexture::ComputeLod4(__m128 dudx, __m128 dvdx, __m128 dudy, __m128 dvdy) const
+{
+	__m128 widthF = _mm_set1_ps((float)width);
+	__m128 heightF = _mm_set1_ps((float)height);
+	dudx = _mm_mul_ps(dudx, widthF);
+	dudy = _mm_mul_ps(dudy, widthF);
+	dvdx = _mm_mul_ps(dvdx, heightF);
+	dvdy = _mm_mul_ps(dvdy, heightF);
+	__m128 lengthSqX = _mm_add_ps(_mm_mul_ps(dudx, dudx), _mm_mul_ps(dvdx, dvdx));
+	__m128 lengthSqY = _mm_add_ps(_mm_mul_ps(dudy, dudy), _mm_mul_ps(dvdy, dvdy));
+
+	// log2(sqrt(x)) = log2(x) / 2
+	return _mm_mul_ps(FastLog2(_mm_max_ps(lengthSqX, lengthSqY)), _mm_set1_ps(0.5f));
+}
+
+void CpuTexture::Sample4(__m128 u, __m128 v, __m128 lod, __m128 rgba[4]) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	int lastLevel = (int)levels.size() - 1;
+
+	// Clamped to the chain (MinLOD 0, MaxLOD unlimited); NaN goes to 0
+	lod = _mm_min_ps(_mm_max_ps(lod, zero), _mm_set1_ps((float)lastLevel));
+	__m128i level = _mm_cvttps_epi32(lod);
+	__m128 fraction = _mm_sub_ps(lod, _mm_cvtepi32_ps(level));
+
+	int level0[4], level1[4];
+	_mm_storeu_si128((__m128i*)level0, level);
+	for (int lane = 0; lane < 4; lane++)
+		level1[lane] = (std::min)(level0[lane] + 1, lastLevel);
+
+	Bilinear4(u, v, level0, rgba);
+
+	// Magnified, or exactly on a level, in every lane: one is enough
+	if (_mm_movemask_ps(_mm_cmpgt_ps(fraction, zero)) == 0)
+		return;
+
+	__m128 next[4];
+	Bilinear4(u, v, level1, next);
+	for (int c = 0; c < 4; c++)
+		rgba[c] = _mm_add_ps(rgba[c], _mm_mul_ps(_mm_sub_ps(next[c], rgba[c]), fraction));
+}
+
+void CpuTexture::SampleBilinear4(__m128 u, __m128 v, int level, __m128 rgba[4]) const
+{
+	level = (std::min)((std::max)(level, 0), (int)levels.size() - 1);
+	int lanes[4] = { level, level, level, level };
+	Bilinear4(u, v, lanes, rgba);
+}
+
+void CpuTexture::SampleArray(const float* u, const float* v, const float* lod, int count, float* rgba) const
+{
+	for (int i = 0; i < count; i += 4)
+	{
+		__m128 color[4];
+		if (i + 4 <= count)
+		{
+			Sample4(_mm_loadu_ps(u + i), _mm_loadu_ps(v + i), _mm_loadu_ps(lod + i), color);
+			_MM_TRANSPOSE4_PS(color[0], color[1], color[2], color[3]);
+			for (int lane = 0; lane < 4; lane++)
+				_mm_storeu_ps(rgba + (i + lane) * 4, color[lane]);
+		}
+		else
+		{
+			// Partial batch at the end
+			float tailU[4] = {}, tailV[4] = {}, tailLod[4] = {}, tailColor[4][4];
+			int tail = count - i;
+			for (int lane = 0; lane < tail; lane++)
+			{
+				tailU[lane] = u[i + lane];
+				tailV[lane] = v[i + lane];
+				tailLod[lane] = lod[i + lane];
+			}
+			Sample4(_mm_loadu_ps(tailU), _mm_loadu_ps(tailV), _mm_loadu_ps(tailLod), color);
+			_MM_TRANSPOSE4_PS(color[0], color[1], color[2], color[3]);
+			for (int lane = 0; lane < 4; lane++)
+				_mm_storeu_ps(tailColor[lane], color[lane]);
+			for (int lane = 0; lane < tail; lane++)
+				for (int c = 0; c < 4; c++)
+					rgba[(i + lane) * 4 + c] = tailColor[lane][c];
+		}
+	}
+}
+
+void CpuTexture::SampleReference(float u, float v, float lod, float rgba[4]) const
+{
+	int lastLevel = (int)levels.size() - 1;
+	if (!(lod > 0.0f)) lod = 0.0f;
+	if (lod > (float)lastLevel) lod = (float)lastLevel;
+	int level = (int)lod;
+	float fraction = lod - (float)level;
+
+	BilinearReference(u, v, level, rgba);
+	if (fraction > 0.0f)
+	{
+		float next[4];
+		BilinearReference(u, v, (std::min)(level + 1, lastLevel), next);
+		for (int c = 0; c < 4; c++)
+			rgba[c] += (next[c] - rgba[c]) * fraction;
+	}
+}
+
+// --------------------------------------------------------
+// Four bilinear samples, each lane from its own level.
+// Texel centers sit at half coordinates, so the footprint's
+// top left texel is floor(u * width - 0.5); the texel right
+// of (or below) the last one wraps to 0.
+// --------------------------------------------------------
+void CpuTexture::Bilinear4(__m128 u, __m128 v, const int level[4], __m128 rgba[4]) const
+{
+	const MipLevel& l0 = levels[level[0]];
+	const MipLevel& l1 = levels[level[1]];
+	const MipLevel& l2 = levels[level[2]];
+	const MipLevel& l3 = levels[level[3]];
+	__m128i levelWidth = _mm_setr_epi32(l0.Width, l1.Width, l2.Width, l3.Width);
+	__m128i levelHeight = _mm_setr_epi32(l0.Height, l1.Height, l2.Height, l3.Height);
+	__m128i levelOffset = _mm_setr_epi32(l0.Offset, l1.Offset, l2.Offset, l3.Offset);
+	__m128 tilesX = _mm_setr_ps((float)l0.TilesX, (float)l1.TilesX, (float)l2.TilesX, (float)l3.TilesX);
+
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i three = _mm_set1_epi32(3);
+
+	__m128 x = _mm_sub_ps(_mm_mul_ps(WrapUnit4(u), _mm_cvtepi32_ps(levelWidth)), half);
+	__m128 y = _mm_sub_ps(_mm_mul_ps(WrapUnit4(v), _mm_cvtepi32_ps(levelHeight)), half);
+	__m128 floorX = Floor4(x);
+	__m128 floorY = Floor4(y);
+	__m128 tx = _mm_sub_ps(x, floorX);
+	__m128 ty = _mm_sub_ps(y, floorY);
+
+	// x0 is at least -1 and x1 at most width
+	__m128i x0 = _mm_cvttps_epi32(floorX);
+	__m128i y0 = _mm_cvttps_epi32(floorY);
+	__m128i x1 = _mm_add_epi32(x0, _mm_set1_epi32(1));
+	__m128i y1 = _mm_add_epi32(y0, _mm_set1_epi32(1));
+	x0 = _mm_add_epi32(x0, _mm_and_si128(_mm_cmplt_epi32(x0, zero), levelWidth));
+	y0 = _mm_add_epi32(y0, _mm_and_si128(_mm_cmplt_epi32(y0, zero), levelHeight));
+	x1 = _mm_sub_epi32(x1, _mm_andnot_si128(_mm_cmplt_epi32(x1, levelWidth), levelWidth));
+	y1 = _mm_sub_epi32(y1, _mm_andnot_si128(_mm_cmplt_epi32(y1, levelHeight), levelHeight));
+
+	// Texel index = level offset + tile * 16 + row in tile * 4 + column in tile,
+	// split into a part from y and a part from x.  SSE2 has no
+	// 32 bit multiply, but tile rows times tiles per row fits
+	// a float exactly.
+	auto rowPart = [&](__m128i row)
+	{
+		__m128i tileRow = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(row, 2)), tilesX));
+		return _mm_add_epi32(levelOffset, _mm_add_epi32(_mm_slli_epi32(tileRow, 4), _mm_slli_epi32(_mm_and_si128(row, three), 2)));
+	};
+	auto columnPart = [&](__m128i column)
+	{
+		return _mm_add_epi32(_mm_slli_epi32(_mm_srli_epi32(column, 2), 4), _mm_and_si128(column, three));
+	};
+	__m128i row0 = rowPart(y0);
+	__m128i row1 = rowPart(y1);
+	__m128i column0 = columnPart(x0);
+	__m128i column1 = columnPart(x1);
+
+	int index[4][4];
+	_mm_storeu_si128((__m128i*)index[0], _mm_add_epi32(row0, column0));
+	_mm_storeu_si128((__m128i*)index[1], _mm_add_epi32(row0, column1));
+	_mm_storeu_si128((__m128i*)index[2], _mm_add_epi32(row1, column0));
+	_mm_storeu_si128((__m128i*)index[3], _mm_add_epi32(row1, column1));
+
+	const unsigned int* texels = &tiledTexels[0];
+	__m128i corner[4];
+	for (int t = 0; t < 4; t++)
+		corner[t] = _mm_setr_epi32(texels[index[t][0]], texels[index[t][1]], texels[index[t][2]], texels[index[t][3]]);
+
+	__m128 weight[4];
+	__m128 inverseX = _mm_sub_ps(one, tx);
+	__m128 inverseY = _mm_sub_ps(one, ty);
+	weight[0] = _mm_mul_ps(inverseX, inverseY);
+	weight[1] = _mm_mul_ps(tx, inverseY);
+	weight[2] = _mm_mul_ps(inverseX, ty);
+	weight[3] = _mm_mul_ps(tx, ty);
+
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 sum = _mm_setzero_ps();
+		for (int t = 0; t < 4; t++)
+		{
+			__m128 channel = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(corner[t], c * 8), byteMask));
+			sum = _mm_add_ps(sum, _mm_mul_ps(channel, weight[t]));
+		}
+		rgba[c] = _mm_mul_ps(sum, scale);
+	}
+}
+
+void CpuTexture::BilinearReference(float u, float v, int level, float rgba[4]) const
+{
+	const MipLevel& mip = levels[level];
+	float x = WrapUnit(u) * mip.Width - 0.5f;
+	float y = WrapUnit(v) * mip.Height - 0.5f;
+	float fx = floorf(x);
+	float fy = floorf(y);
+	float tx = x - fx;
+	float ty = y - fy;
+
+	int x0 = (int)fx, y0 = (int)fy;
+	int x1 = x0 + 1, y1 = y0 + 1;
+	if (x0 < 0) x0 += mip.Width;
+	if (y0 < 0) y0 += mip.Height;
+	if (x1 >= mip.Width) x1 -= mip.Width;
+	if (y1 >= mip.Height) y1 -= mip.Height;
+
+	unsigned int t00 = FetchTexel(level, x0, y0), t10 = FetchTexel(level, x1, y0);
+	unsigned int t01 = FetchTexel(level, x0, y1), t11 = FetchTexel(level, x1, y1);
+	float w00 = (1.0f - tx) * (1.0f - ty), w10 = tx * (1.0f - ty);
+	float w01 = (1.0f - tx) * ty, w11 = tx * ty;
+	for (int c = 0; c < 4; c++)
+	{
+		int shift = c * 8;
+		rgba[c] = (
+			((t00 >> shift) & 0xFF) * w00 + ((t10 >> shift) & 0xFF) * w10 +
+			((t01 >> shift) & 0xFF) * w01 + ((t11 >> shift) & 0xFF) * w11) * (1.0f / 255.0f);
+	}
+}
+
+unsigned int CpuTexture::FetchTexel(int level, int x, int y) const
+{
+	const MipLevel& mip = levels[level];
+	int tile = (y / TileSize) * mip.TilesX + x / TileSize;
+	return tiledTexels[mip.Offset + tile * TileSize * TileSize + (y % TileSize) * TileSize + x % TileSize];
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <emmintrin.h>
+
+// --------------------------------------------------------
+// An RGBA8 texture (R in the lowest byte, like
+// DXGI_FORMAT_R8G8B8A8_UNORM) with a full mip chain, sampled
+// on the CPU the way the game's sampler state samples on the
+// GPU: D3D11_FILTER_MIN_MAG_MIP_LINEAR with WRAP addressing.
+//
+// Every level is stored in 4x4 texel tiles (64 bytes, one
+// cache line each), so a bilinear footprint touches one to
+// four lines however the UVs are rotated, and neighboring
+// pixels mostly hit lines the last sample already brought in.
+//
+// The Sample*4 calls take four UVs in SSE registers and
+// return the filtered colors as four registers of R, G, B
+// and A (0 to 1).  Addressing, wrapping and filtering are
+// done four lanes at a time; only the texel loads are scalar
+// (SSE2 has no gather).  Non-finite UVs or LODs are clamped
+// rather than trusted, so masked-off lanes can hold anything.
+// --------------------------------------------------------
+class CpuTexture
+{
+public:
+	CpuTexture();
+
+	// Copies rgba (width * height texels, row by row), builds
+	// the mip chain down to 1x1 with a 2x2 box filter and
+	// rearranges every level into tiles
+	void Create(int width, int height, const unsigned int* rgba);
+
+	bool IsEmpty() const { return levels.empty(); }
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	int GetLevelCount() const { return (int)levels.size(); }
+
+	// Level of detail for four pixels from their UV derivatives
+	// (per pixel, in UV units), as D3D picks it: log2 of the
+	// longer of the two footprint axes in texels
+	__m128 ComputeLod4(__m128 dudx, __m128 dvdx, __m128 dudy, __m128 dvdy) const;
+
+	// Trilinear: bilinear samples from the two levels around
+	// lod, blended.  At or below lod 0 that's just level 0.
+	void Sample4(__m128 u, __m128 v, __m128 lod, __m128 rgba[4]) const;
+
+	// Bilinear from a single mip level
+	void SampleBilinear4(__m128 u, __m128 v, int level, __m128 rgba[4]) const;
+
+	// Samples count UVs four at a time (count need not be a
+	// multiple of four), writing RGBA to rgba[i * 4 .. i * 4 + 3]
+	void SampleArray(const float* u, const float* v, const float* lod, int count, float* rgba) const;
+
+	// One sample at a time without SIMD, for checking the fast paths
+	void SampleReference(float u, float v, float lod, float rgba[4]) const;
+
+private:
+	struct MipLevel
+	{
+		int Width;
+		int Height;
+		int TilesX;
+		int Offset;		// First texel in tiledTexels
+	};
+
+	int width;
+	int height;
+	std::vector<MipLevel> levels;
+	std::vector<unsigned int> tiledTexels;
+
+	void Bilinear4(__m128 u, __m128 v, const int level[4], __m128 rgba[4]) const;
+	void BilinearReference(float u, float v, int level, float rgba[4]) const;
+	unsigned int FetchTexel(int level, int x, int y) const;
+};
@@ -0,0 +1,275 @@
+#include "D3D11RenderDevice.h"
+#include "SimpleShader.h"
+#include <vector>
+
+// --------------------------------------------------------
+// D3D11StateContext
+// --------------------------------------------------------
+D3D11StateContext::D3D11StateContext(ID3D11DeviceContext* context)
+{
+	this->context = nullptr;
+	context1 = nullptr;
+	SetContext(context);
+}
+
+D3D11StateContext::~D3D11StateContext()
+{
+	if (context1) context1->Release();
+}
+
+void D3D11StateContext::SetContext(ID3D11DeviceContext* context)
+{
+	if (context1) context1->Release();
+	context1 = nullptr;
+
+	this->context = context;
+	if (context && FAILED(context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&context1)))
+		context1 = nullptr;
+}
+
+void D3D11StateContext::SetInputLayout(RenderInputLayout* layout) { context->IASetInputLayout(ToD3D11(layout)); }
+
+void D3D11StateContext::SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset)
+{
+	ID3D11Buffer* d3dBuffer = ToD3D11(buffer);
+	context->IASetVertexBuffers(slot, 1, &d3dBuffer, &stride, &offset);
+}
+
+void D3D11StateContext::SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset)
+{
+	context->IASetIndexBuffer(ToD3D11(buffer), format == RenderIndexFormat::UInt16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, offset);
+}
+
+void D3D11StateContext::SetVertexShader(RenderVertexShader* shader) { context->VSSetShader(ToD3D11(shader), 0, 0); }
+void D3D11StateContext::SetPixelShader(RenderPixelShader* shader) { context->PSSetShader(ToD3D11(shader), 0, 0); }
+
+void D3D11StateContext::SetVSShaderResource(unsigned int slot, RenderShaderResource* srv)
+{
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	context->VSSetShaderResources(slot, 1, &d3dSrv);
+}
+
+void D3D11StateContext::SetVSSampler(unsigned int slot, RenderSampler* sampler)
+{
+	ID3D11SamplerState* d3dSampler = ToD3D11(sampler);
+	context->VSSetSamplers(slot, 1, &d3dSampler);
+}
+
+void D3D11StateContext::SetPSShaderResource(unsigned int slot, RenderShaderResource* srv)
+{
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	context->PSSetShaderResources(slot, 1, &d3dSrv);
+}
+
+void D3D11StateContext::SetPSSampler(unsigned int slot, RenderSampler* sampler)
+{
+	ID3D11SamplerState* d3dSampler = ToD3D11(sampler);
+	context->PSSetSamplers(slot, 1, &d3dSampler);
+}
+
+void D3D11StateContext::SetBlendState(RenderBlendState* state) { context->OMSetBlendState(ToD3D11(state), 0, 0xffffffff); }
+void D3D11StateContext::SetDepthStencilState(RenderDepthStencilState* state) { context->OMSetDepthStencilState(ToD3D11(state), 0); }
+
+void D3D11StateContext::SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	ID3D11Buffer* d3dBuffer = ToD3D11(buffer);
+	if (constantCount > 0 && context1)
+		context1->VSSetConstantBuffers1(slot, 1, &d3dBuffer, &firstConstant, &constantCount);
+	else
+		context->VSSetConstantBuffers(slot, 1, &d3dBuffer);
+}
+
+void D3D11StateContext::SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	ID3D11Buffer* d3dBuffer = ToD3D11(buffer);
+	if (constantCount > 0 && context1)
+		context1->PSSetConstantBuffers1(slot, 1, &d3dBuffer, &firstConstant, &constantCount);
+	else
+		context->PSSetConstantBuffers(slot, 1, &d3dBuffer);
+}
+
+void D3D11StateContext::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	context->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11StateContext::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	context->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+// --------------------------------------------------------
+// D3D11RenderDevice
+// --------------------------------------------------------
+D3D11RenderDevice::D3D11RenderDevice()
+{
+	device = nullptr;
+	context = nullptr;
+	constantBufferOffsets = false;
+}
+
+void D3D11RenderDevice::Init(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->device = device;
+	this->context = context;
+	stateContext.SetContext(context);
+
+	// Binding at an offset needs 11.1, and so does mapping a
+	// constant buffer without discarding it
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	constantBufferOffsets = stateContext.SupportsOffsets() &&
+		SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferOffsetting &&
+		options.MapNoOverwriteOnDynamicConstantBuffer;
+}
+
+RenderBuffer* D3D11RenderDevice::CreateBuffer(const RenderBufferDesc& desc, const void* initialData)
+{
+	D3D11_BUFFER_DESC d3dDesc = {};
+	d3dDesc.ByteWidth = desc.ByteWidth;
+	switch (desc.Usage)
+	{
+	case RenderUsage::Default: d3dDesc.Usage = D3D11_USAGE_DEFAULT; break;
+	case RenderUsage::Immutable: d3dDesc.Usage = D3D11_USAGE_IMMUTABLE; break;
+	case RenderUsage::Dynamic:
+		d3dDesc.Usage = D3D11_USAGE_DYNAMIC;
+		d3dDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		break;
+	}
+	if (desc.BindFlags & RenderBindVertexBuffer) d3dDesc.BindFlags |= D3D11_BIND_VERTEX_BUFFER;
+	if (desc.BindFlags & RenderBindIndexBuffer) d3dDesc.BindFlags |= D3D11_BIND_INDEX_BUFFER;
+	if (desc.BindFlags & RenderBindConstantBuffer) d3dDesc.BindFlags |= D3D11_BIND_CONSTANT_BUFFER;
+	if (desc.BindFlags & RenderBindShaderResource) d3dDesc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+	if (desc.StructureStride > 0)
+	{
+		d3dDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		d3dDesc.StructureByteStride = desc.StructureStride;
+	}
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = initialData;
+
+	ID3D11Buffer* buffer = nullptr;
+	if (FAILED(device->CreateBuffer(&d3dDesc, initialData ? &data : nullptr, &buffer)))
+		return nullptr;
+
+	stats.BuffersCreated++;
+	stats.BytesCreated += desc.ByteWidth;
+	return ToHandle(buffer);
+}
+
+void D3D11RenderDevice::ReleaseBuffer(RenderBuffer* buffer)
+{
+	if (!buffer)
+		return;
+	ToD3D11(buffer)->Release();
+	stats.BuffersReleased++;
+}
+
+void D3D11RenderDevice::UpdateSubresource(RenderBuffer* buffer, const void* data, unsigned int size)
+{
+	context->UpdateSubresource(ToD3D11(buffer), 0, nullptr, data, 0, 0);
+	stats.Updates++;
+	stats.BytesUpdated += size;
+}
+
+void* D3D11RenderDevice::Map(RenderBuffer* buffer, RenderMapMode mode)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	D3D11_MAP type = mode == RenderMapMode::WriteDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (FAILED(context->Map(ToD3D11(buffer), 0, type, 0, &mapped)))
+		return nullptr;
+
+	stats.Maps++;
+	return mapped.pData;
+}
+
+void D3D11RenderDevice::Unmap(RenderBuffer* buffer)
+{
+	context->Unmap(ToD3D11(buffer), 0);
+}
+
+RenderShaderResource* D3D11RenderDevice::CreateStructuredView(RenderBuffer* buffer, unsigned int elementCount)
+{
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = elementCount;
+
+	ID3D11ShaderResourceView* srv = nullptr;
+	if (FAILED(device->CreateShaderResourceView(ToD3D11(buffer), &srvDesc, &srv)))
+		return nullptr;
+	return ToHandle(srv);
+}
+
+void D3D11RenderDevice::ReleaseShaderResource(RenderShaderResource* view)
+{
+	if (view) ToD3D11(view)->Release();
+}
+
+RenderVertexShader* D3D11RenderDevice::CreateVertexShader(const void* code, size_t size)
+{
+	ID3D11VertexShader* shader = nullptr;
+	if (FAILED(device->CreateVertexShader(code, size, 0, &shader)))
+		return nullptr;
+	return ToHandle(shader);
+}
+
+RenderPixelShader* D3D11RenderDevice::CreatePixelShader(const void* code, size_t size)
+{
+	ID3D11PixelShader* shader = nullptr;
+	if (FAILED(device->CreatePixelShader(code, size, 0, &shader)))
+		return nullptr;
+	return ToHandle(shader);
+}
+
+void D3D11RenderDevice::ReleaseVertexShader(RenderVertexShader* shader)
+{
+	if (shader) ToD3D11(shader)->Release();
+}
+
+void D3D11RenderDevice::ReleasePixelShader(RenderPixelShader* shader)
+{
+	if (shader) ToD3D11(shader)->Release();
+}
+
+RenderInputLayout* D3D11RenderDevice::CreateInputLayout(const ShaderReflectionData& data, const void* code, size_t size)
+{
+	if (data.Inputs.empty())
+		return nullptr;
+
+	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
+	for (const ShaderReflectionData::InputElement& element : data.Inputs)
+	{
+		// Fill out input element desc
+		D3D11_INPUT_ELEMENT_DESC elementDesc;
+		elementDesc.SemanticName = element.SemanticName.c_str();
+		elementDesc.SemanticIndex = element.SemanticIndex;
+		elementDesc.Format = (DXGI_FORMAT)element.Format;
+		elementDesc.InputSlot = 0;
+		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+		elementDesc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+		elementDesc.InstanceDataStepRate = 0;
+
+		// Replace anything affected by "per instance" data
+		if (element.PerInstance)
+		{
+			elementDesc.InputSlot = 1; // Assume per instance data comes from another input slot!
+			elementDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+			elementDesc.InstanceDataStepRate = 1;
+		}
+
+		inputLayoutDesc.push_back(elementDesc);
+	}
+
+	ID3D11InputLayout* layout = nullptr;
+	if (FAILED(device->CreateInputLayout(&inputLayoutDesc[0], (unsigned int)inputLayoutDesc.size(), code, size, &layout)))
+		return nullptr;
+	return ToHandle(layout);
+}
+
+void D3D11RenderDevice::ReleaseInputLayout(RenderInputLayout* layout)
+{
+	if (layout) ToD3D11(layout)->Release();
+}
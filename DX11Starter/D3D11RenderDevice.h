@@ -0,0 +1,99 @@
+#pragma once
+#include <d3d11_1.h>
+
+#include "RenderDevice.h"
+
+// --------------------------------------------------------
+// The D3D11 backend's handles are its own interfaces, so
+// converting either way is just a cast.  Only code that
+// talks to D3D11 itself (the backend, and whatever creates
+// textures, samplers and blend states) should need these.
+// --------------------------------------------------------
+inline RenderBuffer* ToHandle(ID3D11Buffer* buffer) { return reinterpret_cast<RenderBuffer*>(buffer); }
+inline RenderShaderResource* ToHandle(ID3D11ShaderResourceView* srv) { return reinterpret_cast<RenderShaderResource*>(srv); }
+inline RenderSampler* ToHandle(ID3D11SamplerState* sampler) { return reinterpret_cast<RenderSampler*>(sampler); }
+inline RenderInputLayout* ToHandle(ID3D11InputLayout* layout) { return reinterpret_cast<RenderInputLayout*>(layout); }
+inline RenderVertexShader* ToHandle(ID3D11VertexShader* shader) { return reinterpret_cast<RenderVertexShader*>(shader); }
+inline RenderPixelShader* ToHandle(ID3D11PixelShader* shader) { return reinterpret_cast<RenderPixelShader*>(shader); }
+inline RenderBlendState* ToHandle(ID3D11BlendState* state) { return reinterpret_cast<RenderBlendState*>(state); }
+inline RenderDepthStencilState* ToHandle(ID3D11DepthStencilState* state) { return reinterpret_cast<RenderDepthStencilState*>(state); }
+
+inline ID3D11Buffer* ToD3D11(RenderBuffer* buffer) { return reinterpret_cast<ID3D11Buffer*>(buffer); }
+inline ID3D11ShaderResourceView* ToD3D11(RenderShaderResource* srv) { return reinterpret_cast<ID3D11ShaderResourceView*>(srv); }
+inline ID3D11SamplerState* ToD3D11(RenderSampler* sampler) { return reinterpret_cast<ID3D11SamplerState*>(sampler); }
+inline ID3D11InputLayout* ToD3D11(RenderInputLayout* layout) { return reinterpret_cast<ID3D11InputLayout*>(layout); }
+inline ID3D11VertexShader* ToD3D11(RenderVertexShader* shader) { return reinterpret_cast<ID3D11VertexShader*>(shader); }
+inline ID3D11PixelShader* ToD3D11(RenderPixelShader* shader) { return reinterpret_cast<ID3D11PixelShader*>(shader); }
+inline ID3D11BlendState* ToD3D11(RenderBlendState* state) { return reinterpret_cast<ID3D11BlendState*>(state); }
+inline ID3D11DepthStencilState* ToD3D11(RenderDepthStencilState* state) { return reinterpret_cast<ID3D11DepthStencilState*>(state); }
+
+// --------------------------------------------------------
+// Forwards straight to a D3D11 device context
+// --------------------------------------------------------
+class D3D11StateContext : public IStateContext
+{
+public:
+	D3D11StateContext(ID3D11DeviceContext* context = nullptr);
+	~D3D11StateContext();
+	void SetContext(ID3D11DeviceContext* context);
+
+	// False before 11.1, when ranges are bound whole
+	bool SupportsOffsets() { return context1 != nullptr; }
+
+	void SetInputLayout(RenderInputLayout* layout);
+	void SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset);
+	void SetVertexShader(RenderVertexShader* shader);
+	void SetPixelShader(RenderPixelShader* shader);
+	void SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetVSShaderResource(unsigned int slot, RenderShaderResource* srv);
+	void SetVSSampler(unsigned int slot, RenderSampler* sampler);
+	void SetPSShaderResource(unsigned int slot, RenderShaderResource* srv);
+	void SetPSSampler(unsigned int slot, RenderSampler* sampler);
+	void SetBlendState(RenderBlendState* state);
+	void SetDepthStencilState(RenderDepthStencilState* state);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+private:
+	ID3D11DeviceContext* context;
+	ID3D11DeviceContext1* context1;		// For binding at an offset (null before 11.1)
+};
+
+// --------------------------------------------------------
+// Forwards to a D3D11 device and its immediate context
+// --------------------------------------------------------
+class D3D11RenderDevice : public IRenderDevice
+{
+public:
+	D3D11RenderDevice();
+	void Init(ID3D11Device* device, ID3D11DeviceContext* context);
+
+	RenderBuffer* CreateBuffer(const RenderBufferDesc& desc, const void* initialData);
+	void ReleaseBuffer(RenderBuffer* buffer);
+	void UpdateSubresource(RenderBuffer* buffer, const void* data, unsigned int size);
+	void* Map(RenderBuffer* buffer, RenderMapMode mode);
+	void Unmap(RenderBuffer* buffer);
+	RenderShaderResource* CreateStructuredView(RenderBuffer* buffer, unsigned int elementCount);
+	void ReleaseShaderResource(RenderShaderResource* view);
+	RenderVertexShader* CreateVertexShader(const void* code, size_t size);
+	RenderPixelShader* CreatePixelShader(const void* code, size_t size);
+	void ReleaseVertexShader(RenderVertexShader* shader);
+	void ReleasePixelShader(RenderPixelShader* shader);
+	RenderInputLayout* CreateInputLayout(const ShaderReflectionData& data, const void* code, size_t size);
+	void ReleaseInputLayout(RenderInputLayout* layout);
+	bool SupportsConstantBufferOffsets() { return constantBufferOffsets; }
+	IStateContext* GetContext() { return &stateContext; }
+
+	// For what only D3D11 has (textures, render targets,
+	// deferred contexts, the other shader stages)
+	ID3D11Device* GetDevice() { return device; }
+	ID3D11DeviceContext* GetDeviceContext() { return context; }
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	D3D11StateContext stateContext;
+	bool constantBufferOffsets;
+};
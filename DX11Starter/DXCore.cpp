@@ -471,6 +471,9 @@ void DXCore::UpdateTitleBarStats()
 	default:                     output << "    DX ???";  break;
 	}
 
+	// Anything the game wants to add
+	output << GetTitleBarStats();
+
 	// Actually update the title bar and reset fps data
 	SetWindowText(hWnd, output.str().c_str());
 	fpsFrameCount = 0;
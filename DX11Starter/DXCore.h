@@ -49,6 +49,9 @@ public:
 	virtual void OnMouseUp	 (WPARAM buttonState, int x, int y) { }
 	virtual void OnMouseMove (WPARAM buttonState, int x, int y) { }
 	virtual void OnMouseWheel(float wheelDelta,   int x, int y) { }
+
+	// Optional extra text for the title bar stats
+	virtual std::string GetTitleBarStats() { return std::string(); }
 	
 protected:
 	HINSTANCE	hInstance;		// The handle to the application
@@ -0,0 +1,220 @@
+#include "DeferredSubmitter.h"
+#include <string.h>
+
+// --------------------------------------------------------
+// SubmitWorker
+// --------------------------------------------------------
+SubmitWorker::SubmitWorker(ID3D11Device* device)
+{
+	this->device = device;
+	context = nullptr;
+	commandList = nullptr;
+	frame = 1;
+
+	device->CreateDeferredContext(0, &context);
+	stateContext.SetContext(context);
+	stateCache.SetContext(&stateContext);
+}
+
+SubmitWorker::~SubmitWorker()
+{
+	for (auto& s : staged)
+	{
+		if (s.second.Buffer) s.second.Buffer->Release();
+	}
+	if (commandList) commandList->Release();
+	if (context) context->Release();
+}
+
+// --------------------------------------------------------
+// Returns this worker's copy of one of the shader's constant
+// buffers, refreshed from the shader once per frame
+// --------------------------------------------------------
+SubmitWorker::StagedBuffer& SubmitWorker::Stage(ISimpleShader* shader, unsigned int bufferIndex)
+{
+	const SimpleConstantBuffer* info = shader->GetBufferInfo(bufferIndex);
+	StagedBuffer& buffer = staged[info];
+
+	if (!buffer.Buffer)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = info->Size;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		device->CreateBuffer(&desc, 0, &buffer.Buffer);
+		buffer.Data.resize(info->Size);
+	}
+
+	// Last frame's upload is still good if the shader's data
+	// hasn't changed since
+	if (buffer.Frame != frame)
+	{
+		if (buffer.Frame == 0 || memcmp(&buffer.Data[0], info->LocalDataBuffer, info->Size) != 0)
+		{
+			memcpy(&buffer.Data[0], info->LocalDataBuffer, info->Size);
+			buffer.Dirty = true;
+		}
+		buffer.Frame = frame;
+	}
+	return buffer;
+}
+
+bool SubmitWorker::SetConstant(ISimpleShader* shader, const std::string& name, const void* data, unsigned int size)
+{
+	return Write(shader, shader->GetVariableInfo(name), data, size);
+}
+
+bool SubmitWorker::SetConstant(ISimpleShader* shader, SimpleShaderHandle variable, const void* data, unsigned int size)
+{
+	return Write(shader, shader->GetVariableInfo(variable), data, size);
+}
+
+bool SubmitWorker::Write(ISimpleShader* shader, const SimpleShaderVariable* variable, const void* data, unsigned int size)
+{
+	if (!variable || variable->Size != size)
+		return false;
+
+	StagedBuffer& buffer = Stage(shader, variable->ConstantBufferIndex);
+	unsigned char* target = &buffer.Data[variable->ByteOffset];
+	if (memcmp(target, data, size) != 0)
+	{
+		memcpy(target, data, size);
+		buffer.Dirty = true;
+	}
+	return true;
+}
+
+bool SubmitWorker::WriteBuffer(ISimpleShader* shader, SimpleShaderHandle buffer, const void* data, unsigned int size)
+{
+	const SimpleConstantBuffer* info = buffer.IsValid() ? shader->GetBufferInfo((unsigned int)buffer.Index) : nullptr;
+	if (!info || info->Size != size)
+		return false;
+
+	StagedBuffer& staging = Stage(shader, (unsigned int)buffer.Index);
+	if (memcmp(&staging.Data[0], data, size) != 0)
+	{
+		memcpy(&staging.Data[0], data, size);
+		staging.Dirty = true;
+	}
+	return true;
+}
+
+// Per-frame data (lights, view and projection) only goes
+// up once per worker, per-object data once per draw
+RenderBuffer* SubmitWorker::Upload(ISimpleShader* shader, unsigned int bufferIndex)
+{
+	StagedBuffer& buffer = Stage(shader, bufferIndex);
+	if (buffer.Dirty)
+	{
+		context->UpdateSubresource(buffer.Buffer, 0, 0, &buffer.Data[0], 0, 0);
+		buffer.Dirty = false;
+	}
+	return ToHandle(buffer.Buffer);
+}
+
+void SubmitWorker::CommitConstants(SimpleVertexShader* shader)
+{
+	for (unsigned int b = 0; b < shader->GetBufferCount(); b++)
+		stateCache.SetVSConstantBuffer(shader->GetBufferInfo(b)->BindIndex, Upload(shader, b));
+}
+
+void SubmitWorker::CommitConstants(SimplePixelShader* shader, int skipSlot)
+{
+	for (unsigned int b = 0; b < shader->GetBufferCount(); b++)
+	{
+		if ((int)shader->GetBufferInfo(b)->BindIndex != skipSlot)
+			stateCache.SetPSConstantBuffer(shader->GetBufferInfo(b)->BindIndex, Upload(shader, b));
+	}
+}
+
+// --------------------------------------------------------
+// DeferredSubmitter
+// --------------------------------------------------------
+DeferredSubmitter::DeferredSubmitter(ThreadPool* threadPool)
+{
+	this->threadPool = threadPool;
+}
+
+DeferredSubmitter::~DeferredSubmitter()
+{
+	for (auto& w : workers) delete w;
+}
+
+void DeferredSubmitter::Init(ID3D11Device* device, int workerCount)
+{
+	if (workerCount < 0)
+		workerCount = threadPool->GetThreadCount();
+
+	for (int i = 0; i < workerCount; i++)
+	{
+		SubmitWorker* worker = new SubmitWorker(device);
+		if (!worker->GetContext())
+		{
+			// Single threaded device - stay on the immediate context
+			delete worker;
+			break;
+		}
+		workers.push_back(worker);
+	}
+}
+
+// --------------------------------------------------------
+// Gives each worker a run of jobs worth about the same total
+// cost, then records all the runs in parallel
+// --------------------------------------------------------
+void DeferredSubmitter::Record(int jobCount, const int* jobCosts, const std::function<void(SubmitWorker& worker, int first, int end)>& record)
+{
+	int workerCount = (int)workers.size();
+
+	long long totalCost = 0;
+	for (int i = 0; i < jobCount; i++)
+		totalCost += jobCosts ? jobCosts[i] : 1;
+
+	rangeStarts.assign(workerCount + 1, jobCount);
+	rangeStarts[0] = 0;
+	long long cost = 0;
+	int w = 1;
+	for (int i = 0; i < jobCount && w < workerCount; i++)
+	{
+		while (w < workerCount && cost >= totalCost * w / workerCount)
+			rangeStarts[w++] = i;
+		cost += jobCosts ? jobCosts[i] : 1;
+	}
+
+	threadPool->ParallelFor(workerCount, [&](int index)
+	{
+		SubmitWorker& worker = *workers[index];
+		worker.frame++;
+		worker.stateCache.Invalidate();
+		worker.stateCache.ResetStats();
+
+		record(worker, rangeStarts[index], rangeStarts[index + 1]);
+		worker.context->FinishCommandList(FALSE, &worker.commandList);
+	});
+}
+
+void DeferredSubmitter::Execute(ID3D11DeviceContext* immediate)
+{
+	for (auto& w : workers)
+	{
+		if (!w->commandList)
+			continue;
+
+		immediate->ExecuteCommandList(w->commandList, FALSE);
+		w->commandList->Release();
+		w->commandList = nullptr;
+	}
+}
+
+BindStats DeferredSubmitter::GetStats()
+{
+	BindStats total;
+	for (auto& w : workers)
+	{
+		BindStats stats = w->stateCache.GetStats();
+		total.Requested += stats.Requested;
+		total.Issued += stats.Issued;
+		total.Draws += stats.Draws;
+	}
+	return total;
+}
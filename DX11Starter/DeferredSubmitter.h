@@ -0,0 +1,104 @@
+#pragma once
+#include <d3d11.h>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "D3D11RenderDevice.h"
+#include "SimpleShaderD3D11.h"
+#include "StateCache.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// One recording thread's deferred context, state cache and
+// private constant buffers.
+//
+// SimpleShader keeps a single CPU copy of each constant
+// buffer, so workers can't write per-object values into it
+// at the same time.  Instead each worker stages its own copy:
+// the first use of a shader in a frame copies the shader's
+// current (per-frame) data, SetConstant() overwrites single
+// variables (SetConstants() whole buffers), and
+// CommitConstants() uploads any staged copy that changed to
+// the worker's own buffer and binds it.
+// --------------------------------------------------------
+class SubmitWorker : public IConstantStager
+{
+public:
+	SubmitWorker(ID3D11Device* device);
+	~SubmitWorker();
+
+	ID3D11DeviceContext* GetContext() { return context; }
+	StateCache& GetStateCache() { return stateCache; }
+
+	bool SetConstant(ISimpleShader* shader, const std::string& name, const void* data, unsigned int size);
+	bool SetConstant(ISimpleShader* shader, SimpleShaderHandle variable, const void* data, unsigned int size);
+
+	void CommitConstants(SimpleVertexShader* shader);
+	void CommitConstants(SimplePixelShader* shader, int skipSlot = -1);
+
+private:
+	friend class DeferredSubmitter;
+
+	struct StagedBuffer
+	{
+		ID3D11Buffer* Buffer = nullptr;
+		std::vector<unsigned char> Data;
+		unsigned int Frame = 0;			// Frame the data was last copied from the shader
+		bool Dirty = false;				// Changed since the last upload
+	};
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	ID3D11CommandList* commandList;
+	D3D11StateContext stateContext;
+	StateCache stateCache;
+
+	std::unordered_map<const SimpleConstantBuffer*, StagedBuffer> staged;
+	unsigned int frame;
+
+	StagedBuffer& Stage(ISimpleShader* shader, unsigned int bufferIndex);
+	bool Write(ISimpleShader* shader, const SimpleShaderVariable* variable, const void* data, unsigned int size);
+	bool WriteBuffer(ISimpleShader* shader, SimpleShaderHandle buffer, const void* data, unsigned int size);
+	RenderBuffer* Upload(ISimpleShader* shader, unsigned int bufferIndex);
+};
+
+// --------------------------------------------------------
+// Records draws on several threads and plays them back in
+// order on the immediate context.
+//
+// Record() splits a list of jobs into one contiguous range
+// per worker, balanced by each job's cost, and each worker
+// records its range into its own deferred context on the
+// thread pool.  Execute() then runs the command lists in
+// worker order, so the result draws exactly as if it had
+// been recorded on one thread.
+//
+// Deferred contexts start every list from default state
+// (no render targets, viewport or topology), and playback
+// leaves the immediate context at defaults as well.
+// --------------------------------------------------------
+class DeferredSubmitter
+{
+public:
+	DeferredSubmitter(ThreadPool* threadPool = &ThreadPool::Shared());
+	~DeferredSubmitter();
+
+	// workerCount < 0 uses one worker per pool thread.  Leaves
+	// zero workers if deferred contexts can't be created.
+	void Init(ID3D11Device* device, int workerCount = -1);
+	int GetWorkerCount() { return (int)workers.size(); }
+
+	// record(worker, first, end) records jobs [first, end)
+	void Record(int jobCount, const int* jobCosts, const std::function<void(SubmitWorker& worker, int first, int end)>& record);
+	void Execute(ID3D11DeviceContext* immediate);
+
+	// Every worker's binds and draws from the last Record()
+	BindStats GetStats();
+
+private:
+	ThreadPool* threadPool;
+	std::vector<SubmitWorker*> workers;
+	std::vector<int> rangeStarts;
+};
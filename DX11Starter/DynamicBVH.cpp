@@ -0,0 +1,545 @@
+#include "DynamicBVH.h"
+
+#include <algorithm>
+
+// --------------------------------------------------------
+// Box helpers
+// --------------------------------------------------------
+static AABB Union(const AABB& a, const AABB& b)
+{
+	AABB result;
+	result.Min = DirectX::XMFLOAT3(std::min(a.Min.x, b.Min.x), std::min(a.Min.y, b.Min.y), std::min(a.Min.z, b.Min.z));
+	result.Max = DirectX::XMFLOAT3(std::max(a.Max.x, b.Max.x), std::max(a.Max.y, b.Max.y), std::max(a.Max.z, b.Max.z));
+	return result;
+}
+
+static float SurfaceArea(const AABB& box)
+{
+	float dx = box.Max.x - box.Min.x;
+	float dy = box.Max.y - box.Min.y;
+	float dz = box.Max.z - box.Min.z;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static bool Contains(const AABB& outer, const AABB& inner)
+{
+	return
+		outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z &&
+		outer.Max.x >= inner.Max.x && outer.Max.y >= inner.Max.y && outer.Max.z >= inner.Max.z;
+}
+
+static bool Overlaps(const AABB& a, const AABB& b)
+{
+	return
+		a.Min.x <= b.Max.x && a.Max.x >= b.Min.x &&
+		a.Min.y <= b.Max.y && a.Max.y >= b.Min.y &&
+		a.Min.z <= b.Max.z && a.Max.z >= b.Min.z;
+}
+
+// --------------------------------------------------------
+// Constructor
+//
+// margin - How much each leaf box is grown on every side
+// displacementMultiplier - How far ahead (in frames) to
+//   extend the box along the object's motion
+// --------------------------------------------------------
+DynamicBVH::DynamicBVH(float margin, float displacementMultiplier)
+{
+	this->margin = margin;
+	this->displacementMultiplier = displacementMultiplier;
+
+	root = -1;
+	freeList = -1;
+	nodeCount = 0;
+	proxyCount = 0;
+	rebalancePath = 0;
+	nodesVisited = 0;
+}
+
+// --------------------------------------------------------
+// Grabs a node from the free list, growing the pool if needed
+// --------------------------------------------------------
+int DynamicBVH::AllocateNode()
+{
+	int node;
+	if (freeList != -1)
+	{
+		node = freeList;
+		freeList = nodes[node].Parent;
+	}
+	else
+	{
+		node = (int)nodes.size();
+		nodes.push_back(BVHNode());
+	}
+
+	BVHNode& n = nodes[node];
+	n.Parent = -1;
+	n.Child1 = -1;
+	n.Child2 = -1;
+	n.Height = 0;
+	n.UserData = -1;
+	nodeCount++;
+	return node;
+}
+
+void DynamicBVH::FreeNode(int node)
+{
+	nodes[node].Parent = freeList;
+	nodes[node].Height = -1;
+	freeList = node;
+	nodeCount--;
+}
+
+// --------------------------------------------------------
+// Creates a leaf with a fattened copy of the box
+// --------------------------------------------------------
+int DynamicBVH::CreateProxy(const AABB& box, int userData)
+{
+	int proxy = AllocateNode();
+
+	AABB fat = box;
+	fat.Min = DirectX::XMFLOAT3(box.Min.x - margin, box.Min.y - margin, box.Min.z - margin);
+	fat.Max = DirectX::XMFLOAT3(box.Max.x + margin, box.Max.y + margin, box.Max.z + margin);
+	nodes[proxy].Box = fat;
+	nodes[proxy].UserData = userData;
+
+	InsertLeaf(proxy);
+	proxyCount++;
+	return proxy;
+}
+
+void DynamicBVH::DestroyProxy(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	proxyCount--;
+}
+
+// --------------------------------------------------------
+// Only touches the tree when the object left its fat box
+// --------------------------------------------------------
+bool DynamicBVH::MoveProxy(int proxy, const AABB& box, DirectX::XMFLOAT3 displacement)
+{
+	if (Contains(nodes[proxy].Box, box))
+		return false;
+
+	RemoveLeaf(proxy);
+
+	// Grow by the margin, then stretch along the motion so
+	// the object can keep moving a while before escaping again
+	AABB fat;
+	fat.Min = DirectX::XMFLOAT3(box.Min.x - margin, box.Min.y - margin, box.Min.z - margin);
+	fat.Max = DirectX::XMFLOAT3(box.Max.x + margin, box.Max.y + margin, box.Max.z + margin);
+
+	DirectX::XMFLOAT3 d(
+		displacement.x * displacementMultiplier,
+		displacement.y * displacementMultiplier,
+		displacement.z * displacementMultiplier);
+	if (d.x < 0.0f) fat.Min.x += d.x; else fat.Max.x += d.x;
+	if (d.y < 0.0f) fat.Min.y += d.y; else fat.Max.y += d.y;
+	if (d.z < 0.0f) fat.Min.z += d.z; else fat.Max.z += d.z;
+
+	nodes[proxy].Box = fat;
+	InsertLeaf(proxy);
+	return true;
+}
+
+// --------------------------------------------------------
+// Reinserts leaves one at a time, walking a different path
+// down the tree each call so every leaf gets its turn
+// --------------------------------------------------------
+void DynamicBVH::Rebalance(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		if (root == -1 || proxyCount < 2)
+			return;
+
+		int node = root;
+		unsigned int bit = 0;
+		while (!nodes[node].IsLeaf())
+		{
+			node = ((rebalancePath >> bit) & 1) ? nodes[node].Child2 : nodes[node].Child1;
+			bit = (bit + 1) & 31;
+		}
+		rebalancePath++;
+
+		RemoveLeaf(node);
+		InsertLeaf(node);
+	}
+}
+
+// --------------------------------------------------------
+// Finds the cheapest sibling for the leaf (by the surface
+// area the insertion would add) and splices it in
+// --------------------------------------------------------
+void DynamicBVH::InsertLeaf(int leaf)
+{
+	if (root == -1)
+	{
+		root = leaf;
+		nodes[root].Parent = -1;
+		return;
+	}
+
+	AABB leafBox = nodes[leaf].Box;
+	int index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		int child1 = nodes[index].Child1;
+		int child2 = nodes[index].Child2;
+
+		float area = SurfaceArea(nodes[index].Box);
+		float combinedArea = SurfaceArea(Union(nodes[index].Box, leafBox));
+
+		// Cost of making a new parent for this node and the leaf
+		float cost = 2.0f * combinedArea;
+
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float cost1 = SurfaceArea(Union(leafBox, nodes[child1].Box)) + inheritanceCost;
+		if (!nodes[child1].IsLeaf())
+			cost1 -= SurfaceArea(nodes[child1].Box);
+
+		float cost2 = SurfaceArea(Union(leafBox, nodes[child2].Box)) + inheritanceCost;
+		if (!nodes[child2].IsLeaf())
+			cost2 -= SurfaceArea(nodes[child2].Box);
+
+		// Descend or stop here?
+		if (cost < cost1 && cost < cost2)
+			break;
+
+		index = cost1 < cost2 ? child1 : child2;
+	}
+
+	int sibling = index;
+
+	// Make a new parent for the sibling and the leaf
+	int oldParent = nodes[sibling].Parent;
+	int newParent = AllocateNode();
+	nodes[newParent].Parent = oldParent;
+	nodes[newParent].Box = Union(leafBox, nodes[sibling].Box);
+	nodes[newParent].Height = nodes[sibling].Height + 1;
+	nodes[newParent].Child1 = sibling;
+	nodes[newParent].Child2 = leaf;
+	nodes[sibling].Parent = newParent;
+	nodes[leaf].Parent = newParent;
+
+	if (oldParent != -1)
+	{
+		if (nodes[oldParent].Child1 == sibling)
+			nodes[oldParent].Child1 = newParent;
+		else
+			nodes[oldParent].Child2 = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// Walk back up fixing boxes and heights
+	Refit(nodes[leaf].Parent);
+}
+
+// --------------------------------------------------------
+// Removes a leaf by collapsing its parent into its sibling
+// --------------------------------------------------------
+void DynamicBVH::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	int parent = nodes[leaf].Parent;
+	int grandParent = nodes[parent].Parent;
+	int sibling = nodes[parent].Child1 == leaf ? nodes[parent].Child2 : nodes[parent].Child1;
+
+	if (grandParent != -1)
+	{
+		if (nodes[grandParent].Child1 == parent)
+			nodes[grandParent].Child1 = sibling;
+		else
+			nodes[grandParent].Child2 = sibling;
+		nodes[sibling].Parent = grandParent;
+		FreeNode(parent);
+
+		Refit(grandParent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].Parent = -1;
+		FreeNode(parent);
+	}
+}
+
+// --------------------------------------------------------
+// Rebalances and recomputes every node from index to the root
+// --------------------------------------------------------
+void DynamicBVH::Refit(int index)
+{
+	while (index != -1)
+	{
+		index = Balance(index);
+
+		int child1 = nodes[index].Child1;
+		int child2 = nodes[index].Child2;
+		nodes[index].Height = 1 + std::max(nodes[child1].Height, nodes[child2].Height);
+		nodes[index].Box = Union(nodes[child1].Box, nodes[child2].Box);
+
+		index = nodes[index].Parent;
+	}
+}
+
+// --------------------------------------------------------
+// Performs a left or right rotation if node A is imbalanced.
+// Returns the index of the node now at A's position.
+//
+//        A
+//      /   \     B and C are A's children,
+//     B     C    and D to G its grandchildren
+//    / \   / \   (what gets swapped around)
+//   D   E F   G
+// --------------------------------------------------------
+int DynamicBVH::Balance(int iA)
+{
+	if (nodes[iA].IsLeaf() || nodes[iA].Height < 2)
+		return iA;
+
+	int iB = nodes[iA].Child1;
+	int iC = nodes[iA].Child2;
+	int balance = nodes[iC].Height - nodes[iB].Height;
+
+	// Rotate C up
+	if (balance > 1)
+	{
+		int iF = nodes[iC].Child1;
+		int iG = nodes[iC].Child2;
+
+		// Swap A and C
+		nodes[iC].Child1 = iA;
+		nodes[iC].Parent = nodes[iA].Parent;
+		nodes[iA].Parent = iC;
+
+		// A's old parent should point to C
+		int cParent = nodes[iC].Parent;
+		if (cParent != -1)
+		{
+			if (nodes[cParent].Child1 == iA)
+				nodes[cParent].Child1 = iC;
+			else
+				nodes[cParent].Child2 = iC;
+		}
+		else
+		{
+			root = iC;
+		}
+
+		// Keep the taller of F and G under C
+		if (nodes[iF].Height > nodes[iG].Height)
+		{
+			nodes[iC].Child2 = iF;
+			nodes[iA].Child2 = iG;
+			nodes[iG].Parent = iA;
+			nodes[iA].Box = Union(nodes[iB].Box, nodes[iG].Box);
+			nodes[iC].Box = Union(nodes[iA].Box, nodes[iF].Box);
+			nodes[iA].Height = 1 + std::max(nodes[iB].Height, nodes[iG].Height);
+			nodes[iC].Height = 1 + std::max(nodes[iA].Height, nodes[iF].Height);
+		}
+		else
+		{
+			nodes[iC].Child2 = iG;
+			nodes[iA].Child2 = iF;
+			nodes[iF].Parent = iA;
+			nodes[iA].Box = Union(nodes[iB].Box, nodes[iF].Box);
+			nodes[iC].Box = Union(nodes[iA].Box, nodes[iG].Box);
+			nodes[iA].Height = 1 + std::max(nodes[iB].Height, nodes[iF].Height);
+			nodes[iC].Height = 1 + std::max(nodes[iA].Height, nodes[iG].Height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (balance < -1)
+	{
+		int iD = nodes[iB].Child1;
+		int iE = nodes[iB].Child2;
+
+		// Swap A and B
+		nodes[iB].Child1 = iA;
+		nodes[iB].Parent = nodes[iA].Parent;
+		nodes[iA].Parent = iB;
+
+		// A's old parent should point to B
+		int bParent = nodes[iB].Parent;
+		if (bParent != -1)
+		{
+			if (nodes[bParent].Child1 == iA)
+				nodes[bParent].Child1 = iB;
+			else
+				nodes[bParent].Child2 = iB;
+		}
+		else
+		{
+			root = iB;
+		}
+
+		// Keep the taller of D and E under B
+		if (nodes[iD].Height > nodes[iE].Height)
+		{
+			nodes[iB].Child2 = iD;
+			nodes[iA].Child1 = iE;
+			nodes[iE].Parent = iA;
+			nodes[iA].Box = Union(nodes[iC].Box, nodes[iE].Box);
+			nodes[iB].Box = Union(nodes[iA].Box, nodes[iD].Box);
+			nodes[iA].Height = 1 + std::max(nodes[iC].Height, nodes[iE].Height);
+			nodes[iB].Height = 1 + std::max(nodes[iA].Height, nodes[iD].Height);
+		}
+		else
+		{
+			nodes[iB].Child2 = iE;
+			nodes[iA].Child1 = iD;
+			nodes[iD].Parent = iA;
+			nodes[iA].Box = Union(nodes[iC].Box, nodes[iD].Box);
+			nodes[iB].Box = Union(nodes[iA].Box, nodes[iE].Box);
+			nodes[iA].Height = 1 + std::max(nodes[iC].Height, nodes[iD].Height);
+			nodes[iB].Height = 1 + std::max(nodes[iA].Height, nodes[iE].Height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+// --------------------------------------------------------
+// Frustum query.  Each stack entry remembers which planes
+// still matter: once a node is fully inside a plane, none
+// of its children need to test that plane again, and once
+// it's inside all six the whole subtree is accepted as-is.
+// --------------------------------------------------------
+void DynamicBVH::QueryFrustum(const Frustum& frustum, std::vector<int>& results)
+{
+	results.clear();
+	nodesVisited = 0;
+	if (root == -1)
+	{
+		stats = CullingStats();
+		return;
+	}
+
+	stack.clear();
+	stack.push_back({ root, 0x3F });
+	while (!stack.empty())
+	{
+		StackEntry entry = stack.back();
+		stack.pop_back();
+		nodesVisited++;
+
+		const BVHNode& node = nodes[entry.Node];
+		int planeMask = entry.PlaneMask;
+		bool outside = false;
+
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			if (!(planeMask & (1 << p)))
+				continue;
+
+			const DirectX::XMFLOAT4& plane = frustum.Planes[p];
+
+			// Corner farthest along the normal - if it's behind, the box is out
+			float px = plane.x >= 0.0f ? node.Box.Max.x : node.Box.Min.x;
+			float py = plane.y >= 0.0f ? node.Box.Max.y : node.Box.Min.y;
+			float pz = plane.z >= 0.0f ? node.Box.Max.z : node.Box.Min.z;
+			if (plane.x * px + plane.y * py + plane.z * pz + plane.w < 0.0f)
+			{
+				outside = true;
+				break;
+			}
+
+			// Nearest corner - if even it's in front, the box is fully inside
+			float nx = plane.x >= 0.0f ? node.Box.Min.x : node.Box.Max.x;
+			float ny = plane.y >= 0.0f ? node.Box.Min.y : node.Box.Max.y;
+			float nz = plane.z >= 0.0f ? node.Box.Min.z : node.Box.Max.z;
+			if (plane.x * nx + plane.y * ny + plane.z * nz + plane.w >= 0.0f)
+				planeMask &= ~(1 << p);
+		}
+
+		if (outside)
+			continue;
+
+		if (node.IsLeaf())
+			results.push_back(node.UserData);
+		else if (planeMask == 0)
+			CollectLeaves(entry.Node, results);
+		else
+		{
+			stack.push_back({ node.Child1, planeMask });
+			stack.push_back({ node.Child2, planeMask });
+		}
+	}
+
+	stats.Tested = proxyCount;
+	stats.Visible = (int)results.size();
+	stats.Culled = proxyCount - stats.Visible;
+}
+
+// --------------------------------------------------------
+// Overlap query against a box
+// --------------------------------------------------------
+void DynamicBVH::QueryAABB(const AABB& box, std::vector<int>& results)
+{
+	results.clear();
+	nodesVisited = 0;
+	if (root == -1)
+		return;
+
+	stack.clear();
+	stack.push_back({ root, 0 });
+	while (!stack.empty())
+	{
+		int index = stack.back().Node;
+		stack.pop_back();
+		nodesVisited++;
+
+		const BVHNode& node = nodes[index];
+		if (!Overlaps(node.Box, box))
+			continue;
+
+		if (node.IsLeaf())
+			results.push_back(node.UserData);
+		else
+		{
+			stack.push_back({ node.Child1, 0 });
+			stack.push_back({ node.Child2, 0 });
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Adds every leaf below a node without any further tests
+// --------------------------------------------------------
+void DynamicBVH::CollectLeaves(int node, std::vector<int>& results)
+{
+	size_t base = stack.size();
+	stack.push_back({ node, 0 });
+	while (stack.size() > base)
+	{
+		int index = stack.back().Node;
+		stack.pop_back();
+		nodesVisited++;
+
+		if (nodes[index].IsLeaf())
+			results.push_back(nodes[index].UserData);
+		else
+		{
+			stack.push_back({ nodes[index].Child1, 0 });
+			stack.push_back({ nodes[index].Child2, 0 });
+		}
+	}
+}
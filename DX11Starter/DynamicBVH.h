@@ -0,0 +1,96 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Bounds.h"
+#include "FrustumCuller.h"
+
+// --------------------------------------------------------
+// A single node of the tree.  Leaves hold a user value
+// (usually an entity index), internal nodes hold the
+// union of their children's boxes.
+// --------------------------------------------------------
+struct BVHNode
+{
+	AABB Box;
+	int Parent;		// Also used as the "next" link while on the free list
+	int Child1;
+	int Child2;
+	int Height;		// 0 for leaves, -1 for free nodes
+	int UserData;
+
+	bool IsLeaf() const { return Child1 == -1; }
+};
+
+// --------------------------------------------------------
+// Dynamic bounding volume hierarchy over world space boxes.
+//
+// Leaves store "fat" boxes (grown by a margin and by the
+// predicted motion) so small movements don't touch the tree.
+// Insertion picks the cheapest sibling by surface area, the
+// tree is kept balanced with AVL-style rotations and can be
+// further improved a few leaves at a time with Rebalance().
+// --------------------------------------------------------
+class DynamicBVH
+{
+public:
+	DynamicBVH(float margin = 0.1f, float displacementMultiplier = 2.0f);
+
+	// Proxies are leaf node ids
+	int CreateProxy(const AABB& box, int userData);
+	void DestroyProxy(int proxy);
+
+	// Refits a proxy after its object moved.  Returns true if the
+	// tight box escaped the fat box and the leaf was reinserted.
+	bool MoveProxy(int proxy, const AABB& box, DirectX::XMFLOAT3 displacement);
+
+	// Removes and reinserts a handful of leaves to slowly
+	// improve a tree that has degraded from lots of motion
+	void Rebalance(int iterations);
+
+	// Gather the user data of every leaf touching the volume.
+	// Subtrees that miss it are never visited.
+	void QueryFrustum(const Frustum& frustum, std::vector<int>& results);
+	void QueryAABB(const AABB& box, std::vector<int>& results);
+
+	int GetUserData(int proxy) { return nodes[proxy].UserData; }
+	const AABB& GetFatAABB(int proxy) { return nodes[proxy].Box; }
+
+	int GetHeight() { return root == -1 ? 0 : nodes[root].Height; }
+	int GetNodeCount() { return nodeCount; }
+	int GetProxyCount() { return proxyCount; }
+
+	// Stats for the last query
+	int GetNodesVisited() { return nodesVisited; }
+	CullingStats GetStats() { return stats; }
+
+private:
+	std::vector<BVHNode> nodes;
+	int root;
+	int freeList;
+	int nodeCount;
+	int proxyCount;
+
+	float margin;
+	float displacementMultiplier;
+
+	// Bits that pick the path down the tree for Rebalance()
+	unsigned int rebalancePath;
+
+	// Scratch space for traversal (node, active plane mask)
+	struct StackEntry { int Node; int PlaneMask; };
+	std::vector<StackEntry> stack;
+
+	int nodesVisited;
+	CullingStats stats;
+
+	int AllocateNode();
+	void FreeNode(int node);
+
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int index);
+	void Refit(int index);
+
+	void CollectLeaves(int node, std::vector<int>& results);
+};
@@ -9,6 +9,10 @@ Entity::Entity(Mesh* meshPtr, Material* matPtr)
 	position = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
 	scale = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
 	rotation = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	worldBounds = mesh->GetLocalBounds();
+	worldSphere = mesh->GetLocalSphere();
+	occluder = false;
+	isStatic = false;
 }
 
 //Accessors
@@ -23,21 +27,32 @@ void Entity::SetRotation(DirectX::XMFLOAT3 rot) { rotation = rot; }
 
 Mesh* Entity::GetMesh() { return mesh; }
 
+AABB Entity::GetWorldBounds() { return worldBounds; }
+BoundingSphere Entity::GetWorldSphere() { return worldSphere; }
+
+bool Entity::IsOccluder() { return occluder; }
+void Entity::SetOccluder(bool isOccluder) { occluder = isOccluder; }
+
+bool Entity::IsStatic() { return isStatic; }
+void Entity::SetStatic(bool isStatic) { this->isStatic = isStatic; }
+
 Material* Entity::GetMaterial() { return material; }
 
-void Entity::PrepareMaterial(DirectX::XMFLOAT4X4 viewMatrix, DirectX::XMFLOAT4X4 projectionMatrix)
+void Entity::PrepareMaterial(float fade)
 {
 	worldMatrix = GetWorldMatrix();
 
-	material->GetVertexShader()->SetMatrix4x4("world", worldMatrix);
-	material->GetVertexShader()->SetMatrix4x4("view", viewMatrix);
-	material->GetVertexShader()->SetMatrix4x4("projection", projectionMatrix);
-
-	material->GetPixelShader()->SetShader();
-	material->GetPixelShader()->CopyAllBufferData();
-
-	material->GetVertexShader()->SetShader();
-	material->GetVertexShader()->CopyAllBufferData();
+	//Only this entity's own buffer goes up - per-frame and
+	//per-material data were uploaded once by the caller, and
+	//binding is left to the caller too.  If nothing about the
+	//entity changed, last frame's upload is reused.
+	PerObjectConstants constants = {};
+	constants.world = worldMatrix;
+	constants.fade = fade;
+
+	const MaterialHandles& handles = material->GetHandles();
+	material->GetVertexShader()->SetBufferData(handles.PerObject, constants);
+	material->GetVertexShader()->CopyBufferData(handles.PerObject.Buffer, objectConstants);
 }
 
 void Entity::UpdateWorldMatrix()
@@ -48,6 +63,30 @@ void Entity::UpdateWorldMatrix()
 
 	DirectX::XMMATRIX world = scl * rot * trans;
 	XMStoreFloat4x4(&worldMatrix, XMMatrixTranspose(world));
+
+	//Move the mesh's box into world space: transform its center and
+	//grow its half extents by the absolute value of the rotation/scale
+	AABB local = mesh->GetLocalBounds();
+	DirectX::XMFLOAT3 center((local.Min.x + local.Max.x) * 0.5f, (local.Min.y + local.Max.y) * 0.5f, (local.Min.z + local.Max.z) * 0.5f);
+	DirectX::XMFLOAT3 extent((local.Max.x - local.Min.x) * 0.5f, (local.Max.y - local.Min.y) * 0.5f, (local.Max.z - local.Min.z) * 0.5f);
+
+	DirectX::XMFLOAT4X4 w;
+	XMStoreFloat4x4(&w, world);
+	DirectX::XMFLOAT3 worldCenter;
+	XMStoreFloat3(&worldCenter, DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&center), world));
+	DirectX::XMFLOAT3 worldExtent(
+		fabsf(w._11) * extent.x + fabsf(w._21) * extent.y + fabsf(w._31) * extent.z,
+		fabsf(w._12) * extent.x + fabsf(w._22) * extent.y + fabsf(w._32) * extent.z,
+		fabsf(w._13) * extent.x + fabsf(w._23) * extent.y + fabsf(w._33) * extent.z);
+
+	worldBounds.Min = DirectX::XMFLOAT3(worldCenter.x - worldExtent.x, worldCenter.y - worldExtent.y, worldCenter.z - worldExtent.z);
+	worldBounds.Max = DirectX::XMFLOAT3(worldCenter.x + worldExtent.x, worldCenter.y + worldExtent.y, worldCenter.z + worldExtent.z);
+
+	//The sphere only needs its center moved and radius scaled by the largest axis
+	BoundingSphere localSphere = mesh->GetLocalSphere();
+	float maxScale = fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+	XMStoreFloat3(&worldSphere.Center, DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&localSphere.Center), world));
+	worldSphere.Radius = localSphere.Radius * maxScale;
 }
 
 DirectX::XMFLOAT4X4 Entity::GetWorldMatrix() 
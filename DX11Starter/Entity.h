@@ -1,5 +1,4 @@
 #pragma once
-#include <d3d11.h>
 #include <DirectXMath.h>
 
 #include "Mesh.h"
@@ -12,8 +11,15 @@ private:
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 scale;
 	DirectX::XMFLOAT3 rotation;
+	AABB worldBounds;
+	BoundingSphere worldSphere;
 	Mesh* mesh;
 	Material* material;
+	bool occluder;
+	bool isStatic;
+
+	//Last upload of this entity's per-object constants
+	RetainedConstants objectConstants;
 public:
 	//Constructor
 	Entity(Mesh* meshPtr, Material* matPtr);
@@ -29,8 +35,20 @@ public:
 
 	Mesh* GetMesh();
 
+	//World space bounds, refreshed by UpdateWorldMatrix
+	AABB GetWorldBounds();
+	BoundingSphere GetWorldSphere();
+
+	//Occluders are rasterized for CPU occlusion culling
+	bool IsOccluder();
+	void SetOccluder(bool isOccluder);
+
+	//Static entities never move, so precomputed visibility applies to them
+	bool IsStatic();
+	void SetStatic(bool isStatic);
+
 	Material* GetMaterial();
-	void PrepareMaterial(DirectX::XMFLOAT4X4 viewMatrix, DirectX::XMFLOAT4X4 projectionMatrix);
+	void PrepareMaterial(float fade);
 
 	//Method to move entity
 	void Move(float x, float y, float z);
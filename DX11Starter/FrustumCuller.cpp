@@ -0,0 +1,281 @@
+#include "FrustumCuller.h"
+
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+// Views tested together per sweep (their splatted planes
+// have to fit on the stack); more views take extra sweeps
+static const int MaxViewsPerSweep = 8;
+
+// --------------------------------------------------------
+// Visibility bitset helpers
+// --------------------------------------------------------
+void VisibilityBits::GetIndices(std::vector<int>& indices) const
+{
+	for (size_t w = 0; w < Words.size(); w++)
+	{
+		unsigned int bits = Words[w];
+		while (bits)
+		{
+			int bit = 0;
+			while (!(bits & (1u << bit))) bit++;
+			indices.push_back((int)w * 32 + bit);
+			bits &= ~(1u << bit);
+		}
+	}
+}
+
+FrustumCuller::FrustumCuller()
+{
+	count = 0;
+	paddedCount = 0;
+}
+
+// --------------------------------------------------------
+// Resizes the streams.  They're padded to a multiple of four
+// so the SIMD loop never needs a scalar tail; padding entries
+// have a negative radius and can never be visible.
+// --------------------------------------------------------
+void FrustumCuller::Resize(int newCount)
+{
+	count = newCount;
+	paddedCount = (newCount + 3) & ~3;
+
+	centerX.resize(paddedCount, 0.0f);
+	centerY.resize(paddedCount, 0.0f);
+	centerZ.resize(paddedCount, 0.0f);
+	radius.resize(paddedCount, -1.0f);
+	minX.resize(paddedCount, 0.0f);
+	minY.resize(paddedCount, 0.0f);
+	minZ.resize(paddedCount, 0.0f);
+	maxX.resize(paddedCount, 0.0f);
+	maxY.resize(paddedCount, 0.0f);
+	maxZ.resize(paddedCount, 0.0f);
+
+	// Entries past the end might be left over from a larger size
+	for (int i = count; i < paddedCount; i++)
+		radius[i] = -1.0f;
+}
+
+void FrustumCuller::SetBounds(int index, const BoundingSphere& sphere, const AABB& box)
+{
+	centerX[index] = sphere.Center.x;
+	centerY[index] = sphere.Center.y;
+	centerZ[index] = sphere.Center.z;
+	radius[index] = sphere.Radius;
+
+	minX[index] = box.Min.x; minY[index] = box.Min.y; minZ[index] = box.Min.z;
+	maxX[index] = box.Max.x; maxY[index] = box.Max.y; maxZ[index] = box.Max.z;
+}
+
+// --------------------------------------------------------
+// Culls four objects per step against all six planes
+// --------------------------------------------------------
+int FrustumCuller::Cull(const Frustum& frustum, std::vector<int>& visible)
+{
+	visible.clear();
+
+	// Splat each plane once up front
+	__m128 planeX[6], planeY[6], planeZ[6], planeD[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm_set1_ps(frustum.Planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.Planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.Planes[p].z);
+		planeD[p] = _mm_set1_ps(frustum.Planes[p].w);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < paddedCount; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 r = _mm_loadu_ps(&radius[i]);
+		__m128 negR = _mm_sub_ps(zero, r);
+
+		// Padding has a negative radius
+		__m128 inside = _mm_cmpge_ps(r, zero);
+
+		for (int p = 0; p < 6; p++)
+		{
+			// Sphere: signed distance must be >= -radius
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeD[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negR));
+
+			// Box: the corner farthest along the plane normal must be
+			// inside.  The normal is the same for all four lanes, so the
+			// corner is picked per plane rather than per lane.
+			const float* px = frustum.Planes[p].x >= 0.0f ? &maxX[i] : &minX[i];
+			const float* py = frustum.Planes[p].y >= 0.0f ? &maxY[i] : &minY[i];
+			const float* pz = frustum.Planes[p].z >= 0.0f ? &maxZ[i] : &minZ[i];
+			__m128 boxDist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planeX[p], _mm_loadu_ps(px)), _mm_mul_ps(planeY[p], _mm_loadu_ps(py))),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], _mm_loadu_ps(pz)), planeD[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(boxDist, zero));
+		}
+
+		// Emit the lanes that survived
+		int mask = _mm_movemask_ps(inside);
+		while (mask)
+		{
+			int lane = 0;
+			while (!(mask & (1 << lane))) lane++;
+			visible.push_back(i + lane);
+			mask &= ~(1 << lane);
+		}
+	}
+
+	stats.Tested = count;
+	stats.Visible = (int)visible.size();
+	stats.Culled = count - stats.Visible;
+	return stats.Visible;
+}
+
+// --------------------------------------------------------
+// Culls against every view, a group of views per sweep
+// --------------------------------------------------------
+void FrustumCuller::CullViews(const Frustum* frusta, int viewCount, std::vector<VisibilityBits>& visibility, const VisibilityBits* const* candidates)
+{
+	visibility.resize(viewCount);
+	viewStats.resize(viewCount);
+
+	for (int first = 0; first < viewCount; first += MaxViewsPerSweep)
+	{
+		int groupCount = viewCount - first < MaxViewsPerSweep ? viewCount - first : MaxViewsPerSweep;
+		CullViewGroup(frusta + first, groupCount, &visibility[first], &viewStats[first], candidates ? candidates + first : nullptr);
+	}
+}
+
+// --------------------------------------------------------
+// Same tests as Cull(), but every block of four objects is
+// run against all the views before moving on, so the bounds
+// are only streamed through the cache once
+// --------------------------------------------------------
+void FrustumCuller::CullViewGroup(const Frustum* frusta, int viewCount, VisibilityBits* visibility, CullingStats* groupStats, const VisibilityBits* const* candidates)
+{
+	int wordCount = (paddedCount + 31) / 32;
+
+	// Views without a candidate set consider everything
+	const unsigned int* candidateWords[MaxViewsPerSweep] = {};
+	for (int v = 0; v < viewCount; v++)
+	{
+		if (candidates && candidates[v] && (int)candidates[v]->Words.size() >= wordCount)
+			candidateWords[v] = &candidates[v]->Words[0];
+	}
+
+	__m128 planeX[MaxViewsPerSweep][6], planeY[MaxViewsPerSweep][6];
+	__m128 planeZ[MaxViewsPerSweep][6], planeD[MaxViewsPerSweep][6];
+
+	// Which box corner is farthest along each plane normal
+	bool useMaxX[MaxViewsPerSweep][6], useMaxY[MaxViewsPerSweep][6], useMaxZ[MaxViewsPerSweep][6];
+
+	for (int v = 0; v < viewCount; v++)
+	{
+		visibility[v].Words.assign(wordCount, 0);
+		for (int p = 0; p < 6; p++)
+		{
+			const XMFLOAT4& plane = frusta[v].Planes[p];
+			planeX[v][p] = _mm_set1_ps(plane.x);
+			planeY[v][p] = _mm_set1_ps(plane.y);
+			planeZ[v][p] = _mm_set1_ps(plane.z);
+			planeD[v][p] = _mm_set1_ps(plane.w);
+			useMaxX[v][p] = plane.x >= 0.0f;
+			useMaxY[v][p] = plane.y >= 0.0f;
+			useMaxZ[v][p] = plane.z >= 0.0f;
+		}
+	}
+
+	int visibleCounts[MaxViewsPerSweep] = {};
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < paddedCount; i += 4)
+	{
+		// Candidate bits for this block, and whether any view has any
+		unsigned int candidateMask[MaxViewsPerSweep];
+		unsigned int anyCandidate = 0;
+		for (int v = 0; v < viewCount; v++)
+		{
+			candidateMask[v] = candidateWords[v] ? (candidateWords[v][i >> 5] >> (i & 31)) & 0xF : 0xF;
+			anyCandidate |= candidateMask[v];
+		}
+		if (!anyCandidate)
+			continue;
+
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 r = _mm_loadu_ps(&radius[i]);
+		__m128 negR = _mm_sub_ps(zero, r);
+		__m128 valid = _mm_cmpge_ps(r, zero);
+
+		__m128 bMinX = _mm_loadu_ps(&minX[i]), bMaxX = _mm_loadu_ps(&maxX[i]);
+		__m128 bMinY = _mm_loadu_ps(&minY[i]), bMaxY = _mm_loadu_ps(&maxY[i]);
+		__m128 bMinZ = _mm_loadu_ps(&minZ[i]), bMaxZ = _mm_loadu_ps(&maxZ[i]);
+
+		for (int v = 0; v < viewCount; v++)
+		{
+			if (!candidateMask[v])
+				continue;
+
+			__m128 inside = valid;
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 dist = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(planeX[v][p], cx), _mm_mul_ps(planeY[v][p], cy)),
+					_mm_add_ps(_mm_mul_ps(planeZ[v][p], cz), planeD[v][p]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negR));
+
+				__m128 px = useMaxX[v][p] ? bMaxX : bMinX;
+				__m128 py = useMaxY[v][p] ? bMaxY : bMinY;
+				__m128 pz = useMaxZ[v][p] ? bMaxZ : bMinZ;
+				__m128 boxDist = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(planeX[v][p], px), _mm_mul_ps(planeY[v][p], py)),
+					_mm_add_ps(_mm_mul_ps(planeZ[v][p], pz), planeD[v][p]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(boxDist, zero));
+			}
+
+			// Four bits per block, eight blocks per word
+			unsigned int mask = (unsigned int)_mm_movemask_ps(inside) & candidateMask[v];
+			visibility[v].Words[i >> 5] |= mask << (i & 31);
+			visibleCounts[v] += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + (mask >> 3);
+		}
+	}
+
+	for (int v = 0; v < viewCount; v++)
+	{
+		groupStats[v].Tested = count;
+		groupStats[v].Visible = visibleCounts[v];
+		groupStats[v].Culled = count - visibleCounts[v];
+	}
+}
+
+// --------------------------------------------------------
+// Gribb/Hartmann plane extraction: the planes are sums and
+// differences of the matrix columns
+// --------------------------------------------------------
+Frustum FrustumCuller::ExtractFrustum(const XMFLOAT4X4& viewProj)
+{
+	const XMFLOAT4X4& m = viewProj;
+	XMFLOAT4 c0(m._11, m._21, m._31, m._41);
+	XMFLOAT4 c1(m._12, m._22, m._32, m._42);
+	XMFLOAT4 c2(m._13, m._23, m._33, m._43);
+	XMFLOAT4 c3(m._14, m._24, m._34, m._44);
+
+	XMFLOAT4 planes[6] =
+	{
+		XMFLOAT4(c3.x + c0.x, c3.y + c0.y, c3.z + c0.z, c3.w + c0.w),	// Left
+		XMFLOAT4(c3.x - c0.x, c3.y - c0.y, c3.z - c0.z, c3.w - c0.w),	// Right
+		XMFLOAT4(c3.x + c1.x, c3.y + c1.y, c3.z + c1.z, c3.w + c1.w),	// Bottom
+		XMFLOAT4(c3.x - c1.x, c3.y - c1.y, c3.z - c1.z, c3.w - c1.w),	// Top
+		c2,																// Near (D3D depth starts at 0)
+		XMFLOAT4(c3.x - c2.x, c3.y - c2.y, c3.z - c2.z, c3.w - c2.w)	// Far
+	};
+
+	Frustum frustum;
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&frustum.Planes[i], XMPlaneNormalize(XMLoadFloat4(&planes[i])));
+	return frustum;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Bounds.h"
+
+// --------------------------------------------------------
+// Visible/culled counts for one culling pass
+// --------------------------------------------------------
+struct CullingStats
+{
+	int Tested = 0;
+	int Visible = 0;
+	int Culled = 0;
+};
+
+// --------------------------------------------------------
+// One visibility bit per object for a single view
+// (bit i & 31 of word i / 32)
+// --------------------------------------------------------
+struct VisibilityBits
+{
+	std::vector<unsigned int> Words;
+
+	bool IsVisible(int index) const { return (Words[index >> 5] >> (index & 31)) & 1; }
+
+	// Appends the index of every set bit, in order
+	void GetIndices(std::vector<int>& indices) const;
+};
+
+// --------------------------------------------------------
+// Tests many world space bounds against a frustum at once.
+//
+// Bounds are kept as structure-of-arrays (one float stream
+// per component) so four objects are tested per SSE step:
+// first their spheres, then their boxes for a tighter fit.
+// --------------------------------------------------------
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	// Sizes the bounds arrays (new objects start out empty)
+	void Resize(int count);
+	int GetCount() { return count; }
+
+	void SetBounds(int index, const BoundingSphere& sphere, const AABB& box);
+
+	// Fills "visible" with the indices of every object that
+	// intersects the frustum and returns how many there are
+	int Cull(const Frustum& frustum, std::vector<int>& visible);
+
+	// Culls against several views (main camera, light views,
+	// other cameras...) in one sweep over the bounds, writing
+	// one bitset per view.  Each block of four objects is loaded
+	// once and tested against every view while it's in registers.
+	// Optional candidate sets (one per view, null for "all")
+	// restrict each view to objects already known to be visible
+	// from it; blocks no view has a candidate in are skipped.
+	void CullViews(const Frustum* frusta, int viewCount, std::vector<VisibilityBits>& visibility, const VisibilityBits* const* candidates = nullptr);
+
+	CullingStats GetStats() { return stats; }
+	CullingStats GetViewStats(int view) { return viewStats[view]; }
+
+	// Frustum planes of a row-vector view * projection matrix
+	static Frustum ExtractFrustum(const DirectX::XMFLOAT4X4& viewProj);
+
+private:
+	int count;
+	int paddedCount;
+
+	// Sphere streams
+	std::vector<float> centerX, centerY, centerZ, radius;
+
+	// Box streams
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+
+	CullingStats stats;
+	std::vector<CullingStats> viewStats;
+
+	void CullViewGroup(const Frustum* frusta, int viewCount, VisibilityBits* visibility, CullingStats* groupStats, const VisibilityBits* const* candidates);
+};
@@ -1,9 +1,33 @@
 #include "Game.h"
 #include "Vertex.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
 
 // For the DirectX Math library
 using namespace DirectX;
 
+// Entity count at which culling switches from a linear
+// SIMD sweep to traversing the BVH
+static const int BVHCullingThreshold = 4096;
+
+// Number of leaves reinserted per frame to keep the BVH healthy
+static const int BVHRebalancePerFrame = 4;
+
+// Draw count at which recording is split across worker
+// threads (below it the deferred contexts cost more than
+// they save)
+static const int MinDeferredDrawCount = 512;
+
+// Precomputed visibility: where it's saved, how big each cell
+// is and how far past the scene's bounds the cells reach
+static const char* PVSFileName = "scene.pvs";
+static const float PVSCellSize = 2.0f;
+static const float PVSRegionMargin = 10.0f;
+
+// Point and spot lights when there's no "-lights N"
+static const int DefaultLocalLightCount = 256;
+
 // --------------------------------------------------------
 // Constructor
 //
@@ -18,12 +42,17 @@ Game::Game(HINSTANCE hInstance)
 		"DirectX Game",	   // Text for the window's title bar
 		1280,			   // Width of the window's client area
 		720,			   // Height of the window's client area
-		true)			   // Show extra stats (fps) in title bar?
+		true),			   // Show extra stats (fps) in title bar?
+	localLightBuffer(sizeof(LocalLight)),
+	clusterRangeBuffer(sizeof(ClusterRange)),
+	clusterIndexBuffer(sizeof(unsigned int))
 {
 	indexBuffer;
 	vertexBuffer;
 	vertexShader = 0;
 	pixelShader = 0;
+	instancedVertexShader = 0;
+	sphereFieldPixelShader = 0;
 
 	dLight1 = {};
 	dLight2 = {};
@@ -32,6 +61,11 @@ Game::Game(HINSTANCE hInstance)
 	entityCount = 4;
 
 	prevMousePos = { 0,0 };
+	pickedEntity = -1;
+	smallCulled = 0;
+	clusterMs = 0.0f;
+	softwareRendering = false;
+	softwareSaveKeyDown = false;
 
 	samplerStruct = {};
 
@@ -51,16 +85,15 @@ Game::Game(HINSTANCE hInstance)
 Game::~Game()
 {
 
-	// Delete our simple shader objects, which
-	// will clean up their own internal DirectX stuff
-	delete vertexShader;
-	delete pixelShader;
+	// Our simple shader objects belong to the shader cache,
+	// which cleans them (and their DirectX stuff) up itself
 
 	//Delete meshes
 	for (auto& m : meshes) delete m;
 
 	delete material1;
 	delete material2;
+	delete sphereFieldMaterial;
 
 	for (auto& e : entities) delete e;
 
@@ -70,6 +103,8 @@ Game::~Game()
 	wallTexture->Release();
 	cliffTexture->Release();
 	samplerState->Release();
+	transparentBlendState->Release();
+	transparentDepthState->Release();
 }
 
 // --------------------------------------------------------
@@ -78,6 +113,9 @@ Game::~Game()
 // --------------------------------------------------------
 void Game::Init()
 {
+	// Everything below makes its buffers through the render device
+	renderDevice.Init(device, context);
+
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
@@ -95,7 +133,60 @@ void Game::Init()
 	samplerStruct.MaxLOD = D3D11_FLOAT32_MAX;
 	device->CreateSamplerState(&samplerStruct, &samplerState);
 
+	D3D11_BLEND_DESC blendDesc = {};
+	blendDesc.RenderTarget[0].BlendEnable = true;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	device->CreateBlendState(&blendDesc, &transparentBlendState);
+
+	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
+	depthDesc.DepthEnable = true;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	device->CreateDepthStencilState(&depthDesc, &transparentDepthState);
+
 	CreateBasicGeometry();
+	CreateLocalLights();
+
+	//"-softwarerender" also draws each frame on the CPU (P saves it)
+	softwareRendering = strstr(GetCommandLineA(), "-softwarerender") != nullptr;
+	if (softwareRendering)
+	{
+		softwareRasterizer.Resize(width, height);
+		ReadBackTexture(cliffTexture, softwareTextures[ToHandle(cliffTexture)]);
+		ReadBackTexture(wallTexture, softwareTextures[ToHandle(wallTexture)]);
+	}
+
+	// Every draw binds through the state cache
+	stateCache.SetContext(renderDevice.GetContext());
+
+	//"-noinstancing" draws every entity on its own, to stress submission
+	sceneSubmitter.Init(&renderDevice);
+	sceneSubmitter.SetInstancing(strstr(GetCommandLineA(), "-noinstancing") == nullptr);
+	sceneSubmitter.SetTransparentStates(ToHandle(transparentBlendState), ToHandle(transparentDepthState));
+
+	// One deferred context per worker thread
+	deferredSubmitter.Init(device);
+	submitMs = 0.0f;
+	submitThreads = 1;
+
+	// Visibility is baked offline with "-bakepvs" and loaded
+	// on later runs (a file baked for a different scene is
+	// ignored, and everything is drawn as potentially visible)
+	if (strstr(GetCommandLineA(), "-bakepvs"))
+		BakePVS();
+	else
+	{
+		std::vector<AABB> bounds;
+		std::vector<bool> isStatic;
+		GetPVSEntities(bounds, isStatic);
+		pvs.Load(PVSFileName, bounds, isStatic);
+	}
 
 	// Tell the input assembler stage of the pipeline what kind of
 	// geometric primitives (points, lines or triangles) we want to draw.  
@@ -136,11 +227,53 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
-	vertexShader = new SimpleVertexShader(device, context);
-	vertexShader->LoadShaderFile(L"VertexShader.cso");
-
-	pixelShader = new SimplePixelShader(device, context);
-	pixelShader->LoadShaderFile(L"PixelShader.cso");
+	// Per-draw constants are appended to one big dynamic buffer
+	// where the device can bind constant buffers at an offset
+	constantRing.Init(&renderDevice);
+	shaderCache.Init(&renderDevice);
+	if (constantRing.IsSupported())
+		shaderCache.SetConstantBufferRing(&constantRing);
+
+	// Shaders are shared (loading one twice gives the same
+	// object) and their reflection is cached beside each .cso
+	vertexShader = shaderCache.LoadVertexShader(L"VertexShader.cso");
+	pixelShader = shaderCache.LoadPixelShader(L"PixelShader.cso");
+	instancedVertexShader = shaderCache.LoadVertexShader(L"VertexShaderInstanced.cso");
+
+	// Variants with only the features their materials need
+	// (compiled on the first run, loaded from disk after that).
+	// Falls back to the full shader if the source isn't there.
+	sphereFieldPixelShader = shaderCache.LoadPixelShaderVariant(L"PixelShader.hlsl",
+		ShaderFeature_Texture | ShaderFeature_DirectionalLights | ShaderFeature_Fade);
+	if (!sphereFieldPixelShader)
+		sphereFieldPixelShader = pixelShader;
+
+	ShaderCacheStats shaderStats = shaderCache.GetStats();
+	printf("Shaders: %d loaded, %d reflected, %d from cached reflection, %d variants compiled, %d from disk\n",
+		shaderStats.ShadersLoaded, shaderStats.Reflections, shaderStats.ReflectionsCached,
+		shaderStats.VariantsCompiled, shaderStats.VariantsCached);
+
+	// Checks the C++ constant structs against what the shaders
+	// actually compiled to (materials bind theirs as they're made)
+	static constexpr SimpleShaderName PerFrameName("perFrame");
+	vsFrameConstants = vertexShader->BindConstantBuffer<PerFrameVSConstants>(PerFrameName);
+	instancedFrameConstants = instancedVertexShader->BindConstantBuffer<PerFrameVSConstants>(PerFrameName);
+
+	// Each pixel shader keeps its own copy of the frame's data
+	SimplePixelShader* pixelShaders[] = { pixelShader, sphereFieldPixelShader };
+	for (SimplePixelShader* ps : pixelShaders)
+	{
+		bool loaded = false;
+		for (const FramePixelShader& frameShader : framePixelShaders)
+			loaded |= frameShader.Shader == ps;
+		if (loaded)
+			continue;
+
+		FramePixelShader frameShader;
+		frameShader.Shader = ps;
+		frameShader.Constants = ps->BindConstantBuffer<PerFramePSConstants>(PerFrameName);
+		framePixelShaders.push_back(frameShader);
+	}
 }
 
 
@@ -174,9 +307,9 @@ void Game::CreateBasicGeometry()
 	XMFLOAT4 blue = XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
 	XMFLOAT4 yellow = XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f);
 
-	meshes.push_back(new Mesh("cube.obj", device));
+	meshes.push_back(new Mesh("cube.obj", &renderDevice));
 
-	meshes.push_back(new Mesh("sphere.obj", device));
+	meshes.push_back(new Mesh("sphere.obj", &renderDevice));
 
 	Vertex starVertices[] =
 	{
@@ -193,12 +326,23 @@ void Game::CreateBasicGeometry()
 
 	int starIndices[] = { 0, 1, 2, 3, 4, 5, 6, 2, 5 };
 
-	meshes.push_back(new Mesh(starVertices, 7, (UINT*)starIndices, 9, device));
+	meshes.push_back(new Mesh(starVertices, 7, (UINT*)starIndices, 9, &renderDevice));
+
+	meshes.push_back(new Mesh("helix.obj", &renderDevice));
+
+	material1 = new Material(&renderDevice, pixelShader, vertexShader, ToHandle(cliffTexture), ToHandle(samplerState));
+	material2 = new Material(&renderDevice, pixelShader, vertexShader, ToHandle(wallTexture), ToHandle(samplerState));
 
-	meshes.push_back(new Mesh("helix.obj", device));
+	//The wall texture's detail is lost sooner, so let it go earlier
+	material2->SetContributionCulling(4.0f, 12.0f);
 
-	material1 = new Material(pixelShader, vertexShader, cliffTexture, samplerState);
-	material2 = new Material(pixelShader, vertexShader, wallTexture, samplerState);
+	//Both can be batched when several entities share a mesh
+	material1->SetInstancedVertexShader(instancedVertexShader);
+	material2->SetInstancedVertexShader(instancedVertexShader);
+
+	//Lots of small spheres, so no point or spot lights
+	sphereFieldMaterial = new Material(&renderDevice, sphereFieldPixelShader, vertexShader, ToHandle(cliffTexture), ToHandle(samplerState));
+	sphereFieldMaterial->SetInstancedVertexShader(instancedVertexShader);
 
 	//Assign meshes to entities
 	for (int i = 0; i < entityCount-1; i++)
@@ -213,6 +357,56 @@ void Game::CreateBasicGeometry()
 	entities[1]->SetPostion(DirectX::XMFLOAT3(-1.0f, -2.0f, 0.0f));
 	entities[2]->SetPostion(DirectX::XMFLOAT3(-2.0f, -1.0f, 0.0f));
 	entities[3]->SetPostion(DirectX::XMFLOAT3(3.0f, 0.0f, 0.0f));
+
+	//"-spheres N" adds a field of N static spheres, to stress instancing
+	const char* spheresArg = strstr(GetCommandLineA(), "-spheres ");
+	int sphereCount = spheresArg ? atoi(spheresArg + 9) : 0;
+	int sphereRow = (int)ceilf(sqrtf((float)sphereCount));
+	for (int i = 0; i < sphereCount; i++)
+	{
+		Entity* sphere = new Entity(meshes[1], sphereFieldMaterial);
+		sphere->SetPostion(XMFLOAT3((i % sphereRow - sphereRow * 0.5f) * 0.75f, -3.0f, 2.0f + (i / sphereRow) * 0.75f));
+		sphere->SetScale(XMFLOAT3(0.5f, 0.5f, 0.5f));
+		sphere->SetStatic(true);
+		entities.push_back(sphere);
+	}
+	entityCount += sphereCount;
+
+	//Set up entity motion
+	KinematicMotion spin;
+	spin.AngularVelocity = XMFLOAT3(0.0f, 0.0f, 0.3f);		//Rotate entity1
+	kinematics.AddBody(entities[0], spin);
+
+	KinematicMotion right;
+	right.Velocity = XMFLOAT3(0.2f, 0.0f, 0.0f);			//Move entity2 to the right
+	kinematics.AddBody(entities[1], right);
+
+	KinematicMotion diagonal;
+	diagonal.Velocity = XMFLOAT3(0.1f, 0.05f, 0.0f);		//Move entity3 diagonally up to the right
+	kinematics.AddBody(entities[2], diagonal);
+
+	KinematicMotion stretch;
+	stretch.ScaleRate = XMFLOAT3(0.0f, 0.1f, 0.0f);			//Scale entity4 vertically
+	kinematics.AddBody(entities[3], stretch);
+
+	//Every mesh can be raycast against
+	for (auto& m : meshes) m->BuildTriangleBVH();
+
+	//The cube is big and solid enough to hide things behind it
+	entities[0]->SetOccluder(true);
+
+	//One culling slot and one BVH leaf per entity
+	frustumCuller.Resize(entityCount);
+	for (int i = 0; i < entityCount; i++)
+	{
+		entities[i]->UpdateWorldMatrix();
+		entityProxies.push_back(sceneTree.CreateProxy(entities[i]->GetWorldBounds(), i));
+
+		XMFLOAT4X4 world = entities[i]->GetWorldMatrix();
+		XMStoreFloat4x4(&world, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+		sceneRaycaster.AddInstance(entities[i]->GetMesh()->GetTriangleBVH(), world, i);
+	}
+	sceneRaycaster.Commit();
 }
 
 
@@ -227,6 +421,9 @@ void Game::OnResize()
 
 	gameCamera->UpdateProjectionMatrix((float)width / height);
 	projectionMatrix = gameCamera->GetProjectionMatrix();
+
+	if (softwareRendering)
+		softwareRasterizer.Resize(width, height);
 }
 
 // --------------------------------------------------------
@@ -239,28 +436,209 @@ void Game::Update(float deltaTime, float totalTime)
 		Quit();
 
 	//Call the camera's update method
-	gameCamera->Update(deltaTime, totalTime);
+	CameraInput cameraInput;
+	cameraInput.Forward = (GetAsyncKeyState('W') & 0x8000) != 0;
+	cameraInput.Back = (GetAsyncKeyState('S') & 0x8000) != 0;
+	cameraInput.Left = (GetAsyncKeyState('A') & 0x8000) != 0;
+	cameraInput.Right = (GetAsyncKeyState('D') & 0x8000) != 0;
+	cameraInput.Up = (GetAsyncKeyState(VK_SPACE) & 0x8000) != 0;
+	cameraInput.Down = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0;
+	gameCamera->Update(deltaTime, totalTime, cameraInput);
+
+	//Integrate all moving entities in one pass and copy the results back
+	kinematics.Integrate(deltaTime);
+	kinematics.SyncEntities();
+
+	for (size_t i = 0; i < entityCount; i++)
+	{
+		AABB oldBounds = entities[i]->GetWorldBounds();
+		entities[i]->UpdateWorldMatrix();
 
-	//Rotate entity1
-	XMFLOAT3 e1CurrentRotation = entities[0]->GetRotation();
-	e1CurrentRotation.z += 0.3f * deltaTime;
-	entities[0]->SetRotation(e1CurrentRotation);
+		AABB newBounds = entities[i]->GetWorldBounds();
+		XMFLOAT3 displacement(newBounds.Min.x - oldBounds.Min.x, newBounds.Min.y - oldBounds.Min.y, newBounds.Min.z - oldBounds.Min.z);
 
-	//Move entity2 to the right
-	entities[1]->Move(0.2f * deltaTime, 0.0f, 0.0f);
+		BoundingSphere sphere = entities[i]->GetWorldSphere();
+		frustumCuller.SetBounds((int)i, sphere, newBounds);
+		sceneTree.MoveProxy(entityProxies[i], newBounds, displacement);
 
-	//Move enitity3 diagonally up to the right
-	entities[2]->Move(0.1f * deltaTime, 0.05f * deltaTime, 0.0f);
+		XMFLOAT4X4 world = entities[i]->GetWorldMatrix();
+		XMStoreFloat4x4(&world, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+		sceneRaycaster.SetTransform((int)i, world);
+	}
+	sceneTree.Rebalance(BVHRebalancePerFrame);
 
-	//Scale entity5 vertically
-	XMFLOAT3 e5CurrentScale = entities[3]->GetScale();
-	e5CurrentScale.y += 0.1f * deltaTime;
-	entities[3]->SetScale(e5CurrentScale);
+	// Refits the raycast tree if anything moved, otherwise free
+	sceneRaycaster.Commit();
 
-	for (size_t i = 0; i < entityCount; i++)
+	UpdateLightView();
+	UpdateLocalLights(totalTime);
+}
+
+// --------------------------------------------------------
+// Scatters point and spot lights on circles around the
+// scene.  "-lights N" sets how many.
+// --------------------------------------------------------
+void Game::CreateLocalLights()
+{
+	const char* lightsArg = strstr(GetCommandLineA(), "-lights ");
+	int lightCount = lightsArg ? atoi(lightsArg + 8) : DefaultLocalLightCount;
+
+	std::mt19937 rng(13579);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	localLights.resize(lightCount);
+	lightOrbits.resize(lightCount);
+	for (int i = 0; i < lightCount; i++)
 	{
-		entities[i]->UpdateWorldMatrix();
+		LightOrbit& orbit = lightOrbits[i];
+		orbit.Radius = 1.0f + unit(rng) * 20.0f;
+		orbit.Height = -2.5f + unit(rng) * 5.0f;
+		orbit.Speed = (unit(rng) - 0.5f) * 1.5f;
+		orbit.Phase = unit(rng) * XM_2PI;
+
+		LocalLight& light = localLights[i];
+		light = {};
+		light.Range = 0.75f + unit(rng) * 1.5f;
+		light.Color = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+
+		// Every fourth light is a spot pointing down
+		if (i % 4 == 3)
+		{
+			light.Type = (unsigned int)LocalLightType::Spot;
+			light.Range *= 2.0f;
+			light.Direction = XMFLOAT3(0.0f, -1.0f, 0.0f);
+			light.CosOuterAngle = cosf(0.6f);
+			light.CosInnerAngle = cosf(0.4f);
+		}
+		else
+			light.Type = (unsigned int)LocalLightType::Point;
+	}
+}
+
+void Game::UpdateLocalLights(float totalTime)
+{
+	for (size_t i = 0; i < localLights.size(); i++)
+	{
+		const LightOrbit& orbit = lightOrbits[i];
+		float angle = orbit.Phase + orbit.Speed * totalTime;
+		localLights[i].Position = XMFLOAT3(cosf(angle) * orbit.Radius, orbit.Height, 5.0f + sinf(angle) * orbit.Radius);
+	}
+}
+
+// --------------------------------------------------------
+// Bins this frame's lights into clusters for the camera and
+// uploads the lights, cluster ranges and index list
+// --------------------------------------------------------
+void Game::BuildLightClusters()
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	// Camera matrices are transposed for HLSL (the projection's
+	// scales are on the diagonal, so they're the same either way)
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixTranspose(XMLoadFloat4x4(&viewMatrix)));
+	clusterBuilder.SetProjection(projectionMatrix._11, projectionMatrix._22, gameCamera->GetNearPlane(), gameCamera->GetFarPlane());
+	clusterBuilder.Build(localLights.empty() ? nullptr : &localLights[0], (int)localLights.size(), view);
+
+	const std::vector<ClusterRange>& clusters = clusterBuilder.GetClusters();
+	const std::vector<unsigned int>& indices = clusterBuilder.GetLightIndices();
+	localLightBuffer.Update(&renderDevice, localLights.empty() ? nullptr : &localLights[0], (int)localLights.size());
+	clusterRangeBuffer.Update(&renderDevice, &clusters[0], (int)clusters.size());
+	clusterIndexBuffer.Update(&renderDevice, indices.empty() ? nullptr : &indices[0], (int)indices.size());
+
+	clusterMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Game::BindLightClusters(StateCache& cache)
+{
+	cache.SetPSShaderResource(1, localLightBuffer.GetShaderResourceView());
+	cache.SetPSShaderResource(2, clusterRangeBuffer.GetShaderResourceView());
+	cache.SetPSShaderResource(3, clusterIndexBuffer.GetShaderResourceView());
+}
+
+// --------------------------------------------------------
+// What the PVS is baked from (and checked against on load):
+// every entity's starting bounds and whether it's static
+// --------------------------------------------------------
+void Game::GetPVSEntities(std::vector<AABB>& bounds, std::vector<bool>& isStatic)
+{
+	bounds.resize(entityCount);
+	isStatic.resize(entityCount);
+	for (int i = 0; i < entityCount; i++)
+	{
+		bounds[i] = entities[i]->GetWorldBounds();
+		isStatic[i] = entities[i]->IsStatic();
+	}
+}
+
+// --------------------------------------------------------
+// Bakes and saves which static entities can be seen from
+// each cell of the space around the scene
+// --------------------------------------------------------
+void Game::BakePVS()
+{
+	std::vector<AABB> bounds;
+	std::vector<bool> isStatic;
+	GetPVSEntities(bounds, isStatic);
+
+	// Only static entities hide anything: moving ones won't
+	// be where they were when the bake ran
+	SceneRaycaster occluders;
+	AABB region = bounds[0];
+	for (int i = 0; i < entityCount; i++)
+	{
+		if (isStatic[i])
+		{
+			XMFLOAT4X4 world = entities[i]->GetWorldMatrix();
+			XMStoreFloat4x4(&world, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+			occluders.AddInstance(entities[i]->GetMesh()->GetTriangleBVH(), world, i);
+		}
+
+		region.Min = XMFLOAT3((std::min)(region.Min.x, bounds[i].Min.x), (std::min)(region.Min.y, bounds[i].Min.y), (std::min)(region.Min.z, bounds[i].Min.z));
+		region.Max = XMFLOAT3((std::max)(region.Max.x, bounds[i].Max.x), (std::max)(region.Max.y, bounds[i].Max.y), (std::max)(region.Max.z, bounds[i].Max.z));
+	}
+	region.Min = XMFLOAT3(region.Min.x - PVSRegionMargin, region.Min.y - PVSRegionMargin, region.Min.z - PVSRegionMargin);
+	region.Max = XMFLOAT3(region.Max.x + PVSRegionMargin, region.Max.y + PVSRegionMargin, region.Max.z + PVSRegionMargin);
+
+	occluders.Commit();
+
+	pvs.Bake(region, PVSCellSize, occluders, bounds, isStatic);
+	printf("PVS: %d cells, %d unique sets, %d bytes\n", pvs.GetCellCount(), pvs.GetUniqueSetCount(), pvs.GetCompressedBytes());
+
+	// Still used for this run, later ones just draw without it
+	if (!pvs.Save(PVSFileName))
+		printf("PVS: couldn't write %s\n", PVSFileName);
+}
+
+// --------------------------------------------------------
+// Fits an orthographic view down the main light's direction
+// around every entity, so shadow casters can be culled
+// --------------------------------------------------------
+void Game::UpdateLightView()
+{
+	// Box around the whole scene
+	AABB sceneBounds = entities[0]->GetWorldBounds();
+	for (size_t i = 1; i < entityCount; i++)
+	{
+		AABB box = entities[i]->GetWorldBounds();
+		sceneBounds.Min = XMFLOAT3((std::min)(sceneBounds.Min.x, box.Min.x), (std::min)(sceneBounds.Min.y, box.Min.y), (std::min)(sceneBounds.Min.z, box.Min.z));
+		sceneBounds.Max = XMFLOAT3((std::max)(sceneBounds.Max.x, box.Max.x), (std::max)(sceneBounds.Max.y, box.Max.y), (std::max)(sceneBounds.Max.z, box.Max.z));
 	}
+	XMVECTOR center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&sceneBounds.Min), XMLoadFloat3(&sceneBounds.Max)), 0.5f);
+	float radius = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&sceneBounds.Max), center)));
+
+	// Back away from the scene along the light direction
+	XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&dLight1.Direction));
+	XMVECTOR up = fabsf(dLight1.Direction.x) + fabsf(dLight1.Direction.z) < 0.001f ?
+		XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) :
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMVECTOR eye = XMVectorSubtract(center, XMVectorScale(direction, radius * 2.0f));
+
+	XMMATRIX lightView = XMMatrixLookToLH(eye, direction, up);
+	XMMATRIX lightProj = XMMatrixOrthographicLH(radius * 2.0f, radius * 2.0f, 0.01f, radius * 4.0f);
+
+	XMFLOAT4X4 lightViewProj;
+	XMStoreFloat4x4(&lightViewProj, XMMatrixMultiply(lightView, lightProj));
+	lightFrustum = FrustumCuller::ExtractFrustum(lightViewProj);
 }
 
 // --------------------------------------------------------
@@ -281,6 +659,10 @@ void Game::Draw(float deltaTime, float totalTime)
 		1.0f,
 		0);
 
+	// Grows the constant ring if last frame's data didn't fit
+	constantRing.BeginFrame();
+	ISimpleShader::ResetUploadStats();
+
 	//Get camera matrices
 	viewMatrix = gameCamera->GetViewMatrix();
 	projectionMatrix = gameCamera->GetProjectionMatrix();
@@ -291,47 +673,103 @@ void Game::Draw(float deltaTime, float totalTime)
 	//    and then copying that entire buffer to the GPU.  
 	//  - The "SimpleShader" class handles all of that for you.
 
-	for (size_t i = 0; i < entityCount; i++)
+	// Static entities the camera's cell can never see are out
+	// before anything else (null outside the baked region)
+	const VisibilityBits* potentiallyVisible = pvs.IsReady() ? pvs.GetVisibleSet(gameCamera->GetPosition()) : nullptr;
+
+	// Only draw what the camera can actually see
+	// (and what the main light can see, for shadow casters)
+	if (entityCount >= BVHCullingThreshold)
+	{
+		sceneTree.QueryFrustum(gameCamera->GetFrustum(), visibleEntities);
+		cullingStats = sceneTree.GetStats();
+		sceneTree.QueryFrustum(lightFrustum, shadowCasters);
+
+		if (potentiallyVisible)
+		{
+			size_t kept = 0;
+			for (size_t i = 0; i < visibleEntities.size(); i++)
+			{
+				if (potentiallyVisible->IsVisible(visibleEntities[i]))
+					visibleEntities[kept++] = visibleEntities[i];
+			}
+			visibleEntities.resize(kept);
+		}
+	}
+	else
+	{
+		// Both views in one sweep over the bounds (the light sees
+		// from outside the cells, so it gets no candidate set)
+		Frustum views[] = { gameCamera->GetFrustum(), lightFrustum };
+		const VisibilityBits* candidates[] = { potentiallyVisible, nullptr };
+		frustumCuller.CullViews(views, 2, viewVisibility, candidates);
+		cullingStats = frustumCuller.GetViewStats(0);
+
+		visibleEntities.clear();
+		viewVisibility[0].GetIndices(visibleEntities);
+		shadowCasters.clear();
+		viewVisibility[1].GetIndices(shadowCasters);
+	}
+
+	// Then anything too small to matter, and anything
+	// hidden behind the occluders
+	CullSmallEntities();
+	CullOccluded();
+
+	// Queue, sort and group everything that survived
+	sceneSubmitter.Prepare(entities, entityFade, visibleEntities, gameCamera);
+
+	// Camera and lights are the same for every draw, so they
+	// go up once here instead of with each object
+	BuildLightClusters();
+	UploadFrameConstants();
+
+	// Nothing is known to be bound at the start of a frame
+	stateCache.Invalidate();
+	stateCache.ResetStats();
+	BindLightClusters(stateCache);
+
+	// Big frames are recorded across the worker threads, each
+	// into its own deferred context, and played back in order
+	std::chrono::high_resolution_clock::time_point submitStart = std::chrono::high_resolution_clock::now();
+	submitThreads = 1;
+	if (deferredSubmitter.GetWorkerCount() > 1 && sceneSubmitter.GetDrawCount() >= MinDeferredDrawCount)
+	{
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (float)width;
+		viewport.Height = (float)height;
+		viewport.MaxDepth = 1.0f;
+
+		deferredSubmitter.Record(sceneSubmitter.GetGroupCount(), sceneSubmitter.GetGroupCosts(), [&](SubmitWorker& worker, int first, int end)
+		{
+			// Deferred contexts start from default state
+			ID3D11DeviceContext* deferred = worker.GetContext();
+			deferred->OMSetRenderTargets(1, &backBufferRTV, depthStencilView);
+			deferred->RSSetViewports(1, &viewport);
+			deferred->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			BindLightClusters(worker.GetStateCache());
+
+			sceneSubmitter.Record(first, end, worker.GetStateCache(), &worker);
+		});
+		deferredSubmitter.Execute(context);
+		bindStats = deferredSubmitter.GetStats();
+		submitThreads = deferredSubmitter.GetWorkerCount();
+
+		// Playback leaves the immediate context cleared to defaults
+		stateCache.Invalidate();
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context->RSSetViewports(1, &viewport);
+	}
+	else
 	{
-		Entity* currentEntity = entities[i];
-		ID3D11Buffer* vertexBuffer = currentEntity->GetMesh()->GetVertexBuffer();
-		ID3D11Buffer* indexBuffer = currentEntity->GetMesh()->GetIndexBuffer();
-
-		// Set buffers in the input assembler
-		//  - Do this ONCE PER OBJECT you're drawing, since each object might
-		//    have different geometry.
-		UINT stride = sizeof(Vertex);
-		UINT offset = 0;
-		context->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-		context->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-		currentEntity->PrepareMaterial(viewMatrix, projectionMatrix);
-		vertexShader = currentEntity->GetMaterial()->GetVertexShader();
-		pixelShader = currentEntity->GetMaterial()->GetPixelShader();
-
-		pixelShader->SetShaderResourceView("diffuseTexture", currentEntity->GetMaterial()->GetResourceView());
-		pixelShader->SetSamplerState("basicSampler", samplerState);
-
-		pixelShader->SetData(
-			"light1",
-			&dLight1,
-			sizeof(dLight1));
-
-		pixelShader->SetData(
-			"light2",
-			&dLight2,
-			sizeof(dLight2));
-
-		// Finally do the actual drawing
-		//  - Do this ONCE PER OBJECT you intend to draw
-		//  - This will use all of the currently set DirectX "stuff" (shaders, buffers, etc)
-		//  - DrawIndexed() uses the currently set INDEX BUFFER to look up corresponding
-		//     vertices in the currently set VERTEX BUFFER
-		context->DrawIndexed(
-			currentEntity->GetMesh()->GetIndexCount(),     // The number of indices to use (we could draw a subset if we wanted)
-			0,     // Offset to the first index we want to use
-			0);    // Offset to add to each index when looking up vertices
+		sceneSubmitter.Record(0, sceneSubmitter.GetGroupCount(), stateCache, nullptr);
+		bindStats = stateCache.GetStats();
 	}
+	submitMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - submitStart).count();
+	uploadStats = ISimpleShader::GetUploadStats();
+
+	if (softwareRendering)
+		RenderSoftwareFrame(color);
 
 	// Present the back buffer to the user
 	//  - Puts the final frame we're drawing into the window so the user can see it
@@ -344,6 +782,280 @@ void Game::Draw(float deltaTime, float totalTime)
 }
 
 
+// --------------------------------------------------------
+// Sets and uploads the constant buffers that only change
+// once a frame (the camera and the lights).  Deferred
+// workers start their own copies from this data too.
+// --------------------------------------------------------
+void Game::UploadFrameConstants()
+{
+	PerFrameVSConstants vsConstants = {};
+	vsConstants.view = viewMatrix;
+	vsConstants.projection = projectionMatrix;
+
+	vertexShader->SetBufferData(vsFrameConstants, vsConstants);
+	vertexShader->CopyBufferData(vsFrameConstants.Buffer);
+	instancedVertexShader->SetBufferData(instancedFrameConstants, vsConstants);
+	instancedVertexShader->CopyBufferData(instancedFrameConstants.Buffer);
+
+	PerFramePSConstants psConstants = {};
+	psConstants.light1 = dLight1;
+	psConstants.light2 = dLight2;
+
+	// Pixels to tiles, and view depth to slices
+	psConstants.clusterParams = XMFLOAT4(
+		(float)ClusterBuilder::TilesX / width,
+		(float)ClusterBuilder::TilesY / height,
+		clusterBuilder.GetSliceScale(),
+		clusterBuilder.GetSliceBias());
+	psConstants.clusterDims[0] = ClusterBuilder::TilesX;
+	psConstants.clusterDims[1] = ClusterBuilder::TilesY;
+	psConstants.clusterDims[2] = ClusterBuilder::Slices;
+	for (FramePixelShader& frameShader : framePixelShaders)
+	{
+		frameShader.Shader->SetBufferData(frameShader.Constants, psConstants);
+		frameShader.Shader->CopyBufferData(frameShader.Constants.Buffer);
+	}
+}
+
+// --------------------------------------------------------
+// Drops visible entities that cover too few pixels for
+// their material, and works out how faded the rest are
+// --------------------------------------------------------
+void Game::CullSmallEntities()
+{
+	contributionCuller.SetView(
+		gameCamera->GetPosition(),
+		gameCamera->GetFieldOfView(),
+		gameCamera->GetAspectRatio(),
+		width,
+		height);
+
+	entityFade.resize(entityCount);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < visibleEntities.size(); i++)
+	{
+		int index = visibleEntities[i];
+		Material* material = entities[index]->GetMaterial();
+
+		float screenSize = contributionCuller.GetScreenSize(entities[index]->GetWorldSphere());
+		float fade = ContributionCuller::GetFade(screenSize, material->GetMinScreenSize(), material->GetFadeBand());
+		entityFade[index] = fade;
+
+		if (fade > 0.0f)
+			visibleEntities[kept++] = index;
+	}
+
+	smallCulled = (int)(visibleEntities.size() - kept);
+	visibleEntities.resize(kept);
+}
+
+// --------------------------------------------------------
+// Rasterizes the visible occluders into the CPU depth buffer
+// and removes every visible entity that ends up behind them
+// --------------------------------------------------------
+void Game::CullOccluded()
+{
+	// Our matrices are transposed for HLSL, the culler wants them as-is
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&viewMatrix)),
+		XMMatrixTranspose(XMLoadFloat4x4(&projectionMatrix))));
+
+	occlusionCuller.BeginFrame(viewProj);
+	occludeeBounds.clear();
+
+	bool anyOccluders = false;
+	for (int index : visibleEntities)
+	{
+		Entity* entity = entities[index];
+		if (entity->IsOccluder())
+		{
+			XMFLOAT4X4 world = entity->GetWorldMatrix();
+			XMStoreFloat4x4(&world, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+			occlusionCuller.AddOccluder(entity->GetMesh()->GetPositions(), entity->GetMesh()->GetIndices(), world);
+			anyOccluders = true;
+		}
+		occludeeBounds.push_back(entity->GetWorldBounds());
+	}
+
+	if (!anyOccluders)
+	{
+		occlusionStats = OcclusionStats();
+		return;
+	}
+
+	occlusionCuller.Rasterize();
+	occlusionCuller.TestOccludees(occludeeBounds, occludeeVisible);
+	occlusionStats = occlusionCuller.GetStats();
+
+	// Compact the visible list (occluders always stay, or
+	// they'd end up hiding behind themselves)
+	size_t kept = 0;
+	for (size_t i = 0; i < visibleEntities.size(); i++)
+	{
+		int index = visibleEntities[i];
+		if (occludeeVisible[i] || entities[index]->IsOccluder())
+			visibleEntities[kept++] = index;
+	}
+	visibleEntities.resize(kept);
+}
+
+// --------------------------------------------------------
+// Returns the index of the entity under the given pixel,
+// or -1 if the click hit nothing
+// --------------------------------------------------------
+int Game::PickEntity(int x, int y)
+{
+	// Undo the view and projection to get the pixel's
+	// points on the near and far planes
+	XMFLOAT4X4 view = gameCamera->GetViewMatrix();
+	XMFLOAT4X4 proj = gameCamera->GetProjectionMatrix();
+	XMMATRIX viewProj = XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&view)),
+		XMMatrixTranspose(XMLoadFloat4x4(&proj)));
+	XMMATRIX inverseViewProj = XMMatrixInverse(nullptr, viewProj);
+
+	float ndcX = 2.0f * x / width - 1.0f;
+	float ndcY = 1.0f - 2.0f * y / height;
+	XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), inverseViewProj);
+	XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverseViewProj);
+	XMVECTOR toFar = XMVectorSubtract(farPoint, nearPoint);
+
+	Ray ray;
+	XMStoreFloat3(&ray.Origin, nearPoint);
+	XMStoreFloat3(&ray.Direction, XMVector3Normalize(toFar));
+	ray.MaxDistance = XMVectorGetX(XMVector3Length(toFar));
+
+	RayHit hit;
+	return sceneRaycaster.Raycast(ray, hit) ? hit.Instance : -1;
+}
+
+// --------------------------------------------------------
+// Copies the top mip of an RGBA8 or BGRA8 texture into a
+// CPU texture for the software rasterizer, which builds its
+// own mip chain from it.  Anything else is left empty (and
+// drawn untextured).
+// --------------------------------------------------------
+void Game::ReadBackTexture(ID3D11ShaderResourceView* view, CpuTexture& texture)
+{
+	if (!view)
+		return;
+
+	ID3D11Resource* resource = nullptr;
+	view->GetResource(&resource);
+	ID3D11Texture2D* source = nullptr;
+	HRESULT result = resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&source);
+	resource->Release();
+	if (FAILED(result))
+		return;
+
+	D3D11_TEXTURE2D_DESC desc;
+	source->GetDesc(&desc);
+	bool bgra = desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM || desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+	bool rgba = desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM || desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+	if (!bgra && !rgba)
+	{
+		source->Release();
+		return;
+	}
+
+	// Just the top mip, somewhere the CPU can read it
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+
+	ID3D11Texture2D* staging = nullptr;
+	if (SUCCEEDED(device->CreateTexture2D(&stagingDesc, nullptr, &staging)))
+	{
+		context->CopySubresourceRegion(staging, 0, 0, 0, 0, source, 0, nullptr);
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (SUCCEEDED(context->Map(staging, 0, D3D11_MAP_READ, 0, &mapped)))
+		{
+			std::vector<unsigned int> rgba(desc.Width * desc.Height);
+			for (UINT y = 0; y < desc.Height; y++)
+			{
+				const unsigned int* row = (const unsigned int*)((const char*)mapped.pData + y * mapped.RowPitch);
+				unsigned int* texels = &rgba[y * desc.Width];
+				for (UINT x = 0; x < desc.Width; x++)
+					texels[x] = bgra ? (row[x] & 0xFF00FF00) | ((row[x] >> 16) & 0xFF) | ((row[x] & 0xFF) << 16) : row[x];
+			}
+			context->Unmap(staging, 0);
+			texture.Create(desc.Width, desc.Height, &rgba[0]);
+		}
+		staging->Release();
+	}
+	source->Release();
+}
+
+// --------------------------------------------------------
+// Draws this frame's visible entities again on the CPU.
+// Everything is drawn opaque, with its contribution fade.
+// --------------------------------------------------------
+void Game::RenderSoftwareFrame(const float clearColor[4])
+{
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&viewMatrix)),
+		XMMatrixTranspose(XMLoadFloat4x4(&projectionMatrix))));
+
+	softwareRasterizer.BeginFrame(viewProj, dLight1, dLight2, XMFLOAT4(clearColor[0], clearColor[1], clearColor[2], clearColor[3]));
+	for (int index : visibleEntities)
+	{
+		Entity* entity = entities[index];
+		Material* material = entity->GetMaterial();
+		Mesh* mesh = entity->GetMesh();
+
+		XMFLOAT4X4 world = entity->GetWorldMatrix();
+		XMStoreFloat4x4(&world, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+
+		auto texture = softwareTextures.find(material->GetResourceView());
+		softwareRasterizer.AddDraw(mesh->GetVertices(), mesh->GetIndices(), world,
+			texture != softwareTextures.end() ? &texture->second : nullptr,
+			material->GetColorTint(), entityFade[index]);
+	}
+	softwareRasterizer.Render();
+	softwareStats = softwareRasterizer.GetStats();
+
+	// P saves what the CPU drew
+	bool saveKey = (GetAsyncKeyState('P') & 0x8000) != 0;
+	if (saveKey && !softwareSaveKeyDown)
+		softwareRasterizer.SaveBitmap("SoftwareFrame.bmp");
+	softwareSaveKeyDown = saveKey;
+}
+
+// --------------------------------------------------------
+// Appends culling results to the title bar stats
+// --------------------------------------------------------
+std::string Game::GetTitleBarStats()
+{
+	return
+		"    Visible: " + std::to_string(cullingStats.Visible) +
+		"    Culled: " + std::to_string(cullingStats.Culled) +
+		"    Too small: " + std::to_string(smallCulled) +
+		"    Occluded: " + std::to_string(occlusionStats.Culled) +
+		"    Occlusion: " + std::to_string(occlusionStats.RasterizeMs + occlusionStats.TestMs) + "ms" +
+		"    Shadow casters: " + std::to_string(shadowCasters.size()) +
+		"    Picked: " + std::to_string(pickedEntity) +
+		"    Binds: " + std::to_string(bindStats.Issued) + "/" + std::to_string(bindStats.Requested) +
+		"    Draws: " + std::to_string(bindStats.Draws) +
+		"    Lights: " + std::to_string(clusterBuilder.GetStats().LightsInView) + "/" + std::to_string(localLights.size()) +
+		" (" + std::to_string(clusterMs) + "ms to cluster)" +
+		"    Submit: " + std::to_string(submitMs) + "ms on " + std::to_string(submitThreads) + " thread(s)" +
+		"    CB uploads: " + std::to_string(uploadStats.Uploads) + " (" + std::to_string(uploadStats.BytesUploaded) + "B)" +
+		"    skipped: " + std::to_string(uploadStats.UploadsSkipped) + " (" + std::to_string(uploadStats.BytesSaved) + "B)" +
+		(softwareRendering ?
+			"    CPU render: " + std::to_string(softwareStats.TotalMs) + "ms (" + std::to_string(1000.0f / (std::max)(softwareStats.TotalMs, 0.001f)) + " fps)" :
+			std::string());
+}
+
+
 #pragma region Mouse Input
 
 // --------------------------------------------------------
@@ -354,6 +1066,7 @@ void Game::Draw(float deltaTime, float totalTime)
 void Game::OnMouseDown(WPARAM buttonState, int x, int y)
 {
 	// Add any custom code here...
+	pickedEntity = PickEntity(x, y);
 
 	// Save the previous mouse position, so we have it for the future
 	prevMousePos.x = x;
@@ -7,6 +7,24 @@
 #include "Camera.h"
 #include "Material.h"
 #include "Light.h"
+#include "ShaderConstants.h"
+#include "ShaderCache.h"
+#include "KinematicSystem.h"
+#include "FrustumCuller.h"
+#include "DynamicBVH.h"
+#include "OcclusionCuller.h"
+#include "SceneRaycaster.h"
+#include "ContributionCuller.h"
+#include "PotentiallyVisibleSet.h"
+#include "RenderQueue.h"
+#include "StateCache.h"
+#include "D3D11RenderDevice.h"
+#include "DeferredSubmitter.h"
+#include "SceneSubmitter.h"
+#include "ClusterBuilder.h"
+#include "StructuredBuffer.h"
+#include "SoftwareRasterizer.h"
+#include <unordered_map>
 #include <DirectXMath.h>
 #include <WICTextureLoader.h>
 
@@ -30,12 +48,28 @@ public:
 	void OnMouseUp	 (WPARAM buttonState, int x, int y);
 	void OnMouseMove (WPARAM buttonState, int x, int y);
 	void OnMouseWheel(float wheelDelta,   int x, int y);
+
+	// Extra debug info for the title bar
+	std::string GetTitleBarStats();
 private:
 
 	// Initialization helper methods - feel free to customize, combine, etc.
 	void LoadShaders(); 
 	void CreateMatrices();
 	void CreateBasicGeometry();
+	void UpdateLightView();
+	void CreateLocalLights();
+	void UpdateLocalLights(float totalTime);
+	void BuildLightClusters();
+	void BindLightClusters(StateCache& cache);
+	void GetPVSEntities(std::vector<AABB>& bounds, std::vector<bool>& isStatic);
+	void BakePVS();
+	void UploadFrameConstants();
+	void CullSmallEntities();
+	void CullOccluded();
+	int PickEntity(int x, int y);
+	void ReadBackTexture(ID3D11ShaderResourceView* view, CpuTexture& texture);
+	void RenderSoftwareFrame(const float clearColor[4]);
 
 	// Buffers to hold actual geometry data
 	ID3D11Buffer* vertexBuffer = 0;
@@ -44,6 +78,30 @@ private:
 	// Wrappers for DirectX shaders to provide simplified functionality
 	SimpleVertexShader* vertexShader;
 	SimplePixelShader* pixelShader;
+	SimpleVertexShader* instancedVertexShader;
+
+	// Cheaper variant of pixelShader (no point or spot lights)
+	// for the "-spheres" field
+	SimplePixelShader* sphereFieldPixelShader;
+
+	// The shaders' per-frame cbuffers, bound to their C++ structs
+	TypedConstantBuffer<PerFrameVSConstants> vsFrameConstants;
+	TypedConstantBuffer<PerFrameVSConstants> instancedFrameConstants;
+
+	// Every pixel shader variant using the frame's constants
+	struct FramePixelShader
+	{
+		SimplePixelShader* Shader;
+		TypedConstantBuffer<PerFramePSConstants> Constants;
+	};
+	std::vector<FramePixelShader> framePixelShaders;
+
+	// Owns the shaders above
+	ShaderCache shaderCache;
+
+	// Where the shaders' per-draw constants go, if supported
+	ConstantBufferRing constantRing;
+	ConstantUploadStats uploadStats;
 
 	// The matrices to go from model space to screen space
 	DirectX::XMFLOAT4X4 worldMatrix;
@@ -59,18 +117,101 @@ private:
 
 	Material* material1 = nullptr;
 	Material* material2 = nullptr;
+	Material* sphereFieldMaterial = nullptr;
 
 	std::vector<Entity*> entities;
 	int entityCount;
 
+	// Velocity, angular velocity and scale rate for moving entities
+	KinematicSystem kinematics;
+
+	// SIMD view-frustum culling of entity bounds
+	FrustumCuller frustumCuller;
+	std::vector<int> visibleEntities;
+
+	// Main light's view, culled in the same sweep as the camera
+	Frustum lightFrustum;
+	std::vector<VisibilityBits> viewVisibility;
+	std::vector<int> shadowCasters;
+	CullingStats cullingStats;
+
+	// Hierarchy over entity bounds, used for culling once
+	// there are too many entities for a linear sweep
+	DynamicBVH sceneTree;
+	std::vector<int> entityProxies;
+
+	// Ray queries against entity triangles (picking, line of sight)
+	SceneRaycaster sceneRaycaster;
+	int pickedEntity;
+
+	// Baked visibility of static entities from each cell of the
+	// scene, checked before any other culling
+	PotentiallyVisibleSet pvs;
+
+	// Screen size culling, with each entity's fade for this frame
+	ContributionCuller contributionCuller;
+	std::vector<float> entityFade;
+	int smallCulled;
+
+	// Software depth buffer occlusion culling
+	OcclusionCuller occlusionCuller;
+	std::vector<AABB> occludeeBounds;
+	std::vector<char> occludeeVisible;
+	OcclusionStats occlusionStats;
+
+	// Meshes, materials and draws make buffers and bind through
+	// this (and the cache in front of it drops binds that
+	// wouldn't change anything)
+	D3D11RenderDevice renderDevice;
+	StateCache stateCache;
+	BindStats bindStats;
+
+	// Visible draws, sorted and grouped to keep state changes
+	// down, then bound and drawn
+	SceneSubmitter sceneSubmitter;
+
+	// Records draw groups on the worker threads at high draw counts
+	DeferredSubmitter deferredSubmitter;
+	float submitMs;
+	int submitThreads;
+
 	Camera* gameCamera = nullptr;
 
 	DirectionalLight dLight1;
 	DirectionalLight dLight2;
 
+	// Point and spot lights circling the scene, binned into
+	// view space clusters every frame for the pixel shader
+	struct LightOrbit
+	{
+		float Radius;
+		float Height;
+		float Speed;	// Radians per second
+		float Phase;
+	};
+	std::vector<LocalLight> localLights;
+	std::vector<LightOrbit> lightOrbits;
+	ClusterBuilder clusterBuilder;
+	StructuredBuffer localLightBuffer;
+	StructuredBuffer clusterRangeBuffer;
+	StructuredBuffer clusterIndexBuffer;
+	float clusterMs;
+
+	// "-softwarerender" draws every frame on the CPU as well,
+	// with CPU copies of the materials' textures
+	bool softwareRendering;
+	SoftwareRasterizer softwareRasterizer;
+	std::unordered_map<RenderShaderResource*, CpuTexture> softwareTextures;
+	SoftwareRasterStats softwareStats;
+	bool softwareSaveKeyDown;
+
 	ID3D11ShaderResourceView* cliffTexture = nullptr;
 	ID3D11ShaderResourceView* wallTexture = nullptr;
 
 	ID3D11SamplerState* samplerState = 0;
 	D3D11_SAMPLER_DESC samplerStruct;
+
+	// Alpha blending without depth writes for the transparent pass
+	ID3D11BlendState* transparentBlendState = nullptr;
+	ID3D11DepthStencilState* transparentDepthState = nullptr;
 };
\ No newline at end of file
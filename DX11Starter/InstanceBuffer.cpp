@@ -0,0 +1,52 @@
+#include "InstanceBuffer.h"
+#include <string.h>
+
+// Smallest buffer worth creating
+static const int MinInstanceCapacity = 256;
+
+InstanceBuffer::InstanceBuffer()
+{
+	device = nullptr;
+	buffer = nullptr;
+	capacity = 0;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	if (buffer) device->ReleaseBuffer(buffer);
+}
+
+void InstanceBuffer::Update(IRenderDevice* device, const InstanceData* instances, int count)
+{
+	if (count == 0)
+		return;
+
+	if (count > capacity)
+	{
+		if (buffer) this->device->ReleaseBuffer(buffer);
+		this->device = device;
+
+		capacity = capacity < MinInstanceCapacity ? MinInstanceCapacity : capacity;
+		while (capacity < count)
+			capacity *= 2;
+
+		RenderBufferDesc desc;
+		desc.Usage = RenderUsage::Dynamic;
+		desc.ByteWidth = capacity * sizeof(InstanceData);
+		desc.BindFlags = RenderBindVertexBuffer;
+		buffer = device->CreateBuffer(desc, nullptr);
+		if (!buffer)
+		{
+			capacity = 0;
+			return;
+		}
+	}
+
+	// Discard whatever the GPU still has, instead of waiting for it
+	void* mapped = device->Map(buffer, RenderMapMode::WriteDiscard);
+	if (mapped)
+	{
+		memcpy(mapped, instances, count * sizeof(InstanceData));
+		device->Unmap(buffer);
+	}
+}
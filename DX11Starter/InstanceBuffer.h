@@ -0,0 +1,39 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include "RenderDevice.h"
+
+// --------------------------------------------------------
+// Per-instance vertex data read by VertexShaderInstanced.
+// World is the row-vector matrix (NOT transposed) since the
+// shader rebuilds it from four rows.
+// --------------------------------------------------------
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World;
+	float Fade;
+};
+
+// --------------------------------------------------------
+// Dynamic vertex buffer holding every instance drawn in a
+// frame.  Rewritten once per frame with WRITE_DISCARD, and
+// regrown (doubling) when a frame needs more room.  Each
+// instanced draw picks its range with StartInstanceLocation.
+// --------------------------------------------------------
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	// Uploads count instances, growing the buffer if needed
+	void Update(IRenderDevice* device, const InstanceData* instances, int count);
+
+	RenderBuffer* GetBuffer() { return buffer; }
+	int GetCapacity() { return capacity; }
+
+private:
+	IRenderDevice* device;		// The buffer's, once there is one
+	RenderBuffer* buffer;
+	int capacity;
+};
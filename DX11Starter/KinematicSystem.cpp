@@ -0,0 +1,261 @@
+#include "KinematicSystem.h"
+#include "Entity.h"
+
+#include <xmmintrin.h>
+#include <utility>
+
+// Number of float streams that get integrated each tick
+// (position, rotation and scale, three components each)
+static const int StreamCount = 9;
+
+KinematicSystem::KinematicSystem()
+{
+	bodyCount = 0;
+	awakeCount = 0;
+}
+
+// --------------------------------------------------------
+// Adds a body that mirrors the given entity's transform.
+// Without an entity it starts at the origin, unrotated and
+// unscaled, and is never synced.
+// --------------------------------------------------------
+int KinematicSystem::AddBody(Entity* entity, const KinematicMotion& motion)
+{
+	if (!entity)
+		return AddBody(DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f), motion);
+
+	int body = AddBody(entity->GetPosition(), entity->GetRotation(), entity->GetScale(), motion);
+	entities[slotOfBody[body]] = entity;
+	return body;
+}
+
+// --------------------------------------------------------
+// Adds a free-standing body (no entity to sync back to)
+// --------------------------------------------------------
+int KinematicSystem::AddBody(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale, const KinematicMotion& motion)
+{
+	// Reuse a dead id if we have one
+	int body;
+	if (!freeBodies.empty())
+	{
+		body = freeBodies.back();
+		freeBodies.pop_back();
+	}
+	else
+	{
+		body = (int)slotOfBody.size();
+		slotOfBody.push_back(-1);
+	}
+
+	AllocateSlot(body);
+	SetTransform(body, position, rotation, scale);
+
+	// New bodies start asleep at the back, SetMotion
+	// moves them forward if they actually move
+	SetMotion(body, motion);
+	return body;
+}
+
+// --------------------------------------------------------
+// Removes a body, keeping the awake/asleep partitions packed
+// --------------------------------------------------------
+void KinematicSystem::RemoveBody(int body)
+{
+	int slot = slotOfBody[body];
+
+	// Move it to the end of the awake range first, if needed,
+	// then to the very end of the arrays
+	if (slot < awakeCount)
+	{
+		SwapSlots(slot, awakeCount - 1);
+		slot = awakeCount - 1;
+		awakeCount--;
+	}
+	SwapSlots(slot, bodyCount - 1);
+	bodyCount--;
+
+	posX.pop_back(); posY.pop_back(); posZ.pop_back();
+	rotX.pop_back(); rotY.pop_back(); rotZ.pop_back();
+	sclX.pop_back(); sclY.pop_back(); sclZ.pop_back();
+	velX.pop_back(); velY.pop_back(); velZ.pop_back();
+	angX.pop_back(); angY.pop_back(); angZ.pop_back();
+	rateX.pop_back(); rateY.pop_back(); rateZ.pop_back();
+	entities.pop_back();
+	bodyOfSlot.pop_back();
+
+	slotOfBody[body] = -1;
+	freeBodies.push_back(body);
+}
+
+void KinematicSystem::SetMotion(int body, const KinematicMotion& motion)
+{
+	int slot = slotOfBody[body];
+	velX[slot] = motion.Velocity.x;        velY[slot] = motion.Velocity.y;        velZ[slot] = motion.Velocity.z;
+	angX[slot] = motion.AngularVelocity.x; angY[slot] = motion.AngularVelocity.y; angZ[slot] = motion.AngularVelocity.z;
+	rateX[slot] = motion.ScaleRate.x;      rateY[slot] = motion.ScaleRate.y;      rateZ[slot] = motion.ScaleRate.z;
+
+	SetSleeping(body, IsAtRest(motion));
+}
+
+KinematicMotion KinematicSystem::GetMotion(int body)
+{
+	int slot = slotOfBody[body];
+	KinematicMotion motion;
+	motion.Velocity = DirectX::XMFLOAT3(velX[slot], velY[slot], velZ[slot]);
+	motion.AngularVelocity = DirectX::XMFLOAT3(angX[slot], angY[slot], angZ[slot]);
+	motion.ScaleRate = DirectX::XMFLOAT3(rateX[slot], rateY[slot], rateZ[slot]);
+	return motion;
+}
+
+void KinematicSystem::SetTransform(int body, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale)
+{
+	int slot = slotOfBody[body];
+	posX[slot] = position.x; posY[slot] = position.y; posZ[slot] = position.z;
+	rotX[slot] = rotation.x; rotY[slot] = rotation.y; rotZ[slot] = rotation.z;
+	sclX[slot] = scale.x;    sclY[slot] = scale.y;    sclZ[slot] = scale.z;
+}
+
+DirectX::XMFLOAT3 KinematicSystem::GetPosition(int body)
+{
+	int slot = slotOfBody[body];
+	return DirectX::XMFLOAT3(posX[slot], posY[slot], posZ[slot]);
+}
+
+DirectX::XMFLOAT3 KinematicSystem::GetRotation(int body)
+{
+	int slot = slotOfBody[body];
+	return DirectX::XMFLOAT3(rotX[slot], rotY[slot], rotZ[slot]);
+}
+
+DirectX::XMFLOAT3 KinematicSystem::GetScale(int body)
+{
+	int slot = slotOfBody[body];
+	return DirectX::XMFLOAT3(sclX[slot], sclY[slot], sclZ[slot]);
+}
+
+// --------------------------------------------------------
+// Moves a body across the awake/asleep boundary
+// --------------------------------------------------------
+void KinematicSystem::SetSleeping(int body, bool sleeping)
+{
+	int slot = slotOfBody[body];
+	if (sleeping && slot < awakeCount)
+	{
+		// Swap with the last awake body and shrink the awake range
+		SwapSlots(slot, awakeCount - 1);
+		awakeCount--;
+	}
+	else if (!sleeping && slot >= awakeCount)
+	{
+		// Swap with the first sleeping body and grow the awake range
+		SwapSlots(slot, awakeCount);
+		awakeCount++;
+	}
+}
+
+bool KinematicSystem::IsSleeping(int body)
+{
+	return slotOfBody[body] >= awakeCount;
+}
+
+// --------------------------------------------------------
+// Integrates every awake body in a single pass.
+// Sleeping bodies live past awakeCount and are never touched.
+// --------------------------------------------------------
+void KinematicSystem::Integrate(float deltaTime)
+{
+	if (awakeCount == 0)
+		return;
+
+	float* values[StreamCount] = {
+		&posX[0], &posY[0], &posZ[0],
+		&rotX[0], &rotY[0], &rotZ[0],
+		&sclX[0], &sclY[0], &sclZ[0] };
+	const float* rates[StreamCount] = {
+		&velX[0], &velY[0], &velZ[0],
+		&angX[0], &angY[0], &angZ[0],
+		&rateX[0], &rateY[0], &rateZ[0] };
+
+	// Four bodies at a time, all nine streams per step
+	__m128 dt = _mm_set1_ps(deltaTime);
+	int i = 0;
+	for (; i + 4 <= awakeCount; i += 4)
+	{
+		for (int s = 0; s < StreamCount; s++)
+		{
+			__m128 v = _mm_loadu_ps(values[s] + i);
+			__m128 r = _mm_loadu_ps(rates[s] + i);
+			_mm_storeu_ps(values[s] + i, _mm_add_ps(v, _mm_mul_ps(r, dt)));
+		}
+	}
+
+	// Leftovers
+	for (; i < awakeCount; i++)
+	{
+		for (int s = 0; s < StreamCount; s++)
+			values[s][i] += rates[s][i] * deltaTime;
+	}
+}
+
+// --------------------------------------------------------
+// Pushes awake transforms back to their entities
+// --------------------------------------------------------
+void KinematicSystem::SyncEntities()
+{
+	for (int i = 0; i < awakeCount; i++)
+	{
+		Entity* entity = entities[i];
+		if (!entity) continue;
+
+		entity->SetPostion(DirectX::XMFLOAT3(posX[i], posY[i], posZ[i]));
+		entity->SetRotation(DirectX::XMFLOAT3(rotX[i], rotY[i], rotZ[i]));
+		entity->SetScale(DirectX::XMFLOAT3(sclX[i], sclY[i], sclZ[i]));
+	}
+}
+
+// --------------------------------------------------------
+// Appends a new slot for the given body at the end of the arrays
+// --------------------------------------------------------
+int KinematicSystem::AllocateSlot(int body)
+{
+	int slot = bodyCount++;
+
+	posX.push_back(0); posY.push_back(0); posZ.push_back(0);
+	rotX.push_back(0); rotY.push_back(0); rotZ.push_back(0);
+	sclX.push_back(1); sclY.push_back(1); sclZ.push_back(1);
+	velX.push_back(0); velY.push_back(0); velZ.push_back(0);
+	angX.push_back(0); angY.push_back(0); angZ.push_back(0);
+	rateX.push_back(0); rateY.push_back(0); rateZ.push_back(0);
+	entities.push_back(nullptr);
+	bodyOfSlot.push_back(body);
+
+	slotOfBody[body] = slot;
+	return slot;
+}
+
+// --------------------------------------------------------
+// Swaps all the data of two slots and fixes up the id tables
+// --------------------------------------------------------
+void KinematicSystem::SwapSlots(int a, int b)
+{
+	if (a == b) return;
+
+	std::vector<float>* streams[] = {
+		&posX, &posY, &posZ, &rotX, &rotY, &rotZ, &sclX, &sclY, &sclZ,
+		&velX, &velY, &velZ, &angX, &angY, &angZ, &rateX, &rateY, &rateZ };
+	for (std::vector<float>* s : streams)
+		std::swap((*s)[a], (*s)[b]);
+
+	std::swap(entities[a], entities[b]);
+	std::swap(bodyOfSlot[a], bodyOfSlot[b]);
+	slotOfBody[bodyOfSlot[a]] = a;
+	slotOfBody[bodyOfSlot[b]] = b;
+}
+
+bool KinematicSystem::IsAtRest(const KinematicMotion& motion)
+{
+	return
+		motion.Velocity.x == 0.0f && motion.Velocity.y == 0.0f && motion.Velocity.z == 0.0f &&
+		motion.AngularVelocity.x == 0.0f && motion.AngularVelocity.y == 0.0f && motion.AngularVelocity.z == 0.0f &&
+		motion.ScaleRate.x == 0.0f && motion.ScaleRate.y == 0.0f && motion.ScaleRate.z == 0.0f;
+}
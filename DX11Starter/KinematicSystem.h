@@ -0,0 +1,84 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+class Entity;
+
+// --------------------------------------------------------
+// Linear, angular and scale rates for a single body.
+// All rates are per second.
+// --------------------------------------------------------
+struct KinematicMotion
+{
+	DirectX::XMFLOAT3 Velocity = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	DirectX::XMFLOAT3 AngularVelocity = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	DirectX::XMFLOAT3 ScaleRate = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+};
+
+// --------------------------------------------------------
+// Integrates kinematic motion for many bodies at once.
+//
+// Transforms and rates are stored as structure-of-arrays so
+// a whole tick is one SIMD pass over contiguous floats.
+// Awake bodies are kept packed at the front of the arrays and
+// sleeping bodies at the back, so sleepers cost nothing.
+// --------------------------------------------------------
+class KinematicSystem
+{
+public:
+	KinematicSystem();
+
+	// Adds a body and returns its (stable) id.  The entity may be
+	// null, in which case the body is only simulated, never synced.
+	int AddBody(Entity* entity, const KinematicMotion& motion);
+	int AddBody(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale, const KinematicMotion& motion);
+	void RemoveBody(int body);
+
+	// Setting a motion with all-zero rates puts the body to sleep,
+	// anything else wakes it up
+	void SetMotion(int body, const KinematicMotion& motion);
+	KinematicMotion GetMotion(int body);
+
+	// Teleports a body (does not change its sleep state)
+	void SetTransform(int body, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale);
+	DirectX::XMFLOAT3 GetPosition(int body);
+	DirectX::XMFLOAT3 GetRotation(int body);
+	DirectX::XMFLOAT3 GetScale(int body);
+
+	void SetSleeping(int body, bool sleeping);
+	bool IsSleeping(int body);
+
+	// Advances every awake body by deltaTime
+	void Integrate(float deltaTime);
+
+	// Copies awake bodies' transforms back into their entities
+	void SyncEntities();
+
+	int GetBodyCount() { return bodyCount; }
+	int GetAwakeCount() { return awakeCount; }
+
+private:
+	// Transform streams
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rotX, rotY, rotZ;
+	std::vector<float> sclX, sclY, sclZ;
+
+	// Rate streams
+	std::vector<float> velX, velY, velZ;
+	std::vector<float> angX, angY, angZ;
+	std::vector<float> rateX, rateY, rateZ;
+
+	std::vector<Entity*> entities;
+
+	// Slots move around as bodies sleep/wake, ids do not
+	std::vector<int> slotOfBody;
+	std::vector<int> bodyOfSlot;
+	std::vector<int> freeBodies;
+
+	int bodyCount;
+	int awakeCount;
+
+	int AllocateSlot(int body);
+	void SwapSlots(int a, int b);
+	static bool IsAtRest(const KinematicMotion& motion);
+};
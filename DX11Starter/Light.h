@@ -1,5 +1,4 @@
 #pragma once
-#include <d3d11.h>
 #include <DirectXMath.h>
 
 struct DirectionalLight 
@@ -7,4 +6,8 @@ struct DirectionalLight
 	DirectX::XMFLOAT4 AmbientColor;
 	DirectX::XMFLOAT4 DiffuseColor;
 	DirectX::XMFLOAT3 Direction;
-};
\ No newline at end of file
+	float Padding;	//HLSL starts the next light on a new register
+};
+
+//Lights go into cbuffers whole, so they have to fill whole registers
+static_assert(sizeof(DirectionalLight) == 48, "DirectionalLight has to match the HLSL struct's packed size");
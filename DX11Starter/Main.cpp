@@ -1,6 +1,8 @@
 
 #include <Windows.h>
+#include <stdio.h>
 #include "Game.h"
+#include "Benchmarks.h"
 
 // --------------------------------------------------------
 // Entry point for a graphical (non-console) Windows application
@@ -44,6 +46,21 @@ int WINAPI WinMain(
 		}
 	}
 
+	// Headless benchmark mode - no window or DirectX device needed
+	if (strstr(lpCmdLine, "-benchmark"))
+	{
+		FILE* stream;
+		AllocConsole();
+		freopen_s(&stream, "CONIN$", "r", stdin);
+		freopen_s(&stream, "CONOUT$", "w", stdout);
+
+		Benchmarks::RunAll();
+
+		printf("Done.  Press enter to exit.\n");
+		getchar();
+		return 0;
+	}
+
 	// Create the Game object using
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
@@ -1,17 +1,136 @@
 #include "Material.h"
 
-Material::Material(SimplePixelShader* pShader, SimpleVertexShader* vShader, ID3D11ShaderResourceView* resourceViewPtr, ID3D11SamplerState* samplerStatePtr)
+//Names hashed at compile time
+static constexpr SimpleShaderName PerObjectName("perObject");
+static constexpr SimpleShaderName PerMaterialName("perMaterial");
+static constexpr SimpleShaderName DiffuseTextureName("diffuseTexture");
+static constexpr SimpleShaderName BasicSamplerName("basicSampler");
+
+static unsigned int nextMaterialId = 0;
+
+Material::Material(IRenderDevice* devicePtr, SimplePixelShader* pShader, SimpleVertexShader* vShader, RenderShaderResource* resourceViewPtr, RenderSampler* samplerStatePtr)
 {
+	device = devicePtr;
 	pixelShader = pShader;
 	vertexShader = vShader;
 	resourceView = resourceViewPtr;
 	samplerState = samplerStatePtr;
+	id = nextMaterialId++;
+
+	//Look up everything drawing needs once, here (which also
+	//checks the constant structs match the shaders)
+	handles.PerObject = vertexShader->BindConstantBuffer<PerObjectConstants>(PerObjectName);
+	handles.PerMaterial = pixelShader->BindConstantBuffer<PerMaterialConstants>(PerMaterialName);
+
+	//This material's parameters live in a buffer of its own
+	if (handles.PerMaterial.IsValid())
+	{
+		RenderBufferDesc desc;
+		desc.ByteWidth = sizeof(PerMaterialConstants);
+		desc.Usage = RenderUsage::Default;
+		desc.BindFlags = RenderBindConstantBuffer;
+		parameterBuffer = device->CreateBuffer(desc, nullptr);
+		UploadParameters();
+	}
+
+	BakeBindings(bindings, vertexShader);
+}
+
+Material::~Material()
+{
+	device->ReleaseBuffer(parameterBuffer);
+}
+
+//Resolves every slot and pointer the material binds
+void Material::BakeBindings(MaterialBindings& target, SimpleVertexShader* vShader)
+{
+	target = MaterialBindings();
+	target.InputLayout = vShader->GetInputLayout();
+	target.VertexShader = vShader->GetShader();
+	target.PixelShader = pixelShader->GetShader();
+
+	const SimpleSRV* texture = pixelShader->GetShaderResourceViewInfo(pixelShader->GetShaderResourceViewHandle(DiffuseTextureName));
+	if (texture)
+	{
+		target.TextureSlot = (int)texture->BindIndex;
+		target.Texture = resourceView;
+	}
+
+	const SimpleSampler* sampler = pixelShader->GetSamplerInfo(pixelShader->GetSamplerHandle(BasicSamplerName));
+	if (sampler)
+	{
+		target.SamplerSlot = (int)sampler->BindIndex;
+		target.Sampler = samplerState;
+	}
+
+	if (parameterBuffer)
+	{
+		target.ParameterSlot = (int)pixelShader->GetBufferInfo((unsigned int)handles.PerMaterial.Buffer.Index)->BindIndex;
+		target.ParameterBuffer = parameterBuffer;
+	}
+}
+
+//Writes the parameters to the material's buffer (on the
+//immediate context - materials aren't changed mid-frame)
+void Material::UploadParameters()
+{
+	if (!parameterBuffer)
+		return;
+
+	PerMaterialConstants constants = {};
+	constants.colorTint = colorTint;
+
+	device->UpdateSubresource(parameterBuffer, &constants, sizeof(constants));
+}
+
+void Material::Apply(StateCache& cache, bool instanced)
+{
+	(instanced ? instancedBindings : bindings).Apply(cache);
 }
 
+unsigned int Material::GetId() { return id; }
+
+const MaterialBindings& Material::GetBindings(bool instanced) { return instanced ? instancedBindings : bindings; }
+
 SimplePixelShader* Material::GetPixelShader() { return pixelShader; }
 
 SimpleVertexShader* Material::GetVertexShader() { return vertexShader; }
 
-ID3D11ShaderResourceView* Material::GetResourceView(){ return resourceView; }
+SimpleVertexShader* Material::GetInstancedVertexShader() { return instancedVertexShader; }
+
+const MaterialHandles& Material::GetHandles() { return handles; }
+
+void Material::SetInstancedVertexShader(SimpleVertexShader* vShader)
+{
+	instancedVertexShader = vShader;
+	if (instancedVertexShader)
+		BakeBindings(instancedBindings, instancedVertexShader);
+	else
+		instancedBindings = MaterialBindings();
+}
+
+RenderShaderResource* Material::GetResourceView(){ return resourceView; }
+
+RenderSampler* Material::GetSamplerState(){ return samplerState; }
 
-ID3D11SamplerState* Material::GetSamplerState(){ return samplerState; }
+void Material::SetContributionCulling(float minPixels, float fadeBandPixels)
+{
+	minScreenSize = minPixels;
+	fadeBand = fadeBandPixels;
+}
+
+float Material::GetMinScreenSize() { return minScreenSize; }
+
+float Material::GetFadeBand() { return fadeBand; }
+
+bool Material::IsTransparent() { return transparent; }
+
+void Material::SetTransparent(bool isTransparent) { transparent = isTransparent; }
+
+DirectX::XMFLOAT4 Material::GetColorTint() { return colorTint; }
+
+void Material::SetColorTint(DirectX::XMFLOAT4 tint)
+{
+	colorTint = tint;
+	UploadParameters();
+}
@@ -1,22 +1,122 @@
 #pragma once
-#include <d3d11.h>
 #include <DirectXMath.h>
 
 #include "SimpleShader.h"
+#include "ShaderConstants.h"
+#include "StateCache.h"
+#include "RenderDevice.h"
+
+//Handles into a material's shaders, resolved once so draws
+//don't look anything up by name
+struct MaterialHandles
+{
+	//Vertex shader, per object
+	TypedConstantBuffer<PerObjectConstants> PerObject;
+
+	//Pixel shader, per material (checks the layout the
+	//material's own parameter buffer is written with)
+	TypedConstantBuffer<PerMaterialConstants> PerMaterial;
+};
+
+//Everything needed to bind a material, baked when it's made,
+//so applying it is a few state cache calls and no lookups.
+//Slots are -1 where the pixel shader doesn't use them.
+struct MaterialBindings
+{
+	RenderInputLayout* InputLayout = nullptr;
+	RenderVertexShader* VertexShader = nullptr;
+	RenderPixelShader* PixelShader = nullptr;
+
+	int TextureSlot = -1;
+	RenderShaderResource* Texture = nullptr;
+	int SamplerSlot = -1;
+	RenderSampler* Sampler = nullptr;
+
+	//The material's own perMaterial cbuffer, uploaded when its
+	//parameters change rather than when it's drawn
+	int ParameterSlot = -1;
+	RenderBuffer* ParameterBuffer = nullptr;
+
+	//Binds shaders, texture, sampler and parameters
+	void Apply(StateCache& cache) const
+	{
+		cache.SetInputLayout(InputLayout);
+		cache.SetVertexShader(VertexShader);
+		cache.SetPixelShader(PixelShader);
+		if (TextureSlot >= 0) cache.SetPSShaderResource(TextureSlot, Texture);
+		if (SamplerSlot >= 0) cache.SetPSSampler(SamplerSlot, Sampler);
+		if (ParameterSlot >= 0) cache.SetPSConstantBuffer(ParameterSlot, ParameterBuffer);
+	}
+};
 
 class Material
 {
 private:
 	SimplePixelShader* pixelShader = nullptr;
 	SimpleVertexShader* vertexShader = nullptr;
-	ID3D11ShaderResourceView* resourceView = nullptr;
-	ID3D11SamplerState* samplerState = nullptr;
+
+	//Optional variant of the vertex shader that reads world matrices from
+	//per-instance data, so entities sharing this material can be batched
+	SimpleVertexShader* instancedVertexShader = nullptr;
+	RenderShaderResource* resourceView = nullptr;
+	RenderSampler* samplerState = nullptr;
+
+	//Contribution culling: objects smaller than minScreenSize pixels
+	//aren't drawn, and fade in over the next fadeBand pixels
+	float minScreenSize = 2.0f;
+	float fadeBand = 6.0f;
+
+	//Transparent materials are blended and drawn back to front after everything opaque
+	bool transparent = false;
+
+	//Multiplies the texture color (the pixel shader's per-material data)
+	DirectX::XMFLOAT4 colorTint = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	MaterialHandles handles;
+
+	//Baked bindings for the plain and instanced vertex shaders
+	MaterialBindings bindings;
+	MaterialBindings instancedBindings;
+	RenderBuffer* parameterBuffer = nullptr;
+	IRenderDevice* device = nullptr;
+
+	//Stable (creation order) id for sorting draws
+	unsigned int id;
+
+	void BakeBindings(MaterialBindings& target, SimpleVertexShader* vShader);
+	void UploadParameters();
 public:
-	Material(SimplePixelShader* pShader, SimpleVertexShader* vShader, ID3D11ShaderResourceView* resourceViewPtr, ID3D11SamplerState* samplerStatePtr);
+	Material(IRenderDevice* devicePtr, SimplePixelShader* pShader, SimpleVertexShader* vShader, RenderShaderResource* resourceViewPtr, RenderSampler* samplerStatePtr);
+	~Material();
+
+	//Owns its parameter buffer, so it can't be copied
+	Material(const Material&) = delete;
+	Material& operator=(const Material&) = delete;
+
+	unsigned int GetId();
+	const MaterialBindings& GetBindings(bool instanced);
+
+	//Binds shaders, texture, sampler and parameters
+	void Apply(StateCache& cache, bool instanced);
 
 	SimplePixelShader* GetPixelShader();
 	SimpleVertexShader* GetVertexShader();
-	ID3D11ShaderResourceView* GetResourceView();
-	ID3D11SamplerState* GetSamplerState();
+	SimpleVertexShader* GetInstancedVertexShader();
+	const MaterialHandles& GetHandles();
+
+	//Null turns instancing off for this material
+	void SetInstancedVertexShader(SimpleVertexShader* vShader);
+	RenderShaderResource* GetResourceView();
+	RenderSampler* GetSamplerState();
+
+	void SetContributionCulling(float minPixels, float fadeBandPixels);
+	float GetMinScreenSize();
+	float GetFadeBand();
+
+	bool IsTransparent();
+	void SetTransparent(bool isTransparent);
+
+	DirectX::XMFLOAT4 GetColorTint();
+	void SetColorTint(DirectX::XMFLOAT4 tint);
 };
 
@@ -1,60 +1,107 @@
 #include "Mesh.h"
+#include <stdio.h>
 
-void Mesh::CreateBuffers(Vertex* vertices, int vertexCount, UINT* indices, int indexCount, ID3D11Device* device)
+// The OBJ loader only reads numbers, so the secure version
+// has no buffer sizes to check (and only MSVC has it)
+#ifndef _MSC_VER
+#define sscanf_s sscanf
+#endif
+
+void Mesh::CreateBuffers(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount)
 {
+	// Grab the bounds while we still have the vertices on the CPU
+	ComputeBounds(vertices, vertexCount);
+
+	// Keep positions and indices around for CPU-side queries
+	cpuPositions.resize(vertexCount);
+	for (int i = 0; i < vertexCount; i++)
+		cpuPositions[i] = vertices[i].Position;
+	cpuIndices.assign(indices, indices + indexCount);
+	cpuVertices.assign(vertices, vertices + vertexCount);
+
 	// Create the VERTEX BUFFER description -----------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC vbd;
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
+	RenderBufferDesc vbd;
+	vbd.Usage = RenderUsage::Immutable;
 	vbd.ByteWidth = vertexCount * sizeof(Vertex);       // 3 = number of vertices in the buffer
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells DirectX this is a vertex buffer
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial vertex data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = vertices;
+	vbd.BindFlags = RenderBindVertexBuffer; // Tells DirectX this is a vertex buffer
 
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&vbd, &initialVertexData, &vertexBuffer);
+	vertexBuffer = device->CreateBuffer(vbd, vertices);
 
 
 
 	// Create the INDEX BUFFER description ------------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	RenderBufferDesc ibd;
+	ibd.Usage = RenderUsage::Immutable;
 	ibd.ByteWidth = indexCount * sizeof(int);         // 3 = number of indices in the buffer
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER; // Tells DirectX this is an index buffer
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial index data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = indices;
+	ibd.BindFlags = RenderBindIndexBuffer; // Tells DirectX this is an index buffer
 
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&ibd, &initialIndexData, &indexBuffer);
+	indexBuffer = device->CreateBuffer(ibd, indices);
 }
 
-Mesh::Mesh(Vertex* vertices, int vertexCount, UINT* indices, int indexCount, ID3D11Device* device)
+// --------------------------------------------------------
+// Computes a model space box and sphere around the vertices
+// --------------------------------------------------------
+void Mesh::ComputeBounds(Vertex* vertices, int vertexCount)
 {
+	if (vertexCount <= 0)
+		return;
+
+	DirectX::XMFLOAT3 minPos = vertices[0].Position;
+	DirectX::XMFLOAT3 maxPos = vertices[0].Position;
+	for (int i = 1; i < vertexCount; i++)
+	{
+		DirectX::XMFLOAT3 p = vertices[i].Position;
+		if (p.x < minPos.x) minPos.x = p.x;
+		if (p.y < minPos.y) minPos.y = p.y;
+		if (p.z < minPos.z) minPos.z = p.z;
+		if (p.x > maxPos.x) maxPos.x = p.x;
+		if (p.y > maxPos.y) maxPos.y = p.y;
+		if (p.z > maxPos.z) maxPos.z = p.z;
+	}
+	localBounds.Min = minPos;
+	localBounds.Max = maxPos;
+
+	// Sphere is centered on the box, with a radius that
+	// reaches the farthest actual vertex
+	DirectX::XMFLOAT3 center(
+		(minPos.x + maxPos.x) * 0.5f,
+		(minPos.y + maxPos.y) * 0.5f,
+		(minPos.z + maxPos.z) * 0.5f);
+	float radiusSq = 0.0f;
+	for (int i = 0; i < vertexCount; i++)
+	{
+		float dx = vertices[i].Position.x - center.x;
+		float dy = vertices[i].Position.y - center.y;
+		float dz = vertices[i].Position.z - center.z;
+		float distSq = dx * dx + dy * dy + dz * dz;
+		if (distSq > radiusSq) radiusSq = distSq;
+	}
+	localSphere.Center = center;
+	localSphere.Radius = sqrtf(radiusSq);
+}
+
+Mesh::Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount, IRenderDevice* devicePtr)
+{
+	device = devicePtr;
+
 	//Save indexCount to meshIndices
 	meshIndices = indexCount;
 
-	CreateBuffers(vertices, vertexCount, indices, indexCount, device);
+	CreateBuffers(vertices, vertexCount, indices, indexCount);
 }
 
-Mesh::Mesh(const char* fileName, ID3D11Device* device)
+Mesh::Mesh(const char* fileName, IRenderDevice* devicePtr)
 {
+	device = devicePtr;
+
 	// File input object
 	std::ifstream obj(fileName);
 
@@ -67,7 +114,7 @@ Mesh::Mesh(const char* fileName, ID3D11Device* device)
 	std::vector<DirectX::XMFLOAT3> normals;       // Normals from the file
 	std::vector<DirectX::XMFLOAT2> uvs;           // UVs from the file
 	std::vector<Vertex> verts;           // Verts we're assembling
-	std::vector<UINT> indices;           // Indices of these verts
+	std::vector<unsigned int> indices;           // Indices of these verts
 	unsigned int vertCounter = 0;        // Count of vertices/indices
 	char chars[100];                     // String for line reading
 
@@ -217,7 +264,7 @@ Mesh::Mesh(const char* fileName, ID3D11Device* device)
 	//
 	// - The vector "indices" is similar. It's a vector of unsigned ints and
 	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, device);
+	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter);
 	//
 	// - "vertCounter" is BOTH the number of vertices and the number of indices
 	// - Yes, the indices are a bit redundant here (one per vertex).  Could you skip using
@@ -228,16 +275,17 @@ Mesh::Mesh(const char* fileName, ID3D11Device* device)
 
 Mesh::~Mesh()
 {
-	if (vertexBuffer) { vertexBuffer->Release(); }
-	if (indexBuffer) { indexBuffer->Release(); }
+	device->ReleaseBuffer(vertexBuffer);
+	device->ReleaseBuffer(indexBuffer);
+	delete triangleBVH;
 }
 
-ID3D11Buffer* Mesh::GetVertexBuffer()
+RenderBuffer* Mesh::GetVertexBuffer()
 {
 	return vertexBuffer;
 }
 
-ID3D11Buffer* Mesh::GetIndexBuffer()
+RenderBuffer* Mesh::GetIndexBuffer()
 {
 	return indexBuffer;
 }
@@ -246,3 +294,43 @@ int Mesh::GetIndexCount()
 {
 	return meshIndices;
 }
+
+AABB Mesh::GetLocalBounds()
+{
+	return localBounds;
+}
+
+BoundingSphere Mesh::GetLocalSphere()
+{
+	return localSphere;
+}
+
+const std::vector<DirectX::XMFLOAT3>& Mesh::GetPositions()
+{
+	return cpuPositions;
+}
+
+const std::vector<unsigned int>& Mesh::GetIndices()
+{
+	return cpuIndices;
+}
+
+const std::vector<Vertex>& Mesh::GetVertices()
+{
+	return cpuVertices;
+}
+
+// --------------------------------------------------------
+// Builds the raycast BVH from the CPU copy of the geometry.
+// Meshes that are never raycast can skip this.
+// --------------------------------------------------------
+void Mesh::BuildTriangleBVH()
+{
+	if (triangleBVH) return;
+	triangleBVH = new TriangleBVH(cpuPositions, cpuIndices);
+}
+
+TriangleBVH* Mesh::GetTriangleBVH()
+{
+	return triangleBVH;
+}
@@ -1,31 +1,60 @@
 #pragma once
-#include <d3d11.h>
 #include <vector>
 #include <fstream>
 
 #include "Vertex.h"
+#include "Bounds.h"
+#include "TriangleBVH.h"
+#include "RenderDevice.h"
 class Mesh
 {
 private:
 	//Buffer pointers
-	ID3D11Buffer* vertexBuffer = nullptr;
-	ID3D11Buffer* indexBuffer = nullptr;
+	RenderBuffer* vertexBuffer = nullptr;
+	RenderBuffer* indexBuffer = nullptr;
 
 	//Integer specifying how many indices are in the mesh's index buffer
 	int meshIndices = 0;
 
-	void CreateBuffers(Vertex* vertices, int vertexCount, UINT* indices, int indexCount, ID3D11Device* device);
+	//Model space bounds, computed from the vertices on creation
+	AABB localBounds = {};
+	BoundingSphere localSphere = {};
+
+	void ComputeBounds(Vertex* vertices, int vertexCount);
+
+	//CPU copy of the geometry for occlusion, picking, etc.
+	std::vector<DirectX::XMFLOAT3> cpuPositions;
+	std::vector<unsigned int> cpuIndices;
+
+	//Whole vertices too, for drawing on the CPU
+	std::vector<Vertex> cpuVertices;
+
+	//Optional triangle BVH for raycasts (null until built)
+	TriangleBVH* triangleBVH = nullptr;
+
+	//Owns the buffers
+	IRenderDevice* device = nullptr;
+
+	void CreateBuffers(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount);
 
 public:
 	//Constructor
-	Mesh(Vertex* vertices, int vertexCount, UINT* indices, int indexCount, ID3D11Device* device);
-	Mesh(const char* fileName, ID3D11Device* device);
+	Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount, IRenderDevice* devicePtr);
+	Mesh(const char* fileName, IRenderDevice* devicePtr);
 
 	//Destructor
 	virtual ~Mesh();
 
-	ID3D11Buffer* GetVertexBuffer();
-	ID3D11Buffer* GetIndexBuffer();
+	RenderBuffer* GetVertexBuffer();
+	RenderBuffer* GetIndexBuffer();
 	int GetIndexCount();
+	AABB GetLocalBounds();
+	BoundingSphere GetLocalSphere();
+	const std::vector<DirectX::XMFLOAT3>& GetPositions();
+	const std::vector<unsigned int>& GetIndices();
+	const std::vector<Vertex>& GetVertices();
+
+	void BuildTriangleBVH();
+	TriangleBVH* GetTriangleBVH();
 };
 
@@ -0,0 +1,365 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+// Tiles are square and a multiple of four pixels wide,
+// so SSE groups of four never straddle two tiles
+static const int TileSize = 32;
+
+// Levels 0 (full res) through 5 (one texel per tile)
+static const int HierarchyLevels = 6;
+
+// Anything closer than this in clip space w is treated
+// as crossing the near plane
+static const float MinClipW = 1e-4f;
+
+static float MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// --------------------------------------------------------
+// Constructor - sizes the depth pyramid and tile bins
+// --------------------------------------------------------
+OcclusionCuller::OcclusionCuller(int width, int height, ThreadPool* threadPool)
+{
+	this->threadPool = threadPool;
+
+	tilesX = (width + TileSize - 1) / TileSize;
+	tilesY = (height + TileSize - 1) / TileSize;
+	this->width = tilesX * TileSize;
+	this->height = tilesY * TileSize;
+
+	depthLevels.resize(HierarchyLevels);
+	for (int level = 0; level < HierarchyLevels; level++)
+		depthLevels[level].resize((this->width >> level) * (this->height >> level), 1.0f);
+
+	tileBins.resize(tilesX * tilesY);
+	XMStoreFloat4x4(&viewProj, XMMatrixIdentity());
+}
+
+// --------------------------------------------------------
+// Starts a new frame: forgets last frame's occluders
+// --------------------------------------------------------
+void OcclusionCuller::BeginFrame(const XMFLOAT4X4& viewProj)
+{
+	this->viewProj = viewProj;
+	triangles.clear();
+	for (std::vector<int>& bin : tileBins)
+		bin.clear();
+
+	stats = OcclusionStats();
+}
+
+// --------------------------------------------------------
+// Transforms an occluder mesh to screen space and bins
+// its triangles into every tile they might touch
+// --------------------------------------------------------
+void OcclusionCuller::AddOccluder(const std::vector<XMFLOAT3>& positions, const std::vector<unsigned int>& indices, const XMFLOAT4X4& world)
+{
+	XMMATRIX worldViewProj = XMMatrixMultiply(XMLoadFloat4x4(&world), XMLoadFloat4x4(&viewProj));
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		XMVECTOR v0 = XMVector3Transform(XMLoadFloat3(&positions[indices[i]]), worldViewProj);
+		XMVECTOR v1 = XMVector3Transform(XMLoadFloat3(&positions[indices[i + 1]]), worldViewProj);
+		XMVECTOR v2 = XMVector3Transform(XMLoadFloat3(&positions[indices[i + 2]]), worldViewProj);
+		SetupTriangle(v0, v1, v2);
+	}
+}
+
+// --------------------------------------------------------
+// Projects one clip space triangle and prepares its edge
+// functions.  Skipping a triangle only ever makes culling
+// less aggressive, so anything awkward is simply dropped.
+// --------------------------------------------------------
+void OcclusionCuller::SetupTriangle(FXMVECTOR c0, FXMVECTOR c1, FXMVECTOR c2)
+{
+	XMFLOAT4 clip[3];
+	XMStoreFloat4(&clip[0], c0);
+	XMStoreFloat4(&clip[1], c1);
+	XMStoreFloat4(&clip[2], c2);
+
+	// Crosses the near plane - don't bother clipping occluders
+	if (clip[0].w < MinClipW || clip[1].w < MinClipW || clip[2].w < MinClipW)
+		return;
+
+	// Perspective divide and viewport transform
+	float x[3], y[3], z[3];
+	for (int v = 0; v < 3; v++)
+	{
+		float invW = 1.0f / clip[v].w;
+		x[v] = (clip[v].x * invW * 0.5f + 0.5f) * width;
+		y[v] = (0.5f - clip[v].y * invW * 0.5f) * height;
+		z[v] = clip[v].z * invW;
+	}
+
+	// Orient so the interior is on the positive side of every edge
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (fabsf(area) < 1e-6f)
+		return;
+	if (area < 0.0f)
+	{
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+		area = -area;
+	}
+
+	BinnedTriangle tri;
+	tri.MinX = std::max(0, (int)floorf(std::min(x[0], std::min(x[1], x[2]))));
+	tri.MaxX = std::min(width - 1, (int)ceilf(std::max(x[0], std::max(x[1], x[2]))));
+	tri.MinY = std::max(0, (int)floorf(std::min(y[0], std::min(y[1], y[2]))));
+	tri.MaxY = std::min(height - 1, (int)ceilf(std::max(y[0], std::max(y[1], y[2]))));
+	if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+		return;
+
+	// Edge e goes from vertex e to vertex e+1:
+	// E(x, y) = A * x + B * y + C, positive inside
+	for (int e = 0; e < 3; e++)
+	{
+		int a = e;
+		int b = (e + 1) % 3;
+		tri.EdgeA[e] = y[a] - y[b];
+		tri.EdgeB[e] = x[b] - x[a];
+		tri.EdgeC[e] = -(tri.EdgeA[e] * x[a] + tri.EdgeB[e] * y[a]);
+	}
+
+	// Depth as a plane over the screen, from the barycentrics
+	// of vertex 1 (edge 2) and vertex 2 (edge 0)
+	float invArea = 1.0f / area;
+	float dz1 = (z[1] - z[0]) * invArea;
+	float dz2 = (z[2] - z[0]) * invArea;
+	tri.DepthA = dz1 * tri.EdgeA[2] + dz2 * tri.EdgeA[0];
+	tri.DepthB = dz1 * tri.EdgeB[2] + dz2 * tri.EdgeB[0];
+	tri.DepthC = z[0] + dz1 * tri.EdgeC[2] + dz2 * tri.EdgeC[0];
+
+	// Bin it
+	int index = (int)triangles.size();
+	triangles.push_back(tri);
+	for (int ty = tri.MinY / TileSize; ty <= tri.MaxY / TileSize; ty++)
+		for (int tx = tri.MinX / TileSize; tx <= tri.MaxX / TileSize; tx++)
+			tileBins[ty * tilesX + tx].push_back(index);
+}
+
+// --------------------------------------------------------
+// Fills all tiles in parallel, then builds the pyramid
+// --------------------------------------------------------
+void OcclusionCuller::Rasterize()
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	threadPool->ParallelFor(tilesX * tilesY, [this](int tile)
+	{
+		RasterizeTile(tile);
+		BuildTileHierarchy(tile);
+	});
+
+	stats.OccluderTriangles = (int)triangles.size();
+	stats.RasterizeMs = MillisecondsSince(start);
+}
+
+// --------------------------------------------------------
+// Clears one tile and rasterizes its binned triangles,
+// keeping the nearest depth per pixel
+// --------------------------------------------------------
+void OcclusionCuller::RasterizeTile(int tile)
+{
+	int tileX0 = (tile % tilesX) * TileSize;
+	int tileY0 = (tile / tilesX) * TileSize;
+	float* depth = &depthLevels[0][0];
+
+	for (int y = tileY0; y < tileY0 + TileSize; y++)
+		std::fill(depth + y * width + tileX0, depth + y * width + tileX0 + TileSize, 1.0f);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for (int index : tileBins[tile])
+	{
+		const BinnedTriangle& tri = triangles[index];
+
+		int x0 = std::max(tri.MinX, tileX0) & ~3;
+		int x1 = std::min(tri.MaxX, tileX0 + TileSize - 1);
+		int y0 = std::max(tri.MinY, tileY0);
+		int y1 = std::min(tri.MaxY, tileY0 + TileSize - 1);
+
+		__m128 a0 = _mm_set1_ps(tri.EdgeA[0]), b0 = _mm_set1_ps(tri.EdgeB[0]), c0 = _mm_set1_ps(tri.EdgeC[0]);
+		__m128 a1 = _mm_set1_ps(tri.EdgeA[1]), b1 = _mm_set1_ps(tri.EdgeB[1]), c1 = _mm_set1_ps(tri.EdgeC[1]);
+		__m128 a2 = _mm_set1_ps(tri.EdgeA[2]), b2 = _mm_set1_ps(tri.EdgeB[2]), c2 = _mm_set1_ps(tri.EdgeC[2]);
+		__m128 za = _mm_set1_ps(tri.DepthA), zb = _mm_set1_ps(tri.DepthB), zc = _mm_set1_ps(tri.DepthC);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			__m128 py = _mm_set1_ps(y + 0.5f);
+
+			// Per-row constant parts of each equation
+			__m128 row0 = _mm_add_ps(_mm_mul_ps(b0, py), c0);
+			__m128 row1 = _mm_add_ps(_mm_mul_ps(b1, py), c1);
+			__m128 row2 = _mm_add_ps(_mm_mul_ps(b2, py), c2);
+			__m128 rowZ = _mm_add_ps(_mm_mul_ps(zb, py), zc);
+
+			float* rowDepth = depth + y * width;
+			for (int x = x0; x <= x1; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), row0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), row1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), row2);
+				__m128 inside = _mm_and_ps(
+					_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+					_mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 z = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(za, px), rowZ), zero), one);
+				__m128 old = _mm_loadu_ps(rowDepth + x);
+				__m128 nearest = _mm_min_ps(old, z);
+				_mm_storeu_ps(rowDepth + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Builds the farthest-depth pyramid for one tile.  Tiles
+// are a power of two wide, so each one owns its texels all
+// the way up to the last level.
+// --------------------------------------------------------
+void OcclusionCuller::BuildTileHierarchy(int tile)
+{
+	int tileX = tile % tilesX;
+	int tileY = tile / tilesX;
+
+	for (int level = 1; level < HierarchyLevels; level++)
+	{
+		int size = TileSize >> level;
+		int srcWidth = width >> (level - 1);
+		int dstWidth = width >> level;
+		const float* src = &depthLevels[level - 1][0];
+		float* dst = &depthLevels[level][0];
+
+		for (int y = tileY * size; y < (tileY + 1) * size; y++)
+		{
+			for (int x = tileX * size; x < (tileX + 1) * size; x++)
+			{
+				const float* s = src + (y * 2) * srcWidth + x * 2;
+				dst[y * dstWidth + x] = std::max(
+					std::max(s[0], s[1]),
+					std::max(s[srcWidth], s[srcWidth + 1]));
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// A box is hidden if its nearest point is behind the
+// farthest occluder depth everywhere it covers
+// --------------------------------------------------------
+bool OcclusionCuller::IsVisible(const AABB& box)
+{
+	XMMATRIX vp = XMLoadFloat4x4(&viewProj);
+
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for (int c = 0; c < 8; c++)
+	{
+		XMFLOAT3 corner(
+			(c & 1) ? box.Max.x : box.Min.x,
+			(c & 2) ? box.Max.y : box.Min.y,
+			(c & 4) ? box.Max.z : box.Min.z);
+
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corner), vp));
+
+		// Touches the near plane, so it might be right in front of us
+		if (clip.w < MinClipW)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float sx = (clip.x * invW * 0.5f + 0.5f) * width;
+		float sy = (0.5f - clip.y * invW * 0.5f) * height;
+		minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+		minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+		minZ = std::min(minZ, clip.z * invW);
+	}
+
+	int x0 = std::max(0, (int)floorf(minX));
+	int x1 = std::min(width - 1, (int)ceilf(maxX));
+	int y0 = std::max(0, (int)floorf(minY));
+	int y1 = std::min(height - 1, (int)ceilf(maxY));
+
+	// Off screen - leave that to frustum culling
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	// Start at the coarsest level and only refine where needed
+	int top = HierarchyLevels - 1;
+	for (int y = y0 >> top; y <= (y1 >> top); y++)
+		for (int x = x0 >> top; x <= (x1 >> top); x++)
+			if (IsRegionVisible(top, x, y, x0, y0, x1, y1, minZ))
+				return true;
+
+	return false;
+}
+
+// --------------------------------------------------------
+// Checks one pyramid texel.  If the box is behind the texel's
+// farthest depth the whole region is hidden; otherwise we
+// descend into the children that overlap the box's rectangle
+// until we either find a visible pixel or run out of them.
+// --------------------------------------------------------
+bool OcclusionCuller::IsRegionVisible(int level, int x, int y, int x0, int y0, int x1, int y1, float minZ)
+{
+	if (minZ > depthLevels[level][y * (width >> level) + x])
+		return false;
+
+	if (level == 0)
+		return true;
+
+	int child = level - 1;
+	for (int cy = y * 2; cy <= y * 2 + 1; cy++)
+	{
+		if (cy < (y0 >> child) || cy > (y1 >> child)) continue;
+		for (int cx = x * 2; cx <= x * 2 + 1; cx++)
+		{
+			if (cx < (x0 >> child) || cx > (x1 >> child)) continue;
+			if (IsRegionVisible(child, cx, cy, x0, y0, x1, y1, minZ))
+				return true;
+		}
+	}
+	return false;
+}
+
+// --------------------------------------------------------
+// Tests a batch of boxes across the thread pool
+// --------------------------------------------------------
+void OcclusionCuller::TestOccludees(const std::vector<AABB>& boxes, std::vector<char>& visible)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	const int BatchSize = 64;
+	int count = (int)boxes.size();
+	visible.resize(count);
+
+	threadPool->ParallelFor((count + BatchSize - 1) / BatchSize, [&](int batch)
+	{
+		int end = std::min(count, (batch + 1) * BatchSize);
+		for (int i = batch * BatchSize; i < end; i++)
+			visible[i] = IsVisible(boxes[i]) ? 1 : 0;
+	});
+
+	stats.Tested = count;
+	stats.Visible = 0;
+	for (char v : visible)
+		stats.Visible += v;
+	stats.Culled = count - stats.Visible;
+	stats.TestMs = MillisecondsSince(start);
+}
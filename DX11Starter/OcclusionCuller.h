@@ -0,0 +1,88 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Bounds.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// Per-frame occlusion culling numbers
+// --------------------------------------------------------
+struct OcclusionStats
+{
+	int OccluderTriangles = 0;
+	int Tested = 0;
+	int Visible = 0;
+	int Culled = 0;
+	float RasterizeMs = 0.0f;
+	float TestMs = 0.0f;
+};
+
+// --------------------------------------------------------
+// CPU occlusion culling against a small software depth buffer.
+//
+// Each frame a few big occluder meshes are rasterized into a
+// low resolution depth buffer: triangles are binned into
+// screen tiles and the tiles are filled in parallel, four
+// pixels per SSE step.  Every tile then builds its part of a
+// max-depth pyramid, and occludee boxes are tested against
+// it coarse to fine, only refining where they might show.
+//
+// All matrices are row-vector DirectXMath matrices (NOT the
+// transposed copies we hand to HLSL).
+// --------------------------------------------------------
+class OcclusionCuller
+{
+public:
+	// Width and height are rounded up to whole tiles
+	OcclusionCuller(int width = 320, int height = 192, ThreadPool* threadPool = &ThreadPool::Shared());
+
+	void BeginFrame(const DirectX::XMFLOAT4X4& viewProj);
+	void AddOccluder(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<unsigned int>& indices, const DirectX::XMFLOAT4X4& world);
+	void Rasterize();
+
+	// Tests a single box, or a whole batch in parallel
+	// (visible[i] is set to 1 or 0 for each box)
+	bool IsVisible(const AABB& box);
+	void TestOccludees(const std::vector<AABB>& boxes, std::vector<char>& visible);
+
+	OcclusionStats GetStats() { return stats; }
+
+	// Raw depth for debugging (0 = near, 1 = far/empty)
+	const std::vector<float>& GetDepthBuffer() { return depthLevels[0]; }
+	int GetWidth() { return width; }
+	int GetHeight() { return height; }
+
+private:
+	// Screen space triangle with edge and depth equations
+	// already set up, so tiles can share the work
+	struct BinnedTriangle
+	{
+		float EdgeA[3], EdgeB[3], EdgeC[3];
+		float DepthA, DepthB, DepthC;
+		int MinX, MaxX, MinY, MaxY;
+	};
+
+	ThreadPool* threadPool;
+
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+
+	DirectX::XMFLOAT4X4 viewProj;
+
+	// Level 0 is the full depth buffer, each next level holds
+	// the farthest depth of a 2x2 block of the previous one
+	std::vector<std::vector<float>> depthLevels;
+
+	std::vector<BinnedTriangle> triangles;
+	std::vector<std::vector<int>> tileBins;
+
+	OcclusionStats stats;
+
+	void SetupTriangle(DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1, DirectX::FXMVECTOR v2);
+	void RasterizeTile(int tile);
+	void BuildTileHierarchy(int tile);
+	bool IsRegionVisible(int level, int x, int y, int x0, int y0, int x1, int y1, float minZ);
+};
@@ -15,8 +15,26 @@ struct VertexToPixel
 	/*float4 color		: COLOR;*/
 	float3 normal		: NORMAL;
 	float2 uv			: UV;
+	float fade			: FADE;		// 1 = fully drawn, fades to 0 near the contribution cull size
+	float3 worldPos		: WORLDPOS;
 };
 
+// Feature switches (see ShaderFeatures.h).  Anything not
+// defined is on, which is how the project build compiles
+// PixelShader.cso - variants are compiled with them set.
+#ifndef USE_TEXTURE
+#define USE_TEXTURE 1
+#endif
+#ifndef USE_DIRECTIONAL_LIGHTS
+#define USE_DIRECTIONAL_LIGHTS 1
+#endif
+#ifndef USE_CLUSTERED_LIGHTS
+#define USE_CLUSTERED_LIGHTS 1
+#endif
+#ifndef USE_FADE
+#define USE_FADE 1
+#endif
+
 struct DirectionalLight
 {
 	float4 AmbientColor;
@@ -24,15 +42,100 @@ struct DirectionalLight
 	float3 Direction;
 };
 
-cbuffer externalDLight : register(b0)
+// Point or spot light, matching LocalLight in ClusterBuilder.h
+struct LocalLight
+{
+	float3 Position;
+	float Range;
+	float3 Color;
+	uint Type;			// 0 = point, 1 = spot
+	float3 Direction;
+	float CosOuterAngle;
+	float CosInnerAngle;
+	float3 Padding;
+};
+
+// Where a cluster's lights are in clusterLightIndices
+struct ClusterRange
+{
+	uint Offset;
+	uint Count;
+};
+
+// Same for every draw in a frame
+cbuffer perFrame : register(b0)
 {
 	DirectionalLight light1;
 	DirectionalLight light2;
+
+	// Finding a pixel's cluster (see ClusterBuilder):
+	//  tile = pixel * clusterParams.xy
+	//  slice = log(view depth) * clusterParams.z + clusterParams.w
+	float4 clusterParams;
+	uint4 clusterDims;		// Tiles across, tiles down, slices, unused
+};
+
+// Changes only when the material does
+cbuffer perMaterial : register(b1)
+{
+	float4 colorTint;
+};
+
+// 4x4 ordered dither thresholds for the screen-door fade
+static const float DitherThresholds[16] =
+{
+	 0.5f / 16.0f,  8.5f / 16.0f,  2.5f / 16.0f, 10.5f / 16.0f,
+	12.5f / 16.0f,  4.5f / 16.0f, 14.5f / 16.0f,  6.5f / 16.0f,
+	 3.5f / 16.0f, 11.5f / 16.0f,  1.5f / 16.0f,  9.5f / 16.0f,
+	15.5f / 16.0f,  7.5f / 16.0f, 13.5f / 16.0f,  5.5f / 16.0f
 };
 
 Texture2D diffuseTexture  : register(t0);
 SamplerState basicSampler : register(s0);
 
+// Rebuilt by the CPU every frame
+StructuredBuffer<LocalLight> localLights			: register(t1);
+StructuredBuffer<ClusterRange> clusterRanges		: register(t2);
+StructuredBuffer<uint> clusterLightIndices			: register(t3);
+
+// --------------------------------------------------------
+// Diffuse light from every point and spot light in this
+// pixel's cluster
+// --------------------------------------------------------
+float3 ClusteredLight(float4 screenPosition, float3 worldPos, float3 normal)
+{
+	// SV_POSITION's w is the pixel's view space depth
+	uint2 tile = min(uint2(screenPosition.xy * clusterParams.xy), clusterDims.xy - 1);
+	int slice = (int)floor(log(screenPosition.w) * clusterParams.z + clusterParams.w);
+	if (slice < 0 || slice >= (int)clusterDims.z)
+		return float3(0, 0, 0);
+
+	ClusterRange range = clusterRanges[(slice * clusterDims.y + tile.y) * clusterDims.x + tile.x];
+
+	float3 total = float3(0, 0, 0);
+	for (uint i = 0; i < range.Count; i++)
+	{
+		LocalLight light = localLights[clusterLightIndices[range.Offset + i]];
+
+		float3 toLight = light.Position - worldPos;
+		float distance = length(toLight);
+		toLight /= max(distance, 0.0001f);
+
+		// Smooth falloff that reaches zero at the light's range
+		float falloff = saturate(1.0f - (distance * distance) / (light.Range * light.Range));
+		float attenuation = falloff * falloff;
+
+		if (light.Type == 1)
+		{
+			float cosAngle = dot(-toLight, light.Direction);
+			attenuation *= smoothstep(light.CosOuterAngle, light.CosInnerAngle, cosAngle);
+		}
+
+		total += light.Color * saturate(dot(normal, toLight)) * attenuation;
+	}
+	return total;
+}
+
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
@@ -44,15 +147,40 @@ SamplerState basicSampler : register(s0);
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
-	float4 surfaceColor = diffuseTexture.Sample(basicSampler, input.uv);
+#if USE_FADE
+	// Dissolve small, distant objects instead of popping them
+	uint2 ditherCell = uint2(input.position.xy) % 4;
+	clip(input.fade - DitherThresholds[ditherCell.y * 4 + ditherCell.x]);
+#endif
 
+#if USE_TEXTURE
+	float4 surfaceColor = diffuseTexture.Sample(basicSampler, input.uv) * colorTint;
+#else
+	float4 surfaceColor = colorTint;
+#endif
+
+	// Unlit if there are no lights at all
+#if !USE_DIRECTIONAL_LIGHTS && !USE_CLUSTERED_LIGHTS
+	return surfaceColor;
+#else
+	// Alpha comes from the directional lights' terms, as it always has
+	float4 finalColor = float4(0, 0, 0, USE_DIRECTIONAL_LIGHTS ? 0.0f : surfaceColor.a);
+	input.normal = normalize(input.normal);
+
+#if USE_DIRECTIONAL_LIGHTS
 	float3 lightDir1 = normalize(-light1.Direction);
 	float3 lightDir2 = normalize(-light2.Direction);
-	input.normal = normalize(input.normal);
 	float lightAmount1 = saturate(dot(input.normal, -lightDir1));
 	float4 finalLight1 = (light1.DiffuseColor * surfaceColor) * lightAmount1 + (light1.AmbientColor * surfaceColor);
 	float lightAmount2 = saturate(dot(input.normal, -lightDir2));
 	float4 finalLight2 = (light2.DiffuseColor * surfaceColor) * lightAmount2 + (light2.AmbientColor * surfaceColor);
+	finalColor += finalLight1 + finalLight2;
+#endif
+
+#if USE_CLUSTERED_LIGHTS
+	finalColor += float4(ClusteredLight(input.position, input.worldPos, input.normal) * surfaceColor.rgb, 0.0f);
+#endif
 
-	return finalLight1 + finalLight2;
+	return finalColor;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include "PotentiallyVisibleSet.h"
+
+#include <cmath>
+#include <fstream>
+#include <map>
+
+using namespace DirectX;
+
+// Identifies .pvs files ("PVS2")
+static const unsigned int PVSFileMagic = 0x32535650;
+
+// Compressed sets are a stream of tokens.  The top two bits of
+// a token say what follows, the rest is a word count:
+//  - literal: that many words copied as-is
+//  - zeros / ones: that many words of all 0 or all 1 bits
+static const unsigned int TokenLiteral = 0u << 30;
+static const unsigned int TokenZeros = 1u << 30;
+static const unsigned int TokenOnes = 2u << 30;
+static const unsigned int TokenTypeMask = 3u << 30;
+static const unsigned int TokenCountMask = ~TokenTypeMask;
+
+// Where rays start inside a cell: the center and the centers
+// of its eight octants, as fractions of the cell size
+static const int CellSampleCount = 9;
+static const float CellSamples[CellSampleCount][3] =
+{
+	{ 0.50f, 0.50f, 0.50f },
+	{ 0.25f, 0.25f, 0.25f }, { 0.75f, 0.25f, 0.25f }, { 0.25f, 0.75f, 0.25f }, { 0.75f, 0.75f, 0.25f },
+	{ 0.25f, 0.25f, 0.75f }, { 0.75f, 0.25f, 0.75f }, { 0.25f, 0.75f, 0.75f }, { 0.75f, 0.75f, 0.75f }
+};
+
+// Where rays end on an entity's box: the center, the corners
+// and the face centers, pulled in slightly so corner rays
+// don't just graze past the mesh
+static const int TargetSampleCount = 15;
+static const float TargetSamples[TargetSampleCount][3] =
+{
+	{ 0.50f, 0.50f, 0.50f },
+	{ 0.05f, 0.05f, 0.05f }, { 0.95f, 0.05f, 0.05f }, { 0.05f, 0.95f, 0.05f }, { 0.95f, 0.95f, 0.05f },
+	{ 0.05f, 0.05f, 0.95f }, { 0.95f, 0.05f, 0.95f }, { 0.05f, 0.95f, 0.95f }, { 0.95f, 0.95f, 0.95f },
+	{ 0.05f, 0.50f, 0.50f }, { 0.95f, 0.50f, 0.50f },
+	{ 0.50f, 0.05f, 0.50f }, { 0.50f, 0.95f, 0.50f },
+	{ 0.50f, 0.50f, 0.05f }, { 0.50f, 0.50f, 0.95f }
+};
+
+PotentiallyVisibleSet::PotentiallyVisibleSet()
+{
+	region = {};
+	cellSize = 1.0f;
+	cellsX = cellsY = cellsZ = 0;
+	entityCount = 0;
+	sceneHash = 0;
+	cachedSet = -1;
+}
+
+// --------------------------------------------------------
+// Bakes every cell in parallel, then compresses the sets
+// and merges the duplicates
+// --------------------------------------------------------
+void PotentiallyVisibleSet::Bake(
+	const AABB& region,
+	float cellSize,
+	const SceneRaycaster& raycaster,
+	const std::vector<AABB>& entityBounds,
+	const std::vector<bool>& isStatic,
+	ThreadPool* threadPool)
+{
+	this->region = region;
+	this->cellSize = cellSize;
+	cellsX = (int)ceilf((region.Max.x - region.Min.x) / cellSize);
+	cellsY = (int)ceilf((region.Max.y - region.Min.y) / cellSize);
+	cellsZ = (int)ceilf((region.Max.z - region.Min.z) / cellSize);
+	if (cellsX < 1) cellsX = 1;
+	if (cellsY < 1) cellsY = 1;
+	if (cellsZ < 1) cellsZ = 1;
+	entityCount = (int)entityBounds.size();
+	sceneHash = HashScene(entityBounds, isStatic);
+
+	int cellCount = cellsX * cellsY * cellsZ;
+	std::vector<std::vector<unsigned int>> cellWords(cellCount);
+	threadPool->ParallelFor(cellCount, [&](int cell)
+	{
+		BakeCell(cell, raycaster, entityBounds, isStatic, cellWords[cell]);
+	});
+
+	// Compress, sharing one copy between cells that see the same things
+	cellSets.resize(cellCount);
+	setOffsets.clear();
+	setData.clear();
+	std::map<std::vector<unsigned int>, int> uniqueSets;
+	std::vector<unsigned int> compressed;
+	for (int cell = 0; cell < cellCount; cell++)
+	{
+		Compress(cellWords[cell], compressed);
+
+		auto found = uniqueSets.find(compressed);
+		if (found != uniqueSets.end())
+		{
+			cellSets[cell] = found->second;
+			continue;
+		}
+
+		int set = (int)setOffsets.size();
+		uniqueSets[compressed] = set;
+		setOffsets.push_back((unsigned int)setData.size());
+		setData.insert(setData.end(), compressed.begin(), compressed.end());
+		cellSets[cell] = set;
+	}
+
+	cachedSet = -1;
+}
+
+// --------------------------------------------------------
+// Works out which entities can be seen from one cell
+// --------------------------------------------------------
+void PotentiallyVisibleSet::BakeCell(int cell, const SceneRaycaster& raycaster, const std::vector<AABB>& entityBounds, const std::vector<bool>& isStatic, std::vector<unsigned int>& words)
+{
+	int cx = cell % cellsX;
+	int cy = (cell / cellsX) % cellsY;
+	int cz = cell / (cellsX * cellsY);
+	XMFLOAT3 cellMin(
+		region.Min.x + cx * cellSize,
+		region.Min.y + cy * cellSize,
+		region.Min.z + cz * cellSize);
+
+	XMFLOAT3 origins[CellSampleCount];
+	for (int s = 0; s < CellSampleCount; s++)
+	{
+		origins[s] = XMFLOAT3(
+			cellMin.x + CellSamples[s][0] * cellSize,
+			cellMin.y + CellSamples[s][1] * cellSize,
+			cellMin.z + CellSamples[s][2] * cellSize);
+	}
+
+	words.assign((entityCount + 31) / 32, 0);
+	std::vector<Ray> rays(CellSampleCount * TargetSampleCount);
+	std::vector<RayHit> hits(rays.size());
+
+	for (int e = 0; e < entityCount; e++)
+	{
+		const AABB& box = entityBounds[e];
+
+		// Moving things and things touching the cell are always in
+		bool visible = !isStatic[e] ||
+			(box.Min.x <= cellMin.x + cellSize && box.Max.x >= cellMin.x &&
+			 box.Min.y <= cellMin.y + cellSize && box.Max.y >= cellMin.y &&
+			 box.Min.z <= cellMin.z + cellSize && box.Max.z >= cellMin.z);
+
+		if (!visible)
+		{
+			// Every cell sample to every target sample
+			int rayCount = 0;
+			for (int s = 0; s < CellSampleCount; s++)
+			{
+				for (int t = 0; t < TargetSampleCount; t++)
+				{
+					XMFLOAT3 target(
+						box.Min.x + TargetSamples[t][0] * (box.Max.x - box.Min.x),
+						box.Min.y + TargetSamples[t][1] * (box.Max.y - box.Min.y),
+						box.Min.z + TargetSamples[t][2] * (box.Max.z - box.Min.z));
+					XMFLOAT3 d(target.x - origins[s].x, target.y - origins[s].y, target.z - origins[s].z);
+					float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+
+					Ray& ray = rays[rayCount++];
+					ray.Origin = origins[s];
+					ray.Direction = XMFLOAT3(d.x / length, d.y / length, d.z / length);
+					ray.MaxDistance = length;
+				}
+			}
+
+			raycaster.RaycastRange(&rays[0], rayCount, &hits[0]);
+
+			// Seen if a ray lands on the entity itself, or gets all
+			// the way to its bounds without anything in the way
+			for (int r = 0; r < rayCount && !visible; r++)
+				visible = hits[r].Triangle == -1 || hits[r].Instance == e;
+		}
+
+		if (visible)
+			words[e >> 5] |= 1u << (e & 31);
+	}
+}
+
+bool PotentiallyVisibleSet::Save(const char* fileName)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	unsigned int header[] = {
+		PVSFileMagic,
+		(unsigned int)entityCount,
+		(unsigned int)sceneHash, (unsigned int)(sceneHash >> 32),
+		(unsigned int)cellsX, (unsigned int)cellsY, (unsigned int)cellsZ,
+		(unsigned int)setOffsets.size(),
+		(unsigned int)setData.size() };
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&region, sizeof(region));
+	file.write((const char*)&cellSize, sizeof(cellSize));
+	file.write((const char*)cellSets.data(), cellSets.size() * sizeof(int));
+	file.write((const char*)setOffsets.data(), setOffsets.size() * sizeof(unsigned int));
+	file.write((const char*)setData.data(), setData.size() * sizeof(unsigned int));
+	return file.good();
+}
+
+// --------------------------------------------------------
+// Reads into temporaries and only keeps the result if it
+// was baked for this scene, the file is exactly as long as
+// its header says, every cell and set points inside the
+// data and every set unpacks to exactly one bit per entity.
+// A stale, truncated or damaged file just fails (and leaves
+// the current sets alone).
+// --------------------------------------------------------
+bool PotentiallyVisibleSet::Load(const char* fileName, const std::vector<AABB>& entityBounds, const std::vector<bool>& isStatic)
+{
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+	unsigned long long fileBytes = (unsigned long long)file.tellg();
+	file.seekg(0);
+
+	unsigned long long expectedHash = HashScene(entityBounds, isStatic);
+	unsigned int header[9];
+	file.read((char*)header, sizeof(header));
+	if (!file.good() || header[0] != PVSFileMagic || header[1] != (unsigned int)entityBounds.size() ||
+		header[2] != (unsigned int)expectedHash || header[3] != (unsigned int)(expectedHash >> 32))
+		return false;
+
+	unsigned long long cellCount = (unsigned long long)header[4] * header[5] * header[6];
+	unsigned long long expectedBytes = sizeof(header) + sizeof(region) + sizeof(cellSize) +
+		cellCount * sizeof(int) + (unsigned long long)header[7] * sizeof(unsigned int) + (unsigned long long)header[8] * sizeof(unsigned int);
+	if (cellCount == 0 || fileBytes != expectedBytes)
+		return false;
+
+	AABB loadedRegion;
+	float loadedCellSize;
+	std::vector<int> loadedCellSets((size_t)cellCount);
+	std::vector<unsigned int> loadedOffsets(header[7]);
+	std::vector<unsigned int> loadedData(header[8]);
+	file.read((char*)&loadedRegion, sizeof(loadedRegion));
+	file.read((char*)&loadedCellSize, sizeof(loadedCellSize));
+	file.read((char*)loadedCellSets.data(), loadedCellSets.size() * sizeof(int));
+	file.read((char*)loadedOffsets.data(), loadedOffsets.size() * sizeof(unsigned int));
+	file.read((char*)loadedData.data(), loadedData.size() * sizeof(unsigned int));
+	if (!file.good())
+		return false;
+
+	for (int set : loadedCellSets)
+		if (set < 0 || (size_t)set >= loadedOffsets.size())
+			return false;
+	int wordCount = ((int)header[1] + 31) / 32;
+	for (unsigned int offset : loadedOffsets)
+		if (!IsValidSet(loadedData, offset, wordCount))
+			return false;
+
+	entityCount = (int)header[1];
+	sceneHash = expectedHash;
+	cellsX = (int)header[4];
+	cellsY = (int)header[5];
+	cellsZ = (int)header[6];
+	region = loadedRegion;
+	cellSize = loadedCellSize;
+	cellSets.swap(loadedCellSets);
+	setOffsets.swap(loadedOffsets);
+	setData.swap(loadedData);
+	cachedSet = -1;
+	return true;
+}
+
+const VisibilityBits* PotentiallyVisibleSet::GetVisibleSet(XMFLOAT3 position)
+{
+	if (cellSets.empty())
+		return nullptr;
+
+	int x = (int)floorf((position.x - region.Min.x) / cellSize);
+	int y = (int)floorf((position.y - region.Min.y) / cellSize);
+	int z = (int)floorf((position.z - region.Min.z) / cellSize);
+	if (x < 0 || y < 0 || z < 0 || x >= cellsX || y >= cellsY || z >= cellsZ)
+		return nullptr;
+
+	int set = cellSets[(z * cellsY + y) * cellsX + x];
+	if (set != cachedSet)
+	{
+		Decompress(set, cachedBits);
+		cachedSet = set;
+	}
+	return &cachedBits;
+}
+
+// --------------------------------------------------------
+// 64 bit FNV-1a over the entity count, which entities are
+// static and the bounds of the static ones (moving entities
+// are visible from everywhere, so where they start doesn't
+// change the bake)
+// --------------------------------------------------------
+unsigned long long PotentiallyVisibleSet::HashScene(const std::vector<AABB>& entityBounds, const std::vector<bool>& isStatic)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	auto add = [&hash](const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	unsigned int count = (unsigned int)entityBounds.size();
+	add(&count, sizeof(count));
+	for (size_t e = 0; e < entityBounds.size(); e++)
+	{
+		unsigned char staticFlag = isStatic[e] ? 1 : 0;
+		add(&staticFlag, sizeof(staticFlag));
+		if (staticFlag)
+			add(&entityBounds[e], sizeof(AABB));
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Run-length encodes words of all zeros or all ones, and
+// copies everything else as literals
+// --------------------------------------------------------
+void PotentiallyVisibleSet::Compress(const std::vector<unsigned int>& words, std::vector<unsigned int>& compressed)
+{
+	compressed.clear();
+
+	size_t i = 0;
+	while (i < words.size())
+	{
+		unsigned int word = words[i];
+		if (word == 0u || word == ~0u)
+		{
+			size_t run = i;
+			while (run < words.size() && words[run] == word && run - i < TokenCountMask)
+				run++;
+			compressed.push_back((word == 0u ? TokenZeros : TokenOnes) | (unsigned int)(run - i));
+			i = run;
+		}
+		else
+		{
+			size_t end = i;
+			while (end < words.size() && words[end] != 0u && words[end] != ~0u && end - i < TokenCountMask)
+				end++;
+			compressed.push_back(TokenLiteral | (unsigned int)(end - i));
+			compressed.insert(compressed.end(), words.begin() + i, words.begin() + end);
+			i = end;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Walks one compressed set's tokens, checking they unpack to
+// exactly wordCount words without reading past the data
+// --------------------------------------------------------
+bool PotentiallyVisibleSet::IsValidSet(const std::vector<unsigned int>& data, unsigned int offset, int wordCount)
+{
+	size_t read = offset;
+	unsigned long long written = 0;
+	while (written < (unsigned long long)wordCount)
+	{
+		if (read >= data.size())
+			return false;
+
+		unsigned int token = data[read++];
+		unsigned int count = token & TokenCountMask;
+		switch (token & TokenTypeMask)
+		{
+		case TokenZeros:
+		case TokenOnes:
+			break;
+		case TokenLiteral:
+			if (count > data.size() - read)
+				return false;
+			read += count;
+			break;
+		default:
+			return false;
+		}
+		written += count;
+	}
+	return written == (unsigned long long)wordCount;
+}
+
+// Sets are checked when they're loaded (or made by Bake()),
+// so this trusts the tokens
+void PotentiallyVisibleSet::Decompress(int set, VisibilityBits& bits)
+{
+	int wordCount = (entityCount + 31) / 32;
+	bits.Words.resize(wordCount);
+
+	unsigned int read = setOffsets[set];
+	int written = 0;
+	while (written < wordCount)
+	{
+		unsigned int token = setData[read++];
+		unsigned int count = token & TokenCountMask;
+		switch (token & TokenTypeMask)
+		{
+		case TokenZeros:
+			for (unsigned int i = 0; i < count; i++) bits.Words[written++] = 0u;
+			break;
+		case TokenOnes:
+			for (unsigned int i = 0; i < count; i++) bits.Words[written++] = ~0u;
+			break;
+		default:
+			for (unsigned int i = 0; i < count; i++) bits.Words[written++] = setData[read++];
+			break;
+		}
+	}
+}
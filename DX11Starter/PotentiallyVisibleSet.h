@@ -0,0 +1,77 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Bounds.h"
+#include "FrustumCuller.h"
+#include "SceneRaycaster.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// Precomputed visibility for static geometry.
+//
+// The walkable region is split into a grid of cells.  The
+// bake casts rays from sample points in every cell towards
+// sample points on every static entity's bounds; an entity
+// is potentially visible from the cell if any ray gets to it.
+// Entities that aren't static are visible from everywhere.
+//
+// Each cell's set is stored as a run-length compressed
+// bitset, and cells with identical sets share one copy.
+// At runtime the set for the camera's cell is unpacked once
+// and reused until the camera moves into another cell.
+// --------------------------------------------------------
+class PotentiallyVisibleSet
+{
+public:
+	PotentiallyVisibleSet();
+
+	// Entity i is traced as raycaster instance userData i.  The
+	// raycaster should only hold the static entities, since
+	// anything in it hides whatever is behind it.
+	void Bake(
+		const AABB& region,
+		float cellSize,
+		const SceneRaycaster& raycaster,
+		const std::vector<AABB>& entityBounds,
+		const std::vector<bool>& isStatic,
+		ThreadPool* threadPool = &ThreadPool::Shared());
+
+	// Saved data is rejected on load if it was baked for a
+	// different scene (see HashScene)
+	bool Save(const char* fileName);
+	bool Load(const char* fileName, const std::vector<AABB>& entityBounds, const std::vector<bool>& isStatic);
+	bool IsReady() { return !cellSets.empty(); }
+
+	// Set for the cell around the position, or null outside the
+	// baked region (treat everything as potentially visible)
+	const VisibilityBits* GetVisibleSet(DirectX::XMFLOAT3 position);
+
+	int GetCellCount() { return (int)cellSets.size(); }
+	int GetUniqueSetCount() { return (int)setOffsets.size(); }
+	int GetCompressedBytes() { return (int)(setData.size() * sizeof(unsigned int)); }
+
+private:
+	AABB region;
+	float cellSize;
+	int cellsX, cellsY, cellsZ;
+	int entityCount;
+	unsigned long long sceneHash;
+
+	std::vector<int> cellSets;				// Cell -> unique set
+	std::vector<unsigned int> setOffsets;	// Unique set -> start in setData
+	std::vector<unsigned int> setData;		// Every compressed set back to back
+
+	// Last unpacked set
+	int cachedSet;
+	VisibilityBits cachedBits;
+
+	void BakeCell(int cell, const SceneRaycaster& raycaster, const std::vector<AABB>& entityBounds, const std::vector<bool>& isStatic, std::vector<unsigned int>& words);
+
+	// The entity count, which ones are static and where those are
+	static unsigned long long HashScene(const std::vector<AABB>& entityBounds, const std::vector<bool>& isStatic);
+
+	static void Compress(const std::vector<unsigned int>& words, std::vector<unsigned int>& compressed);
+	static bool IsValidSet(const std::vector<unsigned int>& data, unsigned int offset, int wordCount);
+	void Decompress(int set, VisibilityBits& bits);
+};
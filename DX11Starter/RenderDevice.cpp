@@ -0,0 +1,130 @@
+#include "RenderDevice.h"
+
+// Null handles start here and are this far apart (never
+// zero, and never a real object)
+static const size_t FirstNullHandle = 0x10000;
+static const size_t NullHandleStride = 16;
+
+NullRenderDevice::NullRenderDevice()
+{
+	nextHandle = FirstNullHandle;
+}
+
+const void* NullRenderDevice::Create(ObjectKind kind)
+{
+	const void* handle = reinterpret_cast<const void*>(nextHandle);
+	nextHandle += NullHandleStride;
+
+	NullObject& object = objects[handle];
+	object.Kind = kind;
+	object.Usage = RenderUsage::Default;
+	object.ByteWidth = 0;
+	object.Mapped = false;
+	return handle;
+}
+
+// --------------------------------------------------------
+// The live object behind a handle, or null (counted as an
+// invalid call) if there isn't one of that kind
+// --------------------------------------------------------
+NullRenderDevice::NullObject* NullRenderDevice::Find(const void* handle, ObjectKind kind)
+{
+	auto existing = objects.find(handle);
+	if (existing == objects.end() || existing->second.Kind != kind)
+	{
+		stats.InvalidCalls++;
+		return nullptr;
+	}
+	return &existing->second;
+}
+
+void NullRenderDevice::Release(const void* handle, ObjectKind kind)
+{
+	if (!handle)
+		return;
+	if (Find(handle, kind))
+		objects.erase(handle);
+}
+
+RenderBuffer* NullRenderDevice::CreateBuffer(const RenderBufferDesc& desc, const void* initialData)
+{
+	if (desc.ByteWidth == 0 || (desc.Usage == RenderUsage::Immutable && !initialData))
+	{
+		stats.InvalidCalls++;
+		return nullptr;
+	}
+
+	const void* handle = Create(ObjectKind::Buffer);
+	NullObject& object = objects[handle];
+	object.Usage = desc.Usage;
+	object.ByteWidth = desc.ByteWidth;
+	if (desc.Usage == RenderUsage::Dynamic)
+		object.Memory.resize(desc.ByteWidth);
+
+	stats.BuffersCreated++;
+	stats.BytesCreated += desc.ByteWidth;
+	return (RenderBuffer*)handle;
+}
+
+void NullRenderDevice::ReleaseBuffer(RenderBuffer* buffer)
+{
+	if (!buffer)
+		return;
+	Release(buffer, ObjectKind::Buffer);
+	stats.BuffersReleased++;
+}
+
+void NullRenderDevice::UpdateSubresource(RenderBuffer* buffer, const void* data, unsigned int size)
+{
+	NullObject* object = Find(buffer, ObjectKind::Buffer);
+	if (object && (object->Usage != RenderUsage::Default || size > object->ByteWidth || !data))
+		stats.InvalidCalls++;
+
+	stats.Updates++;
+	stats.BytesUpdated += size;
+}
+
+void* NullRenderDevice::Map(RenderBuffer* buffer, RenderMapMode /*mode*/)
+{
+	NullObject* object = Find(buffer, ObjectKind::Buffer);
+	if (!object)
+		return nullptr;
+	if (object->Usage != RenderUsage::Dynamic || object->Mapped)
+	{
+		stats.InvalidCalls++;
+		return nullptr;
+	}
+
+	object->Mapped = true;
+	stats.Maps++;
+	return &object->Memory[0];
+}
+
+void NullRenderDevice::Unmap(RenderBuffer* buffer)
+{
+	NullObject* object = Find(buffer, ObjectKind::Buffer);
+	if (!object)
+		return;
+	if (!object->Mapped)
+		stats.InvalidCalls++;
+	object->Mapped = false;
+}
+
+RenderShaderResource* NullRenderDevice::CreateStructuredView(RenderBuffer* buffer, unsigned int /*elementCount*/)
+{
+	if (!Find(buffer, ObjectKind::Buffer))
+		return nullptr;
+	return (RenderShaderResource*)Create(ObjectKind::ShaderResource);
+}
+
+void NullRenderDevice::ReleaseShaderResource(RenderShaderResource* view) { Release(view, ObjectKind::ShaderResource); }
+
+// Shaders and layouts have no code to check, so they're
+// made whatever they're given
+RenderVertexShader* NullRenderDevice::CreateVertexShader(const void* /*code*/, size_t /*size*/) { return (RenderVertexShader*)Create(ObjectKind::VertexShader); }
+RenderPixelShader* NullRenderDevice::CreatePixelShader(const void* /*code*/, size_t /*size*/) { return (RenderPixelShader*)Create(ObjectKind::PixelShader); }
+RenderInputLayout* NullRenderDevice::CreateInputLayout(const ShaderReflectionData& /*data*/, const void* /*code*/, size_t /*size*/) { return (RenderInputLayout*)Create(ObjectKind::InputLayout); }
+
+void NullRenderDevice::ReleaseVertexShader(RenderVertexShader* shader) { Release(shader, ObjectKind::VertexShader); }
+void NullRenderDevice::ReleasePixelShader(RenderPixelShader* shader) { Release(shader, ObjectKind::PixelShader); }
+void NullRenderDevice::ReleaseInputLayout(RenderInputLayout* layout) { Release(layout, ObjectKind::InputLayout); }
@@ -0,0 +1,148 @@
+#pragma once
+#include <stddef.h>
+#include <unordered_map>
+#include <vector>
+
+#include "RenderTypes.h"
+#include "StateCache.h"
+
+struct ShaderReflectionData;
+
+// --------------------------------------------------------
+// Objects made and buffers written through a device since
+// the last reset
+// --------------------------------------------------------
+struct RenderDeviceStats
+{
+	int BuffersCreated = 0;
+	int BuffersReleased = 0;
+	long long BytesCreated = 0;
+	int Updates = 0;
+	long long BytesUpdated = 0;
+	int Maps = 0;
+	int InvalidCalls = 0;		// Null device only (see NullRenderDevice)
+};
+
+// --------------------------------------------------------
+// Everything the engine's drawing code needs from a GPU:
+// making and writing buffers, making shaders and input
+// layouts, plus the context that binds and draws (see
+// IStateContext).  Meshes, materials, shaders and the
+// constant ring all go through this, so the same code can
+// run on a real device (D3D11RenderDevice.h) or on
+// NullRenderDevice with no GPU (or Windows) behind it.
+// --------------------------------------------------------
+class IRenderDevice
+{
+public:
+	virtual ~IRenderDevice() {}
+
+	// Null on failure.  initialData may be null.
+	virtual RenderBuffer* CreateBuffer(const RenderBufferDesc& desc, const void* initialData) = 0;
+	virtual void ReleaseBuffer(RenderBuffer* buffer) = 0;
+
+	// Replaces a whole (RenderUsage::Default) buffer's contents
+	virtual void UpdateSubresource(RenderBuffer* buffer, const void* data, unsigned int size) = 0;
+
+	// The start of a dynamic buffer's memory (null on failure),
+	// writable until Unmap()
+	virtual void* Map(RenderBuffer* buffer, RenderMapMode mode) = 0;
+	virtual void Unmap(RenderBuffer* buffer) = 0;
+
+	// A view of every element of a structured buffer
+	virtual RenderShaderResource* CreateStructuredView(RenderBuffer* buffer, unsigned int elementCount) = 0;
+	virtual void ReleaseShaderResource(RenderShaderResource* view) = 0;
+
+	// From compiled code.  Null on failure.
+	virtual RenderVertexShader* CreateVertexShader(const void* code, size_t size) = 0;
+	virtual RenderPixelShader* CreatePixelShader(const void* code, size_t size) = 0;
+	virtual void ReleaseVertexShader(RenderVertexShader* shader) = 0;
+	virtual void ReleasePixelShader(RenderPixelShader* shader) = 0;
+
+	// A layout matching a vertex shader's reflected inputs
+	// (per-instance ones read from slot 1)
+	virtual RenderInputLayout* CreateInputLayout(const ShaderReflectionData& data, const void* code, size_t size) = 0;
+	virtual void ReleaseInputLayout(RenderInputLayout* layout) = 0;
+
+	// Constant buffers can be bound at an offset, and dynamic
+	// ones mapped with WriteNoOverwrite (see ConstantBufferRing)
+	virtual bool SupportsConstantBufferOffsets() = 0;
+
+	// Binds and draws on the immediate context
+	virtual IStateContext* GetContext() = 0;
+
+	RenderDeviceStats GetStats() { return stats; }
+	void ResetStats() { stats = RenderDeviceStats(); }
+
+protected:
+	RenderDeviceStats stats;
+};
+
+// --------------------------------------------------------
+// Device with nothing behind it, for headless benchmarks.
+// Handles are addresses that must never be dereferenced,
+// and every bind and draw is recorded by a
+// RecordingStateContext.  Dynamic buffers get real memory,
+// so mapping them works.
+//
+// Anything the D3D11 runtime would reject is counted as
+// invalid: using an unknown handle (or one of the wrong
+// kind), updating anything but a default buffer, mapping
+// anything but a dynamic one, writing more than a buffer
+// holds, and unmapping what isn't mapped.
+// --------------------------------------------------------
+class NullRenderDevice : public IRenderDevice
+{
+public:
+	NullRenderDevice();
+
+	RenderBuffer* CreateBuffer(const RenderBufferDesc& desc, const void* initialData);
+	void ReleaseBuffer(RenderBuffer* buffer);
+	void UpdateSubresource(RenderBuffer* buffer, const void* data, unsigned int size);
+	void* Map(RenderBuffer* buffer, RenderMapMode mode);
+	void Unmap(RenderBuffer* buffer);
+	RenderShaderResource* CreateStructuredView(RenderBuffer* buffer, unsigned int elementCount);
+	void ReleaseShaderResource(RenderShaderResource* view);
+	RenderVertexShader* CreateVertexShader(const void* code, size_t size);
+	RenderPixelShader* CreatePixelShader(const void* code, size_t size);
+	void ReleaseVertexShader(RenderVertexShader* shader);
+	void ReleasePixelShader(RenderPixelShader* shader);
+	RenderInputLayout* CreateInputLayout(const ShaderReflectionData& data, const void* code, size_t size);
+	void ReleaseInputLayout(RenderInputLayout* layout);
+	bool SupportsConstantBufferOffsets() { return true; }
+	IStateContext* GetContext() { return &recording; }
+
+	RecordingStateContext& GetRecording() { return recording; }
+
+	// Everything made and not yet released
+	int GetLiveObjectCount() { return (int)objects.size(); }
+
+private:
+	enum class ObjectKind
+	{
+		Buffer,
+		ShaderResource,
+		VertexShader,
+		PixelShader,
+		InputLayout
+	};
+
+	struct NullObject
+	{
+		ObjectKind Kind;
+		RenderUsage Usage;
+		unsigned int ByteWidth;
+		bool Mapped;
+		std::vector<unsigned char> Memory;	// Dynamic buffers only
+	};
+
+	RecordingStateContext recording;
+
+	// Every live object, by handle
+	std::unordered_map<const void*, NullObject> objects;
+	size_t nextHandle;
+
+	const void* Create(ObjectKind kind);
+	NullObject* Find(const void* handle, ObjectKind kind);
+	void Release(const void* handle, ObjectKind kind);
+};
@@ -0,0 +1,125 @@
+#include "RenderQueue.h"
+
+static const unsigned int DepthMax = (1u << RenderQueue::DepthBits) - 1;
+
+RenderQueue::RenderQueue()
+{
+	nextSortId = 0;
+	SetDepthRange(0.0f, 100.0f);
+}
+
+void RenderQueue::SetDepthRange(float nearDepth, float farDepth)
+{
+	this->nearDepth = nearDepth;
+	depthScale = farDepth > nearDepth ? DepthMax / (farDepth - nearDepth) : 0.0f;
+}
+
+void RenderQueue::Clear()
+{
+	items.clear();
+}
+
+// --------------------------------------------------------
+// Packs a draw's state and depth into its sort key.  Ids
+// wider than their field are masked, which only costs some
+// extra state changes, never a wrong draw.
+// --------------------------------------------------------
+void RenderQueue::Add(RenderPass pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth, int payload)
+{
+	unsigned long long state =
+		((unsigned long long)(shader & ((1u << ShaderBits) - 1)) << (MaterialBits + MeshBits)) |
+		((unsigned long long)(material & ((1u << MaterialBits) - 1)) << MeshBits) |
+		(unsigned long long)(mesh & ((1u << MeshBits) - 1));
+	unsigned long long quantized = QuantizeDepth(depth);
+
+	RenderItem item;
+	item.Payload = payload;
+	if (pass == RenderPass::Transparent)
+		item.Key = ((unsigned long long)pass << 62) | ((DepthMax - quantized) << 38) | state;
+	else
+		item.Key = ((unsigned long long)pass << 62) | (state << DepthBits) | quantized;
+	items.push_back(item);
+}
+
+// --------------------------------------------------------
+// LSD radix sort on the keys, one byte at a time, ping-
+// ponging between the items and a scratch buffer
+// --------------------------------------------------------
+void RenderQueue::Sort()
+{
+	int count = (int)items.size();
+	if (count < 2)
+		return;
+
+	unsigned int histograms[8][256] = {};
+	for (int i = 0; i < count; i++)
+	{
+		unsigned long long key = items[i].Key;
+		for (int digit = 0; digit < 8; digit++)
+			histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+	}
+
+	scratch.resize(count);
+	RenderItem* source = &items[0];
+	RenderItem* destination = &scratch[0];
+	for (int digit = 0; digit < 8; digit++)
+	{
+		unsigned int* histogram = histograms[digit];
+
+		// Nothing to do if every key shares this byte
+		if (histogram[(source[0].Key >> (digit * 8)) & 0xFF] == (unsigned int)count)
+			continue;
+
+		unsigned int offsets[256];
+		unsigned int sum = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			offsets[b] = sum;
+			sum += histogram[b];
+		}
+
+		for (int i = 0; i < count; i++)
+			destination[offsets[(source[i].Key >> (digit * 8)) & 0xFF]++] = source[i];
+
+		RenderItem* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	// Odd number of passes leaves the result in scratch
+	if (source != &items[0])
+		items.swap(scratch);
+}
+
+unsigned long long RenderQueue::GetStateBits(unsigned long long key)
+{
+	const unsigned long long stateMask = (1ull << (ShaderBits + MaterialBits + MeshBits)) - 1;
+	if (GetPass(key) == RenderPass::Transparent)
+		return (key & (3ull << 62)) | (key & stateMask);
+	return key >> DepthBits;
+}
+
+unsigned int RenderQueue::GetSortId(const void* resource)
+{
+	auto found = sortIds.find(resource);
+	if (found != sortIds.end())
+		return found->second;
+
+	unsigned int id = nextSortId++;
+	sortIds[resource] = id;
+	return id;
+}
+
+void RenderQueue::ResetSortIds()
+{
+	sortIds.clear();
+	nextSortId = 0;
+}
+
+unsigned int RenderQueue::QuantizeDepth(float depth) const
+{
+	float scaled = (depth - nearDepth) * depthScale;
+	if (scaled <= 0.0f) return 0;
+	if (scaled >= (float)DepthMax) return DepthMax;
+	return (unsigned int)scaled;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+
+// --------------------------------------------------------
+// Passes in the order they're drawn
+// --------------------------------------------------------
+enum class RenderPass : unsigned int
+{
+	Opaque = 0,
+	Transparent = 1
+};
+
+// --------------------------------------------------------
+// One queued draw: a sort key and the index of whatever
+// the caller wants to draw (an entity, an instance...)
+// --------------------------------------------------------
+struct RenderItem
+{
+	unsigned long long Key;
+	int Payload;
+};
+
+// --------------------------------------------------------
+// Per-frame list of draws, sorted by packed 64-bit keys.
+//
+// Opaque keys, from the top bit down:
+//   pass (2) | shader (10) | material (12) | mesh (16) | depth (24)
+// so opaque draws group by state first and go front to back
+// within a group.  Transparent keys put inverted depth right
+// after the pass so they're drawn strictly back to front:
+//   pass (2) | ~depth (24) | shader (10) | material (12) | mesh (16)
+//
+// Keys are sorted with an 8 bit LSD radix sort.  All eight
+// histograms are built in one read of the keys, and passes
+// where every key has the same digit are skipped.
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	static const int ShaderBits = 10;
+	static const int MaterialBits = 12;
+	static const int MeshBits = 16;
+	static const int DepthBits = 24;
+
+	RenderQueue();
+
+	// View depths are quantized between these
+	void SetDepthRange(float nearDepth, float farDepth);
+
+	void Clear();
+	void Add(RenderPass pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth, int payload);
+	void Sort();
+
+	int GetCount() const { return (int)items.size(); }
+	const RenderItem& GetItem(int index) const { return items[index]; }
+	const std::vector<RenderItem>& GetItems() const { return items; }
+
+	// Small, stable id for any resource pointer (shader,
+	// material, mesh...), handed out in first-seen order.
+	// Ids are never recycled: a resource created at a freed
+	// one's address inherits its id, and a scene that keeps
+	// swapping resources out should ResetSortIds() between
+	// loads so the ids stay small enough for their fields.
+	unsigned int GetSortId(const void* resource);
+	void ResetSortIds();
+	int GetSortIdCount() const { return (int)sortIds.size(); }
+
+	static RenderPass GetPass(unsigned long long key) { return (RenderPass)(key >> 62); }
+
+	// Pass, shader, material and mesh without the depth, so
+	// draws that could share one call compare equal
+	static unsigned long long GetStateBits(unsigned long long key);
+
+private:
+	std::vector<RenderItem> items;
+	std::vector<RenderItem> scratch;
+
+	float nearDepth;
+	float depthScale;
+
+	std::unordered_map<const void*, unsigned int> sortIds;
+	unsigned int nextSortId;
+
+	unsigned int QuantizeDepth(float depth) const;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+// --------------------------------------------------------
+// Opaque handles to GPU objects, made by an IRenderDevice.
+//
+// None of these is ever defined: the D3D11 backend's
+// handles are its own interfaces (see D3D11RenderDevice.h)
+// and the null backend's are addresses nothing lives at, so
+// they're only ever compared or handed back to the device.
+// --------------------------------------------------------
+struct RenderBuffer;
+struct RenderShaderResource;
+struct RenderSampler;
+struct RenderInputLayout;
+struct RenderVertexShader;
+struct RenderPixelShader;
+struct RenderBlendState;
+struct RenderDepthStencilState;
+
+// --------------------------------------------------------
+// How a buffer's contents are written
+// --------------------------------------------------------
+enum class RenderUsage
+{
+	Default,	// Replaced whole with UpdateSubresource()
+	Immutable,	// Initial data only
+	Dynamic		// Written by the CPU with Map()
+};
+
+// Where a buffer can be bound (combine with |)
+enum RenderBindFlags
+{
+	RenderBindVertexBuffer = 1,
+	RenderBindIndexBuffer = 2,
+	RenderBindConstantBuffer = 4,
+	RenderBindShaderResource = 8
+};
+
+struct RenderBufferDesc
+{
+	unsigned int ByteWidth = 0;
+	RenderUsage Usage = RenderUsage::Default;
+	unsigned int BindFlags = 0;
+	unsigned int StructureStride = 0;	// Structured buffers only
+};
+
+enum class RenderIndexFormat
+{
+	UInt16,
+	UInt32
+};
+
+// --------------------------------------------------------
+// How a dynamic buffer is mapped
+// --------------------------------------------------------
+enum class RenderMapMode
+{
+	WriteDiscard,		// Starts over (the GPU keeps what it had)
+	WriteNoOverwrite	// Appends: nothing the GPU may read is touched
+};
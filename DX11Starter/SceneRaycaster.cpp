@@ -0,0 +1,246 @@
+#include "SceneRaycaster.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+
+using namespace DirectX;
+
+// Rays handed to each thread pool task (a multiple of four)
+static const int RaysPerTask = 256;
+
+// BuildNodes() never makes trees deeper than 60 levels
+static const int MaxStackDepth = 64;
+
+SceneRaycaster::SceneRaycaster(ThreadPool* threadPool)
+{
+	this->threadPool = threadPool;
+	rebuildTree = false;
+	refitTree = false;
+}
+
+int SceneRaycaster::AddInstance(const TriangleBVH* bvh, const XMFLOAT4X4& world, int userData)
+{
+	Instance instance;
+	instance.BVH = bvh;
+	instance.UserData = userData;
+	instances.push_back(instance);
+	rebuildTree = true;
+
+	StoreTransform(instances.back(), world);
+	return (int)instances.size() - 1;
+}
+
+// --------------------------------------------------------
+// Only instances whose matrix actually changed need the
+// tree refit on the next Commit()
+// --------------------------------------------------------
+void SceneRaycaster::SetTransform(int index, const XMFLOAT4X4& world)
+{
+	Instance& instance = instances[index];
+	if (memcmp(&instance.World, &world, sizeof(XMFLOAT4X4)) == 0)
+		return;
+
+	StoreTransform(instance, world);
+	refitTree = true;
+}
+
+// --------------------------------------------------------
+// Stores the inverse for moving rays into model space and
+// a world box around the mesh for the scene tree
+// --------------------------------------------------------
+void SceneRaycaster::StoreTransform(Instance& instance, const XMFLOAT4X4& world)
+{
+	instance.World = world;
+
+	XMMATRIX w = XMLoadFloat4x4(&world);
+	XMStoreFloat4x4(&instance.InverseWorld, XMMatrixInverse(nullptr, w));
+
+	// Same trick as Entity::UpdateWorldMatrix: the box center moves
+	// with the matrix, the extents go through its absolute value
+	const AABB& local = instance.BVH->GetBounds();
+	XMFLOAT3 c((local.Min.x + local.Max.x) * 0.5f, (local.Min.y + local.Max.y) * 0.5f, (local.Min.z + local.Max.z) * 0.5f);
+	XMFLOAT3 e((local.Max.x - local.Min.x) * 0.5f, (local.Max.y - local.Min.y) * 0.5f, (local.Max.z - local.Min.z) * 0.5f);
+
+	const XMFLOAT4X4& m = world;
+	XMFLOAT3 wc(
+		c.x * m._11 + c.y * m._21 + c.z * m._31 + m._41,
+		c.x * m._12 + c.y * m._22 + c.z * m._32 + m._42,
+		c.x * m._13 + c.y * m._23 + c.z * m._33 + m._43);
+	XMFLOAT3 we(
+		e.x * fabsf(m._11) + e.y * fabsf(m._21) + e.z * fabsf(m._31),
+		e.x * fabsf(m._12) + e.y * fabsf(m._22) + e.z * fabsf(m._32),
+		e.x * fabsf(m._13) + e.y * fabsf(m._23) + e.z * fabsf(m._33));
+
+	instance.WorldBounds.Min = XMFLOAT3(wc.x - we.x, wc.y - we.y, wc.z - we.z);
+	instance.WorldBounds.Max = XMFLOAT3(wc.x + we.x, wc.y + we.y, wc.z + we.z);
+}
+
+void SceneRaycaster::Clear()
+{
+	instances.clear();
+	nodes.clear();
+	instanceOrder.clear();
+	rebuildTree = false;
+	refitTree = false;
+}
+
+// --------------------------------------------------------
+// Brings the scene tree up to date with the instance boxes:
+// a full SAH build when the instance set changed, otherwise
+// a refit if anything moved
+// --------------------------------------------------------
+void SceneRaycaster::Commit()
+{
+	if (!rebuildTree && !refitTree)
+		return;
+
+	bounds.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+		bounds[i] = instances[i].WorldBounds;
+
+	if (rebuildTree)
+		TriangleBVH::BuildNodes(bounds, nodes, instanceOrder);
+	else
+		TriangleBVH::RefitNodes(bounds, nodes, instanceOrder);
+	rebuildTree = false;
+	refitTree = false;
+}
+
+bool SceneRaycaster::Raycast(const Ray& ray, RayHit& hit) const
+{
+	RayPacket packet;
+	packet.SetRay(0, &ray);
+	for (int lane = 1; lane < 4; lane++)
+		packet.SetRay(lane, nullptr);
+	packet.UpdateInverseDirections();
+
+	TracePacket(packet);
+
+	hit = packet.GetHit(0);
+	return hit.Triangle != -1;
+}
+
+// --------------------------------------------------------
+// Traces a whole batch, four rays per packet, spread over
+// the thread pool in chunks of consecutive rays (so rays
+// that were generated together stay coherent)
+// --------------------------------------------------------
+void SceneRaycaster::Raycast(const std::vector<Ray>& rays, std::vector<RayHit>& hits) const
+{
+	int rayCount = (int)rays.size();
+	hits.resize(rayCount);
+
+	int taskCount = (rayCount + RaysPerTask - 1) / RaysPerTask;
+	threadPool->ParallelFor(taskCount, [&](int task)
+	{
+		int begin = task * RaysPerTask;
+		int end = std::min(begin + RaysPerTask, rayCount);
+		RaycastRange(&rays[begin], end - begin, &hits[begin]);
+	});
+}
+
+void SceneRaycaster::RaycastRange(const Ray* rays, int rayCount, RayHit* hits) const
+{
+	RayPacket packet;
+	for (int first = 0; first < rayCount; first += 4)
+	{
+		for (int lane = 0; lane < 4; lane++)
+			packet.SetRay(lane, first + lane < rayCount ? &rays[first + lane] : nullptr);
+		packet.UpdateInverseDirections();
+
+		TracePacket(packet);
+
+		for (int lane = 0; lane < 4 && first + lane < rayCount; lane++)
+			hits[first + lane] = packet.GetHit(lane);
+	}
+}
+
+// --------------------------------------------------------
+// Walks the scene tree near to far, tracing the instances
+// in every leaf the packet reaches
+// --------------------------------------------------------
+void SceneRaycaster::TracePacket(RayPacket& packet) const
+{
+	if (nodes.empty())
+		return;
+
+	float entry[4];
+	if (TriangleBVH::IntersectNode(nodes[0], packet, entry) == 0)
+		return;
+
+	std::pair<int, float> stack[MaxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = std::make_pair(0, 0.0f);
+
+	while (stackSize > 0)
+	{
+		std::pair<int, float> current = stack[--stackSize];
+
+		float farthest = std::max(std::max(packet.MaxT[0], packet.MaxT[1]), std::max(packet.MaxT[2], packet.MaxT[3]));
+		if (current.second >= farthest)
+			continue;
+
+		const TriangleBVH::Node& node = nodes[current.first];
+		if (node.IsLeaf())
+		{
+			for (int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+				TraceInstance(instances[instanceOrder[i]], packet);
+			continue;
+		}
+
+		float leftEntry[4], rightEntry[4];
+		int leftMask = TriangleBVH::IntersectNode(nodes[node.LeftFirst], packet, leftEntry);
+		int rightMask = TriangleBVH::IntersectNode(nodes[node.LeftFirst + 1], packet, rightEntry);
+
+		float leftNear = FLT_MAX, rightNear = FLT_MAX;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (leftMask & (1 << lane)) leftNear = std::min(leftNear, leftEntry[lane]);
+			if (rightMask & (1 << lane)) rightNear = std::min(rightNear, rightEntry[lane]);
+		}
+
+		// Far child goes on the stack first
+		bool leftFirst = leftNear <= rightNear;
+		if (rightMask && leftFirst) stack[stackSize++] = std::make_pair(node.LeftFirst + 1, rightNear);
+		if (leftMask) stack[stackSize++] = std::make_pair(node.LeftFirst, leftNear);
+		if (rightMask && !leftFirst) stack[stackSize++] = std::make_pair(node.LeftFirst + 1, rightNear);
+	}
+}
+
+// --------------------------------------------------------
+// Moves the packet into the instance's model space, traces
+// its mesh BVH and moves it back.  Directions aren't
+// renormalized, so hit distances stay in world units.
+// --------------------------------------------------------
+void SceneRaycaster::TraceInstance(const Instance& instance, RayPacket& packet) const
+{
+	RayPacket local = packet;
+	const XMFLOAT4X4& m = instance.InverseWorld;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		float ox = packet.OriginX[lane], oy = packet.OriginY[lane], oz = packet.OriginZ[lane];
+		float dx = packet.DirX[lane], dy = packet.DirY[lane], dz = packet.DirZ[lane];
+
+		local.OriginX[lane] = ox * m._11 + oy * m._21 + oz * m._31 + m._41;
+		local.OriginY[lane] = ox * m._12 + oy * m._22 + oz * m._32 + m._42;
+		local.OriginZ[lane] = ox * m._13 + oy * m._23 + oz * m._33 + m._43;
+		local.DirX[lane] = dx * m._11 + dy * m._21 + dz * m._31;
+		local.DirY[lane] = dx * m._12 + dy * m._22 + dz * m._32;
+		local.DirZ[lane] = dx * m._13 + dy * m._23 + dz * m._33;
+	}
+	local.UpdateInverseDirections();
+
+	instance.BVH->IntersectPacket(local, instance.UserData);
+
+	// Only the hit results come back out
+	for (int lane = 0; lane < 4; lane++)
+	{
+		packet.MaxT[lane] = local.MaxT[lane];
+		packet.U[lane] = local.U[lane];
+		packet.V[lane] = local.V[lane];
+		packet.Triangle[lane] = local.Triangle[lane];
+		packet.Instance[lane] = local.Instance[lane];
+	}
+}
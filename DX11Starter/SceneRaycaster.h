@@ -0,0 +1,69 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Bounds.h"
+#include "TriangleBVH.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// Ray queries against every mesh instance in the scene.
+//
+// Instances pair a mesh's triangle BVH with a world matrix.
+// Commit() builds a small SAH tree over their world boxes
+// after instances are added or cleared, refits it when some
+// only moved, and does nothing when nothing changed.  Rays are traced in
+// packets of four through that tree and then, transformed
+// into model space, through each mesh BVH they reach.
+// Batches are split across the thread pool.
+//
+// World matrices are row-vector DirectXMath matrices (NOT the
+// transposed copies we hand to HLSL).  Hit.Instance is the
+// userData given to AddInstance().
+// --------------------------------------------------------
+class SceneRaycaster
+{
+public:
+	SceneRaycaster(ThreadPool* threadPool = &ThreadPool::Shared());
+
+	int AddInstance(const TriangleBVH* bvh, const DirectX::XMFLOAT4X4& world, int userData);
+	void SetTransform(int instance, const DirectX::XMFLOAT4X4& world);
+	void Clear();
+	void Commit();
+
+	// Closest hit for one ray, false on a miss
+	bool Raycast(const Ray& ray, RayHit& hit) const;
+
+	// Closest hit for every ray (hits[i].Triangle is -1 on a miss)
+	void Raycast(const std::vector<Ray>& rays, std::vector<RayHit>& hits) const;
+
+	// Same, but only on the calling thread (for callers that
+	// already split their work across the pool)
+	void RaycastRange(const Ray* rays, int rayCount, RayHit* hits) const;
+
+	int GetInstanceCount() const { return (int)instances.size(); }
+
+private:
+	struct Instance
+	{
+		const TriangleBVH* BVH;
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 InverseWorld;
+		AABB WorldBounds;
+		int UserData;
+	};
+
+	ThreadPool* threadPool;
+
+	std::vector<Instance> instances;
+	std::vector<TriangleBVH::Node> nodes;
+	std::vector<int> instanceOrder;
+	std::vector<AABB> bounds;
+	bool rebuildTree;		// Instances were added or cleared
+	bool refitTree;			// Instances moved
+
+	void StoreTransform(Instance& instance, const DirectX::XMFLOAT4X4& world);
+
+	void TracePacket(RayPacket& packet) const;
+	void TraceInstance(const Instance& instance, RayPacket& packet) const;
+};
@@ -0,0 +1,257 @@
+#include "SceneSubmitter.h"
+#include "Vertex.h"
+#include <assert.h>
+#include <stdio.h>
+
+using namespace DirectX;
+
+// Runs of draws sharing a mesh and material at least this
+// long are drawn instanced
+static const int MinInstancedGroupSize = 2;
+
+// Times a draw can need to re-upload constants the ring
+// lost.  Shaders size the ring so the first pass wraps it
+// at most once and the second never does.
+static const int MaxConstantReuploadPasses = 2;
+
+SceneSubmitter::SceneSubmitter()
+{
+	device = nullptr;
+	instancingEnabled = true;
+	transparentBlendState = nullptr;
+	transparentDepthState = nullptr;
+	entities = nullptr;
+	fades = nullptr;
+}
+
+void SceneSubmitter::Init(IRenderDevice* device)
+{
+	this->device = device;
+}
+
+void SceneSubmitter::SetTransparentStates(RenderBlendState* blendState, RenderDepthStencilState* depthState)
+{
+	transparentBlendState = blendState;
+	transparentDepthState = depthState;
+}
+
+// --------------------------------------------------------
+// Queues and sorts the visible entities, then groups them
+// --------------------------------------------------------
+void SceneSubmitter::Prepare(const std::vector<Entity*>& entities, const std::vector<float>& fades, const std::vector<int>& visible, Camera* camera)
+{
+	this->entities = &entities;
+	this->fades = &fades;
+
+	// Queue everything visible, then sort by state (and by
+	// depth for anything transparent)
+	XMFLOAT3 cameraPosition = camera->GetPosition();
+	XMFLOAT3 cameraDirection = camera->GetDirection();
+	renderQueue.SetDepthRange(camera->GetNearPlane(), camera->GetFarPlane());
+	renderQueue.Clear();
+	for (int index : visible)
+	{
+		Entity* entity = entities[index];
+		Material* material = entity->GetMaterial();
+		XMFLOAT3 center = entity->GetWorldSphere().Center;
+		float depth =
+			(center.x - cameraPosition.x) * cameraDirection.x +
+			(center.y - cameraPosition.y) * cameraDirection.y +
+			(center.z - cameraPosition.z) * cameraDirection.z;
+
+		renderQueue.Add(
+			material->IsTransparent() ? RenderPass::Transparent : RenderPass::Opaque,
+			renderQueue.GetSortId(material->GetPixelShader()),
+			material->GetId(),
+			renderQueue.GetSortId(entity->GetMesh()),
+			depth,
+			index);
+	}
+	renderQueue.Sort();
+
+	// Split the sorted draws into runs that share a pass, shader,
+	// material and mesh.  Long enough runs whose material has an
+	// instanced shader become one instanced draw, and all their
+	// instances go into a single upload for the frame.
+	const std::vector<RenderItem>& items = renderQueue.GetItems();
+	drawGroups.clear();
+	instanceData.clear();
+	for (size_t first = 0; first < items.size(); )
+	{
+		unsigned long long state = RenderQueue::GetStateBits(items[first].Key);
+		size_t end = first + 1;
+		while (end < items.size() && RenderQueue::GetStateBits(items[end].Key) == state)
+			end++;
+
+		DrawGroup group;
+		group.First = (int)first;
+		group.Count = (int)(end - first);
+		group.FirstInstance = -1;
+
+		SimpleVertexShader* instancedShader = entities[items[first].Payload]->GetMaterial()->GetInstancedVertexShader();
+		if (instancingEnabled && group.Count >= MinInstancedGroupSize && instancedShader && instancedShader->GetPerInstanceCompatible())
+		{
+			group.FirstInstance = (int)instanceData.size();
+			for (size_t i = first; i < end; i++)
+			{
+				int index = items[i].Payload;
+				XMFLOAT4X4 world = entities[index]->GetWorldMatrix();
+
+				InstanceData instance;
+				XMStoreFloat4x4(&instance.World, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+				instance.Fade = fades[index];
+				instanceData.push_back(instance);
+			}
+		}
+
+		drawGroups.push_back(group);
+		first = end;
+	}
+	if (!instanceData.empty())
+		instanceBuffer.Update(device, &instanceData[0], (int)instanceData.size());
+}
+
+// Instanced groups cost about as much to record as one draw
+const int* SceneSubmitter::GetGroupCosts()
+{
+	groupCosts.resize(drawGroups.size());
+	for (size_t g = 0; g < drawGroups.size(); g++)
+		groupCosts[g] = drawGroups[g].FirstInstance >= 0 ? 1 : drawGroups[g].Count;
+	return groupCosts.empty() ? nullptr : &groupCosts[0];
+}
+
+// --------------------------------------------------------
+// Records draw groups [first, end) through the given cache
+// --------------------------------------------------------
+void SceneSubmitter::Record(int first, int end, StateCache& cache, IConstantStager* worker)
+{
+	const std::vector<RenderItem>& items = renderQueue.GetItems();
+
+	RenderPass currentPass = RenderPass::Opaque;
+	const MaterialBindings* currentBindings = nullptr;
+	for (int g = first; g < end; g++)
+	{
+		const DrawGroup& group = drawGroups[g];
+		unsigned long long key = items[group.First].Key;
+		if (RenderQueue::GetPass(key) != currentPass)
+		{
+			currentPass = RenderQueue::GetPass(key);
+			cache.SetBlendState(transparentBlendState);
+			cache.SetDepthStencilState(transparentDepthState);
+		}
+
+		// Every draw in the group shares these
+		Entity* firstEntity = (*entities)[items[group.First].Payload];
+		Mesh* mesh = firstEntity->GetMesh();
+		Material* material = firstEntity->GetMaterial();
+
+		// Set buffers in the input assembler
+		//  - The state cache drops the bind if the previous draw
+		//    used the same mesh (likely, now draws are sorted)
+		cache.SetVertexBuffer(0, mesh->GetVertexBuffer(), sizeof(Vertex), 0);
+		cache.SetIndexBuffer(mesh->GetIndexBuffer(), RenderIndexFormat::UInt32, 0);
+
+		// Materials are baked into binding blocks (including their
+		// own parameter buffer), so applying one is a few cached
+		// binds, and only when the material or variant changes
+		bool instanced = group.FirstInstance >= 0;
+		const MaterialBindings* bindings = &material->GetBindings(instanced);
+		if (bindings != currentBindings)
+		{
+			currentBindings = bindings;
+			material->Apply(cache, instanced);
+		}
+
+		SimplePixelShader* ps = material->GetPixelShader();
+		if (instanced)
+		{
+			// World matrices and fades come from the instance buffer,
+			// so there's nothing per object to upload
+			SimpleVertexShader* instancedShader = material->GetInstancedVertexShader();
+			if (worker)
+			{
+				worker->CommitConstants(instancedShader);
+				worker->CommitConstants(ps, bindings->ParameterSlot);
+			}
+			else
+				BindConstantBuffers(instancedShader, ps, *bindings, cache);
+
+			cache.SetVertexBuffer(1, instanceBuffer.GetBuffer(), sizeof(InstanceData), 0);
+			cache.DrawIndexedInstanced(mesh->GetIndexCount(), group.Count, 0, 0, group.FirstInstance);
+			continue;
+		}
+
+		for (int i = group.First; i < group.First + group.Count; i++)
+		{
+			int index = items[i].Payload;
+			Entity* currentEntity = (*entities)[index];
+			SimpleVertexShader* vs = material->GetVertexShader();
+
+			// Per-object data has to be set before it's copied up
+			if (worker)
+			{
+				PerObjectConstants constants = {};
+				constants.world = currentEntity->GetWorldMatrix();
+				constants.fade = (*fades)[index];
+				worker->SetConstants(vs, material->GetHandles().PerObject, constants);
+				worker->CommitConstants(vs);
+				worker->CommitConstants(ps, bindings->ParameterSlot);
+			}
+			else
+			{
+				currentEntity->PrepareMaterial((*fades)[index]);
+				BindConstantBuffers(vs, ps, *bindings, cache);
+			}
+
+			cache.DrawIndexed(mesh->GetIndexCount(), 0, 0);
+		}
+	}
+
+	// Back to the default states for the next frame (or the
+	// next worker's command list)
+	if (currentPass != RenderPass::Opaque)
+	{
+		cache.SetBlendState(nullptr);
+		cache.SetDepthStencilState(nullptr);
+	}
+}
+
+// --------------------------------------------------------
+// Binds wherever the shaders' constant data was last copied
+// (their own buffers, or a range of the ring), except the
+// slot the material binds its own parameters to.
+//
+// The frame constants go into the ring once, but any later
+// upload that wraps it discards them (the state cache would
+// happily keep the stale range bound), so whatever was lost
+// goes up again first.  A re-upload can wrap the ring too,
+// hence the loop.  If it's still losing data after that,
+// the ring is too small and the draw would read garbage.
+// --------------------------------------------------------
+void SceneSubmitter::BindConstantBuffers(SimpleVertexShader* vs, SimplePixelShader* ps, const MaterialBindings& material, StateCache& cache)
+{
+	int passes = 0;
+	while (vs->ReuploadLostBuffers() + ps->ReuploadLostBuffers(material.ParameterSlot) > 0)
+	{
+		if (++passes > MaxConstantReuploadPasses)
+		{
+			printf("Constant ring: still losing a draw's constants after %d re-uploads\n", MaxConstantReuploadPasses);
+			assert(!"Constant ring too small for one draw's constants");
+			break;
+		}
+	}
+
+	for (unsigned int b = 0; b < vs->GetBufferCount(); b++)
+	{
+		const SimpleConstantBuffer* buffer = vs->GetBufferInfo(b);
+		cache.SetVSConstantBuffer(buffer->BindIndex, buffer->Bound.Buffer, buffer->Bound.FirstConstant, buffer->Bound.ConstantCount);
+	}
+
+	for (unsigned int b = 0; b < ps->GetBufferCount(); b++)
+	{
+		const SimpleConstantBuffer* buffer = ps->GetBufferInfo(b);
+		if ((int)buffer->BindIndex == material.ParameterSlot)
+			continue;
+		cache.SetPSConstantBuffer(buffer->BindIndex, buffer->Bound.Buffer, buffer->Bound.FirstConstant, buffer->Bound.ConstantCount);
+	}
+}
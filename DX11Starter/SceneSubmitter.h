@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+
+#include "Camera.h"
+#include "Entity.h"
+#include "InstanceBuffer.h"
+#include "RenderDevice.h"
+#include "RenderQueue.h"
+#include "StateCache.h"
+
+// --------------------------------------------------------
+// Turns a frame's visible entities into draws.
+//
+// Prepare() queues and sorts the entities, splits the
+// sorted draws into groups that share a pass, shader,
+// material and mesh, and uploads the instances of every
+// group that's drawn instanced.  Record() then binds and
+// draws a range of those groups through a state cache,
+// either on the immediate context or on a deferred worker.
+//
+// Only the render device and state cache are touched, so
+// the same path runs on D3D11 or on a NullRenderDevice.
+// The frame's constants must be uploaded before Record().
+// --------------------------------------------------------
+class SceneSubmitter
+{
+public:
+	SceneSubmitter();
+
+	void Init(IRenderDevice* device);
+
+	// Off draws every entity on its own
+	void SetInstancing(bool enabled) { instancingEnabled = enabled; }
+
+	// Bound for the transparent pass (null is the default state)
+	void SetTransparentStates(RenderBlendState* blendState, RenderDepthStencilState* depthState);
+
+	// fades holds every entity's fade, indexed like entities.
+	// Both must stay alive until the last Record() of the frame.
+	void Prepare(const std::vector<Entity*>& entities, const std::vector<float>& fades, const std::vector<int>& visible, Camera* camera);
+
+	// Records groups [first, end).  On the immediate context
+	// (worker == nullptr) per-object data goes through the
+	// shaders' own constant buffers.  A worker (SubmitWorker)
+	// can't share those with the other threads, so it stages
+	// the data and binds its own buffers instead.
+	void Record(int first, int end, StateCache& cache, IConstantStager* worker);
+
+	int GetDrawCount() { return renderQueue.GetCount(); }
+	int GetGroupCount() { return (int)drawGroups.size(); }
+
+	// Rough recording cost of each group, for splitting them
+	// between workers
+	const int* GetGroupCosts();
+
+private:
+	// Runs of sorted draws sharing state, either drawn one by
+	// one or as a single instanced draw
+	struct DrawGroup
+	{
+		int First;			// First item in the render queue
+		int Count;
+		int FirstInstance;	// Start in the instance buffer, -1 if not instanced
+	};
+
+	IRenderDevice* device;
+	RenderQueue renderQueue;
+	std::vector<DrawGroup> drawGroups;
+	std::vector<int> groupCosts;
+	std::vector<InstanceData> instanceData;
+	InstanceBuffer instanceBuffer;
+	bool instancingEnabled;
+
+	RenderBlendState* transparentBlendState;
+	RenderDepthStencilState* transparentDepthState;
+
+	// The last Prepare()'s
+	const std::vector<Entity*>* entities;
+	const std::vector<float>* fades;
+
+	void BindConstantBuffers(SimpleVertexShader* vs, SimplePixelShader* ps, const MaterialBindings& material, StateCache& cache);
+};
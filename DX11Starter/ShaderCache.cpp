@@ -0,0 +1,474 @@
+#include "ShaderCache.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+// "SRFL", and the layout version of the sidecar
+static const unsigned int ReflectionFileMagic = 0x4C465253;
+static const unsigned int ReflectionFileVersion = 1;
+
+// More of anything than this means the file is damaged
+static const unsigned int MaxReflectionCount = 1024;
+
+// How variants are compiled (part of their key, so changing
+// this recompiles them)
+#if defined(DEBUG) || defined(_DEBUG)
+static const UINT VariantCompileFlags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+static const UINT VariantCompileFlags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#endif
+
+// --------------------------------------------------------
+// Hashes a source file and, recursively, every file it
+// #includes, looked up next to the including file the way
+// D3D_COMPILE_STANDARD_FILE_INCLUDE finds them.  Includes in
+// #if blocks that end up switched off are hashed as well,
+// which only costs a recompile when one of them changes.
+// False if the top file can't be read.
+// --------------------------------------------------------
+static bool HashSourceTree(const std::wstring& file, unsigned long long& hash, std::vector<std::wstring>& visited)
+{
+	for (const std::wstring& seen : visited)
+		if (seen == file)
+			return true;
+	visited.push_back(file);
+
+	std::ifstream source(file, std::ios::binary);
+	if (!source.is_open())
+		return false;
+	std::stringstream sourceText;
+	sourceText << source.rdbuf();
+	std::string text = sourceText.str();
+	hash = ShaderCache::HashCode(text.data(), text.size(), hash);
+
+	size_t slash = file.find_last_of(L"/\\");
+	std::wstring directory = slash == std::wstring::npos ? L"" : file.substr(0, slash + 1);
+
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		// #include "name" (or <name>), with any spacing
+		size_t at = line.find_first_not_of(" \t");
+		if (at == std::string::npos || line[at] != '#')
+			continue;
+		at = line.find_first_not_of(" \t", at + 1);
+		if (at == std::string::npos || line.compare(at, 7, "include") != 0)
+			continue;
+		at = line.find_first_of("\"<", at + 7);
+		if (at == std::string::npos)
+			continue;
+		size_t end = line.find(line[at] == '<' ? '>' : '"', at + 1);
+		if (end == std::string::npos)
+			continue;
+
+		// A missing include still changes the key by its name
+		// (the compile will report it)
+		std::string name = line.substr(at + 1, end - at - 1);
+		std::wstring includeFile = directory + std::wstring(name.begin(), name.end());
+		if (!HashSourceTree(includeFile, hash, visited))
+			hash = ShaderCache::HashCode(name.data(), name.size(), hash);
+	}
+	return true;
+}
+
+ShaderCache::ShaderCache()
+{
+	device = nullptr;
+	constantRing = nullptr;
+	variantDirectory = L"ShaderVariants";
+}
+
+ShaderCache::~ShaderCache()
+{
+	for (ISimpleShader* shader : shaders)
+		delete shader;
+
+	for (auto& layout : inputLayouts)
+		device->ReleaseInputLayout(layout.second);
+}
+
+void ShaderCache::Init(IRenderDevice* device)
+{
+	this->device = device;
+}
+
+SimpleVertexShader* ShaderCache::LoadVertexShader(const std::wstring& shaderFile)
+{
+	return static_cast<SimpleVertexShader*>(Load(shaderFile, true));
+}
+
+SimplePixelShader* ShaderCache::LoadPixelShader(const std::wstring& shaderFile)
+{
+	return static_cast<SimplePixelShader*>(Load(shaderFile, false));
+}
+
+ISimpleShader* ShaderCache::Load(const std::wstring& shaderFile, bool vertexShader)
+{
+	auto byFile = shadersByFile.find(shaderFile);
+	if (byFile != shadersByFile.end())
+	{
+		stats.ShadersShared++;
+		return byFile->second;
+	}
+
+	ID3DBlob* blob;
+	if (D3DReadFileToBlob(shaderFile.c_str(), &blob) != S_OK)
+		return nullptr;
+
+	ISimpleShader* shader = CreateShader(blob, shaderFile + L".refl", vertexShader);
+	blob->Release();
+	if (shader)
+		shadersByFile[shaderFile] = shader;
+	return shader;
+}
+
+SimpleVertexShader* ShaderCache::LoadVertexShaderVariant(const std::wstring& sourceFile, unsigned int features)
+{
+	return static_cast<SimpleVertexShader*>(LoadVariant(sourceFile, features, true));
+}
+
+SimplePixelShader* ShaderCache::LoadPixelShaderVariant(const std::wstring& sourceFile, unsigned int features)
+{
+	return static_cast<SimplePixelShader*>(LoadVariant(sourceFile, features, false));
+}
+
+ISimpleShader* ShaderCache::LoadVariant(const std::wstring& sourceFile, unsigned int features, bool vertexShader)
+{
+	unsigned long long key = 14695981039346656037ull;
+	std::vector<std::wstring> sourceFiles;
+	if (!HashSourceTree(sourceFile, key, sourceFiles))
+		return nullptr;
+
+	// Every define is given (as 1 or 0), in a fixed order
+	const char* target = vertexShader ? "vs_5_0" : "ps_5_0";
+	std::vector<D3D_SHADER_MACRO> macros;
+	std::string defines;
+	for (const ShaderFeatureDefine& define : ShaderFeatureDefines)
+	{
+		bool on = (features & define.Feature) != 0;
+		macros.push_back({ define.Define, on ? "1" : "0" });
+		defines += std::string(define.Define) + (on ? "=1;" : "=0;");
+	}
+	macros.push_back({ nullptr, nullptr });
+	defines += std::string(target) + ";" + std::to_string(VariantCompileFlags);
+
+	key = HashCode(defines.data(), defines.size(), key);
+
+	auto existing = shadersByVariant.find(key);
+	if (existing != shadersByVariant.end())
+	{
+		stats.ShadersShared++;
+		return existing->second;
+	}
+
+	// "ShaderVariants/PixelShader_0123456789abcdef.cso"
+	size_t nameStart = sourceFile.find_last_of(L"/\\");
+	nameStart = nameStart == std::wstring::npos ? 0 : nameStart + 1;
+	size_t nameEnd = sourceFile.find_last_of(L'.');
+	nameEnd = nameEnd == std::wstring::npos || nameEnd < nameStart ? sourceFile.size() : nameEnd;
+	wchar_t keyText[17];
+	swprintf(keyText, 17, L"%016llx", key);
+	std::wstring blobFile = variantDirectory + L"/" + sourceFile.substr(nameStart, nameEnd - nameStart) + L"_" + keyText + L".cso";
+
+	ID3DBlob* blob = nullptr;
+	if (D3DReadFileToBlob(blobFile.c_str(), &blob) == S_OK)
+		stats.VariantsCached++;
+	else
+	{
+		ID3DBlob* errors = nullptr;
+		HRESULT result = D3DCompileFromFile(sourceFile.c_str(), &macros[0], D3D_COMPILE_STANDARD_FILE_INCLUDE,
+			"main", target, VariantCompileFlags, 0, &blob, &errors);
+		if (errors)
+		{
+			printf("%s", (const char*)errors->GetBufferPointer());
+			errors->Release();
+		}
+		if (FAILED(result))
+			return nullptr;
+		stats.VariantsCompiled++;
+
+		// Not being able to save it only costs the next start
+		CreateDirectoryW(variantDirectory.c_str(), nullptr);
+		D3DWriteBlobToFile(blob, blobFile.c_str(), TRUE);
+	}
+
+	ISimpleShader* shader = CreateShader(blob, blobFile + L".refl", vertexShader);
+	blob->Release();
+	if (shader)
+		shadersByVariant[key] = shader;
+	return shader;
+}
+
+// --------------------------------------------------------
+// A shader for compiled code, or the one already made for
+// identical code
+// --------------------------------------------------------
+ISimpleShader* ShaderCache::CreateShader(ID3DBlob* blob, const std::wstring& reflectionFile, bool vertexShader)
+{
+	unsigned long long codeHash = HashCode(blob->GetBufferPointer(), blob->GetBufferSize());
+	auto byCode = shadersByCode.find(codeHash);
+	if (byCode != shadersByCode.end())
+	{
+		stats.ShadersShared++;
+		return byCode->second;
+	}
+
+	ISimpleShader* shader;
+	if (vertexShader)
+	{
+		SimpleVertexShader* vs = new SimpleVertexShader(device);
+		vs->SetConstantBufferRing(constantRing);
+		shader = vs;
+	}
+	else
+	{
+		SimplePixelShader* ps = new SimplePixelShader(device);
+		ps->SetConstantBufferRing(constantRing);
+		shader = ps;
+	}
+
+	shader->SetShaderCache(this);
+	if (!shader->LoadShaderBlob(blob, reflectionFile.c_str()))
+	{
+		delete shader;
+		return nullptr;
+	}
+
+	// Vertex shaders with the same input signature share a layout
+	if (vertexShader)
+	{
+		SimpleVertexShader* vs = (SimpleVertexShader*)shader;
+		vs->SetSharedInputLayout(GetInputLayout(vs->GetReflection(), blob->GetBufferPointer(), blob->GetBufferSize()));
+	}
+
+	shaders.push_back(shader);
+	shadersByCode[codeHash] = shader;
+	stats.ShadersLoaded++;
+	return shader;
+}
+
+bool ShaderCache::GetReflection(const std::wstring& reflectionFile, const void* code, size_t size, ShaderReflectionData& data)
+{
+	unsigned long long codeHash = HashCode(code, size);
+	if (LoadReflection(reflectionFile, codeHash, data))
+	{
+		stats.ReflectionsCached++;
+		return true;
+	}
+
+	if (!ISimpleShader::ReflectShader(code, size, data))
+		return false;
+	stats.Reflections++;
+
+	// Not being able to write it only costs the next start
+	SaveReflection(reflectionFile, codeHash, data);
+	return true;
+}
+
+RenderInputLayout* ShaderCache::GetInputLayout(const ShaderReflectionData& data, const void* code, size_t size)
+{
+	// Shaders with the same elements in the same order can
+	// use each other's layouts
+	std::string key;
+	for (const ShaderReflectionData::InputElement& element : data.Inputs)
+	{
+		key += element.SemanticName;
+		key += ':' + std::to_string(element.SemanticIndex) + ':' + std::to_string(element.Format) + (element.PerInstance ? ":i;" : ";");
+	}
+
+	auto existing = inputLayouts.find(key);
+	if (existing != inputLayouts.end())
+	{
+		stats.InputLayoutsShared++;
+		return existing->second;
+	}
+
+	RenderInputLayout* layout = device->CreateInputLayout(data, code, size);
+	if (!layout)
+		return nullptr;
+
+	inputLayouts[key] = layout;
+	return layout;
+}
+
+// --------------------------------------------------------
+// 64 bit FNV-1a over the compiled code (or anything else,
+// continuing from an earlier hash)
+// --------------------------------------------------------
+unsigned long long ShaderCache::HashCode(const void* code, size_t size, unsigned long long hash)
+{
+	const unsigned char* bytes = (const unsigned char*)code;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Sidecar layout: a header (magic, version, code hash and
+// the four counts), then each buffer, texture, sampler and
+// input element in order.  Strings are a length and their
+// characters.
+// --------------------------------------------------------
+static void WriteUInt(std::ofstream& file, unsigned int value)
+{
+	file.write((const char*)&value, sizeof(value));
+}
+
+static void WriteString(std::ofstream& file, const std::string& value)
+{
+	WriteUInt(file, (unsigned int)value.size());
+	file.write(value.data(), value.size());
+}
+
+static unsigned int ReadUInt(std::ifstream& file)
+{
+	unsigned int value = 0;
+	file.read((char*)&value, sizeof(value));
+	return value;
+}
+
+static std::string ReadString(std::ifstream& file)
+{
+	unsigned int length = ReadUInt(file);
+	if (!file.good() || length > MaxReflectionCount)
+	{
+		file.setstate(std::ios::failbit);
+		return std::string();
+	}
+
+	std::string value(length, '\0');
+	file.read(&value[0], length);
+	return value;
+}
+
+bool ShaderCache::SaveReflection(const std::wstring& fileName, unsigned long long codeHash, const ShaderReflectionData& data)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	WriteUInt(file, ReflectionFileMagic);
+	WriteUInt(file, ReflectionFileVersion);
+	file.write((const char*)&codeHash, sizeof(codeHash));
+	WriteUInt(file, (unsigned int)data.Buffers.size());
+	WriteUInt(file, (unsigned int)data.Textures.size());
+	WriteUInt(file, (unsigned int)data.Samplers.size());
+	WriteUInt(file, (unsigned int)data.Inputs.size());
+
+	for (const ShaderReflectionData::Buffer& buffer : data.Buffers)
+	{
+		WriteString(file, buffer.Name);
+		WriteUInt(file, buffer.Type);
+		WriteUInt(file, buffer.Size);
+		WriteUInt(file, buffer.BindIndex);
+		WriteUInt(file, (unsigned int)buffer.Variables.size());
+		for (const ShaderReflectionData::Variable& variable : buffer.Variables)
+		{
+			WriteString(file, variable.Name);
+			WriteUInt(file, variable.ByteOffset);
+			WriteUInt(file, variable.Size);
+		}
+	}
+
+	for (const ShaderReflectionData::Resource& texture : data.Textures)
+	{
+		WriteString(file, texture.Name);
+		WriteUInt(file, texture.BindIndex);
+	}
+
+	for (const ShaderReflectionData::Resource& sampler : data.Samplers)
+	{
+		WriteString(file, sampler.Name);
+		WriteUInt(file, sampler.BindIndex);
+	}
+
+	for (const ShaderReflectionData::InputElement& element : data.Inputs)
+	{
+		WriteString(file, element.SemanticName);
+		WriteUInt(file, element.SemanticIndex);
+		WriteUInt(file, element.Format);
+		WriteUInt(file, element.PerInstance ? 1 : 0);
+	}
+
+	return file.good();
+}
+
+bool ShaderCache::LoadReflection(const std::wstring& fileName, unsigned long long codeHash, ShaderReflectionData& data)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	unsigned long long savedHash = 0;
+	unsigned int magic = ReadUInt(file);
+	unsigned int version = ReadUInt(file);
+	file.read((char*)&savedHash, sizeof(savedHash));
+	if (!file.good() || magic != ReflectionFileMagic || version != ReflectionFileVersion || savedHash != codeHash)
+		return false;
+
+	unsigned int counts[4];
+	for (unsigned int& count : counts)
+	{
+		count = ReadUInt(file);
+		if (!file.good() || count > MaxReflectionCount)
+			return false;
+	}
+
+	data = ShaderReflectionData();
+	data.Buffers.resize(counts[0]);
+	data.Textures.resize(counts[1]);
+	data.Samplers.resize(counts[2]);
+	data.Inputs.resize(counts[3]);
+
+	for (ShaderReflectionData::Buffer& buffer : data.Buffers)
+	{
+		buffer.Name = ReadString(file);
+		buffer.Type = ReadUInt(file);
+		buffer.Size = ReadUInt(file);
+		buffer.BindIndex = ReadUInt(file);
+		unsigned int variableCount = ReadUInt(file);
+		if (!file.good() || variableCount > MaxReflectionCount)
+		{
+			file.setstate(std::ios::failbit);
+			break;
+		}
+		buffer.Variables.resize(variableCount);
+		for (ShaderReflectionData::Variable& variable : buffer.Variables)
+		{
+			variable.Name = ReadString(file);
+			variable.ByteOffset = ReadUInt(file);
+			variable.Size = ReadUInt(file);
+		}
+	}
+
+	for (ShaderReflectionData::Resource& texture : data.Textures)
+	{
+		texture.Name = ReadString(file);
+		texture.BindIndex = ReadUInt(file);
+	}
+
+	for (ShaderReflectionData::Resource& sampler : data.Samplers)
+	{
+		sampler.Name = ReadString(file);
+		sampler.BindIndex = ReadUInt(file);
+	}
+
+	for (ShaderReflectionData::InputElement& element : data.Inputs)
+	{
+		element.SemanticName = ReadString(file);
+		element.SemanticIndex = ReadUInt(file);
+		element.Format = ReadUInt(file);
+		element.PerInstance = ReadUInt(file) != 0;
+	}
+
+	if (!file.good())
+	{
+		data = ShaderReflectionData();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SimpleShader.h"
+#include "ShaderFeatures.h"
+
+// --------------------------------------------------------
+// Where the last loads' work went
+// --------------------------------------------------------
+struct ShaderCacheStats
+{
+	int ShadersLoaded = 0;		// Distinct shaders created
+	int ShadersShared = 0;		// Loads handed an existing shader instead
+	int ReflectionsCached = 0;	// Reflection read from a sidecar
+	int Reflections = 0;		// Reflected (sidecar missing or stale)
+	int InputLayoutsShared = 0;
+	int VariantsCompiled = 0;	// Compiled from source (and saved)
+	int VariantsCached = 0;		// Loaded from a previous run's blob
+};
+
+// --------------------------------------------------------
+// Loads shaders once and hands out shared instances, and
+// keeps their reflection in a small binary sidecar next to
+// each .cso ("X.cso.refl") so warm starts skip D3DReflect.
+//
+// Sidecars are keyed by a hash of the compiled code, so a
+// rebuilt shader is reflected (and its sidecar rewritten)
+// automatically.  Files with identical code share one
+// shader, and vertex shaders with identical input
+// signatures share one input layout.
+//
+// Variants of a shader's source (see ShaderFeatures.h) are
+// keyed by a hash of the source and every file it
+// #includes, the feature defines and the compile settings.
+// Each is compiled once and its blob kept in the variant
+// directory, so later runs load it instead, and editing the
+// source (or an include) recompiles it automatically.
+//
+// The cache owns every shader it loads.
+// --------------------------------------------------------
+class ShaderCache
+{
+public:
+	ShaderCache();
+	~ShaderCache();
+
+	void Init(IRenderDevice* device);
+
+	// Shaders loaded after this copy their constants to the ring
+	void SetConstantBufferRing(ConstantBufferRing* ring) { constantRing = ring; }
+
+	// Null if the file is missing or isn't a valid shader
+	SimpleVertexShader* LoadVertexShader(const std::wstring& shaderFile);
+	SimplePixelShader* LoadPixelShader(const std::wstring& shaderFile);
+
+	// Variants of an .hlsl file with the given ShaderFeature
+	// flags on and the rest off.  Null if it doesn't compile.
+	SimpleVertexShader* LoadVertexShaderVariant(const std::wstring& sourceFile, unsigned int features);
+	SimplePixelShader* LoadPixelShaderVariant(const std::wstring& sourceFile, unsigned int features);
+
+	// Where compiled variants are kept between runs
+	void SetVariantDirectory(const std::wstring& directory) { variantDirectory = directory; }
+
+	// Reflection for the given code: the sidecar's, if it was
+	// written for this exact code, otherwise reflected and
+	// saved to the sidecar
+	bool GetReflection(const std::wstring& reflectionFile, const void* code, size_t size, ShaderReflectionData& data);
+
+	// An input layout for a vertex shader's input signature,
+	// shared with any other shader with the same signature
+	// (the cache keeps it until it's destroyed)
+	RenderInputLayout* GetInputLayout(const ShaderReflectionData& data, const void* code, size_t size);
+
+	// Sidecar reading and writing
+	static unsigned long long HashCode(const void* code, size_t size, unsigned long long hash = 14695981039346656037ull);
+	static bool SaveReflection(const std::wstring& fileName, unsigned long long codeHash, const ShaderReflectionData& data);
+	static bool LoadReflection(const std::wstring& fileName, unsigned long long codeHash, ShaderReflectionData& data);
+
+	ShaderCacheStats GetStats() { return stats; }
+
+private:
+	IRenderDevice* device;
+	ConstantBufferRing* constantRing;
+	ShaderCacheStats stats;
+
+	// Shared by path, then by the code's hash
+	std::unordered_map<std::wstring, ISimpleShader*> shadersByFile;
+	std::unordered_map<unsigned long long, ISimpleShader*> shadersByCode;
+	std::unordered_map<unsigned long long, ISimpleShader*> shadersByVariant;
+	std::vector<ISimpleShader*> shaders;
+	std::wstring variantDirectory;
+
+	// Keyed by the input elements
+	std::unordered_map<std::string, RenderInputLayout*> inputLayouts;
+
+	ISimpleShader* Load(const std::wstring& shaderFile, bool vertexShader);
+	ISimpleShader* LoadVariant(const std::wstring& sourceFile, unsigned int features, bool vertexShader);
+	ISimpleShader* CreateShader(ID3DBlob* blob, const std::wstring& reflectionFile, bool vertexShader);
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <DirectXMath.h>
+
+#include "SimpleShader.h"
+#include "Light.h"
+
+// --------------------------------------------------------
+// C++ mirrors of the game's cbuffers, each written to its
+// shader in one copy with SetBufferData().
+//
+// Member names match the HLSL variables.  Each member's
+// packing is checked at compile time by GetFields(), and the
+// whole layout against the compiled shader when it's bound
+// with BindConstantBuffer().
+// --------------------------------------------------------
+
+// VertexShader.hlsl and VertexShaderInstanced.hlsl, b0
+struct PerFrameVSConstants
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(PerFrameVSConstants, view),
+			CONSTANT_BUFFER_FIELD(PerFrameVSConstants, projection),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// VertexShader.hlsl, b1
+struct PerObjectConstants
+{
+	DirectX::XMFLOAT4X4 world;
+	float fade;
+	float padding[3];
+
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(PerObjectConstants, world),
+			CONSTANT_BUFFER_FIELD(PerObjectConstants, fade),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// PixelShader.hlsl, b0
+struct PerFramePSConstants
+{
+	DirectionalLight light1;
+	DirectionalLight light2;
+	DirectX::XMFLOAT4 clusterParams;	// Tile scale X and Y, slice scale and bias
+	unsigned int clusterDims[4];		// Tiles across, tiles down, slices
+
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(PerFramePSConstants, light1),
+			CONSTANT_BUFFER_FIELD(PerFramePSConstants, light2),
+			CONSTANT_BUFFER_FIELD(PerFramePSConstants, clusterParams),
+			CONSTANT_BUFFER_FIELD(PerFramePSConstants, clusterDims),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// PixelShader.hlsl, b1
+struct PerMaterialConstants
+{
+	DirectX::XMFLOAT4 colorTint;
+
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(PerMaterialConstants, colorTint),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// cbuffers are whole registers
+static_assert(sizeof(PerFrameVSConstants) % 16 == 0, "PerFrameVSConstants must be a multiple of 16 bytes");
+static_assert(sizeof(PerObjectConstants) % 16 == 0, "PerObjectConstants must be a multiple of 16 bytes");
+static_assert(sizeof(PerFramePSConstants) % 16 == 0, "PerFramePSConstants must be a multiple of 16 bytes");
+static_assert(sizeof(PerMaterialConstants) % 16 == 0, "PerMaterialConstants must be a multiple of 16 bytes");
@@ -0,0 +1,41 @@
+#pragma once
+
+// --------------------------------------------------------
+// Pieces of PixelShader.hlsl a material can do without.
+// Each flag is a preprocessor define in the shader, so a
+// variant compiled without one has no code for it at all
+// (rather than branching around it).
+//
+// The project build compiles PixelShader.cso with every
+// feature on.  Other combinations are compiled on first use
+// and kept on disk by ShaderCache.
+// --------------------------------------------------------
+enum ShaderFeature : unsigned int
+{
+	ShaderFeature_Texture			= 1 << 0,	// Sample diffuseTexture (otherwise just colorTint)
+	ShaderFeature_DirectionalLights	= 1 << 1,	// light1 and light2
+	ShaderFeature_ClusteredLights	= 1 << 2,	// Point and spot lights from ClusterBuilder
+	ShaderFeature_Fade				= 1 << 3,	// Screen-door fade for contribution culling
+
+	ShaderFeature_None = 0,
+	ShaderFeature_All = ShaderFeature_Texture | ShaderFeature_DirectionalLights | ShaderFeature_ClusteredLights | ShaderFeature_Fade
+};
+
+// --------------------------------------------------------
+// The define each feature turns on (set to 1 or 0)
+// --------------------------------------------------------
+struct ShaderFeatureDefine
+{
+	ShaderFeature Feature;
+	const char* Define;
+};
+
+static const ShaderFeatureDefine ShaderFeatureDefines[] =
+{
+	{ ShaderFeature_Texture,			"USE_TEXTURE" },
+	{ ShaderFeature_DirectionalLights,	"USE_DIRECTIONAL_LIGHTS" },
+	{ ShaderFeature_ClusteredLights,	"USE_CLUSTERED_LIGHTS" },
+	{ ShaderFeature_Fade,				"USE_FADE" },
+};
+
+static const int ShaderFeatureCount = sizeof(ShaderFeatureDefines) / sizeof(ShaderFeatureDefines[0]);
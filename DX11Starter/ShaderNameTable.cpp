@@ -0,0 +1,41 @@
+#include "ShaderNameTable.h"
+
+int ShaderNameTable::Add(const std::string& name)
+{
+	int index = (int)names.size();
+	names.push_back(name);
+	hashes.insert(std::make_pair(HashShaderName(name.c_str()), index));
+	return index;
+}
+
+SimpleShaderHandle ShaderNameTable::Find(SimpleShaderName name) const
+{
+	SimpleShaderHandle handle;
+
+	auto result = hashes.find(name.Hash);
+	if (result == hashes.end())
+		return handle;
+
+	// Hashes can collide, so check the actual name (and fall
+	// back to a search if another name took this hash first)
+	if (names[result->second] == name.Text)
+	{
+		handle.Index = result->second;
+		return handle;
+	}
+	for (int i = 0; i < (int)names.size(); i++)
+	{
+		if (names[i] == name.Text)
+		{
+			handle.Index = i;
+			break;
+		}
+	}
+	return handle;
+}
+
+void ShaderNameTable::Clear()
+{
+	names.clear();
+	hashes.clear();
+}
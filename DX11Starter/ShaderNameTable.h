@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// --------------------------------------------------------
+// FNV-1a hash of a shader variable/resource name.  constexpr,
+// so names written as literals are hashed at compile time.
+// --------------------------------------------------------
+constexpr unsigned int HashShaderName(const char* name)
+{
+	unsigned int hash = 2166136261u;
+	while (*name)
+	{
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// A name with its hash worked out up front.  Declare these
+// as static constexpr to hash at compile time:
+//   static constexpr SimpleShaderName World("world");
+// --------------------------------------------------------
+struct SimpleShaderName
+{
+	const char* Text;
+	unsigned int Hash;
+
+	constexpr SimpleShaderName(const char* text) : Text(text), Hash(HashShaderName(text)) {}
+};
+
+// --------------------------------------------------------
+// Small integer standing in for a name, resolved once from
+// a shader and valid for that shader only
+// --------------------------------------------------------
+struct SimpleShaderHandle
+{
+	int Index = -1;
+	bool IsValid() const { return Index >= 0; }
+};
+
+// --------------------------------------------------------
+// Names in the order they were added, looked up by their
+// precomputed hash (no string hashing).  Handles are the
+// order names were added in.
+// --------------------------------------------------------
+class ShaderNameTable
+{
+public:
+	int Add(const std::string& name);
+	SimpleShaderHandle Find(SimpleShaderName name) const;
+	void Clear();
+
+	int GetCount() const { return (int)names.size(); }
+	const std::string& GetName(int index) const { return names[index]; }
+
+private:
+	std::vector<std::string> names;
+	std::unordered_map<unsigned int, int> hashes;	// First name with each hash
+};
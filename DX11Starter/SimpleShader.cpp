@@ -1,23 +1,29 @@
 #include "SimpleShader.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+ConstantUploadStats ISimpleShader::uploadStats;
+
 // --------------------------------------------------------
-// Constructor accepts DirectX device & context
+// Constructor accepts the device that makes, writes and
+// binds everything
 // --------------------------------------------------------
-ISimpleShader::ISimpleShader(ID3D11Device* device, ID3D11DeviceContext* context)
+ISimpleShader::ISimpleShader(IRenderDevice* device)
 {
 	// Save the device
 	this->device = device;
-	this->deviceContext = context;
 
 	// Set up fields
 	constantBufferCount = 0;
 	constantBuffers = 0;
-	shaderBlob = 0;
 	shaderValid = false;
+	constantRing = 0;
+	shaderCache = 0;
 }
 
 // --------------------------------------------------------
@@ -26,8 +32,6 @@ ISimpleShader::ISimpleShader(ID3D11Device* device, ID3D11DeviceContext* context)
 ISimpleShader::~ISimpleShader()
 {
 	// Derived class destructors will call this class's CleanUp method
-	if(shaderBlob)
-		shaderBlob->Release();
 }
 
 // --------------------------------------------------------
@@ -39,7 +43,7 @@ void ISimpleShader::CleanUp()
 	// Handle constant buffers and local data buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		constantBuffers[i].ConstantBuffer->Release();
+		device->ReleaseBuffer(constantBuffers[i].ConstantBuffer);
 		delete[] constantBuffers[i].LocalDataBuffer;
 	}
 
@@ -60,156 +64,143 @@ void ISimpleShader::CleanUp()
 	cbTable.clear();
 	samplerTable.clear();
 	textureTable.clear();
+	variables.clear();
+	variableNames.Clear();
+	bufferNames.Clear();
+	srvNames.Clear();
+	samplerNames.Clear();
 }
 
 // --------------------------------------------------------
-// Loads the specified shader and builds the variable table using shader
-// reflection.  This must be a separate step from the constructor since
-// we can't invoke derived class overrides in the base class constructor.
+// Loads a shader with no code from reflection data alone.
+// Only a device that never runs shaders will make one, so
+// this is for driving the real binding and upload paths
+// on NullRenderDevice.
 //
-// shaderFile - A "wide string" specifying the compiled shader to load
-// 
 // Returns true if shader is loaded properly, false otherwise
 // --------------------------------------------------------
-bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
+bool ISimpleShader::LoadReflection(const ShaderReflectionData& data)
 {
-	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, &shaderBlob);
-	if (hr != S_OK)
-	{
-		return false;
-	}
+	reflection = data;
 
-	// Create the shader - Calls an overloaded version of this abstract
-	// method in the appropriate child class
-	shaderValid = CreateShader(shaderBlob);
+	shaderValid = CreateShader(nullptr, 0);
 	if (!shaderValid)
 	{
 		return false;
 	}
 
-	// Set up shader reflection to get information about
-	// this shader and its variables,  buffers, etc.
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
-	
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
+	BuildTables();
+	return true;
+}
 
-	// Get the number of buffers and make the resource array
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
-	
+// --------------------------------------------------------
+// Builds the buffers and lookup tables from the reflection
+// data (however it was obtained)
+// --------------------------------------------------------
+void ISimpleShader::BuildTables()
+{
 	// Handle bound resources (like shaders and samplers)
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	for (const ShaderReflectionData::Resource& resource : reflection.Textures)
 	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
-		// Check the type
-		switch (resourceDesc.Type)
-		{
-		case D3D_SIT_TEXTURE: // A texture resource
-		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
-
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
-		}
-			break;
-
-		case D3D_SIT_SAMPLER: // A sampler resource
-		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
+		// Create the SRV wrapper
+		SimpleSRV* srv = new SimpleSRV();
+		srv->BindIndex = resource.BindIndex;					// Shader bind point
+		srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
+
+		textureTable.insert(std::pair<std::string, SimpleSRV*>(resource.Name, srv));
+		shaderResourceViews.push_back(srv);
+		srvNames.Add(resource.Name);
+	}
 
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
-		}
-			break;
-		}
+	for (const ShaderReflectionData::Resource& resource : reflection.Samplers)
+	{
+		// Create the sampler wrapper
+		SimpleSampler* samp = new SimpleSampler();
+		samp->BindIndex = resource.BindIndex;				// Shader bind point
+		samp->Index = (unsigned int)samplerStates.size();	// Raw index
+
+		samplerTable.insert(std::pair<std::string, SimpleSampler*>(resource.Name, samp));
+		samplerStates.push_back(samp);
+		samplerNames.Add(resource.Name);
 	}
 
+	// Get the number of buffers and make the resource array
+	constantBufferCount = (unsigned int)reflection.Buffers.size();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+
 	// Loop through all constant buffers
 	for (unsigned int b = 0; b < constantBufferCount; b++)
 	{
-		// Get this buffer
-		ID3D11ShaderReflectionConstantBuffer* cb =
-			refl->GetConstantBufferByIndex(b);
-		
-		// Get the description of this buffer
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		cb->GetDesc(&bufferDesc);
-		
+		const ShaderReflectionData::Buffer& buffer = reflection.Buffers[b];
+
 		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
+		constantBuffers[b].Type = buffer.Type;
 
-		// Get the description of the resource binding, so
-		// we know exactly how it's bound in the shader
-		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
-		
 		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
+		constantBuffers[b].BindIndex = buffer.BindIndex;
+		constantBuffers[b].Name = buffer.Name;
+		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(buffer.Name, &constantBuffers[b]));
+		bufferNames.Add(buffer.Name);
 
 		// Create this constant buffer
-		D3D11_BUFFER_DESC newBuffDesc;
-		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = max(bufferDesc.Size, 16); // NEW: Must be multiple of 16
-		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		newBuffDesc.CPUAccessFlags = 0;
-		newBuffDesc.MiscFlags = 0;
-		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, &constantBuffers[b].ConstantBuffer);
+		RenderBufferDesc newBuffDesc;
+		newBuffDesc.Usage = RenderUsage::Default;
+		newBuffDesc.ByteWidth = (std::max)(buffer.Size, 16u); // NEW: Must be multiple of 16
+		newBuffDesc.BindFlags = RenderBindConstantBuffer;
+		constantBuffers[b].ConstantBuffer = device->CreateBuffer(newBuffDesc, nullptr);
+		constantBuffers[b].Bound.Buffer = constantBuffers[b].ConstantBuffer;
 
 		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].Size = buffer.Size;
+		constantBuffers[b].LocalDataBuffer = new unsigned char[buffer.Size];
+		memset(constantBuffers[b].LocalDataBuffer, 0, buffer.Size);
+
+		// The GPU copy starts out undefined, so all of it is dirty
+		constantBuffers[b].DirtyStart = 0;
+		constantBuffers[b].DirtyEnd = buffer.Size;
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (const ShaderReflectionData::Variable& variable : buffer.Variables)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
-
 			// Create the variable struct
 			SimpleShaderVariable varStruct;
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
-			varStruct.Size = varDesc.Size;
-			
-			// Get a string version
-			std::string varName(varDesc.Name);
+			varStruct.ByteOffset = variable.ByteOffset;
+			varStruct.Size = variable.Size;
 
 			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
+			varTable.insert(std::pair<std::string, SimpleShaderVariable>(variable.Name, varStruct));
 			constantBuffers[b].Variables.push_back(varStruct);
+			variables.push_back(varStruct);
+			variableNames.Add(variable.Name);
 		}
 	}
 
-	// All set
-	refl->Release();
-	return true;
+	ReserveRingSpace();
+}
+
+// --------------------------------------------------------
+// Makes the ring big enough that re-uploading a draw's lost
+// constants (see ReuploadLostBuffers) can wrap it only once.
+//
+// A draw binds a vertex and a pixel shader, so it uploads at
+// most twice the larger one's buffers.  A ring holding two
+// draws' worth (four of this shader's) always has room for
+// what the wrap discarded without wrapping again.
+// --------------------------------------------------------
+void ISimpleShader::ReserveRingSpace()
+{
+	if (!shaderValid || !constantRing || !constantRing->IsSupported())
+		return;
+
+	unsigned int alignment = constantRing->GetAllocator().GetAlignment();
+	unsigned int bytes = 0;
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		if (constantBuffers[i].Type == SimpleCBufferType)
+			bytes += (constantBuffers[i].Size + alignment - 1) / alignment * alignment;
+	}
+	constantRing->Reserve(4 * bytes);
 }
 
 // --------------------------------------------------------
@@ -233,7 +224,7 @@ SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
 	SimpleShaderVariable* var = &(result->second);
 
 	// Is the data size correct ?
-	if (size > 0 && var->Size != size)
+	if (size > 0 && var->Size != (unsigned int)size)
 		return 0;
 
 	// Success
@@ -282,12 +273,7 @@ void ISimpleShader::CopyAllBufferData()
 
 	// Loop through the constant buffers and copy all data
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer, 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
-	}
+		UploadBuffer(&constantBuffers[i]);
 }
 
 // --------------------------------------------------------
@@ -315,9 +301,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer, 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -337,11 +321,127 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer, 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
+}
+
+
+// --------------------------------------------------------
+// Copies local data to the shader's specified constant buffer,
+// for one object that keeps its own copy of the last upload
+//
+// bufferName - Specifies the name of the buffer to copy
+// retained   - The object's last upload.  If the data matches
+//              and it's still in the ring, it's bound again
+//              instead of uploading.
+// --------------------------------------------------------
+void ISimpleShader::CopyBufferData(std::string bufferName, RetainedConstants& retained)
+{
+	// Check for the buffer
+	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
+	if (!cb) return;
+
+	SimpleShaderHandle buffer;
+	buffer.Index = (int)(cb - constantBuffers);
+	CopyBufferData(buffer, retained);
+}
+
+// --------------------------------------------------------
+// Copies local data to the constant buffer with the given
+// handle (from GetBufferHandle)
+// --------------------------------------------------------
+void ISimpleShader::CopyBufferData(SimpleShaderHandle buffer)
+{
+	if (buffer.IsValid())
+		CopyBufferData((unsigned int)buffer.Index);
+}
+
+void ISimpleShader::CopyBufferData(SimpleShaderHandle buffer, RetainedConstants& retained)
+{
+	// Ensure the shader is valid
+	if (!shaderValid) return;
+
+	// Validate the handle
+	if (buffer.Index < 0 || buffer.Index >= (int)constantBufferCount)
+		return;
+	SimpleConstantBuffer* cb = &constantBuffers[buffer.Index];
+
+	if (constantRing && constantRing->IsCurrent(retained.Slice) &&
+		retained.Data.size() == cb->Size &&
+		memcmp(&retained.Data[0], cb->LocalDataBuffer, cb->Size) == 0)
+	{
+		cb->Bound = retained.Slice;
+		cb->DirtyStart = cb->DirtyEnd = 0;
+		uploadStats.UploadsSkipped++;
+		uploadStats.BytesSaved += cb->Size;
+		return;
+	}
+
+	UploadBuffer(cb);
+
+	// Only ring uploads stay put for next time
+	if (cb->Bound.ConstantCount > 0)
+	{
+		retained.Slice = cb->Bound;
+		retained.Data.assign(cb->LocalDataBuffer, cb->LocalDataBuffer + cb->Size);
+	}
+}
+
+// --------------------------------------------------------
+// Ring data only lives until the ring wraps, and any upload
+// can wrap it - including another shader's, later in the
+// frame.  Anything bound from a range that has since been
+// discarded has to go up again before the next draw.
+// --------------------------------------------------------
+int ISimpleShader::ReuploadLostBuffers(int skipSlot)
+{
+	if (!shaderValid || !constantRing)
+		return 0;
+
+	int uploaded = 0;
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		SimpleConstantBuffer* cb = &constantBuffers[i];
+		if ((int)cb->BindIndex == skipSlot || cb->Bound.ConstantCount == 0 || constantRing->IsCurrent(cb->Bound))
+			continue;
+
+		UploadBuffer(cb);
+		uploaded++;
+	}
+	return uploaded;
 }
 
+// --------------------------------------------------------
+// Copies a buffer's local data to the GPU: appended to the
+// ring if there is one (rebinding at the new offset), or
+// written over the buffer's own contents if not
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer* cb)
+{
+	// Nothing's changed since the last copy, and that copy is
+	// still on the GPU (ring data doesn't survive a wrap)
+	bool dirty = cb->DirtyEnd > cb->DirtyStart;
+	bool lost = constantRing && cb->Bound.ConstantCount > 0 && !constantRing->IsCurrent(cb->Bound);
+	if (!dirty && !lost)
+	{
+		uploadStats.UploadsSkipped++;
+		uploadStats.BytesSaved += cb->Size;
+		return;
+	}
+
+	// Constant buffers can only be replaced whole, so the dirty
+	// range decides whether to upload, not how much
+	cb->DirtyStart = cb->DirtyEnd = 0;
+	uploadStats.Uploads++;
+	uploadStats.BytesUploaded += cb->Size;
+
+	if (constantRing && cb->Type == SimpleCBufferType &&
+		constantRing->Upload(cb->LocalDataBuffer, cb->Size, cb->Bound))
+		return;
+
+	device->UpdateSubresource(cb->ConstantBuffer, cb->LocalDataBuffer, cb->Size);
+	cb->Bound = ConstantBufferSlice();
+	cb->Bound.Buffer = cb->ConstantBuffer;
+}
 
 // --------------------------------------------------------
 // Sets a variable by name with arbitrary data of the specified size
@@ -360,14 +460,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	if (var == 0)
 		return false;
 
-	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
-
-	// Success
-	return true;
+	return WriteVariable(var, data);
 }
 
 // --------------------------------------------------------
@@ -450,6 +543,169 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 dat
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Writes a variable's data into its local data buffer,
+// skipping the write (and leaving the buffer clean) if the
+// bytes are the same as what's already there
+// --------------------------------------------------------
+bool ISimpleShader::WriteVariable(const SimpleShaderVariable* var, const void* data)
+{
+	SimpleConstantBuffer* cb = &constantBuffers[var->ConstantBufferIndex];
+	unsigned char* target = cb->LocalDataBuffer + var->ByteOffset;
+	if (memcmp(target, data, var->Size) == 0)
+	{
+		uploadStats.SetsSkipped++;
+		return true;
+	}
+
+	// Set the data in the local data buffer
+	memcpy(target, data, var->Size);
+
+	// Grow the dirty range to cover it
+	unsigned int end = var->ByteOffset + var->Size;
+	if (cb->DirtyEnd <= cb->DirtyStart)
+	{
+		cb->DirtyStart = var->ByteOffset;
+		cb->DirtyEnd = end;
+	}
+	else
+	{
+		cb->DirtyStart = (std::min)(cb->DirtyStart, var->ByteOffset);
+		cb->DirtyEnd = (std::max)(cb->DirtyEnd, end);
+	}
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a variable by handle with arbitrary data of the
+// specified size (which must match the variable's)
+// --------------------------------------------------------
+bool ISimpleShader::SetData(SimpleShaderHandle variable, const void* data, unsigned int size)
+{
+	if (variable.Index < 0 || variable.Index >= (int)variables.size())
+		return false;
+
+	const SimpleShaderVariable* var = &variables[variable.Index];
+	if (var->Size != size)
+		return false;
+
+	return WriteVariable(var, data);
+}
+
+bool ISimpleShader::SetInt(SimpleShaderHandle variable, int data)
+{
+	return this->SetData(variable, &data, sizeof(int));
+}
+
+bool ISimpleShader::SetFloat(SimpleShaderHandle variable, float data)
+{
+	return this->SetData(variable, &data, sizeof(float));
+}
+
+bool ISimpleShader::SetFloat4(SimpleShaderHandle variable, const DirectX::XMFLOAT4& data)
+{
+	return this->SetData(variable, &data, sizeof(float) * 4);
+}
+
+bool ISimpleShader::SetMatrix4x4(SimpleShaderHandle variable, const DirectX::XMFLOAT4X4& data)
+{
+	return this->SetData(variable, &data, sizeof(float) * 16);
+}
+
+// --------------------------------------------------------
+// Checks a C++ struct's members (from BindConstantBuffer)
+// against the reflected layout of the named buffer.  Every
+// variable in the buffer needs a member at the same offset
+// that's at least as big (C++ pads structs out to a whole
+// register, HLSL doesn't), and every member needs a variable.
+//
+// Returns the buffer's handle, or an invalid handle (and
+// prints why) if anything disagrees
+// --------------------------------------------------------
+SimpleShaderHandle ISimpleShader::ValidateBufferLayout(SimpleShaderName name, const ConstantBufferField* fields, unsigned int fieldCount, unsigned int size)
+{
+	SimpleShaderHandle invalid;
+	SimpleShaderHandle buffer = bufferNames.Find(name);
+	if (!buffer.IsValid())
+	{
+		printf("Constant buffer %s: not in the shader\n", name.Text);
+		return invalid;
+	}
+
+	const SimpleConstantBuffer* cb = &constantBuffers[buffer.Index];
+	if (cb->Size != size)
+	{
+		printf("Constant buffer %s: %u bytes in the shader, %u in C++\n", name.Text, cb->Size, size);
+		return invalid;
+	}
+
+	for (int v = 0; v < (int)variables.size(); v++)
+	{
+		const SimpleShaderVariable& var = variables[v];
+		if ((int)var.ConstantBufferIndex != buffer.Index)
+			continue;
+
+		const std::string& varName = variableNames.GetName(v);
+		const ConstantBufferField* field = 0;
+		for (unsigned int f = 0; f < fieldCount && !field; f++)
+		{
+			if (varName == fields[f].Name)
+				field = &fields[f];
+		}
+
+		if (!field)
+		{
+			printf("Constant buffer %s: no C++ member for %s\n", name.Text, varName.c_str());
+			return invalid;
+		}
+		if (field->Offset != var.ByteOffset || field->Size < var.Size)
+		{
+			printf("Constant buffer %s: %s is %u bytes at %u in the shader, %u bytes at %u in C++\n",
+				name.Text, varName.c_str(), var.Size, var.ByteOffset, field->Size, field->Offset);
+			return invalid;
+		}
+	}
+
+	for (unsigned int f = 0; f < fieldCount; f++)
+	{
+		SimpleShaderHandle var = variableNames.Find(SimpleShaderName(fields[f].Name));
+		if (!var.IsValid() || (int)variables[var.Index].ConstantBufferIndex != buffer.Index)
+		{
+			printf("Constant buffer %s: C++ member %s isn't in the buffer\n", name.Text, fields[f].Name);
+			return invalid;
+		}
+	}
+
+	return buffer;
+}
+
+// --------------------------------------------------------
+// Replaces a whole buffer's local data in one copy (size
+// must match the buffer's), skipping it if nothing changed
+// --------------------------------------------------------
+bool ISimpleShader::WriteBuffer(SimpleShaderHandle buffer, const void* data, unsigned int size)
+{
+	if (buffer.Index < 0 || buffer.Index >= (int)constantBufferCount)
+		return false;
+
+	SimpleConstantBuffer* cb = &constantBuffers[buffer.Index];
+	if (cb->Size != size)
+		return false;
+
+	if (memcmp(cb->LocalDataBuffer, data, size) == 0)
+	{
+		uploadStats.SetsSkipped++;
+		return true;
+	}
+
+	memcpy(cb->LocalDataBuffer, data, size);
+	cb->DirtyStart = 0;
+	cb->DirtyEnd = size;
+	return true;
+}
+
 // --------------------------------------------------------
 // Gets info about a shader variable, if it exists
 // --------------------------------------------------------
@@ -458,6 +714,13 @@ const SimpleShaderVariable* ISimpleShader::GetVariableInfo(std::string name)
 	return FindVariable(name, -1);
 }
 
+const SimpleShaderVariable* ISimpleShader::GetVariableInfo(SimpleShaderHandle handle)
+{
+	if (handle.Index < 0 || handle.Index >= (int)variables.size())
+		return 0;
+	return &variables[handle.Index];
+}
+
 // --------------------------------------------------------
 // Gets info about an SRV in the shader (or null)
 //
@@ -492,6 +755,11 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 	return shaderResourceViews[index];
 }
 
+const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(SimpleShaderHandle handle)
+{
+	return handle.IsValid() ? GetShaderResourceViewInfo((unsigned int)handle.Index) : 0;
+}
+
 
 // --------------------------------------------------------
 // Gets info about a sampler in the shader (or null)
@@ -526,6 +794,11 @@ const SimpleSampler* ISimpleShader::GetSamplerInfo(unsigned int index)
 	return samplerStates[index];
 }
 
+const SimpleSampler* ISimpleShader::GetSamplerInfo(SimpleShaderHandle handle)
+{
+	return handle.IsValid() ? GetSamplerInfo((unsigned int)handle.Index) : 0;
+}
+
 
 // --------------------------------------------------------
 // Gets the number of constant buffers in this shader
@@ -581,12 +854,13 @@ const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(unsigned int index)
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimpleVertexShader::SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext* context)
-	: ISimpleShader(device, context) 
+SimpleVertexShader::SimpleVertexShader(IRenderDevice* device)
+	: ISimpleShader(device) 
 { 
 	// Ensure we set to zero to successfully trigger
 	// the Input Layout creation during LoadShader()
 	this->inputLayout = 0;
+	this->ownsInputLayout = true;
 	this->shader = 0;
 	this->perInstanceCompatible = false;
 }
@@ -597,11 +871,12 @@ SimpleVertexShader::SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext
 // Passing in a valid input layout will stop LoadShader()
 // from creating an input layout from shader reflection
 // --------------------------------------------------------
-SimpleVertexShader::SimpleVertexShader(ID3D11Device * device, ID3D11DeviceContext * context, ID3D11InputLayout * inputLayout, bool perInstanceCompatible)
-	: ISimpleShader(device, context)
+SimpleVertexShader::SimpleVertexShader(IRenderDevice* device, RenderInputLayout* inputLayout, bool perInstanceCompatible)
+	: ISimpleShader(device)
 {
 	// Save the custom input layout
 	this->inputLayout = inputLayout;
+	this->ownsInputLayout = true;
 	this->shader = 0;
 
 	// Unable to determine from an input layout, require user to tell us
@@ -622,32 +897,29 @@ SimpleVertexShader::~SimpleVertexShader()
 void SimpleVertexShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
-	if (shader) { shader->Release(); shader = 0; }
-	if (inputLayout) { inputLayout->Release(); inputLayout = 0; }
+	if (shader) { device->ReleaseVertexShader(shader); shader = 0; }
+	if (inputLayout && ownsInputLayout) device->ReleaseInputLayout(inputLayout);
+	inputLayout = 0;
 }
 
 // --------------------------------------------------------
-// Creates the DirectX vertex shader
+// Creates the vertex shader on the device
 //
-// shaderBlob - The shader's compiled code
+// code, size - The shader's compiled code
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::CreateShader(ID3DBlob* shaderBlob)
+bool SimpleVertexShader::CreateShader(const void* code, size_t size)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
 	this->CleanUp();
 
-	// Create the shader from the blob
-	HRESULT result = device->CreateVertexShader(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		0,
-		&shader);
+	// Create the shader from the code
+	shader = device->CreateVertexShader(code, size);
 
 	// Did the creation work?
-	if (result != S_OK)
+	if (!shader)
 		return false;
 
 	// Do we already have an input layout?
@@ -656,102 +928,35 @@ bool SimpleVertexShader::CreateShader(ID3DBlob* shaderBlob)
 		return true;
 
 	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
-	// matches what the vertex shader expects.  Code adapted from:
-	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
-
-	// Reflect shader info
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
-	
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Read input layout description from shader info
-	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
-	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
-
-		// Check the semantic name for "_PER_INSTANCE"
-		std::string perInstanceStr = "_PER_INSTANCE";
-		std::string sem = paramDesc.SemanticName;
-		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
-		bool isPerInstance = 
-			lenDiff >= 0 &&
-			sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
-
-		// Fill out input element desc
-		D3D11_INPUT_ELEMENT_DESC elementDesc;
-		elementDesc.SemanticName = paramDesc.SemanticName;
-		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
-		elementDesc.InputSlot = 0;
-		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-		elementDesc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-		elementDesc.InstanceDataStepRate = 0;
-
-		// Replace anything affected by "per instance" data
-		if (isPerInstance)
-		{
-			elementDesc.InputSlot = 1; // Assume per instance data comes from another input slot!
-			elementDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
-			elementDesc.InstanceDataStepRate = 1;
-
-			perInstanceCompatible = true;
-		}
-
-		// Determine DXGI format
-		if (paramDesc.Mask == 1)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 3)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 7)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 15)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-		}
-
-		// Save element desc
-		inputLayoutDesc.push_back(elementDesc);
-	}
-
-	// Try to create Input Layout
-	HRESULT hr = device->CreateInputLayout(
-		&inputLayoutDesc[0], 
-		(unsigned int)inputLayoutDesc.size(), 
-		shaderBlob->GetBufferPointer(), 
-		shaderBlob->GetBufferSize(),
-		&inputLayout);
+	// reflected input signature to make an input layout that
+	// matches what the vertex shader expects (unless the shader
+	// cache loaded it - the cache hands over a layout shared
+	// with any other shader that had the same signature)
+	for (const ShaderReflectionData::InputElement& element : reflection.Inputs)
+		perInstanceCompatible = perInstanceCompatible || element.PerInstance;
+
+	ownsInputLayout = !shaderCache;
+	if (shaderCache)
+		return true;
 
-	// All done, clean up
-	refl->Release();
+	inputLayout = device->CreateInputLayout(reflection, code, size);
 	return true;
 }
 
+// --------------------------------------------------------
+// Uses an input layout owned by someone else (the shader
+// cache), releasing the shader's own if it made one
+// --------------------------------------------------------
+void SimpleVertexShader::SetSharedInputLayout(RenderInputLayout* layout)
+{
+	if (inputLayout && ownsInputLayout) device->ReleaseInputLayout(inputLayout);
+	inputLayout = layout;
+	ownsInputLayout = false;
+}
+
 // --------------------------------------------------------
 // Sets the vertex shader, input layout and constant buffers
-// for future DirectX drawing
+// for future drawing
 // --------------------------------------------------------
 void SimpleVertexShader::SetShaderAndCBs()
 {
@@ -759,21 +964,21 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout);
-	deviceContext->VSSetShader(shader, 0, 0);
+	IStateContext* context = device->GetContext();
+	context->SetInputLayout(inputLayout);
+	context->SetVertexShader(shader);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (constantBuffers[i].Type != SimpleCBufferType)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			&constantBuffers[i].ConstantBuffer);
+		// This is a real constant buffer, so set it (at its
+		// offset in the ring, if that's where the data is)
+		const ConstantBufferSlice& bound = constantBuffers[i].Bound;
+		context->SetVSConstantBuffer(constantBuffers[i].BindIndex, bound.Buffer, bound.FirstConstant, bound.ConstantCount);
 	}
 }
 
@@ -785,7 +990,7 @@ void SimpleVertexShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimpleVertexShader::SetShaderResourceView(std::string name, RenderShaderResource* srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -793,7 +998,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, ID3D11ShaderRes
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	device->GetContext()->SetVSShaderResource(srvInfo->BindIndex, srv);
 
 	// Success
 	return true;
@@ -807,7 +1012,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, ID3D11ShaderRes
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimpleVertexShader::SetSamplerState(std::string name, RenderSampler* samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -815,12 +1020,36 @@ bool SimpleVertexShader::SetSamplerState(std::string name, ID3D11SamplerState* s
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	device->GetContext()->SetVSSampler(sampInfo->BindIndex, samplerState);
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Handle versions of the above (handles from
+// GetShaderResourceViewHandle and GetSamplerHandle)
+// --------------------------------------------------------
+bool SimpleVertexShader::SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(handle);
+	if (srvInfo == 0)
+		return false;
+
+	device->GetContext()->SetVSShaderResource(srvInfo->BindIndex, srv);
+	return true;
+}
+
+bool SimpleVertexShader::SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(handle);
+	if (sampInfo == 0)
+		return false;
+
+	device->GetContext()->SetVSSampler(sampInfo->BindIndex, samplerState);
+	return true;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ SIMPLE PIXEL SHADER -------------------------------------------------
@@ -829,8 +1058,8 @@ bool SimpleVertexShader::SetSamplerState(std::string name, ID3D11SamplerState* s
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimplePixelShader::SimplePixelShader(ID3D11Device* device, ID3D11DeviceContext* context)
-	: ISimpleShader(device, context) 
+SimplePixelShader::SimplePixelShader(IRenderDevice* device)
+	: ISimpleShader(device) 
 { 
 	this->shader = 0;
 }
@@ -849,36 +1078,32 @@ SimplePixelShader::~SimplePixelShader()
 void SimplePixelShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
-	if (shader) { shader->Release(); shader = 0; }
+	if (shader) { device->ReleasePixelShader(shader); shader = 0; }
 }
 
 // --------------------------------------------------------
-// Creates the DirectX pixel shader
+// Creates the pixel shader on the device
 //
-// shaderBlob - The shader's compiled code
+// code, size - The shader's compiled code
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::CreateShader(ID3DBlob* shaderBlob)
+bool SimplePixelShader::CreateShader(const void* code, size_t size)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
 	this->CleanUp();
 
-	// Create the shader from the blob
-	HRESULT result = device->CreatePixelShader(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		0,
-		&shader);
+	// Create the shader from the code
+	shader = device->CreatePixelShader(code, size);
 
 	// Check the result
-	return (result == S_OK);
+	return shader != 0;
 }
 
 // --------------------------------------------------------
 // Sets the pixel shader and constant buffers for
-// future DirectX drawing
+// future drawing
 // --------------------------------------------------------
 void SimplePixelShader::SetShaderAndCBs()
 {
@@ -886,20 +1111,20 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader, 0, 0);
+	IStateContext* context = device->GetContext();
+	context->SetPixelShader(shader);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (constantBuffers[i].Type != SimpleCBufferType)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			&constantBuffers[i].ConstantBuffer);
+		// This is a real constant buffer, so set it (at its
+		// offset in the ring, if that's where the data is)
+		const ConstantBufferSlice& bound = constantBuffers[i].Bound;
+		context->SetPSConstantBuffer(constantBuffers[i].BindIndex, bound.Buffer, bound.FirstConstant, bound.ConstantCount);
 	}
 }
 
@@ -911,7 +1136,7 @@ void SimplePixelShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimplePixelShader::SetShaderResourceView(std::string name, RenderShaderResource* srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -919,7 +1144,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderReso
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	device->GetContext()->SetPSShaderResource(srvInfo->BindIndex, srv);
 
 	// Success
 	return true;
@@ -933,7 +1158,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderReso
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimplePixelShader::SetSamplerState(std::string name, RenderSampler* samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -941,801 +1166,32 @@ bool SimplePixelShader::SetSamplerState(std::string name, ID3D11SamplerState* sa
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	device->GetContext()->SetPSSampler(sampInfo->BindIndex, samplerState);
 
 	// Success
 	return true;
 }
 
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ------ SIMPLE DOMAIN SHADER ------------------------------------------------
-///////////////////////////////////////////////////////////////////////////////
-
 // --------------------------------------------------------
-// Constructor just calls the base
+// Handle versions of the above (handles from
+// GetShaderResourceViewHandle and GetSamplerHandle)
 // --------------------------------------------------------
-SimpleDomainShader::SimpleDomainShader(ID3D11Device* device, ID3D11DeviceContext* context)
-	: ISimpleShader(device, context) 
-{ 
-	this->shader = 0;
+bool SimplePixelShader::SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(handle);
+	if (srvInfo == 0)
+		return false;
+
+	device->GetContext()->SetPSShaderResource(srvInfo->BindIndex, srv);
+	return true;
 }
 
-// --------------------------------------------------------
-// Destructor - Clean up actual shader (base will be called automatically)
-// --------------------------------------------------------
-SimpleDomainShader::~SimpleDomainShader()
+bool SimplePixelShader::SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState)
 {
-	CleanUp();
-}
+	const SimpleSampler* sampInfo = GetSamplerInfo(handle);
+	if (sampInfo == 0)
+		return false;
 
-// --------------------------------------------------------
-// Handles cleaning up shader and base class clean up
-// --------------------------------------------------------
-void SimpleDomainShader::CleanUp()
-{
-	ISimpleShader::CleanUp();
-	if (shader) { shader->Release(); shader = 0; }
-}
-
-// --------------------------------------------------------
-// Creates the DirectX domain shader
-//
-// shaderBlob - The shader's compiled code
-//
-// Returns true if shader is created correctly, false otherwise
-// --------------------------------------------------------
-bool SimpleDomainShader::CreateShader(ID3DBlob* shaderBlob)
-{
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
-	// Create the shader from the blob
-	HRESULT result = device->CreateDomainShader(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		0,
-		&shader);
-
-	// Check the result
-	return (result == S_OK);
-}
-
-// --------------------------------------------------------
-// Sets the domain shader and constant buffers for
-// future DirectX drawing
-// --------------------------------------------------------
-void SimpleDomainShader::SetShaderAndCBs()
-{
-	// Is shader valid?
-	if (!shaderValid) return;
-
-	// Set the shader
-	deviceContext->DSSetShader(shader, 0, 0);
-
-	// Set the constant buffers
-	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
-
-		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			&constantBuffers[i].ConstantBuffer);
-	}
-}
-
-// --------------------------------------------------------
-// Sets a shader resource view in the domain shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleDomainShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
-{
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, &srv);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Sets a sampler state in the domain shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleDomainShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
-{
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
-
-	// Success
-	return true;
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ------ SIMPLE HULL SHADER --------------------------------------------------
-///////////////////////////////////////////////////////////////////////////////
-
-// --------------------------------------------------------
-// Constructor just calls the base
-// --------------------------------------------------------
-SimpleHullShader::SimpleHullShader(ID3D11Device* device, ID3D11DeviceContext* context)
-	: ISimpleShader(device, context) 
-{ 
-	this->shader = 0;
-}
-
-// --------------------------------------------------------
-// Destructor - Clean up actual shader (base will be called automatically)
-// --------------------------------------------------------
-SimpleHullShader::~SimpleHullShader()
-{
-	CleanUp();
-}
-
-// --------------------------------------------------------
-// Handles cleaning up shader and base class clean up
-// --------------------------------------------------------
-void SimpleHullShader::CleanUp()
-{
-	ISimpleShader::CleanUp();
-	if (shader) { shader->Release(); shader = 0; }
-}
-
-// --------------------------------------------------------
-// Creates the DirectX hull shader
-//
-// shaderBlob - The shader's compiled code
-//
-// Returns true if shader is created correctly, false otherwise
-// --------------------------------------------------------
-bool SimpleHullShader::CreateShader(ID3DBlob* shaderBlob)
-{
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
-	// Create the shader from the blob
-	HRESULT result = device->CreateHullShader(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		0,
-		&shader);
-
-	// Check the result
-	return (result == S_OK);
-}
-
-// --------------------------------------------------------
-// Sets the hull shader and constant buffers for
-// future DirectX drawing
-// --------------------------------------------------------
-void SimpleHullShader::SetShaderAndCBs()
-{
-	// Is shader valid?
-	if (!shaderValid) return;
-
-	// Set the shader
-	deviceContext->HSSetShader(shader, 0, 0);
-
-	// Set the constant buffers?
-	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
-
-		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			&constantBuffers[i].ConstantBuffer);
-	}
-}
-
-// --------------------------------------------------------
-// Sets a shader resource view in the hull shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleHullShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
-{
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, &srv);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Sets a sampler state in the hull shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleHullShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
-{
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
-
-	// Success
+	device->GetContext()->SetPSSampler(sampInfo->BindIndex, samplerState);
 	return true;
-}
-
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ------ SIMPLE GEOMETRY SHADER ----------------------------------------------
-///////////////////////////////////////////////////////////////////////////////
-
-// --------------------------------------------------------
-// Constructor calls the base and sets up potential stream-out options
-// --------------------------------------------------------
-SimpleGeometryShader::SimpleGeometryShader(ID3D11Device* device, ID3D11DeviceContext* context, bool useStreamOut, bool allowStreamOutRasterization)
-	: ISimpleShader(device, context) 
-{ 
-	this->shader = 0;
-	this->useStreamOut = useStreamOut;
-	this->streamOutVertexSize = 0;
-	this->allowStreamOutRasterization = allowStreamOutRasterization;
-}
-
-// --------------------------------------------------------
-// Destructor - Clean up actual shader (base will be called automatically)
-// --------------------------------------------------------
-SimpleGeometryShader::~SimpleGeometryShader()
-{
-	CleanUp();
-}
-
-// --------------------------------------------------------
-// Handles cleaning up shader and base class clean up
-// --------------------------------------------------------
-void SimpleGeometryShader::CleanUp()
-{
-	ISimpleShader::CleanUp();
-	if (shader) { shader->Release(); shader = 0; }
-}
-
-// --------------------------------------------------------
-// Creates the DirectX Geometry shader
-//
-// shaderBlob - The shader's compiled code
-//
-// Returns true if shader is created correctly, false otherwise
-// --------------------------------------------------------
-bool SimpleGeometryShader::CreateShader(ID3DBlob* shaderBlob)
-{
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
-	// Using stream out?
-	if (useStreamOut)
-		return this->CreateShaderWithStreamOut(shaderBlob);
-
-	// Create the shader from the blob
-	HRESULT result = device->CreateGeometryShader(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		0,
-		&shader);
-
-	// Check the result
-	return (result == S_OK);
-}
-
-// --------------------------------------------------------
-// Creates the DirectX Geometry shader and sets it up for
-// stream output, if possible.
-//
-// shaderBlob - The shader's compiled code
-//
-// Returns true if shader is created correctly, false otherwise
-// --------------------------------------------------------
-bool SimpleGeometryShader::CreateShaderWithStreamOut(ID3DBlob* shaderBlob)
-{
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
-	// Reflect shader info
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
-
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Set up the output signature
-	streamOutVertexSize = 0;
-	std::vector<D3D11_SO_DECLARATION_ENTRY> soDecl;
-	for (unsigned int i = 0; i < shaderDesc.OutputParameters; i++)
-	{
-		// Get the info about this entry
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetOutputParameterDesc(i, &paramDesc);
-		
-		// Create the SO Declaration
-		D3D11_SO_DECLARATION_ENTRY entry;
-		entry.SemanticIndex  = paramDesc.SemanticIndex;
-		entry.SemanticName   = paramDesc.SemanticName;
-		entry.Stream         = paramDesc.Stream;
-		entry.StartComponent = 0; // Assume starting at 0
-		entry.OutputSlot     = 0; // Assume the first output slot
-
-		// Check the mask to determine how many components are used
-		entry.ComponentCount = CalcComponentCount(paramDesc.Mask);
-	
-		// Increment the size
-		streamOutVertexSize += entry.ComponentCount * sizeof(float);
-
-		// Add to the declaration
-		soDecl.push_back(entry);
-	}
-
-	// Rasterization allowed?
-	unsigned int rast = allowStreamOutRasterization ? 0 : D3D11_SO_NO_RASTERIZED_STREAM;
-
-	// Create the shader
-	HRESULT result = device->CreateGeometryShaderWithStreamOutput(
-		shaderBlob->GetBufferPointer(), // Shader blob pointer
-		shaderBlob->GetBufferSize(),    // Shader blob size
-		&soDecl[0],                     // Stream out declaration
-		(unsigned int)soDecl.size(),    // Number of declaration entries
-		NULL,                           // Buffer strides (not used - assume tightly packed?)
-		0,                              // No buffer strides
-		rast,                           // Index of the stream to rasterize (if any)
-		NULL,                           // Not using class linkage
-		&shader);
-	
-	return (result == S_OK);
-}
-
-// --------------------------------------------------------
-// Creates a vertex buffer that is compatible with the stream output
-// delcaration that was used to create the shader.  This buffer will
-// not be cleaned up (Released) by the simple shader - you must clean
-// it up yourself when you're done with it.  Immediately returns
-// false if the shader was not created with stream output, the shader
-// isn't valid or the determined stream out vertex size is zero.
-//
-// buffer - Pointer to an ID3D11Buffer pointer to hold the buffer ref
-// vertexCount - Amount of vertices the buffer should hold
-//
-// Returns true if buffer is created successfully AND stream output
-// was used to create the shader.  False otherwise.
-// --------------------------------------------------------
-bool SimpleGeometryShader::CreateCompatibleStreamOutBuffer(ID3D11Buffer** buffer, int vertexCount)
-{
-	// Was stream output actually used?
-	if (!this->useStreamOut || !shaderValid || streamOutVertexSize == 0)
-		return false;
-
-	// Set up the buffer description
-	D3D11_BUFFER_DESC desc;
-	desc.BindFlags           = D3D11_BIND_STREAM_OUTPUT | D3D11_BIND_VERTEX_BUFFER;
-	desc.ByteWidth           = streamOutVertexSize * vertexCount;
-	desc.CPUAccessFlags      = 0;
-	desc.MiscFlags           = 0;
-	desc.StructureByteStride = 0;
-	desc.Usage               = D3D11_USAGE_DEFAULT;
-
-	// Attempt to create the buffer and return the result
-	HRESULT result = device->CreateBuffer(&desc, 0, buffer);
-	return (result == S_OK);
-}
-
-// --------------------------------------------------------
-// Helper method to unbind all stream out buffers from the SO stage
-// --------------------------------------------------------
-void SimpleGeometryShader::UnbindStreamOutStage(ID3D11DeviceContext* deviceContext)
-{
-	unsigned int offset = 0;
-	ID3D11Buffer* unset[1] = { 0 };
-	deviceContext->SOSetTargets(1, unset, &offset);
-}
-
-// --------------------------------------------------------
-// Sets the geometry shader and constant buffers for
-// future DirectX drawing
-// --------------------------------------------------------
-void SimpleGeometryShader::SetShaderAndCBs()
-{
-	// Is shader valid?
-	if (!shaderValid) return;
-
-	// Set the shader
-	deviceContext->GSSetShader(shader, 0, 0);
-
-	// Set the constant buffers?
-	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
-
-		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			&constantBuffers[i].ConstantBuffer);
-	}
-}
-
-// --------------------------------------------------------
-// Sets a shader resource view in the Geometry shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleGeometryShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
-{
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, &srv);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Sets a sampler state in the Geometry shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleGeometryShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
-{
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Calculates the number of components specified by a parameter description mask
-//
-// mask - The mask to check (only values 0 - 15 are considered)
-//
-// Returns an integer between 0 - 4 inclusive
-// --------------------------------------------------------
-unsigned int SimpleGeometryShader::CalcComponentCount(unsigned int mask)
-{
-	unsigned int result = 0;
-	result += (unsigned int)((mask & 1) == 1);
-	result += (unsigned int)((mask & 2) == 2);
-	result += (unsigned int)((mask & 4) == 4);
-	result += (unsigned int)((mask & 8) == 8);
-	return result;
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ------ SIMPLE COMPUTE SHADER -----------------------------------------------
-///////////////////////////////////////////////////////////////////////////////
-
-// --------------------------------------------------------
-// Constructor just calls the base
-// --------------------------------------------------------
-SimpleComputeShader::SimpleComputeShader(ID3D11Device* device, ID3D11DeviceContext* context)
-	: ISimpleShader(device, context) 
-{ 
-	this->shader = 0;
-
-	this->threadsX = 0; 
-	this->threadsY = 0;
-	this->threadsZ = 0;
-	this->threadsTotal = 0;
-}
-
-// --------------------------------------------------------
-// Destructor - Clean up actual shader (base will be called automatically)
-// --------------------------------------------------------
-SimpleComputeShader::~SimpleComputeShader()
-{
-	CleanUp();
-}
-
-// --------------------------------------------------------
-// Handles cleaning up shader and base class clean up
-// --------------------------------------------------------
-void SimpleComputeShader::CleanUp()
-{
-	ISimpleShader::CleanUp();
-	if (shader) { shader->Release(); shader = 0; }
-
-	uavTable.clear();
-}
-
-// --------------------------------------------------------
-// Creates the DirectX Compute shader
-//
-// shaderBlob - The shader's compiled code
-//
-// Returns true if shader is created correctly, false otherwise
-// --------------------------------------------------------
-bool SimpleComputeShader::CreateShader(ID3DBlob* shaderBlob)
-{
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
-	// Create the shader from the blob
-	HRESULT result = device->CreateComputeShader(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		0,
-		&shader);
-
-	// Was the shader created correctly?
-	if (result != S_OK)
-		return false;
-
-	// Set up shader reflection to get information about UAV's
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
-
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-	
-	// Grab the thread info
-	threadsTotal = refl->GetThreadGroupSize(
-		&threadsX,
-		&threadsY,
-		&threadsZ);
-
-	// Loop and get all UAV resources
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
-	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
-		// Check the type, looking for any kind of UAV
-		switch (resourceDesc.Type)
-		{
-		case D3D_SIT_UAV_APPEND_STRUCTURED:
-		case D3D_SIT_UAV_CONSUME_STRUCTURED:
-		case D3D_SIT_UAV_RWBYTEADDRESS:
-		case D3D_SIT_UAV_RWSTRUCTURED:
-		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
-		case D3D_SIT_UAV_RWTYPED:
-			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
-		}
-	}
-
-	// All set
-	refl->Release();
-	return true;
-}
-
-// --------------------------------------------------------
-// Sets the Compute shader and constant buffers for
-// future DirectX drawing
-// --------------------------------------------------------
-void SimpleComputeShader::SetShaderAndCBs()
-{
-	// Is shader valid?
-	if (!shaderValid) return;
-
-	// Set the shader
-	deviceContext->CSSetShader(shader, 0, 0);
-
-	// Set the constant buffers?
-	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
-
-		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			&constantBuffers[i].ConstantBuffer);
-	}
-}
-
-// --------------------------------------------------------
-// Dispatches the compute shader with the specified amount 
-// of groups, using the number of threads per group
-// specified in the shader file itself
-//
-// For example, calling this method with params (5,1,1) on
-// a shader with (8,2,2) threads per group will launch a 
-// total of 160 threads: ((5 * 8) * (1 * 2) * (1 * 2))
-//
-// This is identical to using the device context's 
-// Dispatch() method yourself.  
-//
-// Note: This will dispatch the currently active shader, 
-// not necessarily THIS shader. Be sure to activate this
-// shader with SetShader() before calling Dispatch
-//
-// groupsX - Numbers of groups in the X dimension
-// groupsY - Numbers of groups in the Y dimension
-// groupsZ - Numbers of groups in the Z dimension
-// --------------------------------------------------------
-void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
-{
-	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
-}
-
-// --------------------------------------------------------
-// Dispatches the compute shader with AT LEAST the 
-// specified amount of threads, calculating the number of
-// groups to dispatch using the number of threads per group
-// specified in the shader file itself
-//
-// For example, calling this method with params (10,3,3) on
-// a shader with (5,2,2) threads per group will launch 
-// 8 total groups and 160 total threads, calculated by:
-// Groups: ceil(10/5) * ceil(3/2) * ceil(3/2) = 8
-// Threads: ((2 * 5) * (2 * 2) * (2 * 2)) = 160
-//
-// Note: This will dispatch the currently active shader, 
-// not necessarily THIS shader. Be sure to activate this
-// shader with SetShader() before calling Dispatch
-//
-// threadsX - Desired numbers of threads in the X dimension
-// threadsY - Desired numbers of threads in the Y dimension
-// threadsZ - Desired numbers of threads in the Z dimension
-// --------------------------------------------------------
-void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
-{
-	deviceContext->Dispatch(
-		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
-		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
-		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
-}
-
-// --------------------------------------------------------
-// Sets a shader resource view in the Compute shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleComputeShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
-{
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, &srv);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Sets a sampler state in the Compute shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleComputeShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
-{
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Sets an unordered access view in the Compute shader stage
-//
-// name - The name of the sampler state in the shader
-// uav - The UAV in GPU memory
-// appendConsumeOffset - Used for append or consume UAV's (optional)
-//
-// Returns true if a UAV of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimpleComputeShader::SetUnorderedAccessView(std::string name, ID3D11UnorderedAccessView * uav, unsigned int appendConsumeOffset)
-{
-	// Look for the variable and verify
-	unsigned int bindIndex = GetUnorderedAccessViewIndex(name);
-	if (bindIndex == -1)
-		return false;
-
-	// Set the shader resource view
-	deviceContext->CSSetUnorderedAccessViews(bindIndex, 1, &uav, &appendConsumeOffset);
-
-	// Success
-	return true;
-}
-
-// --------------------------------------------------------
-// Gets the index of the specified UAV (or -1)
-// --------------------------------------------------------
-int SimpleComputeShader::GetUnorderedAccessViewIndex(std::string name)
-{
-	// Look for the key
-	std::unordered_map<std::string, unsigned int>::iterator result =
-		uavTable.find(name);
-
-	// Did we find the key?
-	if (result == uavTable.end())
-		return -1;
-
-	// Success
-	return result->second;
 }
\ No newline at end of file
@@ -1,14 +1,14 @@
 #pragma once
-#pragma comment(lib, "dxguid.lib")
-#pragma comment(lib, "d3dcompiler.lib")
-
-#include <d3d11.h>
-#include <d3dcompiler.h>
 #include <DirectXMath.h>
 
+#include "ConstantBufferRing.h"
+#include "RenderDevice.h"
+#include "ShaderNameTable.h"
+
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <stddef.h>
 
 // --------------------------------------------------------
 // Used by simple shaders to store information about
@@ -21,6 +21,10 @@ struct SimpleShaderVariable
 	unsigned int ConstantBufferIndex;
 };
 
+// D3D_CBUFFER_TYPE of a true constant buffer (the others
+// are texture buffers and the like, which aren't copied)
+const unsigned int SimpleCBufferType = 0;
+
 // --------------------------------------------------------
 // Contains information about a specific
 // constant buffer in a shader, as well as
@@ -29,12 +33,144 @@ struct SimpleShaderVariable
 struct SimpleConstantBuffer
 {
 	std::string Name;
-	D3D_CBUFFER_TYPE Type = D3D_CBUFFER_TYPE::D3D11_CT_CBUFFER;
+	unsigned int Type = SimpleCBufferType;	// D3D_CBUFFER_TYPE
 	unsigned int Size = 0;
 	unsigned int BindIndex = 0;
-	ID3D11Buffer* ConstantBuffer = 0;
+	RenderBuffer* ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
 	std::vector<SimpleShaderVariable> Variables;
+	ConstantBufferSlice Bound;	// Where the last copied data lives (ConstantBuffer or a ring)
+
+	// Bytes of LocalDataBuffer changed since the last copy to
+	// the GPU - empty (start == end) when there's nothing new
+	unsigned int DirtyStart = 0;
+	unsigned int DirtyEnd = 0;
+};
+
+// --------------------------------------------------------
+// The last upload of a buffer made on behalf of one object,
+// kept by the object so it can be bound again next frame
+// without uploading anything, as long as the data matches
+// and the ring still holds it
+// --------------------------------------------------------
+struct RetainedConstants
+{
+	ConstantBufferSlice Slice;
+	std::vector<unsigned char> Data;
+};
+
+// --------------------------------------------------------
+// Constant buffer traffic since the last reset
+// --------------------------------------------------------
+struct ConstantUploadStats
+{
+	int Uploads = 0;
+	int UploadsSkipped = 0;			// Nothing changed, or a retained upload was reused
+	unsigned int BytesUploaded = 0;
+	unsigned int BytesSaved = 0;		// Bytes the skipped uploads would have sent
+	int SetsSkipped = 0;			// SetData() calls with the same bytes as before
+};
+
+// --------------------------------------------------------
+// Everything the shaders use from reflection, as plain data
+// (so it can be cached on disk instead of reflected again)
+// --------------------------------------------------------
+struct ShaderReflectionData
+{
+	struct Variable
+	{
+		std::string Name;
+		unsigned int ByteOffset = 0;
+		unsigned int Size = 0;
+	};
+
+	struct Buffer
+	{
+		std::string Name;
+		unsigned int Type = 0;			// D3D_CBUFFER_TYPE
+		unsigned int Size = 0;
+		unsigned int BindIndex = 0;
+		std::vector<Variable> Variables;
+	};
+
+	struct Resource
+	{
+		std::string Name;
+		unsigned int BindIndex = 0;
+	};
+
+	// One element of the vertex shader's input signature
+	struct InputElement
+	{
+		std::string SemanticName;
+		unsigned int SemanticIndex = 0;
+		unsigned int Format = 0;		// DXGI_FORMAT
+		bool PerInstance = false;		// Semantic ends in "_PER_INSTANCE"
+	};
+
+	std::vector<Buffer> Buffers;
+	std::vector<Resource> Textures;
+	std::vector<Resource> Samplers;
+	std::vector<InputElement> Inputs;	// Vertex shaders only
+};
+
+class ShaderCache;
+
+// Compiled code, only touched by the D3D11 loaders (see
+// SimpleShaderD3D11.cpp)
+struct ID3D10Blob;
+typedef ID3D10Blob ID3DBlob;
+
+// --------------------------------------------------------
+// One member of a C++ struct that mirrors a cbuffer: the
+// name of the HLSL variable it stands for, and where it is
+// in the struct
+// --------------------------------------------------------
+struct ConstantBufferField
+{
+	const char* Name;
+	unsigned int Offset;
+	unsigned int Size;
+};
+
+// --------------------------------------------------------
+// HLSL packs cbuffers in 16 byte registers: a member that
+// fits in one never straddles two, and bigger members (and
+// structs) start a new one.  A C++ member that breaks this
+// is somewhere else on the GPU.
+// --------------------------------------------------------
+constexpr bool IsHLSLPacked(size_t offset, size_t size)
+{
+	return size >= 16 ? offset % 16 == 0 : offset % 16 + size <= 16;
+}
+
+template<bool Packed>
+ConstantBufferField PackedField(const char* name, size_t offset, size_t size)
+{
+	static_assert(Packed, "Constant buffer member breaks HLSL packing (pad it onto a 16 byte boundary)");
+	return { name, (unsigned int)offset, (unsigned int)size };
+}
+
+// Describes (and checks at compile time) one member for a
+// struct's GetFields() - the member must have the same name
+// as its HLSL variable
+#define CONSTANT_BUFFER_FIELD(Struct, member) \
+	PackedField<IsHLSLPacked(offsetof(Struct, member), sizeof(Struct::member))>( \
+		#member, offsetof(Struct, member), sizeof(Struct::member))
+
+// --------------------------------------------------------
+// A cbuffer bound to the C++ struct T, from
+// BindConstantBuffer<T>().  Only valid if T's layout matched
+// the shader's.
+//
+// T needs a static GetFields(unsigned int& count) listing
+// its members with CONSTANT_BUFFER_FIELD.
+// --------------------------------------------------------
+template<typename T>
+struct TypedConstantBuffer
+{
+	SimpleShaderHandle Buffer;
+	bool IsValid() const { return Buffer.IsValid(); }
 };
 
 // --------------------------------------------------------
@@ -61,12 +197,27 @@ struct SimpleSampler
 class ISimpleShader
 {
 public:
-	ISimpleShader(ID3D11Device* device, ID3D11DeviceContext* context);
+	ISimpleShader(IRenderDevice* device);
 	virtual ~ISimpleShader();
 
 	// Initialization method (since we can't invoke derived class
 	// overrides in the base class constructor)
-	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderFile(const wchar_t* shaderFile);
+
+	// Same, for code already in memory.  With a cache set, its
+	// reflection comes from (or is saved to) reflectionFile.
+	bool LoadShaderBlob(ID3DBlob* blob, const wchar_t* reflectionFile);
+
+	// Same, from reflection alone with no code - only for
+	// devices that never run it (NullRenderDevice)
+	bool LoadReflection(const ShaderReflectionData& data);
+
+	// Reflects into a .refl sidecar next to each .cso, and
+	// shares input layouts (set before loading)
+	void SetShaderCache(ShaderCache* cache) { shaderCache = cache; }
+
+	// Reflects compiled shader code into plain data
+	static bool ReflectShader(const void* code, size_t size, ShaderReflectionData& data);
 
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
@@ -76,6 +227,19 @@ public:
 	void CopyAllBufferData();
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
+	void CopyBufferData(std::string bufferName, RetainedConstants& retained);
+	void CopyBufferData(SimpleShaderHandle buffer);
+	void CopyBufferData(SimpleShaderHandle buffer, RetainedConstants& retained);
+
+	// Uploads again every buffer whose copy in the ring was
+	// discarded by a wrap since it was written (except the one
+	// bound at skipSlot).  Returns how many went up.
+	int ReuploadLostBuffers(int skipSlot = -1);
+
+	// Traffic across every shader (only the immediate context
+	// uploads through shaders, so this isn't locked)
+	static ConstantUploadStats GetUploadStats() { return uploadStats; }
+	static void ResetUploadStats() { uploadStats = ConstantUploadStats(); }
 
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
@@ -91,19 +255,61 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Resolving names once, for the handle versions below
+	// (invalid handles if the shader has no such name)
+	SimpleShaderHandle GetVariableHandle(SimpleShaderName name) const { return variableNames.Find(name); }
+	SimpleShaderHandle GetBufferHandle(SimpleShaderName name) const { return bufferNames.Find(name); }
+	SimpleShaderHandle GetShaderResourceViewHandle(SimpleShaderName name) const { return srvNames.Find(name); }
+	SimpleShaderHandle GetSamplerHandle(SimpleShaderName name) const { return samplerNames.Find(name); }
+
+	// Sets shader data by handle - no lookup, just a write at
+	// the variable's offset
+	bool SetData(SimpleShaderHandle variable, const void* data, unsigned int size);
+	bool SetInt(SimpleShaderHandle variable, int data);
+	bool SetFloat(SimpleShaderHandle variable, float data);
+	bool SetFloat4(SimpleShaderHandle variable, const DirectX::XMFLOAT4& data);
+	bool SetMatrix4x4(SimpleShaderHandle variable, const DirectX::XMFLOAT4X4& data);
+
+	// Binds a C++ struct to a whole cbuffer, checking every
+	// member's offset and size against reflection (and the
+	// struct's size against the buffer's).  A mismatch is
+	// printed and gives an invalid buffer.
+	template<typename T>
+	TypedConstantBuffer<T> BindConstantBuffer(SimpleShaderName name)
+	{
+		unsigned int fieldCount = 0;
+		const ConstantBufferField* fields = T::GetFields(fieldCount);
+
+		TypedConstantBuffer<T> typed;
+		typed.Buffer = ValidateBufferLayout(name, fields, fieldCount, sizeof(T));
+		return typed;
+	}
+
+	// Replaces a bound buffer's data in one copy
+	template<typename T>
+	bool SetBufferData(TypedConstantBuffer<T> buffer, const T& data)
+	{
+		return WriteBuffer(buffer.Buffer, &data, sizeof(T));
+	}
+
 	// Setting shader resources
-	virtual bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv) = 0;
-	virtual bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState) = 0;
+	virtual bool SetShaderResourceView(std::string name, RenderShaderResource* srv) = 0;
+	virtual bool SetSamplerState(std::string name, RenderSampler* samplerState) = 0;
+	virtual bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv) = 0;
+	virtual bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState) = 0;
 
 	// Getting data about variables and resources
 	const SimpleShaderVariable* GetVariableInfo(std::string name);
+	const SimpleShaderVariable* GetVariableInfo(SimpleShaderHandle handle);
 	
 	const SimpleSRV* GetShaderResourceViewInfo(std::string name);
 	const SimpleSRV* GetShaderResourceViewInfo(unsigned int index);
+	const SimpleSRV* GetShaderResourceViewInfo(SimpleShaderHandle handle);
 	size_t GetShaderResourceViewCount() { return textureTable.size(); }
 	
 	const SimpleSampler* GetSamplerInfo(std::string name);
 	const SimpleSampler* GetSamplerInfo(unsigned int index);
+	const SimpleSampler* GetSamplerInfo(SimpleShaderHandle handle);
 	size_t GetSamplerCount() { return samplerTable.size(); }
 
 	// Get data about constant buffers
@@ -113,14 +319,14 @@ public:
 	const SimpleConstantBuffer* GetBufferInfo(unsigned int index);
 	
 	// Misc getters
-	ID3DBlob* GetShaderBlob() { return shaderBlob; }
+	const std::vector<unsigned char>& GetShaderCode() { return shaderCode; }
+	const ShaderReflectionData& GetReflection() { return reflection; }
 
 protected:
 	
 	bool shaderValid;
-	ID3DBlob* shaderBlob;
-	ID3D11Device* device;
-	ID3D11DeviceContext* deviceContext;
+	std::vector<unsigned char> shaderCode;	// Empty if loaded from reflection alone
+	IRenderDevice* device;
 
 	// Resource counts
 	unsigned int constantBufferCount;
@@ -134,14 +340,39 @@ protected:
 	std::unordered_map<std::string, SimpleSRV*> textureTable;
 	std::unordered_map<std::string, SimpleSampler*> samplerTable;
 
+	// Handle lookups: variables in handle order, and the names
+	// of everything (SRV and sampler handles are their Index,
+	// buffer handles their index in constantBuffers)
+	std::vector<SimpleShaderVariable> variables;
+	ShaderNameTable variableNames;
+	ShaderNameTable bufferNames;
+	ShaderNameTable srvNames;
+	ShaderNameTable samplerNames;
+
+	// Where reflection came from, and the reflection itself
+	// (tables below are built from it)
+	ShaderCache* shaderCache;
+	ShaderReflectionData reflection;
+	void BuildTables();
+
+	// Shared ring the buffers are copied to, if set
+	ConstantBufferRing* constantRing;
+	void UploadBuffer(SimpleConstantBuffer* cb);
+	void ReserveRingSpace();
+
+	static ConstantUploadStats uploadStats;
+
 	// Pure virtual functions for dealing with shader types
-	virtual bool CreateShader(ID3DBlob* shaderBlob) = 0;
+	virtual bool CreateShader(const void* code, size_t size) = 0;
 	virtual void SetShaderAndCBs() = 0;
 
 	virtual void CleanUp();
 
 	// Helpers for finding data by name
 	SimpleShaderVariable* FindVariable(std::string name, int size);
+	bool WriteVariable(const SimpleShaderVariable* var, const void* data);
+	bool WriteBuffer(SimpleShaderHandle buffer, const void* data, unsigned int size);
+	SimpleShaderHandle ValidateBufferLayout(SimpleShaderName name, const ConstantBufferField* fields, unsigned int fieldCount, unsigned int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 };
 
@@ -151,21 +382,29 @@ protected:
 class SimpleVertexShader : public ISimpleShader
 {
 public:
-	SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext* context);
-	SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11InputLayout* inputLayout, bool perInstanceCompatible);
+	SimpleVertexShader(IRenderDevice* device);
+	SimpleVertexShader(IRenderDevice* device, RenderInputLayout* inputLayout, bool perInstanceCompatible);
 	~SimpleVertexShader();
-	ID3D11VertexShader* GetDirectXShader() { return shader; }
-	ID3D11InputLayout* GetInputLayout() { return inputLayout; }
+	RenderVertexShader* GetShader() { return shader; }
+	RenderInputLayout* GetInputLayout() { return inputLayout; }
 	bool GetPerInstanceCompatible() { return perInstanceCompatible; }
+	void SetSharedInputLayout(RenderInputLayout* layout);
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	// Copies constant data into the ring (when it's supported)
+	// instead of updating this shader's own buffers
+	void SetConstantBufferRing(ConstantBufferRing* ring) { constantRing = ring; ReserveRingSpace(); }
+
+	bool SetShaderResourceView(std::string name, RenderShaderResource* srv);
+	bool SetSamplerState(std::string name, RenderSampler* samplerState);
+	bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState);
 
 protected:
 	bool perInstanceCompatible;
-	ID3D11InputLayout* inputLayout;
-	ID3D11VertexShader* shader;
-	bool CreateShader(ID3DBlob* shaderBlob);
+	RenderInputLayout* inputLayout;
+	bool ownsInputLayout;		// False when the shader cache shares it
+	RenderVertexShader* shader;
+	bool CreateShader(const void* code, size_t size);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
@@ -177,125 +416,45 @@ protected:
 class SimplePixelShader : public ISimpleShader
 {
 public:
-	SimplePixelShader(ID3D11Device* device, ID3D11DeviceContext* context);
+	SimplePixelShader(IRenderDevice* device);
 	~SimplePixelShader();
-	ID3D11PixelShader* GetDirectXShader() { return shader; }
+	RenderPixelShader* GetShader() { return shader; }
+	void SetConstantBufferRing(ConstantBufferRing* ring) { constantRing = ring; ReserveRingSpace(); }
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	bool SetShaderResourceView(std::string name, RenderShaderResource* srv);
+	bool SetSamplerState(std::string name, RenderSampler* samplerState);
+	bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState);
 
 protected:
-	ID3D11PixelShader* shader;
-	bool CreateShader(ID3DBlob* shaderBlob);
+	RenderPixelShader* shader;
+	bool CreateShader(const void* code, size_t size);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
 
 // --------------------------------------------------------
-// Derived class for DOMAIN shaders ///////////////////////
+// Somewhere other than the shaders' own CPU copies to put
+// constants, for recording draws on another thread (see
+// SubmitWorker).  Writes go to the stager's copy of a
+// shader's buffers, and CommitConstants() uploads and
+// binds that copy.
 // --------------------------------------------------------
-class SimpleDomainShader : public ISimpleShader
+class IConstantStager
 {
 public:
-	SimpleDomainShader(ID3D11Device* device, ID3D11DeviceContext* context);
-	~SimpleDomainShader();
-	ID3D11DomainShader* GetDirectXShader() { return shader; }
-
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
-
-protected:
-	ID3D11DomainShader* shader;
-	bool CreateShader(ID3DBlob* shaderBlob);
-	void SetShaderAndCBs();
-	void CleanUp();
-};
+	virtual ~IConstantStager() {}
 
-// --------------------------------------------------------
-// Derived class for HULL shaders /////////////////////////
-// --------------------------------------------------------
-class SimpleHullShader : public ISimpleShader
-{
-public:
-	SimpleHullShader(ID3D11Device* device, ID3D11DeviceContext* context);
-	~SimpleHullShader();
-	ID3D11HullShader* GetDirectXShader() { return shader; }
+	// Replaces a whole staged buffer (see BindConstantBuffer)
+	template<typename T>
+	bool SetConstants(ISimpleShader* shader, TypedConstantBuffer<T> buffer, const T& data)
+	{
+		return WriteBuffer(shader, buffer.Buffer, &data, sizeof(T));
+	}
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	virtual void CommitConstants(SimpleVertexShader* shader) = 0;
+	virtual void CommitConstants(SimplePixelShader* shader, int skipSlot = -1) = 0;	// skipSlot is bound by something else
 
 protected:
-	ID3D11HullShader* shader;
-	bool CreateShader(ID3DBlob* shaderBlob);
-	void SetShaderAndCBs();
-	void CleanUp();
+	virtual bool WriteBuffer(ISimpleShader* shader, SimpleShaderHandle buffer, const void* data, unsigned int size) = 0;
 };
-
-// --------------------------------------------------------
-// Derived class for GEOMETRY shaders /////////////////////
-// --------------------------------------------------------
-class SimpleGeometryShader : public ISimpleShader
-{
-public:
-	SimpleGeometryShader(ID3D11Device* device, ID3D11DeviceContext* context, bool useStreamOut = 0, bool allowStreamOutRasterization = 0);
-	~SimpleGeometryShader();
-	ID3D11GeometryShader* GetDirectXShader() { return shader; }
-
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
-
-	bool CreateCompatibleStreamOutBuffer(ID3D11Buffer** buffer, int vertexCount);
-
-	static void UnbindStreamOutStage(ID3D11DeviceContext* deviceContext);
-
-protected:
-	// Shader itself
-	ID3D11GeometryShader* shader;
-
-	// Stream out related
-	bool useStreamOut;
-	bool allowStreamOutRasterization;
-	unsigned int streamOutVertexSize;
-
-	bool CreateShader(ID3DBlob* shaderBlob);
-	bool CreateShaderWithStreamOut(ID3DBlob* shaderBlob);
-	void SetShaderAndCBs();
-	void CleanUp();
-
-	// Helpers
-	unsigned int CalcComponentCount(unsigned int mask);
-};
-
-
-// --------------------------------------------------------
-// Derived class for COMPUTE shaders //////////////////////
-// --------------------------------------------------------
-class SimpleComputeShader : public ISimpleShader
-{
-public:
-	SimpleComputeShader(ID3D11Device* device, ID3D11DeviceContext* context);
-	~SimpleComputeShader();
-	ID3D11ComputeShader* GetDirectXShader() { return shader; }
-
-	void DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ);
-	void DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ);
-
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
-	bool SetUnorderedAccessView(std::string name, ID3D11UnorderedAccessView* uav, unsigned int appendConsumeOffset = -1);
-
-	int GetUnorderedAccessViewIndex(std::string name);
-
-protected:
-	ID3D11ComputeShader* shader;
-	std::unordered_map<std::string, unsigned int> uavTable;
-
-	unsigned int threadsX;
-	unsigned int threadsY;
-	unsigned int threadsZ;
-	unsigned int threadsTotal;
-
-	bool CreateShader(ID3DBlob* shaderBlob);
-	void SetShaderAndCBs();
-	void CleanUp();
-};
\ No newline at end of file
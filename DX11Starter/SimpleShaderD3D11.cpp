@@ -0,0 +1,1135 @@
+#include "SimpleShaderD3D11.h"
+#include "ShaderCache.h"
+
+// The core only knows the plain cbuffer type by value
+static_assert(SimpleCBufferType == D3D_CT_CBUFFER, "SimpleCBufferType must match D3D_CT_CBUFFER");
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ D3D11 LOADING -------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Loads the specified shader and builds the variable table using shader
+// reflection.  This must be a separate step from the constructor since
+// we can't invoke derived class overrides in the base class constructor.
+//
+// shaderFile - A "wide string" specifying the compiled shader to load
+// 
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderFile(const wchar_t* shaderFile)
+{
+	// Load the shader to a blob and ensure it worked
+	ID3DBlob* blob;
+	HRESULT hr = D3DReadFileToBlob(shaderFile, &blob);
+	if (hr != S_OK)
+	{
+		return false;
+	}
+
+	// Reflection is cached beside the shader ("X.cso.refl")
+	std::wstring reflectionFile = std::wstring(shaderFile) + L".refl";
+	bool loaded = LoadShaderBlob(blob, reflectionFile.c_str());
+	blob->Release();
+	return loaded;
+}
+
+// --------------------------------------------------------
+// Loads a shader from compiled code already in memory
+//
+// blob           - The compiled shader (the shader keeps a copy)
+// reflectionFile - Where the shader cache (if set) keeps this
+//                  shader's reflection, or null to reflect
+//
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBlob(ID3DBlob* blob, const wchar_t* reflectionFile)
+{
+	const unsigned char* code = (const unsigned char*)blob->GetBufferPointer();
+	shaderCode.assign(code, code + blob->GetBufferSize());
+
+	// Get information about this shader and its variables,
+	// buffers, etc. - from the cache's copy if it has one
+	// for this exact code, or from shader reflection
+	bool reflected = shaderCache && reflectionFile ?
+		shaderCache->GetReflection(reflectionFile, &shaderCode[0], shaderCode.size(), reflection) :
+		ReflectShader(&shaderCode[0], shaderCode.size(), reflection);
+	if (!reflected)
+	{
+		return false;
+	}
+
+	// Create the shader - Calls an overloaded version of this abstract
+	// method in the appropriate child class
+	shaderValid = CreateShader(&shaderCode[0], shaderCode.size());
+	if (!shaderValid)
+	{
+		return false;
+	}
+
+	BuildTables();
+	return true;
+}
+
+
+// --------------------------------------------------------
+// Reflects compiled shader code into plain data: constant
+// buffers and their variables, bound textures and samplers,
+// and (for vertex shaders) the input signature
+// --------------------------------------------------------
+bool ISimpleShader::ReflectShader(const void* code, size_t size, ShaderReflectionData& data)
+{
+	data = ShaderReflectionData();
+
+	// Set up shader reflection to get information about
+	// this shader and its variables,  buffers, etc.
+	ID3D11ShaderReflection* refl;
+	HRESULT hr = D3DReflect(
+		code,
+		size,
+		IID_ID3D11ShaderReflection,
+		(void**)&refl);
+	if (hr != S_OK)
+		return false;
+	
+	// Get the description of the shader
+	D3D11_SHADER_DESC shaderDesc;
+	refl->GetDesc(&shaderDesc);
+
+	// Handle bound resources (like shaders and samplers)
+	unsigned int resourceCount = shaderDesc.BoundResources;
+	for (unsigned int r = 0; r < resourceCount; r++)
+	{
+		// Get this resource's description
+		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
+		refl->GetResourceBindingDesc(r, &resourceDesc);
+
+		ShaderReflectionData::Resource resource;
+		resource.Name = resourceDesc.Name;
+		resource.BindIndex = resourceDesc.BindPoint;
+
+		// Check the type
+		if (resourceDesc.Type == D3D_SIT_TEXTURE)
+			data.Textures.push_back(resource);
+		else if (resourceDesc.Type == D3D_SIT_SAMPLER)
+			data.Samplers.push_back(resource);
+	}
+
+	// Loop through all constant buffers
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
+	{
+		// Get this buffer
+		ID3D11ShaderReflectionConstantBuffer* cb =
+			refl->GetConstantBufferByIndex(b);
+		
+		// Get the description of this buffer
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		cb->GetDesc(&bufferDesc);
+
+		// Get the description of the resource binding, so
+		// we know exactly how it's bound in the shader
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		ShaderReflectionData::Buffer buffer;
+		buffer.Name = bufferDesc.Name;
+		buffer.Type = bufferDesc.Type;
+		buffer.Size = bufferDesc.Size;
+		buffer.BindIndex = bindDesc.BindPoint;
+
+		// Loop through all variables in this buffer
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			// Get the description of the variable
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+
+			ShaderReflectionData::Variable variable;
+			variable.Name = varDesc.Name;
+			variable.ByteOffset = varDesc.StartOffset;
+			variable.Size = varDesc.Size;
+			buffer.Variables.push_back(variable);
+		}
+
+		data.Buffers.push_back(buffer);
+	}
+
+	// Read the input signature (only vertex shaders use it).
+	// Code adapted from:
+	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
+	if (D3D11_SHVER_GET_TYPE(shaderDesc.Version) == D3D11_SHVER_VERTEX_SHADER)
+	{
+		for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+		{
+			D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+			refl->GetInputParameterDesc(i, &paramDesc);
+
+			ShaderReflectionData::InputElement element;
+			element.SemanticName = paramDesc.SemanticName;
+			element.SemanticIndex = paramDesc.SemanticIndex;
+
+			// Check the semantic name for "_PER_INSTANCE"
+			std::string perInstanceStr = "_PER_INSTANCE";
+			const std::string& sem = element.SemanticName;
+			int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
+			element.PerInstance =
+				lenDiff >= 0 &&
+				sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
+
+			// Determine DXGI format
+			DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+			if (paramDesc.Mask == 1)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32_FLOAT;
+			}
+			else if (paramDesc.Mask <= 3)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32G32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32G32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32G32_FLOAT;
+			}
+			else if (paramDesc.Mask <= 7)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32G32B32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32G32B32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32G32B32_FLOAT;
+			}
+			else if (paramDesc.Mask <= 15)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32G32B32A32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32G32B32A32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			}
+			element.Format = format;
+
+			data.Inputs.push_back(element);
+		}
+	}
+
+	// All set
+	refl->Release();
+	return true;
+}
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ SIMPLE DOMAIN SHADER ------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Constructor just calls the base
+// --------------------------------------------------------
+SimpleDomainShader::SimpleDomainShader(D3D11RenderDevice* device)
+	: ISimpleShader(device) 
+{ 
+	this->d3dDevice = device->GetDevice();
+	this->deviceContext = device->GetDeviceContext();
+	this->shader = 0;
+}
+
+// --------------------------------------------------------
+// Destructor - Clean up actual shader (base will be called automatically)
+// --------------------------------------------------------
+SimpleDomainShader::~SimpleDomainShader()
+{
+	CleanUp();
+}
+
+// --------------------------------------------------------
+// Handles cleaning up shader and base class clean up
+// --------------------------------------------------------
+void SimpleDomainShader::CleanUp()
+{
+	ISimpleShader::CleanUp();
+	if (shader) { shader->Release(); shader = 0; }
+}
+
+// --------------------------------------------------------
+// Creates the DirectX domain shader
+//
+// code, size - The shader's compiled code
+//
+// Returns true if shader is created correctly, false otherwise
+// --------------------------------------------------------
+bool SimpleDomainShader::CreateShader(const void* code, size_t size)
+{
+	// Clean up first, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+
+	// Create the shader from the code
+	HRESULT result = d3dDevice->CreateDomainShader(
+		code,
+		size,
+		0,
+		&shader);
+
+	// Check the result
+	return (result == S_OK);
+}
+
+// --------------------------------------------------------
+// Sets the domain shader and constant buffers for
+// future DirectX drawing
+// --------------------------------------------------------
+void SimpleDomainShader::SetShaderAndCBs()
+{
+	// Is shader valid?
+	if (!shaderValid) return;
+
+	// Set the shader
+	deviceContext->DSSetShader(shader, 0, 0);
+
+	// Set the constant buffers
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		// Skip "buffers" that aren't true constant buffers
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+			continue;
+
+		// This is a real constant buffer, so set it
+		ID3D11Buffer* buffer = ToD3D11(constantBuffers[i].ConstantBuffer);
+		deviceContext->DSSetConstantBuffers(
+			constantBuffers[i].BindIndex,
+			1,
+			&buffer);
+	}
+}
+
+// --------------------------------------------------------
+// Sets a shader resource view in the domain shader stage
+//
+// name - The name of the texture resource in the shader
+// srv - The shader resource view of the texture in GPU memory
+//
+// Returns true if a texture of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleDomainShader::SetShaderResourceView(std::string name, RenderShaderResource* srv)
+{
+	// Look for the variable and verify
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	if (srvInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the domain shader stage
+//
+// name - The name of the sampler state in the shader
+// samplerState - The sampler state in GPU memory
+//
+// Returns true if a sampler of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleDomainShader::SetSamplerState(std::string name, RenderSampler* samplerState)
+{
+	// Look for the variable and verify
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	if (sampInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Handle versions of the above (handles from
+// GetShaderResourceViewHandle and GetSamplerHandle)
+// --------------------------------------------------------
+bool SimpleDomainShader::SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(handle);
+	if (srvInfo == 0)
+		return false;
+
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+	return true;
+}
+
+bool SimpleDomainShader::SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(handle);
+	if (sampInfo == 0)
+		return false;
+
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+	return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ SIMPLE HULL SHADER --------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Constructor just calls the base
+// --------------------------------------------------------
+SimpleHullShader::SimpleHullShader(D3D11RenderDevice* device)
+	: ISimpleShader(device) 
+{ 
+	this->d3dDevice = device->GetDevice();
+	this->deviceContext = device->GetDeviceContext();
+	this->shader = 0;
+}
+
+// --------------------------------------------------------
+// Destructor - Clean up actual shader (base will be called automatically)
+// --------------------------------------------------------
+SimpleHullShader::~SimpleHullShader()
+{
+	CleanUp();
+}
+
+// --------------------------------------------------------
+// Handles cleaning up shader and base class clean up
+// --------------------------------------------------------
+void SimpleHullShader::CleanUp()
+{
+	ISimpleShader::CleanUp();
+	if (shader) { shader->Release(); shader = 0; }
+}
+
+// --------------------------------------------------------
+// Creates the DirectX hull shader
+//
+// code, size - The shader's compiled code
+//
+// Returns true if shader is created correctly, false otherwise
+// --------------------------------------------------------
+bool SimpleHullShader::CreateShader(const void* code, size_t size)
+{
+	// Clean up first, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+
+	// Create the shader from the code
+	HRESULT result = d3dDevice->CreateHullShader(
+		code,
+		size,
+		0,
+		&shader);
+
+	// Check the result
+	return (result == S_OK);
+}
+
+// --------------------------------------------------------
+// Sets the hull shader and constant buffers for
+// future DirectX drawing
+// --------------------------------------------------------
+void SimpleHullShader::SetShaderAndCBs()
+{
+	// Is shader valid?
+	if (!shaderValid) return;
+
+	// Set the shader
+	deviceContext->HSSetShader(shader, 0, 0);
+
+	// Set the constant buffers?
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		// Skip "buffers" that aren't true constant buffers
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+			continue;
+
+		// This is a real constant buffer, so set it
+		ID3D11Buffer* buffer = ToD3D11(constantBuffers[i].ConstantBuffer);
+		deviceContext->HSSetConstantBuffers(
+			constantBuffers[i].BindIndex,
+			1,
+			&buffer);
+	}
+}
+
+// --------------------------------------------------------
+// Sets a shader resource view in the hull shader stage
+//
+// name - The name of the texture resource in the shader
+// srv - The shader resource view of the texture in GPU memory
+//
+// Returns true if a texture of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleHullShader::SetShaderResourceView(std::string name, RenderShaderResource* srv)
+{
+	// Look for the variable and verify
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	if (srvInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the hull shader stage
+//
+// name - The name of the sampler state in the shader
+// samplerState - The sampler state in GPU memory
+//
+// Returns true if a sampler of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleHullShader::SetSamplerState(std::string name, RenderSampler* samplerState)
+{
+	// Look for the variable and verify
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	if (sampInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Handle versions of the above (handles from
+// GetShaderResourceViewHandle and GetSamplerHandle)
+// --------------------------------------------------------
+bool SimpleHullShader::SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(handle);
+	if (srvInfo == 0)
+		return false;
+
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+	return true;
+}
+
+bool SimpleHullShader::SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(handle);
+	if (sampInfo == 0)
+		return false;
+
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+	return true;
+}
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ SIMPLE GEOMETRY SHADER ----------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Constructor calls the base and sets up potential stream-out options
+// --------------------------------------------------------
+SimpleGeometryShader::SimpleGeometryShader(D3D11RenderDevice* device, bool useStreamOut, bool allowStreamOutRasterization)
+	: ISimpleShader(device) 
+{ 
+	this->d3dDevice = device->GetDevice();
+	this->deviceContext = device->GetDeviceContext();
+	this->shader = 0;
+	this->useStreamOut = useStreamOut;
+	this->streamOutVertexSize = 0;
+	this->allowStreamOutRasterization = allowStreamOutRasterization;
+}
+
+// --------------------------------------------------------
+// Destructor - Clean up actual shader (base will be called automatically)
+// --------------------------------------------------------
+SimpleGeometryShader::~SimpleGeometryShader()
+{
+	CleanUp();
+}
+
+// --------------------------------------------------------
+// Handles cleaning up shader and base class clean up
+// --------------------------------------------------------
+void SimpleGeometryShader::CleanUp()
+{
+	ISimpleShader::CleanUp();
+	if (shader) { shader->Release(); shader = 0; }
+}
+
+// --------------------------------------------------------
+// Creates the DirectX Geometry shader
+//
+// code, size - The shader's compiled code
+//
+// Returns true if shader is created correctly, false otherwise
+// --------------------------------------------------------
+bool SimpleGeometryShader::CreateShader(const void* code, size_t size)
+{
+	// Clean up first, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+
+	// Using stream out?
+	if (useStreamOut)
+		return this->CreateShaderWithStreamOut(code, size);
+
+	// Create the shader from the code
+	HRESULT result = d3dDevice->CreateGeometryShader(
+		code,
+		size,
+		0,
+		&shader);
+
+	// Check the result
+	return (result == S_OK);
+}
+
+// --------------------------------------------------------
+// Creates the DirectX Geometry shader and sets it up for
+// stream output, if possible.
+//
+// code, size - The shader's compiled code
+//
+// Returns true if shader is created correctly, false otherwise
+// --------------------------------------------------------
+bool SimpleGeometryShader::CreateShaderWithStreamOut(const void* code, size_t size)
+{
+	// Clean up first, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+
+	// Reflect shader info
+	ID3D11ShaderReflection* refl;
+	D3DReflect(
+		code,
+		size,
+		IID_ID3D11ShaderReflection,
+		(void**)&refl);
+
+	// Get shader info
+	D3D11_SHADER_DESC shaderDesc;
+	refl->GetDesc(&shaderDesc);
+
+	// Set up the output signature
+	streamOutVertexSize = 0;
+	std::vector<D3D11_SO_DECLARATION_ENTRY> soDecl;
+	for (unsigned int i = 0; i < shaderDesc.OutputParameters; i++)
+	{
+		// Get the info about this entry
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetOutputParameterDesc(i, &paramDesc);
+		
+		// Create the SO Declaration
+		D3D11_SO_DECLARATION_ENTRY entry;
+		entry.SemanticIndex  = paramDesc.SemanticIndex;
+		entry.SemanticName   = paramDesc.SemanticName;
+		entry.Stream         = paramDesc.Stream;
+		entry.StartComponent = 0; // Assume starting at 0
+		entry.OutputSlot     = 0; // Assume the first output slot
+
+		// Check the mask to determine how many components are used
+		entry.ComponentCount = CalcComponentCount(paramDesc.Mask);
+	
+		// Increment the size
+		streamOutVertexSize += entry.ComponentCount * sizeof(float);
+
+		// Add to the declaration
+		soDecl.push_back(entry);
+	}
+
+	// Rasterization allowed?
+	unsigned int rast = allowStreamOutRasterization ? 0 : D3D11_SO_NO_RASTERIZED_STREAM;
+
+	// Create the shader
+	HRESULT result = d3dDevice->CreateGeometryShaderWithStreamOutput(
+		code,                           // Shader code pointer
+		size,                           // Shader code size
+		&soDecl[0],                     // Stream out declaration
+		(unsigned int)soDecl.size(),    // Number of declaration entries
+		NULL,                           // Buffer strides (not used - assume tightly packed?)
+		0,                              // No buffer strides
+		rast,                           // Index of the stream to rasterize (if any)
+		NULL,                           // Not using class linkage
+		&shader);
+	
+	return (result == S_OK);
+}
+
+// --------------------------------------------------------
+// Creates a vertex buffer that is compatible with the stream output
+// delcaration that was used to create the shader.  This buffer will
+// not be cleaned up (Released) by the simple shader - you must clean
+// it up yourself when you're done with it.  Immediately returns
+// false if the shader was not created with stream output, the shader
+// isn't valid or the determined stream out vertex size is zero.
+//
+// buffer - Pointer to an ID3D11Buffer pointer to hold the buffer ref
+// vertexCount - Amount of vertices the buffer should hold
+//
+// Returns true if buffer is created successfully AND stream output
+// was used to create the shader.  False otherwise.
+// --------------------------------------------------------
+bool SimpleGeometryShader::CreateCompatibleStreamOutBuffer(ID3D11Buffer** buffer, int vertexCount)
+{
+	// Was stream output actually used?
+	if (!this->useStreamOut || !shaderValid || streamOutVertexSize == 0)
+		return false;
+
+	// Set up the buffer description
+	D3D11_BUFFER_DESC desc;
+	desc.BindFlags           = D3D11_BIND_STREAM_OUTPUT | D3D11_BIND_VERTEX_BUFFER;
+	desc.ByteWidth           = streamOutVertexSize * vertexCount;
+	desc.CPUAccessFlags      = 0;
+	desc.MiscFlags           = 0;
+	desc.StructureByteStride = 0;
+	desc.Usage               = D3D11_USAGE_DEFAULT;
+
+	// Attempt to create the buffer and return the result
+	HRESULT result = d3dDevice->CreateBuffer(&desc, 0, buffer);
+	return (result == S_OK);
+}
+
+// --------------------------------------------------------
+// Helper method to unbind all stream out buffers from the SO stage
+// --------------------------------------------------------
+void SimpleGeometryShader::UnbindStreamOutStage(ID3D11DeviceContext* deviceContext)
+{
+	unsigned int offset = 0;
+	ID3D11Buffer* unset[1] = { 0 };
+	deviceContext->SOSetTargets(1, unset, &offset);
+}
+
+// --------------------------------------------------------
+// Sets the geometry shader and constant buffers for
+// future DirectX drawing
+// --------------------------------------------------------
+void SimpleGeometryShader::SetShaderAndCBs()
+{
+	// Is shader valid?
+	if (!shaderValid) return;
+
+	// Set the shader
+	deviceContext->GSSetShader(shader, 0, 0);
+
+	// Set the constant buffers?
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		// Skip "buffers" that aren't true constant buffers
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+			continue;
+
+		// This is a real constant buffer, so set it
+		ID3D11Buffer* buffer = ToD3D11(constantBuffers[i].ConstantBuffer);
+		deviceContext->GSSetConstantBuffers(
+			constantBuffers[i].BindIndex,
+			1,
+			&buffer);
+	}
+}
+
+// --------------------------------------------------------
+// Sets a shader resource view in the Geometry shader stage
+//
+// name - The name of the texture resource in the shader
+// srv - The shader resource view of the texture in GPU memory
+//
+// Returns true if a texture of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleGeometryShader::SetShaderResourceView(std::string name, RenderShaderResource* srv)
+{
+	// Look for the variable and verify
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	if (srvInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the Geometry shader stage
+//
+// name - The name of the sampler state in the shader
+// samplerState - The sampler state in GPU memory
+//
+// Returns true if a sampler of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleGeometryShader::SetSamplerState(std::string name, RenderSampler* samplerState)
+{
+	// Look for the variable and verify
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	if (sampInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Handle versions of the above (handles from
+// GetShaderResourceViewHandle and GetSamplerHandle)
+// --------------------------------------------------------
+bool SimpleGeometryShader::SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(handle);
+	if (srvInfo == 0)
+		return false;
+
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+	return true;
+}
+
+bool SimpleGeometryShader::SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(handle);
+	if (sampInfo == 0)
+		return false;
+
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+	return true;
+}
+
+// --------------------------------------------------------
+// Calculates the number of components specified by a parameter description mask
+//
+// mask - The mask to check (only values 0 - 15 are considered)
+//
+// Returns an integer between 0 - 4 inclusive
+// --------------------------------------------------------
+unsigned int SimpleGeometryShader::CalcComponentCount(unsigned int mask)
+{
+	unsigned int result = 0;
+	result += (unsigned int)((mask & 1) == 1);
+	result += (unsigned int)((mask & 2) == 2);
+	result += (unsigned int)((mask & 4) == 4);
+	result += (unsigned int)((mask & 8) == 8);
+	return result;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ SIMPLE COMPUTE SHADER -----------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Constructor just calls the base
+// --------------------------------------------------------
+SimpleComputeShader::SimpleComputeShader(D3D11RenderDevice* device)
+	: ISimpleShader(device) 
+{ 
+	this->d3dDevice = device->GetDevice();
+	this->deviceContext = device->GetDeviceContext();
+	this->shader = 0;
+
+	this->threadsX = 0; 
+	this->threadsY = 0;
+	this->threadsZ = 0;
+	this->threadsTotal = 0;
+}
+
+// --------------------------------------------------------
+// Destructor - Clean up actual shader (base will be called automatically)
+// --------------------------------------------------------
+SimpleComputeShader::~SimpleComputeShader()
+{
+	CleanUp();
+}
+
+// --------------------------------------------------------
+// Handles cleaning up shader and base class clean up
+// --------------------------------------------------------
+void SimpleComputeShader::CleanUp()
+{
+	ISimpleShader::CleanUp();
+	if (shader) { shader->Release(); shader = 0; }
+
+	uavTable.clear();
+}
+
+// --------------------------------------------------------
+// Creates the DirectX Compute shader
+//
+// code, size - The shader's compiled code
+//
+// Returns true if shader is created correctly, false otherwise
+// --------------------------------------------------------
+bool SimpleComputeShader::CreateShader(const void* code, size_t size)
+{
+	// Clean up first, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+
+	// Create the shader from the code
+	HRESULT result = d3dDevice->CreateComputeShader(
+		code,
+		size,
+		0,
+		&shader);
+
+	// Was the shader created correctly?
+	if (result != S_OK)
+		return false;
+
+	// Set up shader reflection to get information about UAV's
+	ID3D11ShaderReflection* refl;
+	D3DReflect(
+		code,
+		size,
+		IID_ID3D11ShaderReflection,
+		(void**)&refl);
+
+	// Get the description of the shader
+	D3D11_SHADER_DESC shaderDesc;
+	refl->GetDesc(&shaderDesc);
+	
+	// Grab the thread info
+	threadsTotal = refl->GetThreadGroupSize(
+		&threadsX,
+		&threadsY,
+		&threadsZ);
+
+	// Loop and get all UAV resources
+	unsigned int resourceCount = shaderDesc.BoundResources;
+	for (unsigned int r = 0; r < resourceCount; r++)
+	{
+		// Get this resource's description
+		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
+		refl->GetResourceBindingDesc(r, &resourceDesc);
+
+		// Check the type, looking for any kind of UAV
+		switch (resourceDesc.Type)
+		{
+		case D3D_SIT_UAV_APPEND_STRUCTURED:
+		case D3D_SIT_UAV_CONSUME_STRUCTURED:
+		case D3D_SIT_UAV_RWBYTEADDRESS:
+		case D3D_SIT_UAV_RWSTRUCTURED:
+		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
+		case D3D_SIT_UAV_RWTYPED:
+			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// All set
+	refl->Release();
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets the Compute shader and constant buffers for
+// future DirectX drawing
+// --------------------------------------------------------
+void SimpleComputeShader::SetShaderAndCBs()
+{
+	// Is shader valid?
+	if (!shaderValid) return;
+
+	// Set the shader
+	deviceContext->CSSetShader(shader, 0, 0);
+
+	// Set the constant buffers?
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		// Skip "buffers" that aren't true constant buffers
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+			continue;
+
+		// This is a real constant buffer, so set it
+		ID3D11Buffer* buffer = ToD3D11(constantBuffers[i].ConstantBuffer);
+		deviceContext->CSSetConstantBuffers(
+			constantBuffers[i].BindIndex,
+			1,
+			&buffer);
+	}
+}
+
+// --------------------------------------------------------
+// Dispatches the compute shader with the specified amount 
+// of groups, using the number of threads per group
+// specified in the shader file itself
+//
+// For example, calling this method with params (5,1,1) on
+// a shader with (8,2,2) threads per group will launch a 
+// total of 160 threads: ((5 * 8) * (1 * 2) * (1 * 2))
+//
+// This is identical to using the device context's 
+// Dispatch() method yourself.  
+//
+// Note: This will dispatch the currently active shader, 
+// not necessarily THIS shader. Be sure to activate this
+// shader with SetShader() before calling Dispatch
+//
+// groupsX - Numbers of groups in the X dimension
+// groupsY - Numbers of groups in the Y dimension
+// groupsZ - Numbers of groups in the Z dimension
+// --------------------------------------------------------
+void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
+{
+	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
+}
+
+// --------------------------------------------------------
+// Dispatches the compute shader with AT LEAST the 
+// specified amount of threads, calculating the number of
+// groups to dispatch using the number of threads per group
+// specified in the shader file itself
+//
+// For example, calling this method with params (10,3,3) on
+// a shader with (5,2,2) threads per group will launch 
+// 8 total groups and 160 total threads, calculated by:
+// Groups: ceil(10/5) * ceil(3/2) * ceil(3/2) = 8
+// Threads: ((2 * 5) * (2 * 2) * (2 * 2)) = 160
+//
+// Note: This will dispatch the currently active shader, 
+// not necessarily THIS shader. Be sure to activate this
+// shader with SetShader() before calling Dispatch
+//
+// threadsX - Desired numbers of threads in the X dimension
+// threadsY - Desired numbers of threads in the Y dimension
+// threadsZ - Desired numbers of threads in the Z dimension
+// --------------------------------------------------------
+void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
+{
+	deviceContext->Dispatch(
+		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
+		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
+		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
+}
+
+// --------------------------------------------------------
+// Sets a shader resource view in the Compute shader stage
+//
+// name - The name of the texture resource in the shader
+// srv - The shader resource view of the texture in GPU memory
+//
+// Returns true if a texture of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleComputeShader::SetShaderResourceView(std::string name, RenderShaderResource* srv)
+{
+	// Look for the variable and verify
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	if (srvInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the Compute shader stage
+//
+// name - The name of the sampler state in the shader
+// samplerState - The sampler state in GPU memory
+//
+// Returns true if a sampler of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleComputeShader::SetSamplerState(std::string name, RenderSampler* samplerState)
+{
+	// Look for the variable and verify
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	if (sampInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Handle versions of the above (handles from
+// GetShaderResourceViewHandle and GetSamplerHandle)
+// --------------------------------------------------------
+bool SimpleComputeShader::SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(handle);
+	if (srvInfo == 0)
+		return false;
+
+	ID3D11ShaderResourceView* d3dSrv = ToD3D11(srv);
+	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, &d3dSrv);
+	return true;
+}
+
+bool SimpleComputeShader::SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(handle);
+	if (sampInfo == 0)
+		return false;
+
+	ID3D11SamplerState* d3dSampler = ToD3D11(samplerState);
+	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, &d3dSampler);
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets an unordered access view in the Compute shader stage
+//
+// name - The name of the sampler state in the shader
+// uav - The UAV in GPU memory
+// appendConsumeOffset - Used for append or consume UAV's (optional)
+//
+// Returns true if a UAV of the given name was found, false otherwise
+// --------------------------------------------------------
+bool SimpleComputeShader::SetUnorderedAccessView(std::string name, ID3D11UnorderedAccessView * uav, unsigned int appendConsumeOffset)
+{
+	// Look for the variable and verify
+	unsigned int bindIndex = GetUnorderedAccessViewIndex(name);
+	if (bindIndex == -1)
+		return false;
+
+	// Set the shader resource view
+	deviceContext->CSSetUnorderedAccessViews(bindIndex, 1, &uav, &appendConsumeOffset);
+
+	// Success
+	return true;
+}
+
+// --------------------------------------------------------
+// Gets the index of the specified UAV (or -1)
+// --------------------------------------------------------
+int SimpleComputeShader::GetUnorderedAccessViewIndex(std::string name)
+{
+	// Look for the key
+	std::unordered_map<std::string, unsigned int>::iterator result =
+		uavTable.find(name);
+
+	// Did we find the key?
+	if (result == uavTable.end())
+		return -1;
+
+	// Success
+	return result->second;
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+#pragma comment(lib, "dxguid.lib")
+#pragma comment(lib, "d3dcompiler.lib")
+
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+#include "SimpleShader.h"
+#include "D3D11RenderDevice.h"
+
+// --------------------------------------------------------
+// Derived class for DOMAIN shaders ///////////////////////
+//
+// This and the stages below are D3D11 only: they're made
+// on a D3D11RenderDevice and bind straight to its context
+// --------------------------------------------------------
+class SimpleDomainShader : public ISimpleShader
+{
+public:
+	SimpleDomainShader(D3D11RenderDevice* device);
+	~SimpleDomainShader();
+	ID3D11DomainShader* GetDirectXShader() { return shader; }
+
+	bool SetShaderResourceView(std::string name, RenderShaderResource* srv);
+	bool SetSamplerState(std::string name, RenderSampler* samplerState);
+	bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState);
+
+protected:
+	ID3D11Device* d3dDevice;
+	ID3D11DeviceContext* deviceContext;
+	ID3D11DomainShader* shader;
+	bool CreateShader(const void* code, size_t size);
+	void SetShaderAndCBs();
+	void CleanUp();
+};
+
+// --------------------------------------------------------
+// Derived class for HULL shaders /////////////////////////
+// --------------------------------------------------------
+class SimpleHullShader : public ISimpleShader
+{
+public:
+	SimpleHullShader(D3D11RenderDevice* device);
+	~SimpleHullShader();
+	ID3D11HullShader* GetDirectXShader() { return shader; }
+
+	bool SetShaderResourceView(std::string name, RenderShaderResource* srv);
+	bool SetSamplerState(std::string name, RenderSampler* samplerState);
+	bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState);
+
+protected:
+	ID3D11Device* d3dDevice;
+	ID3D11DeviceContext* deviceContext;
+	ID3D11HullShader* shader;
+	bool CreateShader(const void* code, size_t size);
+	void SetShaderAndCBs();
+	void CleanUp();
+};
+
+// --------------------------------------------------------
+// Derived class for GEOMETRY shaders /////////////////////
+// --------------------------------------------------------
+class SimpleGeometryShader : public ISimpleShader
+{
+public:
+	SimpleGeometryShader(D3D11RenderDevice* device, bool useStreamOut = 0, bool allowStreamOutRasterization = 0);
+	~SimpleGeometryShader();
+	ID3D11GeometryShader* GetDirectXShader() { return shader; }
+
+	bool SetShaderResourceView(std::string name, RenderShaderResource* srv);
+	bool SetSamplerState(std::string name, RenderSampler* samplerState);
+	bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState);
+
+	bool CreateCompatibleStreamOutBuffer(ID3D11Buffer** buffer, int vertexCount);
+
+	static void UnbindStreamOutStage(ID3D11DeviceContext* deviceContext);
+
+protected:
+	ID3D11Device* d3dDevice;
+	ID3D11DeviceContext* deviceContext;
+
+	// Shader itself
+	ID3D11GeometryShader* shader;
+
+	// Stream out related
+	bool useStreamOut;
+	bool allowStreamOutRasterization;
+	unsigned int streamOutVertexSize;
+
+	bool CreateShader(const void* code, size_t size);
+	bool CreateShaderWithStreamOut(const void* code, size_t size);
+	void SetShaderAndCBs();
+	void CleanUp();
+
+	// Helpers
+	unsigned int CalcComponentCount(unsigned int mask);
+};
+
+
+// --------------------------------------------------------
+// Derived class for COMPUTE shaders //////////////////////
+// --------------------------------------------------------
+class SimpleComputeShader : public ISimpleShader
+{
+public:
+	SimpleComputeShader(D3D11RenderDevice* device);
+	~SimpleComputeShader();
+	ID3D11ComputeShader* GetDirectXShader() { return shader; }
+
+	void DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ);
+	void DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ);
+
+	bool SetShaderResourceView(std::string name, RenderShaderResource* srv);
+	bool SetSamplerState(std::string name, RenderSampler* samplerState);
+	bool SetShaderResourceView(SimpleShaderHandle handle, RenderShaderResource* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, RenderSampler* samplerState);
+	bool SetUnorderedAccessView(std::string name, ID3D11UnorderedAccessView* uav, unsigned int appendConsumeOffset = -1);
+
+	int GetUnorderedAccessViewIndex(std::string name);
+
+protected:
+	ID3D11Device* d3dDevice;
+	ID3D11DeviceContext* deviceContext;
+	ID3D11ComputeShader* shader;
+	std::unordered_map<std::string, unsigned int> uavTable;
+
+	unsigned int threadsX;
+	unsigned int threadsY;
+	unsigned int threadsZ;
+	unsigned int threadsTotal;
+
+	bool CreateShader(const void* code, size_t size);
+	void SetShaderAndCBs();
+	void CleanUp();
+};
\ No newline at end of file
@@ -0,0 +1,721 @@
+#include "SoftwareRasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+// Tiles are square and a multiple of four pixels wide,
+// so SSE groups of four never straddle two tiles
+static const int TileSize = 64;
+
+// Vertices transformed per task
+static const int VertexChunkSize = 4096;
+
+// Setup tasks per thread (more than one, so a chunk full of
+// big or clipped triangles doesn't hold everyone up), and
+// never fewer triangles than this in a task
+static const int SetupChunksPerThread = 4;
+static const int MinSetupChunkTriangles = 1024;
+
+// Triangles reaching further than this many viewports out
+// (in NDC) are clipped, which keeps screen coordinates small
+// enough for float edge functions
+static const float GuardBand = 8.0f;
+
+// Clipping against near, far and the four guard band planes
+// adds at most one vertex per plane
+static const int ClipPlaneCount = 6;
+static const int MaxClippedVertices = 3 + ClipPlaneCount;
+
+// 4x4 ordered dither thresholds for the screen-door fade,
+// as in PixelShader.hlsl
+static const float DitherThresholds[16] =
+{
+	 0.5f / 16.0f,  8.5f / 16.0f,  2.5f / 16.0f, 10.5f / 16.0f,
+	12.5f / 16.0f,  4.5f / 16.0f, 14.5f / 16.0f,  6.5f / 16.0f,
+	 3.5f / 16.0f, 11.5f / 16.0f,  1.5f / 16.0f,  9.5f / 16.0f,
+	15.5f / 16.0f,  7.5f / 16.0f, 13.5f / 16.0f,  5.5f / 16.0f
+};
+
+// Set bits in a 4 bit movemask
+static const int MaskBitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+static float MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static unsigned int PackColor(const XMFLOAT4& color)
+{
+	auto channel = [](float c) { return (unsigned int)((std::min)((std::max)(c, 0.0f), 1.0f) * 255.0f + 0.5f); };
+	return channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (channel(color.w) << 24);
+}
+
+// --------------------------------------------------------
+// Constructor - sizes the framebuffer
+// --------------------------------------------------------
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, ThreadPool* threadPool)
+{
+	this->threadPool = threadPool;
+	vertexCount = 0;
+	triangleCount = 0;
+	clearColor = 0;
+	lights[0] = {};
+	lights[1] = {};
+	XMStoreFloat4x4(&viewProj, XMMatrixIdentity());
+
+	Resize(width, height);
+}
+
+// --------------------------------------------------------
+// Resizes the color and depth buffers and the tile bins
+// --------------------------------------------------------
+void SoftwareRasterizer::Resize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	tilesX = (width + TileSize - 1) / TileSize;
+	tilesY = (height + TileSize - 1) / TileSize;
+	bufferWidth = tilesX * TileSize;
+	bufferHeight = tilesY * TileSize;
+
+	colorBuffer.assign(bufferWidth * bufferHeight, 0);
+	depthBuffer.assign(bufferWidth * bufferHeight, 1.0f);
+	tilePixels.assign(tilesX * tilesY, 0);
+	for (SetupChunk& chunk : setupChunks)
+		chunk.TileBins.assign(tilesX * tilesY, std::vector<int>());
+}
+
+// --------------------------------------------------------
+// Starts a new frame: forgets last frame's draws
+// --------------------------------------------------------
+void SoftwareRasterizer::BeginFrame(const XMFLOAT4X4& viewProj, const DirectionalLight& light1, const DirectionalLight& light2, const XMFLOAT4& clearColor)
+{
+	this->viewProj = viewProj;
+	lights[0] = light1;
+	lights[1] = light2;
+	this->clearColor = PackColor(clearColor);
+
+	draws.clear();
+	vertexCount = 0;
+	triangleCount = 0;
+	stats = SoftwareRasterStats();
+}
+
+// --------------------------------------------------------
+// Queues one mesh, drawn when Render() is called
+// --------------------------------------------------------
+void SoftwareRasterizer::AddDraw(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const XMFLOAT4X4& world,
+	const CpuTexture* texture, const XMFLOAT4& colorTint, float fade)
+{
+	if (vertices.empty() || indices.size() < 3)
+		return;
+
+	DrawCall draw;
+	draw.Vertices = &vertices;
+	draw.Indices = &indices;
+	draw.World = world;
+	draw.Texture = texture && !texture->IsEmpty() ? texture : nullptr;
+	draw.ColorTint = colorTint;
+	draw.Fade = fade;
+	draw.FirstVertex = vertexCount;
+	draw.FirstTriangle = triangleCount;
+	draws.push_back(draw);
+
+	vertexCount += (int)vertices.size();
+	triangleCount += (int)indices.size() / 3;
+}
+
+// --------------------------------------------------------
+// Runs the whole pipeline over this frame's draws
+// --------------------------------------------------------
+void SoftwareRasterizer::Render()
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	int tileCount = tilesX * tilesY;
+
+	// Vertex "shader"
+	shadedVertices.resize(vertexCount);
+	int vertexChunks = (vertexCount + VertexChunkSize - 1) / VertexChunkSize;
+	threadPool->ParallelFor(vertexChunks, [this](int chunk)
+	{
+		ShadeVertices(chunk * VertexChunkSize, (std::min)(vertexCount, (chunk + 1) * VertexChunkSize));
+	});
+	stats.VertexMs = MillisecondsSince(start);
+
+	// Clip, set up and bin, each chunk into its own bins
+	std::chrono::high_resolution_clock::time_point setupStart = std::chrono::high_resolution_clock::now();
+	int chunkCount = (std::max)(1, (std::min)(threadPool->GetThreadCount() * SetupChunksPerThread, triangleCount / MinSetupChunkTriangles));
+	if ((int)setupChunks.size() < chunkCount)
+	{
+		setupChunks.resize(chunkCount);
+		for (SetupChunk& chunk : setupChunks)
+			chunk.TileBins.resize(tileCount);
+	}
+	threadPool->ParallelFor(chunkCount, [this, chunkCount](int c)
+	{
+		SetupChunk& chunk = setupChunks[c];
+		chunk.Triangles.clear();
+		for (std::vector<int>& bin : chunk.TileBins)
+			bin.clear();
+		chunk.Clipped = 0;
+
+		int first = (int)((long long)triangleCount * c / chunkCount);
+		int end = (int)((long long)triangleCount * (c + 1) / chunkCount);
+		SetupTriangles(first, end, chunk);
+	});
+
+	// Chunks this frame didn't use have to look empty to the tiles
+	for (size_t c = chunkCount; c < setupChunks.size(); c++)
+	{
+		setupChunks[c].Triangles.clear();
+		for (std::vector<int>& bin : setupChunks[c].TileBins)
+			bin.clear();
+	}
+	stats.SetupMs = MillisecondsSince(setupStart);
+
+	// Fill every tile
+	std::chrono::high_resolution_clock::time_point rasterStart = std::chrono::high_resolution_clock::now();
+	threadPool->ParallelFor(tileCount, [this](int tile)
+	{
+		RasterizeTile(tile);
+	});
+	stats.RasterMs = MillisecondsSince(rasterStart);
+
+	stats.Draws = (int)draws.size();
+	stats.Triangles = triangleCount;
+	for (int c = 0; c < chunkCount; c++)
+	{
+		stats.Binned += (int)setupChunks[c].Triangles.size();
+		stats.Clipped += setupChunks[c].Clipped;
+	}
+	for (long long pixels : tilePixels)
+		stats.Pixels += pixels;
+	stats.TotalMs = MillisecondsSince(start);
+}
+
+// --------------------------------------------------------
+// The draw a vertex (or triangle) index belongs to
+// --------------------------------------------------------
+int SoftwareRasterizer::FindDraw(int index, bool byTriangle)
+{
+	int low = 0;
+	int high = (int)draws.size() - 1;
+	while (low < high)
+	{
+		int mid = (low + high + 1) / 2;
+		int first = byTriangle ? draws[mid].FirstTriangle : draws[mid].FirstVertex;
+		if (first <= index)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return low;
+}
+
+// --------------------------------------------------------
+// VertexShader.hlsl for vertices [first, end): clip space
+// position, world space normal and the UV passed through
+// --------------------------------------------------------
+void SoftwareRasterizer::ShadeVertices(int first, int end)
+{
+	if (first >= end)
+		return;
+
+	XMMATRIX viewProjMatrix = XMLoadFloat4x4(&viewProj);
+
+	int d = FindDraw(first, false);
+	int drawEnd = -1;
+	XMMATRIX world = XMMatrixIdentity();
+	XMMATRIX worldViewProj = XMMatrixIdentity();
+	for (int i = first; i < end; i++)
+	{
+		if (i >= drawEnd)
+		{
+			while (d + 1 < (int)draws.size() && draws[d + 1].FirstVertex <= i)
+				d++;
+			drawEnd = draws[d].FirstVertex + (int)draws[d].Vertices->size();
+			world = XMLoadFloat4x4(&draws[d].World);
+			worldViewProj = XMMatrixMultiply(world, viewProjMatrix);
+		}
+
+		const Vertex& in = (*draws[d].Vertices)[i - draws[d].FirstVertex];
+		ShadedVertex& out = shadedVertices[i];
+		XMStoreFloat4(&out.Clip, XMVector3Transform(XMLoadFloat3(&in.Position), worldViewProj));
+		XMStoreFloat3(&out.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&in.Normal), world)));
+		out.UV = in.UV;
+	}
+}
+
+// --------------------------------------------------------
+// Clips and sets up triangles [first, end) (counted across
+// all draws in order).  Triangles entirely outside one clip
+// plane are dropped, ones crossing the near, far or guard
+// band planes are clipped to a polygon and fanned.
+// --------------------------------------------------------
+void SoftwareRasterizer::SetupTriangles(int first, int end, SetupChunk& chunk)
+{
+	if (first >= end)
+		return;
+
+	int d = FindDraw(first, true);
+	for (int t = first; t < end; t++)
+	{
+		while (d + 1 < (int)draws.size() && draws[d + 1].FirstTriangle <= t)
+			d++;
+
+		const DrawCall& draw = draws[d];
+		const unsigned int* indices = &(*draw.Indices)[(t - draw.FirstTriangle) * 3];
+		const ShadedVertex* v[3] =
+		{
+			&shadedVertices[draw.FirstVertex + indices[0]],
+			&shadedVertices[draw.FirstVertex + indices[1]],
+			&shadedVertices[draw.FirstVertex + indices[2]]
+		};
+
+		// Distance to each clip plane, negative outside.  The
+		// viewport's own sides only reject, they never clip.
+		int outsideAll = ~0;
+		int outsideAny = 0;
+		int offscreenAll = 0xF;
+		float distance[3][ClipPlaneCount];
+		for (int i = 0; i < 3; i++)
+		{
+			const XMFLOAT4& c = v[i]->Clip;
+			distance[i][0] = c.z;
+			distance[i][1] = c.w - c.z;
+			distance[i][2] = GuardBand * c.w + c.x;
+			distance[i][3] = GuardBand * c.w - c.x;
+			distance[i][4] = GuardBand * c.w + c.y;
+			distance[i][5] = GuardBand * c.w - c.y;
+
+			int outside = 0;
+			for (int p = 0; p < ClipPlaneCount; p++)
+				outside |= distance[i][p] < 0.0f ? 1 << p : 0;
+			outsideAll &= outside;
+			outsideAny |= outside;
+
+			offscreenAll &=
+				(c.x < -c.w ? 1 : 0) | (c.x > c.w ? 2 : 0) |
+				(c.y < -c.w ? 4 : 0) | (c.y > c.w ? 8 : 0);
+		}
+		if (outsideAll || offscreenAll)
+			continue;
+
+		if (!outsideAny)
+		{
+			SetupTriangle(*v[0], *v[1], *v[2], d, chunk);
+			continue;
+		}
+
+		// Sutherland-Hodgman against just the planes it crosses.
+		// New vertices are always interpolated from the inside
+		// end of an edge, so both triangles sharing an edge get
+		// exactly the same vertex.
+		chunk.Clipped++;
+		ShadedVertex polygons[2][MaxClippedVertices];
+		float distances[2][MaxClippedVertices][ClipPlaneCount];
+		int count = 3;
+		for (int i = 0; i < 3; i++)
+		{
+			polygons[0][i] = *v[i];
+			std::copy(distance[i], distance[i] + ClipPlaneCount, distances[0][i]);
+		}
+
+		int current = 0;
+		for (int p = 0; p < ClipPlaneCount && count >= 3; p++)
+		{
+			if (!(outsideAny & (1 << p)))
+				continue;
+
+			const ShadedVertex* in = polygons[current];
+			int next = 1 - current;
+			int outCount = 0;
+			for (int i = 0; i < count; i++)
+			{
+				int j = (i + 1) % count;
+				float di = distances[current][i][p];
+				float dj = distances[current][j][p];
+
+				if (di >= 0.0f)
+				{
+					polygons[next][outCount] = in[i];
+					std::copy(distances[current][i], distances[current][i] + ClipPlaneCount, distances[next][outCount]);
+					outCount++;
+				}
+				if ((di >= 0.0f) != (dj >= 0.0f))
+				{
+					int inside = di >= 0.0f ? i : j;
+					int outside = di >= 0.0f ? j : i;
+					float dIn = distances[current][inside][p];
+					float dOut = distances[current][outside][p];
+					float s = dIn / (dIn - dOut);
+
+					const ShadedVertex& a = in[inside];
+					const ShadedVertex& b = in[outside];
+					ShadedVertex& o = polygons[next][outCount];
+					XMStoreFloat4(&o.Clip, XMVectorLerp(XMLoadFloat4(&a.Clip), XMLoadFloat4(&b.Clip), s));
+					XMStoreFloat3(&o.Normal, XMVectorLerp(XMLoadFloat3(&a.Normal), XMLoadFloat3(&b.Normal), s));
+					XMStoreFloat2(&o.UV, XMVectorLerp(XMLoadFloat2(&a.UV), XMLoadFloat2(&b.UV), s));
+					for (int q = 0; q < ClipPlaneCount; q++)
+						distances[next][outCount][q] = distances[current][inside][q] + (distances[current][outside][q] - distances[current][inside][q]) * s;
+					distances[next][outCount][p] = 0.0f;
+					outCount++;
+				}
+			}
+			count = outCount;
+			current = next;
+		}
+
+		for (int i = 1; i + 1 < count; i++)
+			SetupTriangle(polygons[current][0], polygons[current][i], polygons[current][i + 1], d, chunk);
+	}
+}
+
+// --------------------------------------------------------
+// Projects one clipped triangle, culls back faces (clockwise
+// on screen is front, as in D3D's default rasterizer state)
+// and bins it into every tile its bounds touch
+// --------------------------------------------------------
+void SoftwareRasterizer::SetupTriangle(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2, int draw, SetupChunk& chunk)
+{
+	const ShadedVertex* v[3] = { &v0, &v1, &v2 };
+
+	// Perspective divide and viewport transform, and the
+	// attributes divided by w
+	float x[3], y[3], q[3][PlaneCount];
+	for (int i = 0; i < 3; i++)
+	{
+		float invW = 1.0f / v[i]->Clip.w;
+		x[i] = (v[i]->Clip.x * invW * 0.5f + 0.5f) * width;
+		y[i] = (0.5f - v[i]->Clip.y * invW * 0.5f) * height;
+		q[i][Plane_Z] = v[i]->Clip.z * invW;
+		q[i][Plane_InvW] = invW;
+		q[i][Plane_U] = v[i]->UV.x * invW;
+		q[i][Plane_V] = v[i]->UV.y * invW;
+		q[i][Plane_NX] = v[i]->Normal.x * invW;
+		q[i][Plane_NY] = v[i]->Normal.y * invW;
+		q[i][Plane_NZ] = v[i]->Normal.z * invW;
+	}
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area > 0.0f))
+		return;
+
+	// Only pixel centers inside the bounds can be covered
+	BinnedTriangle tri;
+	tri.MinX = (std::max)(0, (int)ceilf((std::min)(x[0], (std::min)(x[1], x[2])) - 0.5f));
+	tri.MaxX = (std::min)(width - 1, (int)floorf((std::max)(x[0], (std::max)(x[1], x[2])) - 0.5f));
+	tri.MinY = (std::max)(0, (int)ceilf((std::min)(y[0], (std::min)(y[1], y[2])) - 0.5f));
+	tri.MaxY = (std::min)(height - 1, (int)floorf((std::max)(y[0], (std::max)(y[1], y[2])) - 0.5f));
+	if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+		return;
+
+	// Each edge is measured from whichever end sorts first, so
+	// the two triangles sharing it compute exactly opposite
+	// values and no pixel is missed or drawn twice.  Top and
+	// left edges own the pixels exactly on them.
+	tri.TopLeft = 0;
+	for (int e = 0; e < 3; e++)
+	{
+		int a = e;
+		int b = (e + 1) % 3;
+		tri.EdgeA[e] = y[a] - y[b];
+		tri.EdgeB[e] = x[b] - x[a];
+
+		int ref = (x[a] < x[b] || (x[a] == x[b] && y[a] < y[b])) ? a : b;
+		tri.EdgeRefX[e] = x[ref];
+		tri.EdgeRefY[e] = y[ref];
+
+		if (tri.EdgeA[e] > 0.0f || (tri.EdgeA[e] == 0.0f && tri.EdgeB[e] > 0.0f))
+			tri.TopLeft |= 1 << e;
+	}
+
+	// Attribute planes from the barycentrics of vertex 1
+	// (edge 2) and vertex 2 (edge 0), centered on vertex 0
+	float invArea = 1.0f / area;
+	tri.OriginX = x[0];
+	tri.OriginY = y[0];
+	for (int p = 0; p < PlaneCount; p++)
+	{
+		float d1 = (q[1][p] - q[0][p]) * invArea;
+		float d2 = (q[2][p] - q[0][p]) * invArea;
+		tri.PlaneA[p] = d1 * tri.EdgeA[2] + d2 * tri.EdgeA[0];
+		tri.PlaneB[p] = d1 * tri.EdgeB[2] + d2 * tri.EdgeB[0];
+		tri.PlaneC[p] = q[0][p];
+	}
+	tri.Draw = draw;
+
+	// Bin it
+	int index = (int)chunk.Triangles.size();
+	chunk.Triangles.push_back(tri);
+	for (int ty = tri.MinY / TileSize; ty <= tri.MaxY / TileSize; ty++)
+		for (int tx = tri.MinX / TileSize; tx <= tri.MaxX / TileSize; tx++)
+			chunk.TileBins[ty * tilesX + tx].push_back(index);
+}
+
+// --------------------------------------------------------
+// Clears one tile and draws every triangle binned into it,
+// chunk by chunk in submission order.  This is the pixel
+// shader: depth test (LESS), screen-door fade, texture
+// times tint, then both directional lights.
+// --------------------------------------------------------
+void SoftwareRasterizer::RasterizeTile(int tile)
+{
+	int tileX0 = (tile % tilesX) * TileSize;
+	int tileY0 = (tile / tilesX) * TileSize;
+	unsigned int* color = &colorBuffer[0];
+	float* depth = &depthBuffer[0];
+
+	for (int y = tileY0; y < tileY0 + TileSize; y++)
+	{
+		std::fill(color + y * bufferWidth + tileX0, color + y * bufferWidth + tileX0 + TileSize, clearColor);
+		std::fill(depth + y * bufferWidth + tileX0, depth + y * bufferWidth + tileX0 + TileSize, 1.0f);
+	}
+
+	// Light terms that don't depend on the pixel.  The shader
+	// lights along normalize(-(-Direction)).
+	XMFLOAT3 lightDir[2];
+	for (int l = 0; l < 2; l++)
+		XMStoreFloat3(&lightDir[l], XMVector3Normalize(XMLoadFloat3(&lights[l].Direction)));
+	const __m128 l0x = _mm_set1_ps(lightDir[0].x), l0y = _mm_set1_ps(lightDir[0].y), l0z = _mm_set1_ps(lightDir[0].z);
+	const __m128 l1x = _mm_set1_ps(lightDir[1].x), l1y = _mm_set1_ps(lightDir[1].y), l1z = _mm_set1_ps(lightDir[1].z);
+	const float* d0 = &lights[0].DiffuseColor.x;
+	const float* d1 = &lights[1].DiffuseColor.x;
+	const float* a0 = &lights[0].AmbientColor.x;
+	const float* a1 = &lights[1].AmbientColor.x;
+	__m128 diffuse0[4], diffuse1[4], ambient[4];
+	for (int c = 0; c < 4; c++)
+	{
+		diffuse0[c] = _mm_set1_ps(d0[c]);
+		diffuse1[c] = _mm_set1_ps(d1[c]);
+		ambient[c] = _mm_set1_ps(a0[c] + a1[c]);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale255 = _mm_set1_ps(255.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 laneIndex = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 allOnes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	long long pixels = 0;
+
+	for (const SetupChunk& chunk : setupChunks)
+	{
+		for (int index : chunk.TileBins[tile])
+		{
+			const BinnedTriangle& tri = chunk.Triangles[index];
+			const DrawCall& draw = draws[tri.Draw];
+
+			int x0 = (std::max)(tri.MinX, tileX0) & ~3;
+			int x1 = (std::min)(tri.MaxX, tileX0 + TileSize - 1);
+			int y0 = (std::max)(tri.MinY, tileY0);
+			int y1 = (std::min)(tri.MaxY, tileY0 + TileSize - 1);
+
+			__m128 ea[3], eb[3], erx[3], ery[3], topLeft[3];
+			for (int e = 0; e < 3; e++)
+			{
+				ea[e] = _mm_set1_ps(tri.EdgeA[e]);
+				eb[e] = _mm_set1_ps(tri.EdgeB[e]);
+				erx[e] = _mm_set1_ps(tri.EdgeRefX[e]);
+				ery[e] = _mm_set1_ps(tri.EdgeRefY[e]);
+				topLeft[e] = (tri.TopLeft & (1 << e)) ? allOnes : zero;
+			}
+			__m128 pa[PlaneCount], pb[PlaneCount];
+			for (int p = 0; p < PlaneCount; p++)
+			{
+				pa[p] = _mm_set1_ps(tri.PlaneA[p]);
+				pb[p] = _mm_set1_ps(tri.PlaneB[p]);
+			}
+			const __m128 originX = _mm_set1_ps(tri.OriginX);
+			const __m128 originY = _mm_set1_ps(tri.OriginY);
+
+			const bool fading = draw.Fade < 1.0f;
+			const __m128 fade = _mm_set1_ps(draw.Fade);
+			const float* tint = &draw.ColorTint.x;
+			__m128 tintColor[4];
+			for (int c = 0; c < 4; c++)
+				tintColor[c] = _mm_set1_ps(tint[c]);
+
+			for (int y = y0; y <= y1; y++)
+			{
+				// Where this row crosses each edge, so long thin
+				// triangles don't test their whole bounding box.
+				// A pixel of slack either side, since the SSE test
+				// below has the final say.
+				float centerY = y + 0.5f;
+				float spanStart = (float)x0;
+				float spanEnd = (float)x1;
+				for (int e = 0; e < 3; e++)
+				{
+					float rowValue = tri.EdgeB[e] * (centerY - tri.EdgeRefY[e]);
+					if (tri.EdgeA[e] > 0.0f)
+						spanStart = (std::max)(spanStart, tri.EdgeRefX[e] - rowValue / tri.EdgeA[e] - 1.5f);
+					else if (tri.EdgeA[e] < 0.0f)
+						spanEnd = (std::min)(spanEnd, tri.EdgeRefX[e] - rowValue / tri.EdgeA[e] + 0.5f);
+					else if (rowValue < 0.0f)
+						spanEnd = -1.0f;
+				}
+				if (spanStart > spanEnd)
+					continue;
+				int rowX0 = (std::max)(x0, (int)spanStart) & ~3;
+				int rowX1 = (std::min)(x1, (int)spanEnd);
+
+				__m128 py = _mm_set1_ps(centerY);
+
+				// Per-row parts of each equation
+				__m128 rowEdge[3];
+				for (int e = 0; e < 3; e++)
+					rowEdge[e] = _mm_mul_ps(eb[e], _mm_sub_ps(py, ery[e]));
+				__m128 dy = _mm_sub_ps(py, originY);
+				__m128 rowZ = _mm_add_ps(_mm_mul_ps(pb[Plane_Z], dy), _mm_set1_ps(tri.PlaneC[Plane_Z]));
+
+				__m128 dither = fading ? _mm_loadu_ps(&DitherThresholds[(y & 3) * 4]) : zero;
+
+				unsigned int* rowColor = color + y * bufferWidth;
+				float* rowDepth = depth + y * bufferWidth;
+				for (int x = rowX0; x <= rowX1; x += 4)
+				{
+					__m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+
+					__m128 inside = allOnes;
+					for (int e = 0; e < 3; e++)
+					{
+						__m128 edge = _mm_add_ps(_mm_mul_ps(ea[e], _mm_sub_ps(px, erx[e])), rowEdge[e]);
+						inside = _mm_and_ps(inside, _mm_or_ps(
+							_mm_cmpgt_ps(edge, zero),
+							_mm_and_ps(_mm_cmpeq_ps(edge, zero), topLeft[e])));
+					}
+
+					// Lanes past the triangle's last column
+					if (x + 3 > x1)
+						inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(_mm_set1_ps((float)x), laneIndex), _mm_set1_ps((float)x1)));
+					if (_mm_movemask_ps(inside) == 0)
+						continue;
+
+					__m128 dx = _mm_sub_ps(px, originX);
+					__m128 z = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(pa[Plane_Z], dx), rowZ), zero), one);
+					__m128 oldDepth = _mm_loadu_ps(rowDepth + x);
+					__m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, oldDepth));
+					if (fading)
+						pass = _mm_and_ps(pass, _mm_cmpge_ps(_mm_sub_ps(fade, dither), zero));
+					int passMask = _mm_movemask_ps(pass);
+					if (passMask == 0)
+						continue;
+					pixels += MaskBitCount[passMask];
+
+					// Perspective correct attributes
+					__m128 value[PlaneCount];
+					for (int p = Plane_InvW; p < PlaneCount; p++)
+						value[p] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], dx), _mm_mul_ps(pb[p], dy)), _mm_set1_ps(tri.PlaneC[p]));
+					__m128 w = _mm_div_ps(one, value[Plane_InvW]);
+					__m128 nx = _mm_mul_ps(value[Plane_NX], w);
+					__m128 ny = _mm_mul_ps(value[Plane_NY], w);
+					__m128 nz = _mm_mul_ps(value[Plane_NZ], w);
+					__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+					__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(lengthSq, _mm_set1_ps(1e-12f))));
+					nx = _mm_mul_ps(nx, invLength);
+					ny = _mm_mul_ps(ny, invLength);
+					nz = _mm_mul_ps(nz, invLength);
+
+					// Surface color: texture times tint
+					__m128 surface[4];
+					if (draw.Texture)
+					{
+						// Masked off lanes can have any w, so zero their UVs
+						__m128 u = _mm_and_ps(pass, _mm_mul_ps(value[Plane_U], w));
+						__m128 v = _mm_and_ps(pass, _mm_mul_ps(value[Plane_V], w));
+
+						// Screen derivatives of u = U / InvW straight
+						// from the planes, for the sampler's mip level
+						__m128 dudx = _mm_mul_ps(_mm_sub_ps(pa[Plane_U], _mm_mul_ps(u, pa[Plane_InvW])), w);
+						__m128 dudy = _mm_mul_ps(_mm_sub_ps(pb[Plane_U], _mm_mul_ps(u, pb[Plane_InvW])), w);
+						__m128 dvdx = _mm_mul_ps(_mm_sub_ps(pa[Plane_V], _mm_mul_ps(v, pa[Plane_InvW])), w);
+						__m128 dvdy = _mm_mul_ps(_mm_sub_ps(pb[Plane_V], _mm_mul_ps(v, pb[Plane_InvW])), w);
+
+						__m128 texel[4];
+						draw.Texture->Sample4(u, v, draw.Texture->ComputeLod4(dudx, dvdx, dudy, dvdy), texel);
+						for (int c = 0; c < 4; c++)
+							surface[c] = _mm_mul_ps(texel[c], tintColor[c]);
+					}
+					else
+					{
+						for (int c = 0; c < 4; c++)
+							surface[c] = tintColor[c];
+					}
+
+					// Both directional lights, alpha included
+					__m128 amount0 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, l0x), _mm_mul_ps(ny, l0y)), _mm_mul_ps(nz, l0z)), zero), one);
+					__m128 amount1 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, l1x), _mm_mul_ps(ny, l1y)), _mm_mul_ps(nz, l1z)), zero), one);
+					__m128i packed = _mm_setzero_si128();
+					for (int c = 0; c < 4; c++)
+					{
+						__m128 light = _mm_add_ps(_mm_add_ps(_mm_mul_ps(diffuse0[c], amount0), _mm_mul_ps(diffuse1[c], amount1)), ambient[c]);
+						__m128 result = _mm_min_ps(_mm_max_ps(_mm_mul_ps(surface[c], light), zero), one);
+						__m128i channel = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, scale255), half));
+						packed = _mm_or_si128(packed, _mm_slli_epi32(channel, c * 8));
+					}
+
+					__m128 oldColor = _mm_loadu_ps((float*)(rowColor + x));
+					__m128 newColor = _mm_or_ps(_mm_and_ps(pass, _mm_castsi128_ps(packed)), _mm_andnot_ps(pass, oldColor));
+					_mm_storeu_ps((float*)(rowColor + x), newColor);
+					_mm_storeu_ps(rowDepth + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldDepth)));
+				}
+			}
+		}
+	}
+
+	tilePixels[tile] = pixels;
+}
+
+// --------------------------------------------------------
+// Writes the image (not the tile padding) as a bottom-up,
+// 24 bit uncompressed .bmp
+// --------------------------------------------------------
+bool SoftwareRasterizer::SaveBitmap(const char* fileName)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	int rowBytes = (width * 3 + 3) & ~3;
+	unsigned int imageBytes = rowBytes * height;
+	unsigned char header[54] = {};
+	auto write32 = [&header](int offset, unsigned int value)
+	{
+		for (int b = 0; b < 4; b++)
+			header[offset + b] = (unsigned char)(value >> (b * 8));
+	};
+
+	// BITMAPFILEHEADER then BITMAPINFOHEADER
+	header[0] = 'B';
+	header[1] = 'M';
+	write32(2, 54 + imageBytes);
+	write32(10, 54);
+	write32(14, 40);
+	write32(18, width);
+	write32(22, height);
+	header[26] = 1;
+	header[28] = 24;
+	write32(34, imageBytes);
+	file.write((const char*)header, sizeof(header));
+
+	std::vector<unsigned char> row(rowBytes, 0);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		const unsigned int* pixels = &colorBuffer[y * bufferWidth];
+		for (int x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = (unsigned char)(pixels[x] >> 16);
+			row[x * 3 + 1] = (unsigned char)(pixels[x] >> 8);
+			row[x * 3 + 2] = (unsigned char)pixels[x];
+		}
+		file.write((const char*)&row[0], rowBytes);
+	}
+	return file.good();
+}
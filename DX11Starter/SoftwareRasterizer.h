@@ -0,0 +1,157 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Vertex.h"
+#include "Light.h"
+#include "ThreadPool.h"
+#include "CpuTexture.h"
+
+// --------------------------------------------------------
+// Per-frame software rendering numbers
+// --------------------------------------------------------
+struct SoftwareRasterStats
+{
+	int Draws = 0;
+	int Triangles = 0;			// Submitted
+	int Clipped = 0;			// Went through near/far/guard band clipping
+	int Binned = 0;				// Survived clipping and culling
+	long long Pixels = 0;		// Passed the depth test and were shaded
+	float VertexMs = 0.0f;
+	float SetupMs = 0.0f;		// Clipping, triangle setup and binning
+	float RasterMs = 0.0f;
+	float TotalMs = 0.0f;
+};
+
+// --------------------------------------------------------
+// Draws the scene on the CPU, doing what VertexShader.hlsl
+// and PixelShader.hlsl (with only the two directional
+// lights and the texture) do on the GPU.
+//
+// Render() runs in three parallel passes:
+//  - vertices are transformed to clip space, with world
+//    normals and UVs, in fixed size chunks
+//  - triangles are clipped, back face culled, set up as
+//    screen space plane equations and binned into tiles,
+//    each chunk into its own bins so nothing is shared
+//  - tiles are cleared and filled, four pixels per SSE
+//    step: edge tests, depth test, then perspective correct
+//    attributes, trilinear texture samples (mip level from
+//    the UV planes' derivatives) and shading for whatever passed
+//
+// Bins are walked in submission order, so the image is the
+// same whatever the thread count.
+//
+// All matrices are row-vector DirectXMath matrices (NOT the
+// transposed copies we hand to HLSL).
+// --------------------------------------------------------
+class SoftwareRasterizer
+{
+public:
+	SoftwareRasterizer(int width = 1280, int height = 720, ThreadPool* threadPool = &ThreadPool::Shared());
+
+	// Sizes the framebuffer; width and height are the image's,
+	// the buffers themselves are rounded up to whole tiles
+	void Resize(int width, int height);
+
+	void BeginFrame(const DirectX::XMFLOAT4X4& viewProj, const DirectionalLight& light1, const DirectionalLight& light2, const DirectX::XMFLOAT4& clearColor);
+
+	// Vertices, indices and texture are read during Render(),
+	// so they have to stay alive until then.  A null texture
+	// draws with just the tint.
+	void AddDraw(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const DirectX::XMFLOAT4X4& world,
+		const CpuTexture* texture, const DirectX::XMFLOAT4& colorTint, float fade = 1.0f);
+
+	void Render();
+
+	// The finished image, one RGBA8 pixel per entry and
+	// GetPitch() entries per row
+	const std::vector<unsigned int>& GetColorBuffer() { return colorBuffer; }
+	const std::vector<float>& GetDepthBuffer() { return depthBuffer; }
+	int GetWidth() { return width; }
+	int GetHeight() { return height; }
+	int GetPitch() { return bufferWidth; }
+
+	// Writes the image as a 24 bit .bmp
+	bool SaveBitmap(const char* fileName);
+
+	SoftwareRasterStats GetStats() { return stats; }
+
+private:
+	// Vertex shader output
+	struct ShadedVertex
+	{
+		DirectX::XMFLOAT4 Clip;
+		DirectX::XMFLOAT3 Normal;
+		DirectX::XMFLOAT2 UV;
+	};
+
+	// What a triangle needs from its draw when shading
+	struct DrawCall
+	{
+		const std::vector<Vertex>* Vertices;
+		const std::vector<unsigned int>* Indices;
+		DirectX::XMFLOAT4X4 World;
+		const CpuTexture* Texture;
+		DirectX::XMFLOAT4 ColorTint;
+		float Fade;
+		int FirstVertex;		// In shadedVertices
+		int FirstTriangle;		// Counting every draw's triangles in order
+	};
+
+	// Screen space triangle.  Edge e goes from vertex e to
+	// e+1 and is E(x, y) = A * (x - RefX) + B * (y - RefY),
+	// positive inside.  Each plane is
+	// P(x, y) = A * (x - OriginX) + B * (y - OriginY) + C,
+	// with every attribute divided by w so it interpolates
+	// linearly on screen.
+	enum PlaneIndex { Plane_Z, Plane_InvW, Plane_U, Plane_V, Plane_NX, Plane_NY, Plane_NZ, PlaneCount };
+	struct BinnedTriangle
+	{
+		float EdgeA[3], EdgeB[3], EdgeRefX[3], EdgeRefY[3];
+		float PlaneA[PlaneCount], PlaneB[PlaneCount], PlaneC[PlaneCount];
+		float OriginX, OriginY;
+		int TopLeft;			// Bit e set if edge e owns pixels exactly on it
+		int Draw;
+		int MinX, MaxX, MinY, MaxY;
+	};
+
+	// One setup task's triangles and its own bins
+	struct SetupChunk
+	{
+		std::vector<BinnedTriangle> Triangles;
+		std::vector<std::vector<int>> TileBins;
+		int Clipped;
+	};
+
+	ThreadPool* threadPool;
+
+	int width;
+	int height;
+	int bufferWidth;
+	int bufferHeight;
+	int tilesX;
+	int tilesY;
+
+	DirectX::XMFLOAT4X4 viewProj;
+	DirectionalLight lights[2];
+	unsigned int clearColor;
+
+	std::vector<DrawCall> draws;
+	int vertexCount;
+	int triangleCount;
+	std::vector<ShadedVertex> shadedVertices;
+	std::vector<SetupChunk> setupChunks;
+	std::vector<long long> tilePixels;
+
+	std::vector<unsigned int> colorBuffer;
+	std::vector<float> depthBuffer;
+
+	SoftwareRasterStats stats;
+
+	int FindDraw(int index, bool byTriangle);
+	void ShadeVertices(int first, int end);
+	void SetupTriangles(int first, int end, SetupChunk& chunk);
+	void SetupTriangle(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2, int draw, SetupChunk& chunk);
+	void RasterizeTile(int tile);
+};
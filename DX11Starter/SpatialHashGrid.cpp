@@ -0,0 +1,387 @@
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <mutex>
+
+using namespace DirectX;
+
+// Each cell coordinate gets 21 bits of the 64 bit key
+static const int KeyBits = 21;
+static const int KeyBias = 1 << (KeyBits - 1);
+static const long long KeyMask = (1LL << KeyBits) - 1;
+
+// Once a query spans more cells than this many times the
+// occupied ones, walking every cell beats hashing each one
+static const float WalkAllCellsRatio = 1.0f;
+
+SpatialHashGrid::SpatialHashGrid(float cellSize)
+{
+	this->cellSize = cellSize;
+	inverseCellSize = 1.0f / cellSize;
+	itemCount = 0;
+	maxRadius = 0.0f;
+	occupiedMin = { INT_MAX, INT_MAX, INT_MAX };
+	occupiedMax = { INT_MIN, INT_MIN, INT_MIN };
+}
+
+// --------------------------------------------------------
+// Adds an item, or moves it if the id is already in use
+// --------------------------------------------------------
+void SpatialHashGrid::Insert(int id, XMFLOAT3 center, float radius)
+{
+	Update(id, center, radius);
+}
+
+// --------------------------------------------------------
+// Moves an item.  Only touches the cells if the center
+// actually crossed into a different one.
+// --------------------------------------------------------
+void SpatialHashGrid::Update(int id, XMFLOAT3 center, float radius)
+{
+	std::unique_lock<std::shared_timed_mutex> writeLock(lock);
+
+	if (id >= (int)items.size())
+	{
+		Item empty = { XMFLOAT3(0, 0, 0), 0.0f, -1, -1 };
+		items.resize(id + 1, empty);
+	}
+
+	Item& item = items[id];
+	item.Center = center;
+	item.Radius = radius;
+	maxRadius = std::max(maxRadius, radius);
+
+	CellCoord coord = ToCell(center);
+	if (item.Cell != -1)
+	{
+		if (cells[item.Cell].Key == MakeKey(coord.X, coord.Y, coord.Z))
+			return;
+		RemoveFromCell(id);
+	}
+	else
+	{
+		itemCount++;
+	}
+
+	AddToCell(id, coord);
+}
+
+void SpatialHashGrid::Remove(int id)
+{
+	std::unique_lock<std::shared_timed_mutex> writeLock(lock);
+
+	if (id >= (int)items.size() || items[id].Cell == -1)
+		return;
+
+	RemoveFromCell(id);
+	itemCount--;
+}
+
+void SpatialHashGrid::Clear()
+{
+	std::unique_lock<std::shared_timed_mutex> writeLock(lock);
+
+	items.clear();
+	cells.clear();
+	freeCells.clear();
+	cellLookup.clear();
+	itemCount = 0;
+	maxRadius = 0.0f;
+	occupiedMin = { INT_MAX, INT_MAX, INT_MAX };
+	occupiedMax = { INT_MIN, INT_MIN, INT_MIN };
+}
+
+// --------------------------------------------------------
+// Every item whose sphere overlaps the query sphere
+// --------------------------------------------------------
+void SpatialHashGrid::QueryRadius(XMFLOAT3 center, float radius, std::vector<int>& results) const
+{
+	std::shared_lock<std::shared_timed_mutex> readLock(lock);
+	results.clear();
+
+	// Loose grid: neighbors can poke in from up to maxRadius away
+	float reach = radius + maxRadius;
+	CellCoord lo = ToCell(XMFLOAT3(center.x - reach, center.y - reach, center.z - reach));
+	CellCoord hi = ToCell(XMFLOAT3(center.x + reach, center.y + reach, center.z + reach));
+	lo.X = std::max(lo.X, occupiedMin.X); hi.X = std::min(hi.X, occupiedMax.X);
+	lo.Y = std::max(lo.Y, occupiedMin.Y); hi.Y = std::min(hi.Y, occupiedMax.Y);
+	lo.Z = std::max(lo.Z, occupiedMin.Z); hi.Z = std::min(hi.Z, occupiedMax.Z);
+	if (lo.X > hi.X || lo.Y > hi.Y || lo.Z > hi.Z)
+		return;
+
+	auto testCell = [&](const Cell& cell)
+	{
+		for (int id : cell.Ids)
+		{
+			const Item& item = items[id];
+			float dx = item.Center.x - center.x;
+			float dy = item.Center.y - center.y;
+			float dz = item.Center.z - center.z;
+			float r = radius + item.Radius;
+			if (dx * dx + dy * dy + dz * dz <= r * r)
+				results.push_back(id);
+		}
+	};
+
+	// Huge queries are cheaper as a walk over the occupied cells
+	double rangeCells = (double)(hi.X - lo.X + 1) * (hi.Y - lo.Y + 1) * (hi.Z - lo.Z + 1);
+	if (rangeCells > cellLookup.size() * WalkAllCellsRatio)
+	{
+		for (const Cell& cell : cells)
+			testCell(cell);
+		return;
+	}
+
+	for (int x = lo.X; x <= hi.X; x++)
+		for (int y = lo.Y; y <= hi.Y; y++)
+			for (int z = lo.Z; z <= hi.Z; z++)
+			{
+				int cell = FindCell(x, y, z);
+				if (cell != -1)
+					testCell(cells[cell]);
+			}
+}
+
+// --------------------------------------------------------
+// Every item whose sphere overlaps the query box
+// --------------------------------------------------------
+void SpatialHashGrid::QueryAABB(const AABB& box, std::vector<int>& results) const
+{
+	std::shared_lock<std::shared_timed_mutex> readLock(lock);
+	results.clear();
+
+	CellCoord lo = ToCell(XMFLOAT3(box.Min.x - maxRadius, box.Min.y - maxRadius, box.Min.z - maxRadius));
+	CellCoord hi = ToCell(XMFLOAT3(box.Max.x + maxRadius, box.Max.y + maxRadius, box.Max.z + maxRadius));
+	lo.X = std::max(lo.X, occupiedMin.X); hi.X = std::min(hi.X, occupiedMax.X);
+	lo.Y = std::max(lo.Y, occupiedMin.Y); hi.Y = std::min(hi.Y, occupiedMax.Y);
+	lo.Z = std::max(lo.Z, occupiedMin.Z); hi.Z = std::min(hi.Z, occupiedMax.Z);
+	if (lo.X > hi.X || lo.Y > hi.Y || lo.Z > hi.Z)
+		return;
+
+	auto testCell = [&](const Cell& cell)
+	{
+		for (int id : cell.Ids)
+		{
+			// Distance from the center to the closest point in the box
+			const Item& item = items[id];
+			float dx = std::max(std::max(box.Min.x - item.Center.x, 0.0f), item.Center.x - box.Max.x);
+			float dy = std::max(std::max(box.Min.y - item.Center.y, 0.0f), item.Center.y - box.Max.y);
+			float dz = std::max(std::max(box.Min.z - item.Center.z, 0.0f), item.Center.z - box.Max.z);
+			if (dx * dx + dy * dy + dz * dz <= item.Radius * item.Radius)
+				results.push_back(id);
+		}
+	};
+
+	double rangeCells = (double)(hi.X - lo.X + 1) * (hi.Y - lo.Y + 1) * (hi.Z - lo.Z + 1);
+	if (rangeCells > cellLookup.size() * WalkAllCellsRatio)
+	{
+		for (const Cell& cell : cells)
+			testCell(cell);
+		return;
+	}
+
+	for (int x = lo.X; x <= hi.X; x++)
+		for (int y = lo.Y; y <= hi.Y; y++)
+			for (int z = lo.Z; z <= hi.Z; z++)
+			{
+				int cell = FindCell(x, y, z);
+				if (cell != -1)
+					testCell(cells[cell]);
+			}
+}
+
+// --------------------------------------------------------
+// k nearest item centers, searching outwards one shell of
+// cells at a time until nothing further out could beat
+// the current k-th best
+// --------------------------------------------------------
+void SpatialHashGrid::QueryNearest(XMFLOAT3 point, int k, std::vector<int>& results) const
+{
+	std::shared_lock<std::shared_timed_mutex> readLock(lock);
+	results.clear();
+	if (k <= 0 || itemCount == 0)
+		return;
+
+	// Max-heap of (squared distance, id), worst on top
+	std::vector<std::pair<float, int>> best;
+	best.reserve(k + 1);
+
+	CellCoord c = ToCell(point);
+
+	// Rings past this one can't reach any occupied cell
+	int maxRing = 0;
+	maxRing = std::max(maxRing, std::max(c.X - occupiedMin.X, occupiedMax.X - c.X));
+	maxRing = std::max(maxRing, std::max(c.Y - occupiedMin.Y, occupiedMax.Y - c.Y));
+	maxRing = std::max(maxRing, std::max(c.Z - occupiedMin.Z, occupiedMax.Z - c.Z));
+
+	int seen = 0;
+	for (int ring = 0; ring <= maxRing; ring++)
+	{
+		int x0 = std::max(c.X - ring, occupiedMin.X), x1 = std::min(c.X + ring, occupiedMax.X);
+		int y0 = std::max(c.Y - ring, occupiedMin.Y), y1 = std::min(c.Y + ring, occupiedMax.Y);
+		int z0 = std::max(c.Z - ring, occupiedMin.Z), z1 = std::min(c.Z + ring, occupiedMax.Z);
+
+		auto visitCell = [&](int x, int y, int z)
+		{
+			int cell = FindCell(x, y, z);
+			if (cell == -1)
+				return;
+
+			for (int id : cells[cell].Ids)
+			{
+				const Item& item = items[id];
+				float dx = item.Center.x - point.x;
+				float dy = item.Center.y - point.y;
+				float dz = item.Center.z - point.z;
+				float distSq = dx * dx + dy * dy + dz * dz;
+				seen++;
+
+				if ((int)best.size() < k)
+				{
+					best.push_back(std::make_pair(distSq, id));
+					std::push_heap(best.begin(), best.end());
+				}
+				else if (distSq < best.front().first)
+				{
+					std::pop_heap(best.begin(), best.end());
+					best.back() = std::make_pair(distSq, id);
+					std::push_heap(best.begin(), best.end());
+				}
+			}
+		};
+
+		for (int x = x0; x <= x1; x++)
+			for (int y = y0; y <= y1; y++)
+			{
+				if (std::abs(x - c.X) == ring || std::abs(y - c.Y) == ring)
+				{
+					// On the shell's x/y faces: the whole z column is new
+					for (int z = z0; z <= z1; z++)
+						visitCell(x, y, z);
+				}
+				else
+				{
+					// Inside them only the two z faces are new
+					if (c.Z - ring >= z0)
+						visitCell(x, y, c.Z - ring);
+					if (ring > 0 && c.Z + ring <= z1)
+						visitCell(x, y, c.Z + ring);
+				}
+			}
+
+		// Anything in later rings is at least this far away
+		float shellDistance = ring * cellSize;
+		if ((int)best.size() == k && best.front().first <= shellDistance * shellDistance)
+			break;
+		if (seen == itemCount)
+			break;
+	}
+
+	std::sort_heap(best.begin(), best.end());
+	for (const std::pair<float, int>& entry : best)
+		results.push_back(entry.second);
+}
+
+bool SpatialHashGrid::Contains(int id) const
+{
+	std::shared_lock<std::shared_timed_mutex> readLock(lock);
+	return id >= 0 && id < (int)items.size() && items[id].Cell != -1;
+}
+
+int SpatialHashGrid::GetItemCount() const
+{
+	std::shared_lock<std::shared_timed_mutex> readLock(lock);
+	return itemCount;
+}
+
+int SpatialHashGrid::GetCellCount() const
+{
+	std::shared_lock<std::shared_timed_mutex> readLock(lock);
+	return (int)cellLookup.size();
+}
+
+SpatialHashGrid::CellCoord SpatialHashGrid::ToCell(XMFLOAT3 position) const
+{
+	CellCoord coord;
+	coord.X = (int)std::floor(position.x * inverseCellSize);
+	coord.Y = (int)std::floor(position.y * inverseCellSize);
+	coord.Z = (int)std::floor(position.z * inverseCellSize);
+	return coord;
+}
+
+long long SpatialHashGrid::MakeKey(int x, int y, int z)
+{
+	return
+		(((long long)(x + KeyBias) & KeyMask) << (KeyBits * 2)) |
+		(((long long)(y + KeyBias) & KeyMask) << KeyBits) |
+		((long long)(z + KeyBias) & KeyMask);
+}
+
+int SpatialHashGrid::FindCell(int x, int y, int z) const
+{
+	auto found = cellLookup.find(MakeKey(x, y, z));
+	return found == cellLookup.end() ? -1 : found->second;
+}
+
+// --------------------------------------------------------
+// Files an item under a cell, creating the cell if needed
+// --------------------------------------------------------
+void SpatialHashGrid::AddToCell(int id, const CellCoord& coord)
+{
+	long long key = MakeKey(coord.X, coord.Y, coord.Z);
+
+	int cell;
+	auto found = cellLookup.find(key);
+	if (found != cellLookup.end())
+	{
+		cell = found->second;
+	}
+	else
+	{
+		if (!freeCells.empty())
+		{
+			cell = freeCells.back();
+			freeCells.pop_back();
+		}
+		else
+		{
+			cell = (int)cells.size();
+			cells.push_back(Cell());
+		}
+		cells[cell].Key = key;
+		cellLookup[key] = cell;
+
+		occupiedMin.X = std::min(occupiedMin.X, coord.X); occupiedMax.X = std::max(occupiedMax.X, coord.X);
+		occupiedMin.Y = std::min(occupiedMin.Y, coord.Y); occupiedMax.Y = std::max(occupiedMax.Y, coord.Y);
+		occupiedMin.Z = std::min(occupiedMin.Z, coord.Z); occupiedMax.Z = std::max(occupiedMax.Z, coord.Z);
+	}
+
+	items[id].Cell = cell;
+	items[id].Slot = (int)cells[cell].Ids.size();
+	cells[cell].Ids.push_back(id);
+}
+
+// --------------------------------------------------------
+// Swap-removes an item from its cell, freeing empty cells
+// --------------------------------------------------------
+void SpatialHashGrid::RemoveFromCell(int id)
+{
+	Item& item = items[id];
+	Cell& cell = cells[item.Cell];
+
+	int last = cell.Ids.back();
+	cell.Ids[item.Slot] = last;
+	items[last].Slot = item.Slot;
+	cell.Ids.pop_back();
+
+	if (cell.Ids.empty())
+	{
+		cellLookup.erase(cell.Key);
+		freeCells.push_back(item.Cell);
+	}
+
+	item.Cell = -1;
+	item.Slot = -1;
+}
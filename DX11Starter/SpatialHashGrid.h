@@ -0,0 +1,84 @@
+#pragma once
+#include <DirectXMath.h>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Bounds.h"
+
+// --------------------------------------------------------
+// Loose uniform grid for proximity queries, stored in a
+// hash map so only occupied cells cost memory.
+//
+// Items are spheres filed under the cell that holds their
+// center; queries grow their search range by the largest
+// radius in the grid so nothing overlapping is missed.
+// Moving an item only touches the grid when it changes
+// cells.
+//
+// Queries take a shared lock and write into the caller's
+// vector, so any number of threads can query at once.
+// Insert/Update/Remove take an exclusive lock.
+// --------------------------------------------------------
+class SpatialHashGrid
+{
+public:
+	SpatialHashGrid(float cellSize = 2.0f);
+
+	// Ids are small integers picked by the caller (entity indices)
+	void Insert(int id, DirectX::XMFLOAT3 center, float radius = 0.0f);
+	void Update(int id, DirectX::XMFLOAT3 center, float radius = 0.0f);
+	void Remove(int id);
+	void Clear();
+
+	// Ids of every item whose sphere touches the volume
+	void QueryRadius(DirectX::XMFLOAT3 center, float radius, std::vector<int>& results) const;
+	void QueryAABB(const AABB& box, std::vector<int>& results) const;
+
+	// The k items with centers closest to the point, nearest first
+	void QueryNearest(DirectX::XMFLOAT3 point, int k, std::vector<int>& results) const;
+
+	bool Contains(int id) const;
+	int GetItemCount() const;
+	int GetCellCount() const;
+	float GetCellSize() const { return cellSize; }
+
+private:
+	struct Item
+	{
+		DirectX::XMFLOAT3 Center;
+		float Radius;
+		int Cell;		// Index into cells, -1 when not in the grid
+		int Slot;		// Position inside that cell's id list
+	};
+
+	struct Cell
+	{
+		long long Key;
+		std::vector<int> Ids;
+	};
+
+	struct CellCoord { int X, Y, Z; };
+
+	float cellSize;
+	float inverseCellSize;
+
+	std::vector<Item> items;
+	std::vector<Cell> cells;
+	std::vector<int> freeCells;
+	std::unordered_map<long long, int> cellLookup;
+
+	int itemCount;
+	float maxRadius;
+	CellCoord occupiedMin;
+	CellCoord occupiedMax;
+
+	mutable std::shared_timed_mutex lock;
+
+	CellCoord ToCell(DirectX::XMFLOAT3 position) const;
+	static long long MakeKey(int x, int y, int z);
+	int FindCell(int x, int y, int z) const;
+
+	void AddToCell(int id, const CellCoord& coord);
+	void RemoveFromCell(int id);
+};
@@ -0,0 +1,305 @@
+#include "StateCache.h"
+
+// --------------------------------------------------------
+// RecordingStateContext
+// --------------------------------------------------------
+RecordingStateContext::RecordingStateContext()
+{
+	Clear();
+}
+
+void RecordingStateContext::Clear()
+{
+	commands.clear();
+	drawStates.clear();
+	for (int i = 0; i < (int)StateCommand::Count; i++)
+	{
+		counts[i] = 0;
+		usedSlots[i] = 0;
+		for (int s = 0; s < MaxSlots; s++)
+			current[i][s] = RecordedCommand();
+	}
+}
+
+void RecordingStateContext::SetInputLayout(RenderInputLayout* layout) { Record(StateCommand::InputLayout, 0, layout); }
+void RecordingStateContext::SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset) { Record(StateCommand::VertexBuffer, slot, buffer, stride, offset); }
+void RecordingStateContext::SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset) { Record(StateCommand::IndexBuffer, 0, buffer, (unsigned int)format, offset); }
+void RecordingStateContext::SetVertexShader(RenderVertexShader* shader) { Record(StateCommand::VertexShader, 0, shader); }
+void RecordingStateContext::SetPixelShader(RenderPixelShader* shader) { Record(StateCommand::PixelShader, 0, shader); }
+void RecordingStateContext::SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount) { Record(StateCommand::VSConstantBuffer, slot, buffer, firstConstant, constantCount); }
+void RecordingStateContext::SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount) { Record(StateCommand::PSConstantBuffer, slot, buffer, firstConstant, constantCount); }
+void RecordingStateContext::SetVSShaderResource(unsigned int slot, RenderShaderResource* srv) { Record(StateCommand::VSShaderResource, slot, srv); }
+void RecordingStateContext::SetVSSampler(unsigned int slot, RenderSampler* sampler) { Record(StateCommand::VSSampler, slot, sampler); }
+void RecordingStateContext::SetPSShaderResource(unsigned int slot, RenderShaderResource* srv) { Record(StateCommand::PSShaderResource, slot, srv); }
+void RecordingStateContext::SetPSSampler(unsigned int slot, RenderSampler* sampler) { Record(StateCommand::PSSampler, slot, sampler); }
+void RecordingStateContext::SetBlendState(RenderBlendState* state) { Record(StateCommand::BlendState, 0, state); }
+void RecordingStateContext::SetDepthStencilState(RenderDepthStencilState* state) { Record(StateCommand::DepthStencilState, 0, state); }
+
+void RecordingStateContext::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	Record(StateCommand::DrawIndexed, 0, nullptr, indexCount, 1, startIndex, (unsigned int)baseVertex, 0);
+	FingerprintDraw(commands.back());
+}
+
+void RecordingStateContext::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	Record(StateCommand::DrawIndexedInstanced, 0, nullptr, indexCount, instanceCount, startIndex, (unsigned int)baseVertex, startInstance);
+	FingerprintDraw(commands.back());
+}
+
+// --------------------------------------------------------
+// FNV-1a hash of every bound slot and the draw's own
+// arguments
+// --------------------------------------------------------
+void RecordingStateContext::FingerprintDraw(const RecordedCommand& draw)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	auto mix = [&hash](unsigned long long value)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	for (int type = 0; type < (int)StateCommand::DrawIndexed; type++)
+	{
+		for (unsigned int s = 0; s < usedSlots[type]; s++)
+		{
+			const RecordedCommand& c = current[type][s];
+			mix((unsigned long long)c.Object);
+			mix(((unsigned long long)c.Args[0] << 32) | c.Args[1]);
+		}
+	}
+	for (int i = 0; i < 5; i++)
+		mix(draw.Args[i]);
+	drawStates.push_back(hash);
+}
+
+int RecordingStateContext::GetBindCount()
+{
+	int binds = 0;
+	for (int i = 0; i < (int)StateCommand::DrawIndexed; i++)
+		binds += counts[i];
+	return binds;
+}
+
+void RecordingStateContext::Record(StateCommand type, unsigned int slot, const void* object, unsigned int a, unsigned int b, unsigned int c, unsigned int d, unsigned int e)
+{
+	RecordedCommand command;
+	command.Type = type;
+	command.Slot = slot;
+	command.Object = object;
+	command.Args[0] = a;
+	command.Args[1] = b;
+	command.Args[2] = c;
+	command.Args[3] = d;
+	command.Args[4] = e;
+
+	commands.push_back(command);
+	counts[(int)type]++;
+	if (type < StateCommand::DrawIndexed && slot < MaxSlots)
+	{
+		current[(int)type][slot] = command;
+		if (slot >= usedSlots[(int)type])
+			usedSlots[(int)type] = slot + 1;
+	}
+}
+
+// --------------------------------------------------------
+// StateCache
+// --------------------------------------------------------
+StateCache::StateCache(IStateContext* context)
+{
+	this->context = context;
+	Invalidate();
+}
+
+void StateCache::SetContext(IStateContext* context)
+{
+	this->context = context;
+	Invalidate();
+}
+
+// --------------------------------------------------------
+// Forgets everything, so every slot's next bind is issued
+// --------------------------------------------------------
+void StateCache::Invalidate()
+{
+	inputLayoutValid = indexBufferValid = vertexShaderValid = pixelShaderValid = false;
+	blendStateValid = depthStencilStateValid = false;
+	for (int i = 0; i < MaxVertexBuffers; i++) vertexBufferValid[i] = false;
+	for (int i = 0; i < MaxConstantBuffers; i++) vsConstantBufferValid[i] = psConstantBufferValid[i] = false;
+	for (int i = 0; i < MaxShaderResources; i++) psShaderResourceValid[i] = false;
+	for (int i = 0; i < MaxSamplers; i++) psSamplerValid[i] = false;
+}
+
+void StateCache::SetInputLayout(RenderInputLayout* layout)
+{
+	stats.Requested++;
+	if (inputLayoutValid && inputLayout == layout)
+		return;
+
+	inputLayout = layout;
+	inputLayoutValid = true;
+	stats.Issued++;
+	context->SetInputLayout(layout);
+}
+
+void StateCache::SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset)
+{
+	stats.Requested++;
+	if (slot < MaxVertexBuffers)
+	{
+		if (vertexBufferValid[slot] && vertexBuffers[slot] == buffer && vertexStrides[slot] == stride && vertexOffsets[slot] == offset)
+			return;
+
+		vertexBuffers[slot] = buffer;
+		vertexStrides[slot] = stride;
+		vertexOffsets[slot] = offset;
+		vertexBufferValid[slot] = true;
+	}
+	stats.Issued++;
+	context->SetVertexBuffer(slot, buffer, stride, offset);
+}
+
+void StateCache::SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset)
+{
+	stats.Requested++;
+	if (indexBufferValid && indexBuffer == buffer && indexFormat == format && indexOffset == offset)
+		return;
+
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	indexBufferValid = true;
+	stats.Issued++;
+	context->SetIndexBuffer(buffer, format, offset);
+}
+
+void StateCache::SetVertexShader(RenderVertexShader* shader)
+{
+	stats.Requested++;
+	if (vertexShaderValid && vertexShader == shader)
+		return;
+
+	vertexShader = shader;
+	vertexShaderValid = true;
+	stats.Issued++;
+	context->SetVertexShader(shader);
+}
+
+void StateCache::SetPixelShader(RenderPixelShader* shader)
+{
+	stats.Requested++;
+	if (pixelShaderValid && pixelShader == shader)
+		return;
+
+	pixelShader = shader;
+	pixelShaderValid = true;
+	stats.Issued++;
+	context->SetPixelShader(shader);
+}
+
+void StateCache::SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	stats.Requested++;
+	if (slot < MaxConstantBuffers)
+	{
+		if (vsConstantBufferValid[slot] && vsConstantBuffers[slot] == buffer &&
+			vsConstantRanges[slot][0] == firstConstant && vsConstantRanges[slot][1] == constantCount)
+			return;
+
+		vsConstantBuffers[slot] = buffer;
+		vsConstantRanges[slot][0] = firstConstant;
+		vsConstantRanges[slot][1] = constantCount;
+		vsConstantBufferValid[slot] = true;
+	}
+	stats.Issued++;
+	context->SetVSConstantBuffer(slot, buffer, firstConstant, constantCount);
+}
+
+void StateCache::SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	stats.Requested++;
+	if (slot < MaxConstantBuffers)
+	{
+		if (psConstantBufferValid[slot] && psConstantBuffers[slot] == buffer &&
+			psConstantRanges[slot][0] == firstConstant && psConstantRanges[slot][1] == constantCount)
+			return;
+
+		psConstantBuffers[slot] = buffer;
+		psConstantRanges[slot][0] = firstConstant;
+		psConstantRanges[slot][1] = constantCount;
+		psConstantBufferValid[slot] = true;
+	}
+	stats.Issued++;
+	context->SetPSConstantBuffer(slot, buffer, firstConstant, constantCount);
+}
+
+void StateCache::SetPSShaderResource(unsigned int slot, RenderShaderResource* srv)
+{
+	stats.Requested++;
+	if (slot < MaxShaderResources)
+	{
+		if (psShaderResourceValid[slot] && psShaderResources[slot] == srv)
+			return;
+
+		psShaderResources[slot] = srv;
+		psShaderResourceValid[slot] = true;
+	}
+	stats.Issued++;
+	context->SetPSShaderResource(slot, srv);
+}
+
+void StateCache::SetPSSampler(unsigned int slot, RenderSampler* sampler)
+{
+	stats.Requested++;
+	if (slot < MaxSamplers)
+	{
+		if (psSamplerValid[slot] && psSamplers[slot] == sampler)
+			return;
+
+		psSamplers[slot] = sampler;
+		psSamplerValid[slot] = true;
+	}
+	stats.Issued++;
+	context->SetPSSampler(slot, sampler);
+}
+
+void StateCache::SetBlendState(RenderBlendState* state)
+{
+	stats.Requested++;
+	if (blendStateValid && blendState == state)
+		return;
+
+	blendState = state;
+	blendStateValid = true;
+	stats.Issued++;
+	context->SetBlendState(state);
+}
+
+void StateCache::SetDepthStencilState(RenderDepthStencilState* state)
+{
+	stats.Requested++;
+	if (depthStencilStateValid && depthStencilState == state)
+		return;
+
+	depthStencilState = state;
+	depthStencilStateValid = true;
+	stats.Issued++;
+	context->SetDepthStencilState(state);
+}
+
+void StateCache::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	stats.Draws++;
+	context->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void StateCache::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	stats.Draws++;
+	context->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
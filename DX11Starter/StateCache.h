@@ -0,0 +1,200 @@
+#pragma once
+#include <vector>
+#include "RenderTypes.h"
+
+// --------------------------------------------------------
+// The slice of the device context that draws bind through.
+// Lets the state cache run on a real context (see
+// D3D11RenderDevice.h) or on a recording stand-in with no
+// GPU behind it.
+// --------------------------------------------------------
+class IStateContext
+{
+public:
+	virtual ~IStateContext() {}
+
+	virtual void SetInputLayout(RenderInputLayout* layout) = 0;
+	virtual void SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset) = 0;
+	virtual void SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset) = 0;
+	virtual void SetVertexShader(RenderVertexShader* shader) = 0;
+	virtual void SetPixelShader(RenderPixelShader* shader) = 0;
+	// constantCount 0 binds the whole buffer, otherwise the range
+	// [firstConstant, firstConstant + constantCount) of 16 byte constants
+	virtual void SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount) = 0;
+	virtual void SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount) = 0;
+	virtual void SetVSShaderResource(unsigned int slot, RenderShaderResource* srv) = 0;
+	virtual void SetVSSampler(unsigned int slot, RenderSampler* sampler) = 0;
+	virtual void SetPSShaderResource(unsigned int slot, RenderShaderResource* srv) = 0;
+	virtual void SetPSSampler(unsigned int slot, RenderSampler* sampler) = 0;
+	// Null restores the default state
+	virtual void SetBlendState(RenderBlendState* state) = 0;
+	virtual void SetDepthStencilState(RenderDepthStencilState* state) = 0;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+	virtual void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance) = 0;
+};
+
+// --------------------------------------------------------
+// Everything a recording context can see
+// --------------------------------------------------------
+enum class StateCommand
+{
+	InputLayout,
+	VertexBuffer,
+	IndexBuffer,
+	VertexShader,
+	PixelShader,
+	VSConstantBuffer,
+	PSConstantBuffer,
+	VSShaderResource,
+	VSSampler,
+	PSShaderResource,
+	PSSampler,
+	BlendState,
+	DepthStencilState,
+	DrawIndexed,
+	DrawIndexedInstanced,
+	Count
+};
+
+struct RecordedCommand
+{
+	StateCommand Type;
+	unsigned int Slot;
+	const void* Object;
+	unsigned int Args[5];
+};
+
+// --------------------------------------------------------
+// Stand-in context that records every call instead of
+// talking to a GPU.  It also applies the calls to its own
+// copy of the pipeline state and fingerprints that state at
+// every draw, so two command streams can be checked for
+// drawing exactly the same things.
+// --------------------------------------------------------
+class RecordingStateContext : public IStateContext
+{
+public:
+	RecordingStateContext();
+
+	void SetInputLayout(RenderInputLayout* layout);
+	void SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset);
+	void SetVertexShader(RenderVertexShader* shader);
+	void SetPixelShader(RenderPixelShader* shader);
+	void SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetVSShaderResource(unsigned int slot, RenderShaderResource* srv);
+	void SetVSSampler(unsigned int slot, RenderSampler* sampler);
+	void SetPSShaderResource(unsigned int slot, RenderShaderResource* srv);
+	void SetPSSampler(unsigned int slot, RenderSampler* sampler);
+	void SetBlendState(RenderBlendState* state);
+	void SetDepthStencilState(RenderDepthStencilState* state);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+	void Clear();
+
+	const std::vector<RecordedCommand>& GetCommands() { return commands; }
+	int GetCount(StateCommand type) { return counts[(int)type]; }
+	int GetBindCount();
+
+	int GetDrawCount() { return counts[(int)StateCommand::DrawIndexed] + counts[(int)StateCommand::DrawIndexedInstanced]; }
+
+	// One fingerprint of the bound state per draw
+	const std::vector<unsigned long long>& GetDrawStates() { return drawStates; }
+
+private:
+	std::vector<RecordedCommand> commands;
+	int counts[(int)StateCommand::Count];
+
+	// Last value written per command type and slot
+	static const int MaxSlots = 16;
+	RecordedCommand current[(int)StateCommand::Count][MaxSlots];
+	unsigned int usedSlots[(int)StateCommand::Count];
+	std::vector<unsigned long long> drawStates;
+
+	void Record(StateCommand type, unsigned int slot, const void* object, unsigned int a = 0, unsigned int b = 0, unsigned int c = 0, unsigned int d = 0, unsigned int e = 0);
+	void FingerprintDraw(const RecordedCommand& draw);
+};
+
+// --------------------------------------------------------
+// Requested and actually issued binds, and draw calls,
+// since the last reset
+// --------------------------------------------------------
+struct BindStats
+{
+	int Requested = 0;
+	int Issued = 0;
+	int Draws = 0;
+};
+
+// --------------------------------------------------------
+// Shadow copy of the pipeline state in front of a context.
+//
+// Binds that match what's already bound are dropped before
+// they reach the context.  Anything that binds behind the
+// cache's back (SimpleShader::SetShader(), Present...) must
+// be followed by Invalidate() so the next bind goes through.
+// Slots past the tracked range are always passed on.
+// --------------------------------------------------------
+class StateCache
+{
+public:
+	StateCache(IStateContext* context = nullptr);
+	void SetContext(IStateContext* context);
+
+	void Invalidate();
+
+	void SetInputLayout(RenderInputLayout* layout);
+	void SetVertexBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(RenderBuffer* buffer, RenderIndexFormat format, unsigned int offset);
+	void SetVertexShader(RenderVertexShader* shader);
+	void SetPixelShader(RenderPixelShader* shader);
+	void SetVSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant = 0, unsigned int constantCount = 0);
+	void SetPSConstantBuffer(unsigned int slot, RenderBuffer* buffer, unsigned int firstConstant = 0, unsigned int constantCount = 0);
+	void SetPSShaderResource(unsigned int slot, RenderShaderResource* srv);
+	void SetPSSampler(unsigned int slot, RenderSampler* sampler);
+	void SetBlendState(RenderBlendState* state);
+	void SetDepthStencilState(RenderDepthStencilState* state);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+	BindStats GetStats() { return stats; }
+	void ResetStats() { stats = BindStats(); }
+
+private:
+	static const int MaxVertexBuffers = 8;
+	static const int MaxConstantBuffers = 14;
+	static const int MaxShaderResources = 16;
+	static const int MaxSamplers = 16;
+
+	IStateContext* context;
+	BindStats stats;
+
+	// False until the matching state has been bound through us
+	bool inputLayoutValid, indexBufferValid, vertexShaderValid, pixelShaderValid;
+	bool blendStateValid, depthStencilStateValid;
+	bool vertexBufferValid[MaxVertexBuffers];
+	bool vsConstantBufferValid[MaxConstantBuffers];
+	bool psConstantBufferValid[MaxConstantBuffers];
+	bool psShaderResourceValid[MaxShaderResources];
+	bool psSamplerValid[MaxSamplers];
+
+	RenderInputLayout* inputLayout;
+	RenderBuffer* indexBuffer;
+	RenderIndexFormat indexFormat;
+	unsigned int indexOffset;
+	RenderVertexShader* vertexShader;
+	RenderPixelShader* pixelShader;
+	RenderBuffer* vertexBuffers[MaxVertexBuffers];
+	unsigned int vertexStrides[MaxVertexBuffers];
+	unsigned int vertexOffsets[MaxVertexBuffers];
+	RenderBuffer* vsConstantBuffers[MaxConstantBuffers];
+	unsigned int vsConstantRanges[MaxConstantBuffers][2];
+	RenderBuffer* psConstantBuffers[MaxConstantBuffers];
+	unsigned int psConstantRanges[MaxConstantBuffers][2];
+	RenderShaderResource* psShaderResources[MaxShaderResources];
+	RenderSampler* psSamplers[MaxSamplers];
+	RenderBlendState* blendState;
+	RenderDepthStencilState* depthStencilState;
+};
@@ -0,0 +1,62 @@
+#include "StructuredBuffer.h"
+#include <string.h>
+
+// Smallest buffer worth creating
+static const int MinStructuredCapacity = 256;
+
+StructuredBuffer::StructuredBuffer(unsigned int stride)
+{
+	device = nullptr;
+	buffer = nullptr;
+	srv = nullptr;
+	this->stride = stride;
+	capacity = 0;
+}
+
+StructuredBuffer::~StructuredBuffer()
+{
+	if (srv) device->ReleaseShaderResource(srv);
+	if (buffer) device->ReleaseBuffer(buffer);
+}
+
+void StructuredBuffer::Update(IRenderDevice* device, const void* elements, int count)
+{
+	// Always have a buffer, so shaders can be given a view
+	// even when there's nothing in it
+	if (count > capacity || !buffer)
+	{
+		if (srv) this->device->ReleaseShaderResource(srv);
+		if (buffer) this->device->ReleaseBuffer(buffer);
+		srv = nullptr;
+		this->device = device;
+
+		capacity = capacity < MinStructuredCapacity ? MinStructuredCapacity : capacity;
+		while (capacity < count)
+			capacity *= 2;
+
+		RenderBufferDesc desc;
+		desc.Usage = RenderUsage::Dynamic;
+		desc.ByteWidth = capacity * stride;
+		desc.BindFlags = RenderBindShaderResource;
+		desc.StructureStride = stride;
+		buffer = device->CreateBuffer(desc, nullptr);
+		if (!buffer)
+		{
+			capacity = 0;
+			return;
+		}
+
+		srv = device->CreateStructuredView(buffer, capacity);
+	}
+
+	if (count == 0)
+		return;
+
+	// Discard whatever the GPU still has, instead of waiting for it
+	void* mapped = device->Map(buffer, RenderMapMode::WriteDiscard);
+	if (mapped)
+	{
+		memcpy(mapped, elements, count * stride);
+		device->Unmap(buffer);
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "RenderDevice.h"
+
+// --------------------------------------------------------
+// Dynamic structured buffer (and its shader resource view)
+// for data the CPU rewrites every frame.  Same approach as
+// InstanceBuffer: WRITE_DISCARD each update, regrown
+// (doubling) when an update needs more elements.
+// --------------------------------------------------------
+class StructuredBuffer
+{
+public:
+	StructuredBuffer(unsigned int stride);
+	~StructuredBuffer();
+
+	// Uploads count elements of the buffer's stride, growing
+	// it if needed (the view changes when it grows)
+	void Update(IRenderDevice* device, const void* elements, int count);
+
+	RenderShaderResource* GetShaderResourceView() { return srv; }
+	int GetCapacity() { return capacity; }
+
+private:
+	IRenderDevice* device;		// The buffer's, once there is one
+	RenderBuffer* buffer;
+	RenderShaderResource* srv;
+	unsigned int stride;
+	int capacity;
+};
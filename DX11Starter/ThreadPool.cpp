@@ -0,0 +1,115 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int workerCount)
+{
+	job = nullptr;
+	jobTaskCount = 0;
+	nextTask = 0;
+	generation = 0;
+	workersDone = 0;
+	quitting = false;
+
+	if (workerCount < 0)
+	{
+		int hardwareThreads = (int)std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	for (int i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& t : workers)
+		t.join();
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+// --------------------------------------------------------
+// Hands out task indices until they run out.  Every worker
+// checks in once per job, so no straggler can still be
+// holding on to a job after ParallelFor() returns.
+// --------------------------------------------------------
+void ThreadPool::ParallelFor(int taskCount, const std::function<void(int)>& task)
+{
+	if (taskCount <= 0)
+		return;
+
+	// Not worth waking anyone up
+	if (taskCount == 1 || workers.empty())
+	{
+		for (int i = 0; i < taskCount; i++)
+			task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submitLock(submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &task;
+		jobTaskCount = taskCount;
+		nextTask = 0;
+		workersDone = 0;
+		generation++;
+	}
+	wake.notify_all();
+
+	// Help out
+	RunTasks(&task, taskCount);
+
+	// Wait for every worker to finish with this job
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&] { return workersDone == (int)workers.size(); });
+	job = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	unsigned int seenGeneration = 0;
+	while (true)
+	{
+		const std::function<void(int)>* task;
+		int taskCount;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quitting || generation != seenGeneration; });
+			if (quitting)
+				return;
+
+			seenGeneration = generation;
+			task = job;
+			taskCount = jobTaskCount;
+		}
+
+		RunTasks(task, taskCount);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			workersDone++;
+		}
+		finished.notify_one();
+	}
+}
+
+void ThreadPool::RunTasks(const std::function<void(int)>* task, int taskCount)
+{
+	while (true)
+	{
+		int index = nextTask.fetch_add(1);
+		if (index >= taskCount)
+			return;
+		(*task)(index);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A small fixed pool of worker threads for data-parallel
+// loops.  ParallelFor() splits work into numbered tasks;
+// the calling thread runs tasks too and returns only when
+// every task has finished.
+//
+// Only one ParallelFor() runs at a time, and tasks must
+// not call back into the same pool.
+// --------------------------------------------------------
+class ThreadPool
+{
+public:
+	// workerCount < 0 means one worker per extra hardware thread
+	ThreadPool(int workerCount = -1);
+	~ThreadPool();
+
+	// Workers plus the calling thread
+	int GetThreadCount() { return (int)workers.size() + 1; }
+
+	// Runs task(0) .. task(taskCount - 1) across all threads
+	void ParallelFor(int taskCount, const std::function<void(int)>& task);
+
+	// Pool shared by engine systems that don't need their own
+	static ThreadPool& Shared();
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex submitMutex;		// One ParallelFor at a time
+	std::mutex mutex;			// Guards everything below
+	std::condition_variable wake;
+	std::condition_variable finished;
+
+	const std::function<void(int)>* job;
+	int jobTaskCount;
+	std::atomic<int> nextTask;
+	unsigned int generation;
+	int workersDone;
+	bool quitting;
+
+	void WorkerLoop();
+	void RunTasks(const std::function<void(int)>* task, int taskCount);
+};
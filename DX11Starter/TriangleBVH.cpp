@@ -0,0 +1,482 @@
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+// Number of buckets primitives are sorted into per axis when
+// looking for the cheapest split
+static const int SAHBinCount = 12;
+
+// Relative cost of visiting a node vs. testing a primitive
+static const float SAHTraversalCost = 1.0f;
+static const float SAHIntersectCost = 1.0f;
+
+// Nodes deeper than this become leaves no matter what, which
+// keeps the fixed size traversal stack big enough
+static const int MaxTreeDepth = 60;
+static const int MaxStackDepth = MaxTreeDepth + 2;
+
+// Rays closer than this to a surface don't hit it again
+static const float HitEpsilon = 1e-5f;
+
+// --------------------------------------------------------
+// Small helpers for growing boxes
+// --------------------------------------------------------
+static AABB EmptyBox()
+{
+	AABB box;
+	box.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	box.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	return box;
+}
+
+static void GrowBox(AABB& box, const AABB& other)
+{
+	box.Min.x = std::min(box.Min.x, other.Min.x); box.Max.x = std::max(box.Max.x, other.Max.x);
+	box.Min.y = std::min(box.Min.y, other.Min.y); box.Max.y = std::max(box.Max.y, other.Max.y);
+	box.Min.z = std::min(box.Min.z, other.Min.z); box.Max.z = std::max(box.Max.z, other.Max.z);
+}
+
+static void GrowBox(AABB& box, const XMFLOAT3& p)
+{
+	box.Min.x = std::min(box.Min.x, p.x); box.Max.x = std::max(box.Max.x, p.x);
+	box.Min.y = std::min(box.Min.y, p.y); box.Max.y = std::max(box.Max.y, p.y);
+	box.Min.z = std::min(box.Min.z, p.z); box.Max.z = std::max(box.Max.z, p.z);
+}
+
+static float HalfArea(const AABB& box)
+{
+	float x = box.Max.x - box.Min.x;
+	float y = box.Max.y - box.Min.y;
+	float z = box.Max.z - box.Min.z;
+	if (x < 0.0f || y < 0.0f || z < 0.0f)
+		return 0.0f;
+	return x * y + y * z + z * x;
+}
+
+static float Axis(const XMFLOAT3& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// --------------------------------------------------------
+// Packet setup
+// --------------------------------------------------------
+void RayPacket::SetRay(int lane, const Ray* ray)
+{
+	if (ray)
+	{
+		OriginX[lane] = ray->Origin.x; OriginY[lane] = ray->Origin.y; OriginZ[lane] = ray->Origin.z;
+		DirX[lane] = ray->Direction.x; DirY[lane] = ray->Direction.y; DirZ[lane] = ray->Direction.z;
+		MaxT[lane] = ray->MaxDistance;
+	}
+	else
+	{
+		OriginX[lane] = OriginY[lane] = OriginZ[lane] = 0.0f;
+		DirX[lane] = 1.0f; DirY[lane] = DirZ[lane] = 0.0f;
+		MaxT[lane] = -1.0f;
+	}
+
+	U[lane] = V[lane] = 0.0f;
+	Triangle[lane] = -1;
+	Instance[lane] = -1;
+}
+
+void RayPacket::UpdateInverseDirections()
+{
+	// Huge instead of infinite so slab tests never see 0 * inf
+	for (int i = 0; i < 4; i++)
+	{
+		InvDirX[i] = DirX[i] != 0.0f ? 1.0f / DirX[i] : FLT_MAX;
+		InvDirY[i] = DirY[i] != 0.0f ? 1.0f / DirY[i] : FLT_MAX;
+		InvDirZ[i] = DirZ[i] != 0.0f ? 1.0f / DirZ[i] : FLT_MAX;
+	}
+}
+
+RayHit RayPacket::GetHit(int lane) const
+{
+	RayHit hit;
+	hit.Distance = MaxT[lane];
+	hit.Triangle = Triangle[lane];
+	hit.Instance = Instance[lane];
+	hit.U = U[lane];
+	hit.V = V[lane];
+	return hit;
+}
+
+// --------------------------------------------------------
+// Builds the tree over the mesh's triangles
+// --------------------------------------------------------
+TriangleBVH::TriangleBVH(const std::vector<XMFLOAT3>& positions, const std::vector<unsigned int>& indices)
+{
+	int triangleCount = (int)indices.size() / 3;
+
+	std::vector<AABB> triangleBounds(triangleCount);
+	for (int i = 0; i < triangleCount; i++)
+	{
+		AABB box = EmptyBox();
+		GrowBox(box, positions[indices[i * 3 + 0]]);
+		GrowBox(box, positions[indices[i * 3 + 1]]);
+		GrowBox(box, positions[indices[i * 3 + 2]]);
+		triangleBounds[i] = box;
+	}
+
+	BuildNodes(triangleBounds, nodes, originalIndex);
+	bounds = nodes.empty() ? EmptyBox() : AABB{ nodes[0].Min, nodes[0].Max };
+
+	// Store the triangles in leaf order, ready for intersection
+	triangles.resize(triangleCount);
+	for (int i = 0; i < triangleCount; i++)
+	{
+		int t = originalIndex[i];
+		XMFLOAT3 v0 = positions[indices[t * 3 + 0]];
+		XMFLOAT3 v1 = positions[indices[t * 3 + 1]];
+		XMFLOAT3 v2 = positions[indices[t * 3 + 2]];
+		triangles[i].V0 = v0;
+		triangles[i].Edge1 = XMFLOAT3(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
+		triangles[i].Edge2 = XMFLOAT3(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z);
+	}
+}
+
+// --------------------------------------------------------
+// Top-down binned SAH build.  Each node's primitives are
+// bucketed along every axis by centroid, and the bucket
+// boundary with the lowest surface area cost wins (or the
+// node becomes a leaf if no split beats testing everything).
+// --------------------------------------------------------
+void TriangleBVH::BuildNodes(const std::vector<AABB>& primitiveBounds, std::vector<Node>& nodes, std::vector<int>& primitiveOrder)
+{
+	int count = (int)primitiveBounds.size();
+	nodes.clear();
+	primitiveOrder.resize(count);
+	if (count == 0)
+		return;
+
+	std::vector<XMFLOAT3> centroids(count);
+	for (int i = 0; i < count; i++)
+	{
+		const AABB& b = primitiveBounds[i];
+		centroids[i] = XMFLOAT3((b.Min.x + b.Max.x) * 0.5f, (b.Min.y + b.Max.y) * 0.5f, (b.Min.z + b.Max.z) * 0.5f);
+		primitiveOrder[i] = i;
+	}
+
+	nodes.reserve(count * 2);
+	Node root;
+	root.LeftFirst = 0;
+	root.Count = count;
+	nodes.push_back(root);
+
+	// (node, depth) pairs still waiting to be split
+	std::vector<std::pair<int, int>> pending;
+	pending.push_back(std::make_pair(0, 0));
+	while (!pending.empty())
+	{
+		int nodeIndex = pending.back().first;
+		int depth = pending.back().second;
+		pending.pop_back();
+
+		int first = nodes[nodeIndex].LeftFirst;
+		int primCount = nodes[nodeIndex].Count;
+
+		// Tight bounds, plus bounds of the centroids for binning
+		AABB box = EmptyBox();
+		AABB centroidBox = EmptyBox();
+		for (int i = first; i < first + primCount; i++)
+		{
+			GrowBox(box, primitiveBounds[primitiveOrder[i]]);
+			GrowBox(centroidBox, centroids[primitiveOrder[i]]);
+		}
+		nodes[nodeIndex].Min = box.Min;
+		nodes[nodeIndex].Max = box.Max;
+
+		if (primCount <= 1 || depth >= MaxTreeDepth)
+			continue;
+
+		// Find the cheapest bucket boundary over all three axes
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float lo = Axis(centroidBox.Min, axis);
+			float extent = Axis(centroidBox.Max, axis) - lo;
+			if (extent <= 0.0f)
+				continue;
+			float scale = SAHBinCount / extent;
+
+			AABB binBounds[SAHBinCount];
+			int binCounts[SAHBinCount] = {};
+			for (int b = 0; b < SAHBinCount; b++)
+				binBounds[b] = EmptyBox();
+
+			for (int i = first; i < first + primCount; i++)
+			{
+				int p = primitiveOrder[i];
+				int bin = std::min(SAHBinCount - 1, (int)((Axis(centroids[p], axis) - lo) * scale));
+				binCounts[bin]++;
+				GrowBox(binBounds[bin], primitiveBounds[p]);
+			}
+
+			// Sweep from the right, then evaluate from the left
+			float rightArea[SAHBinCount];
+			int rightCount[SAHBinCount];
+			AABB accum = EmptyBox();
+			int accumCount = 0;
+			for (int b = SAHBinCount - 1; b > 0; b--)
+			{
+				GrowBox(accum, binBounds[b]);
+				accumCount += binCounts[b];
+				rightArea[b] = HalfArea(accum);
+				rightCount[b] = accumCount;
+			}
+
+			accum = EmptyBox();
+			accumCount = 0;
+			for (int b = 0; b < SAHBinCount - 1; b++)
+			{
+				GrowBox(accum, binBounds[b]);
+				accumCount += binCounts[b];
+				if (accumCount == 0 || rightCount[b + 1] == 0)
+					continue;
+
+				float cost = accumCount * HalfArea(accum) + rightCount[b + 1] * rightArea[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b + 1;
+				}
+			}
+		}
+
+		// Stay a leaf unless splitting is actually cheaper
+		float parentArea = HalfArea(box);
+		float leafCost = primCount * SAHIntersectCost;
+		if (bestAxis == -1 || parentArea <= 0.0f ||
+			SAHTraversalCost + SAHIntersectCost * bestCost / parentArea >= leafCost)
+			continue;
+
+		// Partition the primitives around the chosen boundary
+		float lo = Axis(centroidBox.Min, bestAxis);
+		float scale = SAHBinCount / (Axis(centroidBox.Max, bestAxis) - lo);
+		int* begin = &primitiveOrder[first];
+		int* middle = std::partition(begin, begin + primCount, [&](int p)
+		{
+			int bin = std::min(SAHBinCount - 1, (int)((Axis(centroids[p], bestAxis) - lo) * scale));
+			return bin < bestSplit;
+		});
+		int leftCount = (int)(middle - begin);
+
+		Node left;
+		left.LeftFirst = first;
+		left.Count = leftCount;
+		Node right;
+		right.LeftFirst = first + leftCount;
+		right.Count = primCount - leftCount;
+
+		int leftIndex = (int)nodes.size();
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		nodes[nodeIndex].LeftFirst = leftIndex;
+		nodes[nodeIndex].Count = 0;
+
+		pending.push_back(std::make_pair(leftIndex, depth + 1));
+		pending.push_back(std::make_pair(leftIndex + 1, depth + 1));
+	}
+}
+
+// --------------------------------------------------------
+// Children are always stored after their parent, so one
+// backwards pass sees both children before each inner node
+// --------------------------------------------------------
+void TriangleBVH::RefitNodes(const std::vector<AABB>& primitiveBounds, std::vector<Node>& nodes, const std::vector<int>& primitiveOrder)
+{
+	for (int n = (int)nodes.size() - 1; n >= 0; n--)
+	{
+		Node& node = nodes[n];
+		AABB box = EmptyBox();
+		if (node.IsLeaf())
+		{
+			for (int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+				GrowBox(box, primitiveBounds[primitiveOrder[i]]);
+		}
+		else
+		{
+			const Node& left = nodes[node.LeftFirst];
+			const Node& right = nodes[node.LeftFirst + 1];
+			GrowBox(box, AABB{ left.Min, left.Max });
+			GrowBox(box, AABB{ right.Min, right.Max });
+		}
+		node.Min = box.Min;
+		node.Max = box.Max;
+	}
+}
+
+// --------------------------------------------------------
+// Four lane slab test
+// --------------------------------------------------------
+int TriangleBVH::IntersectNode(const Node& node, const RayPacket& packet, float* entry)
+{
+	__m128 ox = _mm_load_ps(packet.OriginX);
+	__m128 oy = _mm_load_ps(packet.OriginY);
+	__m128 oz = _mm_load_ps(packet.OriginZ);
+	__m128 ix = _mm_load_ps(packet.InvDirX);
+	__m128 iy = _mm_load_ps(packet.InvDirY);
+	__m128 iz = _mm_load_ps(packet.InvDirZ);
+
+	__m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min.x), ox), ix);
+	__m128 x2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max.x), ox), ix);
+	__m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min.y), oy), iy);
+	__m128 y2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max.y), oy), iy);
+	__m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min.z), oz), iz);
+	__m128 z2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max.z), oz), iz);
+
+	__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x1, x2), _mm_min_ps(y1, y2)), _mm_min_ps(z1, z2));
+	__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x1, x2), _mm_max_ps(y1, y2)), _mm_max_ps(z1, z2));
+	tNear = _mm_max_ps(tNear, _mm_setzero_ps());
+
+	__m128 hit = _mm_and_ps(
+		_mm_cmple_ps(tNear, tFar),
+		_mm_cmplt_ps(tNear, _mm_load_ps(packet.MaxT)));
+
+	_mm_storeu_ps(entry, tNear);
+	return _mm_movemask_ps(hit);
+}
+
+// --------------------------------------------------------
+// Möller-Trumbore of one triangle against all four lanes
+// --------------------------------------------------------
+void TriangleBVH::IntersectTriangle(const Triangle& tri, int triangleIndex, int instance, RayPacket& packet) const
+{
+	__m128 dx = _mm_load_ps(packet.DirX);
+	__m128 dy = _mm_load_ps(packet.DirY);
+	__m128 dz = _mm_load_ps(packet.DirZ);
+
+	__m128 e1x = _mm_set1_ps(tri.Edge1.x), e1y = _mm_set1_ps(tri.Edge1.y), e1z = _mm_set1_ps(tri.Edge1.z);
+	__m128 e2x = _mm_set1_ps(tri.Edge2.x), e2y = _mm_set1_ps(tri.Edge2.y), e2z = _mm_set1_ps(tri.Edge2.z);
+
+	// p = d x e2
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 valid = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+	__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	// s = o - v0
+	__m128 sx = _mm_sub_ps(_mm_load_ps(packet.OriginX), _mm_set1_ps(tri.V0.x));
+	__m128 sy = _mm_sub_ps(_mm_load_ps(packet.OriginY), _mm_set1_ps(tri.V0.y));
+	__m128 sz = _mm_sub_ps(_mm_load_ps(packet.OriginZ), _mm_set1_ps(tri.V0.z));
+
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+	// q = s x e1
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 hit = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, _mm_set1_ps(HitEpsilon)));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_load_ps(packet.MaxT)));
+
+	int mask = _mm_movemask_ps(hit);
+	if (mask == 0)
+		return;
+
+	// Blend the closer hits into the packet
+	_mm_store_ps(packet.MaxT, _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, _mm_load_ps(packet.MaxT))));
+	_mm_store_ps(packet.U, _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, _mm_load_ps(packet.U))));
+	_mm_store_ps(packet.V, _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, _mm_load_ps(packet.V))));
+	for (int lane = 0; lane < 4; lane++)
+	{
+		if (mask & (1 << lane))
+		{
+			packet.Triangle[lane] = triangleIndex;
+			packet.Instance[lane] = instance;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Front-to-back packet traversal.  A node is entered if any
+// lane hits its box, and skipped on the way back out if every
+// lane has since found something closer.
+// --------------------------------------------------------
+void TriangleBVH::IntersectPacket(RayPacket& packet, int instance) const
+{
+	if (nodes.empty())
+		return;
+
+	float entry[4];
+	if (IntersectNode(nodes[0], packet, entry) == 0)
+		return;
+
+	struct StackEntry { int Node; float Entry; };
+	StackEntry stack[MaxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0.0f };
+
+	while (stackSize > 0)
+	{
+		StackEntry current = stack[--stackSize];
+
+		float farthest = std::max(std::max(packet.MaxT[0], packet.MaxT[1]), std::max(packet.MaxT[2], packet.MaxT[3]));
+		if (current.Entry >= farthest)
+			continue;
+
+		const Node& node = nodes[current.Node];
+		if (node.IsLeaf())
+		{
+			for (int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+				IntersectTriangle(triangles[i], originalIndex[i], instance, packet);
+			continue;
+		}
+
+		float leftEntry[4], rightEntry[4];
+		int leftMask = IntersectNode(nodes[node.LeftFirst], packet, leftEntry);
+		int rightMask = IntersectNode(nodes[node.LeftFirst + 1], packet, rightEntry);
+
+		// Closest entry among the lanes that hit each child
+		float leftNear = FLT_MAX, rightNear = FLT_MAX;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (leftMask & (1 << lane)) leftNear = std::min(leftNear, leftEntry[lane]);
+			if (rightMask & (1 << lane)) rightNear = std::min(rightNear, rightEntry[lane]);
+		}
+
+		// Push the far child first so the near one is visited first
+		if (leftMask && rightMask)
+		{
+			if (leftNear <= rightNear)
+			{
+				stack[stackSize++] = { node.LeftFirst + 1, rightNear };
+				stack[stackSize++] = { node.LeftFirst, leftNear };
+			}
+			else
+			{
+				stack[stackSize++] = { node.LeftFirst, leftNear };
+				stack[stackSize++] = { node.LeftFirst + 1, rightNear };
+			}
+		}
+		else if (leftMask)
+		{
+			stack[stackSize++] = { node.LeftFirst, leftNear };
+		}
+		else if (rightMask)
+		{
+			stack[stackSize++] = { node.LeftFirst + 1, rightNear };
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Bounds.h"
+
+// --------------------------------------------------------
+// Closest hit found for a ray (Triangle is -1 on a miss)
+// --------------------------------------------------------
+struct RayHit
+{
+	float Distance;
+	int Triangle;
+	int Instance;
+	float U, V;		// Barycentrics of the hit inside the triangle
+};
+
+// --------------------------------------------------------
+// Four rays traced together, one per SSE lane.  Lanes that
+// aren't in use have a negative MaxT so they never hit.
+// MaxT shrinks to the closest hit found so far.
+// --------------------------------------------------------
+struct alignas(16) RayPacket
+{
+	float OriginX[4], OriginY[4], OriginZ[4];
+	float DirX[4], DirY[4], DirZ[4];
+	float InvDirX[4], InvDirY[4], InvDirZ[4];
+	float MaxT[4];
+	float U[4], V[4];
+	int Triangle[4];
+	int Instance[4];
+
+	// Fills lane from a ray (or disables it when ray is null)
+	void SetRay(int lane, const Ray* ray);
+	void UpdateInverseDirections();
+	RayHit GetHit(int lane) const;
+};
+
+// --------------------------------------------------------
+// Compact bounding volume hierarchy over the triangles of a
+// single mesh, built top-down with binned SAH.
+//
+// Nodes are 32 bytes; the two children of a node are always
+// stored next to each other so only the first is referenced.
+// Triangles are stored as (v0, edge1, edge2) in leaf order.
+// --------------------------------------------------------
+class TriangleBVH
+{
+public:
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+		int LeftFirst;		// Left child, or first primitive for leaves
+		DirectX::XMFLOAT3 Max;
+		int Count;			// Primitives in a leaf, 0 for inner nodes
+
+		bool IsLeaf() const { return Count > 0; }
+	};
+
+	TriangleBVH(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<unsigned int>& indices);
+
+	// Model space traversal.  Lanes keep their current
+	// MaxT, so several BVHs can be traced in a row.
+	void IntersectPacket(RayPacket& packet, int instance) const;
+
+	const AABB& GetBounds() const { return bounds; }
+	int GetNodeCount() const { return (int)nodes.size(); }
+	int GetTriangleCount() const { return (int)triangles.size(); }
+
+	// Binned SAH build over any set of boxes.  Leaves index
+	// into primitiveOrder.  Also used for scene level trees.
+	static void BuildNodes(const std::vector<AABB>& primitiveBounds, std::vector<Node>& nodes, std::vector<int>& primitiveOrder);
+
+	// Recomputes every node's box from moved primitive boxes,
+	// keeping the tree's shape.  Same primitives as the build.
+	static void RefitNodes(const std::vector<AABB>& primitiveBounds, std::vector<Node>& nodes, const std::vector<int>& primitiveOrder);
+
+	// Slab test of all four lanes against a node.  Returns a
+	// lane mask and writes each lane's entry distance.
+	static int IntersectNode(const Node& node, const RayPacket& packet, float* entry);
+
+private:
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 V0;
+		DirectX::XMFLOAT3 Edge1;
+		DirectX::XMFLOAT3 Edge2;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	std::vector<int> originalIndex;		// Leaf order -> mesh triangle
+	AABB bounds;
+
+	void IntersectTriangle(const Triangle& triangle, int triangleIndex, int instance, RayPacket& packet) const;
+};
@@ -5,13 +5,21 @@
 // - All non-pipeline variables that get their values from 
 //    our C++ code must be defined inside a Constant Buffer
 // - The name of the cbuffer itself is unimportant
-cbuffer externalData : register(b0)
+// - Buffers are split by how often they change, so the camera
+//    is uploaded once per frame and only the object's own
+//    data is uploaded per draw
+cbuffer perFrame : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
 };
 
+cbuffer perObject : register(b1)
+{
+	matrix world;
+	float fade;		// Contribution cull fade, passed on to the pixel shader
+};
+
 // Struct representing a single vertex worth of data
 // - This should match the vertex definition in our C++ code
 // - By "match", I mean the size, order and number of members
@@ -46,6 +54,8 @@ struct VertexToPixel
 	//float4 color		: COLOR;        // RGBA color
 	float3 normal		: NORMAL;
 	float2 uv			: UV;
+	float fade			: FADE;
+	float3 worldPos		: WORLDPOS;		// For the clustered point and spot lights
 };
 
 // --------------------------------------------------------
@@ -81,9 +91,12 @@ VertexToPixel main( VertexShaderInput input )
 	// - We don't need to alter it here, but we do need to send it to the pixel shader
 	//output.color = input.color;
 
+	output.worldPos = mul(float4(input.position, 1.0f), world).xyz;
+
 	output.normal = mul( input.normal, (float3x3)world );
 	output.normal = normalize(output.normal);
 	output.uv = input.uv;
+	output.fade = fade;
 
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)
@@ -0,0 +1,53 @@
+
+// Instanced variant of VertexShader.hlsl
+// - The world matrix and fade come from a second vertex buffer,
+//    one element per instance, instead of the constant buffer
+// - Anything with a "_PER_INSTANCE" semantic is put in input slot 1
+//    and stepped once per instance by SimpleShader's input layout
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+	float3 normal		: NORMAL;
+	float2 uv			: UV;
+
+	// Per-instance data (rows of the world matrix, then the fade)
+	float4 world0		: WORLD_PER_INSTANCE0;
+	float4 world1		: WORLD_PER_INSTANCE1;
+	float4 world2		: WORLD_PER_INSTANCE2;
+	float4 world3		: WORLD_PER_INSTANCE3;
+	float fade			: FADE_PER_INSTANCE;
+};
+
+// Must match VertexShader.hlsl's output
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float3 normal		: NORMAL;
+	float2 uv			: UV;
+	float fade			: FADE;
+	float3 worldPos		: WORLDPOS;
+};
+
+VertexToPixel main( VertexShaderInput input )
+{
+	VertexToPixel output;
+
+	// Rows go straight back into a matrix, so the C++ side
+	// uploads the untransposed world matrix
+	matrix world = matrix(input.world0, input.world1, input.world2, input.world3);
+	matrix worldViewProj = mul(mul(world, view), projection);
+
+	output.position = mul(float4(input.position, 1.0f), worldViewProj);
+	output.worldPos = mul(float4(input.position, 1.0f), world).xyz;
+	output.normal = normalize(mul(input.normal, (float3x3)world));
+	output.uv = input.uv;
+	output.fade = input.fade;
+
+	return output;
+}